@@ -0,0 +1,74 @@
+#include "donde/definitions.h"
+#include "donde/feature_serialize.h"
+
+#include <chrono>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+using donde_toolkits::DeserializeFeature;
+using donde_toolkits::Feature;
+using donde_toolkits::gen_feature_dim;
+using donde_toolkits::SerializeFeature;
+
+using nlohmann::json;
+
+// compare throughput of the binary feature format, with json of the same feature.
+// msgpack is not a dependency of this repo, so it is not measured here.
+//
+// usage: feature_serialize_benchmark [features]
+int main(int argc, char** argv) {
+    int count = argc > 1 ? std::stoi(argv[1]) : 10000;
+
+    std::vector<Feature> fts;
+    for (int i = 0; i < count; i++) {
+        fts.push_back(gen_feature_dim<512>());
+        fts.back().version = 1;
+    }
+
+    auto report = [count](const std::string& name, std::chrono::steady_clock::duration elapsed,
+                          size_t bytes) {
+        double secs = std::chrono::duration<double>(elapsed).count();
+        std::cout << name << ": " << count / secs << " features/s, " << bytes / count
+                  << " bytes/feature" << std::endl;
+    };
+
+    // binary
+    std::vector<std::string> blobs(count);
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        blobs[i] = SerializeFeature(fts[i]);
+        bytes += blobs[i].size();
+    }
+    report("binary serialize", std::chrono::steady_clock::now() - start, bytes);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        Feature ft;
+        DeserializeFeature(blobs[i], ft);
+    }
+    report("binary deserialize", std::chrono::steady_clock::now() - start, bytes);
+
+    // json
+    std::vector<std::string> docs(count);
+    bytes = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        json j{{"version", fts[i].version}, {"dimension", fts[i].dimension}, {"raw", fts[i].raw}};
+        docs[i] = j.dump();
+        bytes += docs[i].size();
+    }
+    report("json serialize", std::chrono::steady_clock::now() - start, bytes);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        json j = json::parse(docs[i]);
+        Feature ft(j["raw"].get<std::vector<float>>());
+        ft.version = j["version"].get<int>();
+    }
+    report("json deserialize", std::chrono::steady_clock::now() - start, bytes);
+
+    return 0;
+}
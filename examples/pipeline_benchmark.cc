@@ -0,0 +1,108 @@
+#include "donde/definitions.h"
+#include "donde/feature_extract/face_pipeline.h"
+#include "donde/feature_extract/processor_factory.h"
+#include "donde/utils.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+using namespace donde_toolkits::feature_extract;
+
+using donde_toolkits::AlignerResult;
+using donde_toolkits::DetectResult;
+using donde_toolkits::FeatureResult;
+using donde_toolkits::Frame;
+using donde_toolkits::LandmarksResult;
+
+using nlohmann::json;
+
+// compare sequential Detect/Landmarks/Align/Extract per frame, with streaming all frames through
+// the pipeline, where stages of different frames overlap.
+//
+// usage: pipeline_benchmark [frames] [image]
+int main(int argc, char** argv) {
+    json conf = R"(
+    {
+        "detector": {
+          "concurrent": 2,
+          "device_id": "CPU",
+          "model": "./contrib/models/face-detection-adas-0001.xml",
+          "warmup": true
+        },
+        "landmarks": {
+          "concurrent": 2,
+          "device_id": "CPU",
+          "model": "./contrib/models/facial-landmarks-35-adas-0002.xml",
+          "warmup": true
+        },
+        "aligner": {
+          "concurrent": 2,
+          "device_id": "CPU",
+          "warmup": true
+        },
+        "feature": {
+          "concurrent": 2,
+          "device_id": "CPU",
+          "model": "./contrib/models/Sphereface.xml",
+          "warmup": true
+        },
+        "streaming": {
+          "queue_size": 8
+        }
+    }
+)"_json;
+
+    int frame_count = argc > 1 ? std::stoi(argv[1]) : 100;
+    std::string img_path = argc > 2 ? argv[2] : "./contrib/data/test_image_5_person.jpeg";
+
+    FacePipeline pipeline{conf};
+    pipeline.Init(ProcessorFactory::createDetector(), ProcessorFactory::createLandmarks(),
+                  ProcessorFactory::createAligner(), ProcessorFactory::createFeature());
+
+    double len = std::filesystem::file_size(img_path);
+    std::vector<uint8_t> image_data(len);
+
+    std::ifstream f{img_path, std::ios::binary};
+    f.read((char*)image_data.data(), image_data.size());
+
+    std::vector<std::shared_ptr<Frame>> frames;
+    for (int i = 0; i < frame_count; i++) {
+        frames.push_back(pipeline.Decode(image_data));
+    }
+
+    // sequential
+    auto start = std::chrono::steady_clock::now();
+    for (auto& frame : frames) {
+        std::shared_ptr<DetectResult> detect_result = pipeline.Detect(frame);
+        std::shared_ptr<LandmarksResult> landmarks_result = pipeline.Landmarks(detect_result);
+        std::shared_ptr<AlignerResult> aligner_result = pipeline.Align(landmarks_result);
+        std::shared_ptr<FeatureResult> feature_result = pipeline.Extract(aligner_result);
+    }
+    std::chrono::duration<double> sequential = std::chrono::steady_clock::now() - start;
+
+    // streaming
+    std::atomic<int> done = 0;
+    pipeline.StartStreaming([&](uint64_t tag, std::shared_ptr<Frame> frame,
+                                std::shared_ptr<FeatureResult> result) { done++; });
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < frames.size(); i++) {
+        pipeline.Submit(frames[i], i);
+    }
+    pipeline.StopStreaming();
+    std::chrono::duration<double> streaming = std::chrono::steady_clock::now() - start;
+
+    std::cout << "frames: " << frame_count << std::endl;
+    std::cout << "sequential: " << sequential.count() << "s, "
+              << frame_count / sequential.count() << " fps" << std::endl;
+    std::cout << "streaming: " << streaming.count() << "s, " << done / streaming.count()
+              << " fps" << std::endl;
+
+    pipeline.Terminate();
+
+    return 0;
+}
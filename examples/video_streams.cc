@@ -0,0 +1,44 @@
+#ifndef SPDLOG_FMT_EXTERNAL
+#    define SPDLOG_FMT_EXTERNAL
+#endif
+
+#include "donde/video_process/stream_manager.h"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using donde_toolkits::video_process::FFmpegVideoFrame;
+using donde_toolkits::video_process::StreamStats;
+using donde_toolkits::video_process::VideoStreamManager;
+
+// decode many streams on shared workers, print per stream stats every second.
+// usage: video_streams <url> [url ...]
+int main(int argc, char** argv) {
+    VideoStreamManager manager;
+    for (int i = 1; i < argc; i++) {
+        manager.AddStream(argv[i], [](const FFmpegVideoFrame* frame) {
+            // slow consumer, to show stale frames being dropped.
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            return true;
+        });
+    }
+
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        bool running = false;
+        for (auto& [id, stats] : manager.GetStats()) {
+            std::cout << "stream " << id << " fps in: " << stats.fps_in
+                      << " fps out: " << stats.fps_out << " dropped: " << stats.dropped
+                      << " queue: " << stats.queue_depth << std::endl;
+            running = running || stats.running;
+        }
+        if (!running) {
+            break;
+        }
+    }
+
+    manager.Stop();
+    return 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace donde_toolkits {
+
+// BoundedQueue is a blocking FIFO with a capacity, Push blocks when it is full, so a slow consumer
+// slows down its producers (backpressure).
+// After Close, Push fails, and Pop returns remaining items then fails.
+template <typename T>
+class BoundedQueue {
+  public:
+    BoundedQueue(size_t capacity) : _capacity(capacity == 0 ? 1 : capacity){};
+
+    // Push blocks until there is room, false if queue is closed.
+    bool Push(T item) {
+        std::unique_lock<std::mutex> l(_mu);
+        _not_full.wait(l, [this] { return _closed || _items.size() < _capacity; });
+        if (_closed) {
+            return false;
+        }
+        _items.push_back(std::move(item));
+        l.unlock();
+        _not_empty.notify_one();
+        return true;
+    };
+
+    // Pop blocks until there is an item, false if queue is closed and drained.
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> l(_mu);
+        _not_empty.wait(l, [this] { return _closed || !_items.empty(); });
+        if (_items.empty()) {
+            return false;
+        }
+        item = std::move(_items.front());
+        _items.pop_front();
+        l.unlock();
+        _not_full.notify_one();
+        return true;
+    };
+
+    void Close() {
+        {
+            std::lock_guard<std::mutex> l(_mu);
+            _closed = true;
+        }
+        _not_full.notify_all();
+        _not_empty.notify_all();
+    };
+
+    size_t Size() {
+        std::lock_guard<std::mutex> l(_mu);
+        return _items.size();
+    };
+
+    size_t Capacity() { return _capacity; };
+
+  private:
+    const size_t _capacity;
+    std::deque<T> _items;
+    bool _closed = false;
+
+    std::mutex _mu;
+    std::condition_variable _not_full;
+    std::condition_variable _not_empty;
+};
+
+} // namespace donde_toolkits
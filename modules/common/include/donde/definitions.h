@@ -111,25 +111,9 @@ struct Feature {
 
         return score;
     };
-
-    // message pack
-    //// MSGPACK_DEFINE(model, version, dimension, raw)
 };
 
-using FeatureSerializeHeader = std::array<uint8_t, 4>;
-using FeatureSerializeBody = std::vector<uint8_t>;
-
-// 4 bytes in header,
-//   (16 bits for version, max value 131072),
-//   (10 bits for dimension, max value 2048, well, that's a huge dimension for feature)
-//   (6  bits for reserved.)
-// note body size can be calculated from dimension
-static void SerializeHeader(const Feature& ft, const FeatureSerializeHeader& header);
-// vector size: dimension * 4 bytes (each float has 4 bytes.)
-static void SerializeBody(const Feature& ft, const FeatureSerializeBody& body);
-
-static void DeserializeHeader(const FeatureSerializeHeader& header, const Feature& ft);
-static void DeserializeBody(const FeatureSerializeBody& body, const Feature& ft);
+// binary format of Feature is in feature_serialize.h
 
 struct FeatureScore {
     Feature feature;
@@ -166,17 +150,21 @@ enum ValueType {
 };
 
 inline std::string format_value_type(const ValueType typ) {
-    static std::map<ValueType, std::string> strings;
-    if (strings.size() == 0) {
-#define insert_elem(p) strings[p] = #p
+    // initialized once, it is called by pipeline stages concurrently.
+    static const std::map<ValueType, std::string> strings = [] {
+        std::map<ValueType, std::string> m;
+#define insert_elem(p) m[p] = #p
         insert_elem(ValueFrame);
         insert_elem(ValueDetectResult);
         insert_elem(ValueLandmarksResult);
         insert_elem(ValueAlignerResult);
+        insert_elem(ValueFeatureResult);
         insert_elem(ValueFeature);
 #undef insert_elem
-    }
-    return strings[typ];
+        return m;
+    }();
+    auto iter = strings.find(typ);
+    return iter == strings.end() ? "" : iter->second;
 };
 
 inline std::ostream& operator<<(std::ostream& out, const ValueType typ) {
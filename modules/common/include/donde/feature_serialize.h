@@ -0,0 +1,171 @@
+#pragma once
+
+#include "definitions.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace donde_toolkits {
+
+//
+// Feature binary format, a 4 bytes header followed by the body.
+//
+// header is a little endian uint32,
+//   (16 bits for version, max value 65535)
+//   (10 bits for dimension, max value 1023)
+//   (6  bits reserved, 0)
+// body is dimension floats, little endian IEEE 754, 4 bytes each, so its size follows from the
+// header. Model is not serialized, features of one db or shard share it.
+//
+// On little endian hosts the body is the memory of Feature::raw, it is written and read in one
+// call, straight between the stream and raw, without per float decoding or temporary buffers.
+//
+
+using FeatureSerializeHeader = std::array<uint8_t, 4>;
+using FeatureSerializeBody = std::vector<uint8_t>;
+
+const int FEATURE_MAX_VERSION = 0xffff;
+const int FEATURE_MAX_DIMENSION = 0x3ff;
+
+namespace serialize {
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+const bool HOST_LITTLE_ENDIAN = false;
+#else
+const bool HOST_LITTLE_ENDIAN = true;
+#endif
+
+inline void swap_floats(float* floats, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t v;
+        memcpy(&v, floats + i, sizeof(v));
+        v = __builtin_bswap32(v);
+        memcpy(floats + i, &v, sizeof(v));
+    }
+};
+
+} // namespace serialize
+
+// SerializeHeader fails if version or dimension do not fit in the header.
+inline RetCode SerializeHeader(const Feature& ft, FeatureSerializeHeader& header) {
+    size_t dimension = ft.raw.size();
+    if (ft.version < 0 || ft.version > FEATURE_MAX_VERSION || dimension > FEATURE_MAX_DIMENSION) {
+        spdlog::error("cannot serialize feature of version {}, dim {}", ft.version, dimension);
+        return RET_ERR;
+    }
+    uint32_t v = (uint32_t)ft.version | ((uint32_t)dimension << 16);
+    header = {uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24)};
+    return RET_OK;
+};
+
+// SerializeBody, body size: dimension * 4 bytes.
+inline void SerializeBody(const Feature& ft, FeatureSerializeBody& body) {
+    body.resize(ft.raw.size() * sizeof(float));
+    memcpy(body.data(), ft.raw.data(), body.size());
+    if (!serialize::HOST_LITTLE_ENDIAN) {
+        serialize::swap_floats(reinterpret_cast<float*>(body.data()), ft.raw.size());
+    }
+};
+
+// DeserializeHeader sets version and dimension of ft, and sizes ft.raw for its body.
+inline RetCode DeserializeHeader(const FeatureSerializeHeader& header, Feature& ft) {
+    uint32_t v = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+    if ((v >> 26) != 0) {
+        spdlog::error("bad feature header {:#x}", v);
+        return RET_ERR;
+    }
+    ft.version = v & 0xffff;
+    ft.dimension = (v >> 16) & 0x3ff;
+    ft.raw.resize(ft.dimension);
+    return RET_OK;
+};
+
+// DeserializeBody reads dimension floats into out, which may be any float buffer, aligned rows of
+// an index for instance.
+inline RetCode DeserializeBody(const uint8_t* data, size_t size, int dimension, float* out) {
+    if (size < dimension * sizeof(float)) {
+        spdlog::error("feature body has {} bytes, expect {}", size, dimension * sizeof(float));
+        return RET_ERR;
+    }
+    memcpy(out, data, dimension * sizeof(float));
+    if (!serialize::HOST_LITTLE_ENDIAN) {
+        serialize::swap_floats(out, dimension);
+    }
+    return RET_OK;
+};
+
+inline RetCode DeserializeBody(const FeatureSerializeBody& body, Feature& ft) {
+    return DeserializeBody(body.data(), body.size(), ft.raw.size(), ft.raw.data());
+};
+
+// WriteFeature writes header and body of ft to out.
+inline RetCode WriteFeature(std::ostream& out, const Feature& ft) {
+    FeatureSerializeHeader header;
+    if (SerializeHeader(ft, header) != RET_OK) {
+        return RET_ERR;
+    }
+    out.write(reinterpret_cast<const char*>(header.data()), header.size());
+    if (serialize::HOST_LITTLE_ENDIAN) {
+        out.write(reinterpret_cast<const char*>(ft.raw.data()), ft.raw.size() * sizeof(float));
+    } else {
+        FeatureSerializeBody body;
+        SerializeBody(ft, body);
+        out.write(reinterpret_cast<const char*>(body.data()), body.size());
+    }
+    return out.good() ? RET_OK : RET_ERR;
+};
+
+// ReadFeature reads a feature written by WriteFeature, the body goes straight into ft.raw.
+inline RetCode ReadFeature(std::istream& in, Feature& ft) {
+    FeatureSerializeHeader header;
+    if (!in.read(reinterpret_cast<char*>(header.data()), header.size())) {
+        return RET_ERR;
+    }
+    if (DeserializeHeader(header, ft) != RET_OK) {
+        return RET_ERR;
+    }
+    if (!in.read(reinterpret_cast<char*>(ft.raw.data()), ft.raw.size() * sizeof(float))) {
+        spdlog::error("feature body is truncated, expect {} floats", ft.raw.size());
+        return RET_ERR;
+    }
+    if (!serialize::HOST_LITTLE_ENDIAN) {
+        serialize::swap_floats(ft.raw.data(), ft.raw.size());
+    }
+    return RET_OK;
+};
+
+// SerializeFeature returns header and body in one buffer, for blobs and messages.
+inline std::string SerializeFeature(const Feature& ft) {
+    FeatureSerializeHeader header;
+    if (SerializeHeader(ft, header) != RET_OK) {
+        return {};
+    }
+    std::string data(header.size() + ft.raw.size() * sizeof(float), '\0');
+    memcpy(data.data(), header.data(), header.size());
+    memcpy(data.data() + header.size(), ft.raw.data(), ft.raw.size() * sizeof(float));
+    if (!serialize::HOST_LITTLE_ENDIAN) {
+        serialize::swap_floats(reinterpret_cast<float*>(data.data() + header.size()),
+                               ft.raw.size());
+    }
+    return data;
+};
+
+inline RetCode DeserializeFeature(const std::string& data, Feature& ft) {
+    FeatureSerializeHeader header;
+    if (data.size() < header.size()) {
+        return RET_ERR;
+    }
+    memcpy(header.data(), data.data(), header.size());
+    if (DeserializeHeader(header, ft) != RET_OK) {
+        return RET_ERR;
+    }
+    return DeserializeBody(reinterpret_cast<const uint8_t*>(data.data()) + header.size(),
+                           data.size() - header.size(), ft.raw.size(), ft.raw.data());
+};
+
+} // namespace donde_toolkits
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "definitions.h"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <opencv2/core/mat.hpp>
+#include <vector>
+
+namespace donde_toolkits {
+
+// MatPool keeps image buffers of released frames, so decoders write into them again instead of
+// allocating a new cv::Mat per frame.
+// It is held by shared_ptr, since frames may outlive their producer.
+class MatPool : public std::enable_shared_from_this<MatPool> {
+  public:
+    static std::shared_ptr<MatPool> Create(size_t capacity) {
+        return std::shared_ptr<MatPool>(new MatPool(capacity));
+    };
+
+    // Acquire a pooled buffer, empty if there is none. cv::Mat::create and decoders reuse it
+    // when size and type match.
+    cv::Mat Acquire() {
+        std::lock_guard<std::mutex> l(_mu);
+        if (_buffers.empty()) {
+            return cv::Mat();
+        }
+        cv::Mat buffer = std::move(_buffers.back());
+        _buffers.pop_back();
+        return buffer;
+    };
+
+    // Acquire a buffer of size and type, a pooled one of the same shape is preferred.
+    cv::Mat Acquire(cv::Size size, int type) {
+        cv::Mat buffer;
+        {
+            std::lock_guard<std::mutex> l(_mu);
+            for (auto it = _buffers.begin(); it != _buffers.end(); it++) {
+                if (it->size() == size && it->type() == type) {
+                    buffer = std::move(*it);
+                    _buffers.erase(it);
+                    break;
+                }
+            }
+        }
+        buffer.create(size, type);
+        return buffer;
+    };
+
+    // MakeFrame wraps image into a frame, image goes back to pool when the frame is released,
+    // unless crops of it are still alive.
+    std::shared_ptr<Frame> MakeFrame(const cv::Mat& image) {
+        if (_capacity == 0) {
+            return std::make_shared<Frame>(image);
+        }
+
+        std::shared_ptr<MatPool> pool = shared_from_this();
+        return std::shared_ptr<Frame>(new Frame(image), [pool](Frame* frame) {
+            cv::Mat buffer = std::move(frame->image);
+            delete frame;
+            pool->release(std::move(buffer));
+        });
+    };
+
+    size_t Size() {
+        std::lock_guard<std::mutex> l(_mu);
+        return _buffers.size();
+    };
+
+  private:
+    MatPool(size_t capacity) : _capacity(capacity){};
+
+    void release(cv::Mat&& buffer) {
+        if (!buffer.u || buffer.u->refcount != 1) {
+            return;
+        }
+        std::lock_guard<std::mutex> l(_mu);
+        if (_buffers.size() < _capacity) {
+            _buffers.push_back(std::move(buffer));
+        }
+    };
+
+  private:
+    const size_t _capacity;
+    std::mutex _mu;
+    std::vector<cv::Mat> _buffers;
+};
+
+} // namespace donde_toolkits
@@ -1,9 +1,14 @@
 #pragma once
 
 #include "donde/definitions.h"
+#include "face_tracker.h"
 #include "processor.h"
 
+#include <functional>
+#include <future>
 #include <map>
+#include <string>
+#include <vector>
 
 using namespace Poco;
 
@@ -12,6 +17,21 @@ using json = nlohmann::json;
 
 namespace donde_toolkits ::feature_extract {
 
+// FeatureCallback receives features of a submitted frame, with the tag it was submitted with.
+// result is nullptr if any stage failed. It is called in pipeline threads, frames may come back
+// out of order when a stage runs concurrently, tag tells which submission it is.
+using FeatureCallback = std::function<void(uint64_t tag, std::shared_ptr<Frame> frame,
+                                           std::shared_ptr<FeatureResult> result)>;
+
+// BatchItem is the result of one input of a batch call.
+// If the input failed, ret is RET_ERR, error tells why, and result is nullptr.
+template <typename T>
+struct BatchItem {
+    RetCode ret = RET_OK;
+    std::string error;
+    std::shared_ptr<T> result;
+};
+
 class IFacePipeline {
   public:
     virtual ~IFacePipeline() = default;
@@ -29,6 +49,9 @@ class IFacePipeline {
 
     virtual std::shared_ptr<Frame> Decode(const std::vector<uint8_t>& image_data) = 0;
 
+    // DecodeAsync decodes in background, so the next image is decoded while this one is detected.
+    virtual std::future<std::shared_ptr<Frame>> DecodeAsync(std::vector<uint8_t> image_data) = 0;
+
     virtual std::shared_ptr<DetectResult> Detect(const cv::Mat& mat) = 0;
     virtual std::shared_ptr<DetectResult> Detect(const std::shared_ptr<Frame> frame) = 0;
 
@@ -40,6 +63,42 @@ class IFacePipeline {
 
     virtual std::shared_ptr<FeatureResult> Extract(std::shared_ptr<AlignerResult> aligner_result)
         = 0;
+
+    // Batch calls hand all inputs to a stage at once, so its workers batch them together.
+    // Results are in input order, and a failed input does not fail the others.
+    virtual std::vector<BatchItem<Frame>>
+    DecodeBatch(const std::vector<std::vector<uint8_t>>& images) = 0;
+
+    virtual std::vector<BatchItem<DetectResult>>
+    DetectBatch(const std::vector<std::shared_ptr<Frame>>& frames) = 0;
+
+    virtual std::vector<BatchItem<FeatureResult>>
+    ExtractBatch(const std::vector<std::shared_ptr<AlignerResult>>& aligner_results) = 0;
+
+    // ProcessImages decodes images and extracts features of their faces, stage by stage.
+    virtual std::vector<BatchItem<FeatureResult>>
+    ProcessImages(const std::vector<std::vector<uint8_t>>& images) = 0;
+
+    // Track detects faces of the next frame of a video, and follows them with tracker. Landmarks,
+    // align and extract only run for faces whose tracks need a feature.
+    // Returns tracks ended by this frame, with their best features. Call tracker.Flush() at the
+    // end of the video for the rest.
+    virtual std::vector<FaceTrack> Track(FaceTracker& tracker, std::shared_ptr<Frame> frame) = 0;
+
+    // StartStreaming runs every stage in its own threads, stages are connected by bounded queues,
+    // so that frame N+1 is detected while frame N is extracted.
+    virtual RetCode StartStreaming(FeatureCallback callback) = 0;
+
+    // Submit a frame to streaming pipeline, blocks when the pipeline is full. tag is handed back
+    // to callback with the result of this frame.
+    virtual RetCode Submit(std::shared_ptr<Frame> frame, uint64_t tag) = 0;
+
+    // SubmitImage submits encoded image, it is decoded by decode threads ahead of detector.
+    // callback gets tag with a nullptr frame if it cannot be decoded.
+    virtual RetCode SubmitImage(std::vector<uint8_t> image_data, uint64_t tag) = 0;
+
+    // StopStreaming waits submitted frames to be done, and stops stage threads.
+    virtual RetCode StopStreaming() = 0;
 };
 
 // forward declearation.
@@ -60,6 +119,7 @@ class FacePipeline : public IFacePipeline {
 
     std::shared_ptr<DetectResult> Detect(const cv::Mat& mat) override;
     std::shared_ptr<Frame> Decode(const std::vector<uint8_t>& image_data) override;
+    std::future<std::shared_ptr<Frame>> DecodeAsync(std::vector<uint8_t> image_data) override;
 
     std::shared_ptr<DetectResult> Detect(const std::shared_ptr<Frame> frame) override;
 
@@ -71,6 +131,28 @@ class FacePipeline : public IFacePipeline {
 
     std::shared_ptr<FeatureResult> Extract(std::shared_ptr<AlignerResult> aligner_result) override;
 
+    std::vector<BatchItem<Frame>>
+    DecodeBatch(const std::vector<std::vector<uint8_t>>& images) override;
+
+    std::vector<BatchItem<DetectResult>>
+    DetectBatch(const std::vector<std::shared_ptr<Frame>>& frames) override;
+
+    std::vector<BatchItem<FeatureResult>>
+    ExtractBatch(const std::vector<std::shared_ptr<AlignerResult>>& aligner_results) override;
+
+    std::vector<BatchItem<FeatureResult>>
+    ProcessImages(const std::vector<std::vector<uint8_t>>& images) override;
+
+    std::vector<FaceTrack> Track(FaceTracker& tracker, std::shared_ptr<Frame> frame) override;
+
+    RetCode StartStreaming(FeatureCallback callback) override;
+
+    RetCode Submit(std::shared_ptr<Frame> frame, uint64_t tag) override;
+
+    RetCode SubmitImage(std::vector<uint8_t> image_data, uint64_t tag) override;
+
+    RetCode StopStreaming() override;
+
   public:
     std::unique_ptr<FacePipelineImpl> pimpl;
 };
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "donde/definitions.h"
+#include "nlohmann/json.hpp"
+
+#include <memory>
+#include <opencv2/core/types.hpp>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace donde_toolkits ::feature_extract {
+
+enum ExtractPolicy {
+    // extract a track once, when it is confirmed.
+    EXTRACT_START,
+    // extract again whenever the face gets clearly better, keep the best feature.
+    EXTRACT_BEST,
+};
+
+// TrackerOptions, from "tracker" block of pipeline config.
+//   "tracker": {
+//       "iou_threshold": 0.3,   // a face belongs to a track when it overlaps its predicted box
+//       "max_missed": 10,       // frames a track survives without its face
+//       "min_hits": 2,          // frames before a track is confirmed and extracted
+//       "extract": "best",      // "start" or "best"
+//       "improve_ratio": 1.2,   // "best" extracts again when quality grows this much
+//       "max_extractions": 3    // "best" extracts a track at most this many times
+//   }
+struct TrackerOptions {
+    float iou_threshold = 0.3;
+    int max_missed = 10;
+    int min_hits = 2;
+    ExtractPolicy extract = EXTRACT_BEST;
+    float improve_ratio = 1.2;
+    int max_extractions = 3;
+};
+
+// FaceTrack is a face followed across frames, with the feature of its best extracted face.
+struct FaceTrack {
+    int id = 0;
+    cv::Rect box;
+    long first_frame = 0;
+    long last_frame = 0;
+    int hits = 0;
+    int missed = 0;
+
+    // nullptr if the track was never extracted.
+    std::shared_ptr<Feature> feature;
+    float feature_quality = 0;
+    int extractions = 0;
+};
+
+// TrackUpdate tells, for a face of a frame, which track it belongs to, and whether its feature
+// should be extracted.
+struct TrackUpdate {
+    int track_id = 0;
+    bool extract = false;
+};
+
+// FaceTracker associates detected faces across frames of one video, by IoU of their boxes with
+// boxes predicted from track velocities, so that landmarks, align and extract run once or a few
+// times a track instead of every frame.
+// It is not thread safe, use one tracker a video stream, and update it in frame order.
+class FaceTracker {
+  public:
+    FaceTracker(const TrackerOptions& opts = {});
+
+    static TrackerOptions ParseTrackerOptions(const json& conf);
+
+    // Update tracks with faces of the next frame, returns an update for each face, in order.
+    std::vector<TrackUpdate> Update(const std::vector<FaceDetection>& faces);
+
+    // SetFeature keeps the feature extracted for a face of last Update, if it is the best so far.
+    void SetFeature(int track_id, const Feature& feature);
+
+    // TakeEnded returns tracks which lost their face for max_missed frames, and forgets them.
+    std::vector<FaceTrack> TakeEnded();
+
+    // Flush ends all confirmed tracks, at the end of a video.
+    std::vector<FaceTrack> Flush();
+
+    size_t Size() { return _tracks.size(); };
+
+  private:
+    struct TrackState {
+        FaceTrack track;
+        // box center velocity, smoothed over frames.
+        cv::Point2f velocity;
+        // quality of the face in last Update, given to its feature by SetFeature.
+        float quality = 0;
+    };
+
+    cv::Rect predict(const TrackState& state) const;
+    bool should_extract(const TrackState& state) const;
+
+  private:
+    TrackerOptions _opts;
+    long _frame_id = 0;
+    int _next_track_id = 1;
+    std::vector<TrackState> _tracks;
+    std::vector<FaceTrack> _ended;
+};
+
+// quality of a detected face, larger and more confident faces make better features.
+float face_quality(const FaceDetection& face);
+
+// iou of two boxes, 0 if they do not overlap.
+float box_iou(const cv::Rect& a, const cv::Rect& b);
+
+} // namespace donde_toolkits::feature_extract
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <memory>
 #include <type_traits>
+#include <vector>
 
 
 
@@ -23,6 +24,19 @@ class Processor {
 
     virtual RetCode Process(const Value& input, Value& output) = 0;
 
+    // ProcessBatch processes inputs together, outputs are in input order.
+    // default one processes them one by one.
+    virtual RetCode ProcessBatch(const std::vector<Value>& inputs, std::vector<Value>& outputs) {
+        RetCode ret = RET_OK;
+        outputs.resize(inputs.size());
+        for (size_t i = 0; i < inputs.size(); i++) {
+            if (Process(inputs[i], outputs[i]) != RET_OK) {
+                ret = RET_ERR;
+            }
+        }
+        return ret;
+    };
+
     virtual RetCode Terminate() = 0;
 
     virtual std::string GetName() = 0;
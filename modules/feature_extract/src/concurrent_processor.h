@@ -4,9 +4,11 @@
 #include "donde/definitions.h"
 #include "donde/feature_extract/processor.h"
 #include "donde/message.h"
+#include "fan_out.h"
 #include "nlohmann/json.hpp"
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <type_traits>
@@ -34,16 +36,22 @@ class ConcurrentProcessor<T, typename std::enable_if_t<std::is_base_of_v<Worker,
     RetCode Init(const json& cfg) override;
     bool IsInited() override;
     RetCode Process(const Value& input, Value& output) override;
+    RetCode ProcessBatch(const std::vector<Value>& inputs, std::vector<Value>& outputs) override;
     RetCode Terminate() override;
 
     std::string GetName() override;
 
   private:
     std::string _name;
-    ThreadPool _pool;
+    // one thread per worker, created when concurrency is known. Worker loops block on the
+    // channel and hold infer requests, so they stay here rather than on the Executor.
+    std::unique_ptr<ThreadPool> _pool;
     std::shared_ptr<MsgChannel> _channel;
     std::vector<std::shared_ptr<T>> _workers;
 
+    // multi-face inputs are split into items, and spread across workers.
+    FanOutOptions _fan_out;
+
     bool _is_inited;
 };
 
@@ -55,7 +63,6 @@ template <typename T>
 ConcurrentProcessor<T,
                     typename std::enable_if_t<std::is_base_of_v<Worker, T>>>::ConcurrentProcessor()
     : _name("concurrent-process-master"),
-      _pool(Poco::ThreadPool(1, 1)),            // TODO 1,1?
       _channel(std::make_shared<MsgChannel>()), // create a channel
       _workers(0){};
 
@@ -72,7 +79,8 @@ RetCode ConcurrentProcessor<T, typename std::enable_if_t<std::is_base_of_v<Worke
     int concurrent = conf["concurrent"];
     std::string device_id = conf["device_id"];
 
-    _pool.addCapacity(concurrent);
+    _fan_out = ParseFanOutOptions(conf);
+    _pool = std::make_unique<ThreadPool>(std::max(concurrent, 1), std::max(concurrent, 1));
 
     for (int i = 0; i < concurrent; i++) {
         auto worker = std::make_shared<T>(_channel);
@@ -87,7 +95,7 @@ RetCode ConcurrentProcessor<T, typename std::enable_if_t<std::is_base_of_v<Worke
 
     // start workers
     for (auto it = _workers.begin(); it != _workers.end(); it++) {
-        _pool.start(*(it->get()));
+        _pool->start(*(it->get()));
     }
     spdlog::info("{} concurrency: {}, created {} workers", _name, concurrent, _workers.size());
 
@@ -107,22 +115,54 @@ RetCode ConcurrentProcessor<T, typename std::enable_if_t<std::is_base_of_v<Worke
     spdlog::trace("input.valueType : {}, valuePtr: {}", format_value_type(input.valueType),
                   input.valuePtr.get());
 
-    WorkMessage<Value>::Ptr msg = WorkMessage<Value>::Ptr(new WorkMessage(input));
-    _channel->enqueueNotification(msg);
-    Value resp = msg->waitResponse();
-    output = resp;
+    std::vector<Value> outputs;
+    RetCode ret = ProcessBatch({input}, outputs);
+    output = outputs[0];
 
     spdlog::trace("output.valueType : {}, valuePtr: {}", format_value_type(output.valueType),
                   output.valuePtr.get());
 
-    return RET_OK;
+    return ret;
+}
+
+template <typename T>
+RetCode
+ConcurrentProcessor<T, typename std::enable_if_t<std::is_base_of_v<Worker, T>>>::ProcessBatch(
+    const std::vector<Value>& inputs, std::vector<Value>& outputs) {
+    // all items of all inputs are enqueued before waiting, so idle workers pick them up
+    // concurrently, and batching workers drain them into one inference.
+    std::vector<std::vector<WorkMessage<Value>::Ptr>> msgs(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        for (auto& item : split_faces(inputs[i], _fan_out.faces_per_item)) {
+            WorkMessage<Value>::Ptr msg = WorkMessage<Value>::Ptr(new WorkMessage(item));
+            _channel->enqueueNotification(msg);
+            msgs[i].push_back(msg);
+        }
+    }
+
+    RetCode ret = RET_OK;
+    outputs.resize(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        std::vector<Value> items;
+        for (auto& msg : msgs[i]) {
+            items.push_back(msg->waitResponse());
+        }
+        outputs[i] = merge_faces(items);
+        if (!outputs[i].valuePtr) {
+            ret = RET_ERR;
+        }
+    }
+
+    return ret;
 }
 
 template <typename T>
 RetCode
 ConcurrentProcessor<T, typename std::enable_if_t<std::is_base_of_v<Worker, T>>>::Terminate() {
     _channel->wakeUpAll();
-    _pool.joinAll();
+    if (_pool) {
+        _pool->joinAll();
+    }
 
     // Logger::Tracef("controller shutdown all workers");
 
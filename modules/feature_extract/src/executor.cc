@@ -0,0 +1,299 @@
+#include "executor.h"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#    include <pthread.h>
+#    include <sched.h>
+#endif
+
+namespace donde_toolkits ::feature_extract {
+
+namespace {
+
+// index of executor thread, -1 for other threads.
+thread_local int worker_index = -1;
+
+// parse cpulist like "0-7,16-23".
+void parse_cpulist(const std::string& list, std::vector<int>& cpus) {
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        size_t dash = range.find('-');
+        try {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        } catch (const std::exception&) {
+            continue;
+        }
+    }
+}
+
+// numa_ordered_cpus lists cpus node by node, so neighbour threads (which steal from each other
+// first) are on the same node. falls back to 0..n-1 without sysfs.
+std::vector<int> numa_ordered_cpus() {
+    std::vector<int> cpus;
+    std::error_code ec;
+    for (int node = 0;; node++) {
+        std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+        if (!std::filesystem::exists(path, ec)) {
+            break;
+        }
+        std::ifstream in(path);
+        std::string list;
+        std::getline(in, list);
+        parse_cpulist(list, cpus);
+    }
+
+    if (cpus.empty()) {
+        for (unsigned i = 0; i < std::max(1u, std::thread::hardware_concurrency()); i++) {
+            cpus.push_back(i);
+        }
+    }
+    return cpus;
+}
+
+void pin_thread(std::thread& t, int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(t.native_handle(), sizeof(set), &set) != 0) {
+        spdlog::warn("cannot pin executor thread to cpu {}", cpu);
+    }
+#else
+    (void)t;
+    (void)cpu;
+#endif
+}
+
+// DoneGuard marks a task of wait group done when it leaves, even by an exception.
+struct DoneGuard {
+    WaitGroup& wg;
+    ~DoneGuard() { wg.Done(); };
+};
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// WaitGroup
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WaitGroup::Add(int n) {
+    std::lock_guard<std::mutex> l(_mu);
+    _count += n;
+}
+
+void WaitGroup::Done() {
+    std::lock_guard<std::mutex> l(_mu);
+    if (--_count <= 0) {
+        _cv.notify_all();
+    }
+}
+
+bool WaitGroup::WaitFor(int ms) {
+    std::unique_lock<std::mutex> l(_mu);
+    return _cv.wait_for(l, std::chrono::milliseconds(ms), [this] { return _count <= 0; });
+}
+
+void WaitGroup::Wait() {
+    std::unique_lock<std::mutex> l(_mu);
+    _cv.wait(l, [this] { return _count <= 0; });
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Executor
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Executor& Executor::getInstance() {
+    static Executor instance;
+    return instance;
+}
+
+ExecutorOptions Executor::ParseExecutorOptions(const json& conf) {
+    ExecutorOptions opts;
+    if (!conf.contains("executor")) {
+        return opts;
+    }
+    const json& executor = conf["executor"];
+    opts.threads = std::max(0, executor.value("threads", opts.threads));
+    opts.pin_cpus = executor.value("pin_cpus", opts.pin_cpus);
+    return opts;
+}
+
+RetCode Executor::Configure(const ExecutorOptions& opts) {
+    std::lock_guard<std::mutex> l(_mu);
+    if (_started) {
+        spdlog::warn("executor is already started, new options are ignored");
+        return RetCode::RET_ERR;
+    }
+    _opts = opts;
+    return RetCode::RET_OK;
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard<std::mutex> l(_mu);
+        _stop = true;
+    }
+    _cv.notify_all();
+    for (auto& t : _threads) {
+        t.join();
+    }
+}
+
+size_t Executor::Size() {
+    start();
+    return _threads.size();
+}
+
+void Executor::start() {
+    if (_started) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> l(_mu);
+    if (_started) {
+        return;
+    }
+
+    std::vector<int> cpus = numa_ordered_cpus();
+    size_t threads = _opts.threads > 0 ? _opts.threads : cpus.size();
+
+    for (size_t i = 0; i < threads; i++) {
+        _queues.push_back(std::make_unique<TaskQueue>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        _threads.emplace_back(&Executor::loop, this, i);
+        if (_opts.pin_cpus) {
+            pin_thread(_threads.back(), cpus[i % cpus.size()]);
+        }
+    }
+
+    _started = true;
+    spdlog::info("executor starts {} threads, pin_cpus: {}", threads, _opts.pin_cpus);
+}
+
+void Executor::Submit(std::function<void()> task) {
+    start();
+
+    // tasks submitted by executor threads stay local, others are spread round robin.
+    size_t id = worker_index >= 0 ? worker_index : _next++ % _queues.size();
+    {
+        std::lock_guard<std::mutex> l(_queues[id]->mu);
+        _queues[id]->tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> l(_mu);
+        _pending++;
+    }
+    _cv.notify_one();
+}
+
+bool Executor::run_one(size_t id) {
+    std::function<void()> task;
+    const size_t n = _queues.size();
+
+    // own queue, newest first.
+    if (id < n) {
+        std::lock_guard<std::mutex> l(_queues[id]->mu);
+        if (!_queues[id]->tasks.empty()) {
+            task = std::move(_queues[id]->tasks.back());
+            _queues[id]->tasks.pop_back();
+        }
+    }
+
+    // steal oldest task of others, nearest first.
+    for (size_t i = 1; !task && i <= n; i++) {
+        auto& victim = _queues[(id + i) % n];
+        std::lock_guard<std::mutex> l(victim->mu);
+        if (!victim->tasks.empty()) {
+            task = std::move(victim->tasks.front());
+            victim->tasks.pop_front();
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+
+    _pending--;
+    task();
+    return true;
+}
+
+void Executor::loop(size_t id) {
+    worker_index = id;
+    for (;;) {
+        if (run_one(id)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> l(_mu);
+        _cv.wait(l, [this] { return _stop || _pending > 0; });
+        if (_stop) {
+            break;
+        }
+    }
+}
+
+void Executor::ParallelFor(size_t n, const std::function<void(size_t)>& fn) {
+    if (n == 0) {
+        return;
+    }
+    if (n == 1) {
+        fn(0);
+        return;
+    }
+
+    // tasks reference fn and wg of this frame, so all of them must be done before an exception
+    // leaves, the first one is kept and rethrown.
+    std::mutex error_mu;
+    std::exception_ptr error;
+    auto run = [&fn, &error_mu, &error](size_t i) {
+        try {
+            fn(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> l(error_mu);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+
+    WaitGroup wg;
+    wg.Add(n - 1);
+    for (size_t i = 1; i < n; i++) {
+        Submit([&run, &wg, i] {
+            DoneGuard done{wg};
+            run(i);
+        });
+    }
+    run(0);
+
+    // help instead of blocking, tasks of this group may be queued behind the caller.
+    size_t id = worker_index >= 0 ? worker_index : _queues.size();
+    while (!wg.WaitFor(0)) {
+        if (!run_one(id)) {
+            wg.WaitFor(1);
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace donde_toolkits::feature_extract
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "donde/definitions.h"
+#include "nlohmann/json.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace donde_toolkits ::feature_extract {
+
+// ExecutorOptions, from "executor" block of pipeline config.
+//   "executor": {"threads": 0, "pin_cpus": false}
+// threads 0 means one per cpu, pin_cpus pins each thread to one cpu, numa node by numa node.
+struct ExecutorOptions {
+    int threads = 0;
+    bool pin_cpus = false;
+};
+
+// WaitGroup waits until a group of tasks are done, a counter instead of a message per task.
+class WaitGroup {
+  public:
+    void Add(int n = 1);
+    void Done();
+    // WaitFor returns true if all tasks are done.
+    bool WaitFor(int ms);
+    void Wait();
+
+  private:
+    std::mutex _mu;
+    std::condition_variable _cv;
+    int _count = 0;
+};
+
+// Executor is a work-stealing thread pool shared by all stages, for short cpu tasks
+// (host-side resize, face alignment) which used to run serially on one stage worker.
+//
+// Each thread has its own deque, it pops the newest task of its own, and steals the oldest task
+// of others when it is idle. Only these tasks are shared, stage workers keep running on threads
+// of their ConcurrentProcessor, since each one owns its infer requests.
+class Executor {
+  public:
+    static Executor& getInstance();
+
+    static ExecutorOptions ParseExecutorOptions(const json& conf);
+
+    // Configure takes effect only before threads are started by first Submit.
+    RetCode Configure(const ExecutorOptions& opts);
+
+    void Submit(std::function<void()> task);
+
+    // ParallelFor runs fn(0) .. fn(n - 1) and returns when all are done. The caller runs tasks
+    // too while waiting, so it is safe to be called from tasks of executor. If any fn throws,
+    // the first exception is rethrown once all are done.
+    void ParallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+    size_t Size();
+
+    ~Executor();
+
+  private:
+    Executor() = default;
+
+    struct TaskQueue {
+        std::mutex mu;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void start();
+    void loop(size_t id);
+    // run_one runs one task of own queue or stolen from others, false if there is none.
+    bool run_one(size_t id);
+
+  private:
+    std::mutex _mu;
+    std::condition_variable _cv;
+    std::atomic<bool> _started = false;
+    bool _stop = false;
+    ExecutorOptions _opts;
+
+    std::vector<std::unique_ptr<TaskQueue>> _queues;
+    std::vector<std::thread> _threads;
+    std::atomic<long> _pending = 0;
+    std::atomic<size_t> _next = 0;
+};
+
+} // namespace donde_toolkits::feature_extract
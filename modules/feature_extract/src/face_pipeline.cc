@@ -62,6 +62,10 @@ std::shared_ptr<Frame> FacePipeline::Decode(const std::vector<uint8_t>& image_da
     return pimpl->Decode(image_data);
 }
 
+std::future<std::shared_ptr<Frame>> FacePipeline::DecodeAsync(std::vector<uint8_t> image_data) {
+    return pimpl->DecodeAsync(std::move(image_data));
+}
+
 std::shared_ptr<DetectResult> FacePipeline::Detect(const cv::Mat& mat) {
     auto frame = std::make_shared<Frame>(mat);
     return pimpl->Detect(frame);
@@ -86,4 +90,42 @@ FacePipeline::Extract(std::shared_ptr<AlignerResult> aligner_result) {
     return pimpl->Extract(aligner_result);
 }
 
+std::vector<BatchItem<Frame>>
+FacePipeline::DecodeBatch(const std::vector<std::vector<uint8_t>>& images) {
+    return pimpl->DecodeBatch(images);
+}
+
+std::vector<BatchItem<DetectResult>>
+FacePipeline::DetectBatch(const std::vector<std::shared_ptr<Frame>>& frames) {
+    return pimpl->DetectBatch(frames);
+}
+
+std::vector<BatchItem<FeatureResult>>
+FacePipeline::ExtractBatch(const std::vector<std::shared_ptr<AlignerResult>>& aligner_results) {
+    return pimpl->ExtractBatch(aligner_results);
+}
+
+std::vector<BatchItem<FeatureResult>>
+FacePipeline::ProcessImages(const std::vector<std::vector<uint8_t>>& images) {
+    return pimpl->ProcessImages(images);
+}
+
+std::vector<FaceTrack> FacePipeline::Track(FaceTracker& tracker, std::shared_ptr<Frame> frame) {
+    return pimpl->Track(tracker, frame);
+}
+
+RetCode FacePipeline::StartStreaming(FeatureCallback callback) {
+    return pimpl->StartStreaming(callback);
+}
+
+RetCode FacePipeline::Submit(std::shared_ptr<Frame> frame, uint64_t tag) {
+    return pimpl->Submit(frame, tag);
+}
+
+RetCode FacePipeline::SubmitImage(std::vector<uint8_t> image_data, uint64_t tag) {
+    return pimpl->SubmitImage(std::move(image_data), tag);
+}
+
+RetCode FacePipeline::StopStreaming() { return pimpl->StopStreaming(); }
+
 } // namespace donde_toolkits::feature_extract
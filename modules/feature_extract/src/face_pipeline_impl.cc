@@ -2,11 +2,13 @@
 
 #include "concurrent_processor.h"
 #include "donde/definitions.h"
+#include "executor.h"
 #include "donde/feature_extract/processor.h"
 #include "nlohmann/json.hpp"
 #include "openvino_worker/openvino_worker.h"
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <opencv2/core/mat.hpp>
@@ -41,13 +43,100 @@ using json = nlohmann::json;
            "device_id": "CPU",
            "concurrent": 4,
            "model": "xxxx.xml"
+       },
+       "streaming": {
+           "queue_size": 8
+       },
+       "executor": {
+           "threads": 0,
+           "pin_cpus": false
+       },
+       "decoder": {
+           "concurrent": 2,
+           "pool_size": 8,
+           "reduce_width": 0,
+           "reduce_height": 0
        }
    }
  */
 
 namespace donde_toolkits ::feature_extract {
 
-FacePipelineImpl::FacePipelineImpl(const json& conf) : _config(conf) {}
+namespace {
+
+// run_batch hands inputs to processor as one batch, nullptr inputs fail without processing.
+template <typename In, typename Out>
+std::vector<BatchItem<Out>> run_batch(Processor* processor, const std::string& stage,
+                                      ValueType input_type, ValueType output_type,
+                                      const std::vector<std::shared_ptr<In>>& inputs) {
+    std::vector<BatchItem<Out>> results(inputs.size());
+    if (!processor || !processor->IsInited()) {
+        for (auto& r : results) {
+            r.ret = RET_ERR;
+            r.error = stage + " processor is not inited";
+        }
+        return results;
+    }
+
+    std::vector<size_t> index;
+    std::vector<Value> batch;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (!inputs[i]) {
+            results[i].ret = RET_ERR;
+            results[i].error = stage + " input is nullptr";
+            continue;
+        }
+        index.push_back(i);
+        batch.push_back(Value{input_type, inputs[i]});
+    }
+
+    std::vector<Value> outputs;
+    if (!batch.empty()) {
+        processor->ProcessBatch(batch, outputs);
+    }
+
+    for (size_t j = 0; j < index.size(); j++) {
+        BatchItem<Out>& r = results[index[j]];
+        if (j >= outputs.size() || outputs[j].valueType != output_type || !outputs[j].valuePtr) {
+            r.ret = RET_ERR;
+            r.error = stage + " failed";
+            continue;
+        }
+        r.result = std::static_pointer_cast<Out>(outputs[j].valuePtr);
+    }
+    return results;
+}
+
+// results_of returns results of items, nullptr for failed ones.
+template <typename T>
+std::vector<std::shared_ptr<T>> results_of(const std::vector<BatchItem<T>>& items) {
+    std::vector<std::shared_ptr<T>> results;
+    for (auto& item : items) {
+        results.push_back(item.ret == RET_OK ? item.result : nullptr);
+    }
+    return results;
+}
+
+// carry_errors keeps errors of earlier stages, instead of "input is nullptr" of later ones.
+template <typename From, typename To>
+void carry_errors(const std::vector<BatchItem<From>>& from, std::vector<BatchItem<To>>& to) {
+    for (size_t i = 0; i < from.size() && i < to.size(); i++) {
+        if (from[i].ret != RET_OK) {
+            to[i].ret = from[i].ret;
+            to[i].error = from[i].error;
+        }
+    }
+}
+
+} // namespace
+
+FacePipelineImpl::FacePipelineImpl(const json& conf)
+    : _config(conf), _decoder(new ImageDecoder(ImageDecoder::ParseDecoderOptions(conf))) {
+    // executor is shared by pipelines, the last one configured before it starts wins.
+    if (_config.contains("executor")) {
+        Executor::getInstance().Configure(Executor::ParseExecutorOptions(_config));
+    }
+}
 
 RetCode FacePipelineImpl::Init(Processor* detector, Processor* landmarks, Processor* aligner,
                                Processor* feature) {
@@ -97,6 +186,8 @@ RetCode FacePipelineImpl::Init(Processor* detector, Processor* landmarks, Proces
 }
 
 RetCode FacePipelineImpl::Terminate() {
+    StopStreaming();
+
     if (_detectorProcessor && _detectorProcessor->IsInited()) {
         RetCode ret = _detectorProcessor->Terminate();
     }
@@ -117,9 +208,17 @@ RetCode FacePipelineImpl::Terminate() {
 }
 
 std::shared_ptr<Frame> FacePipelineImpl::Decode(const std::vector<uint8_t>& image_data) {
-    cv::Mat image(cv::imdecode(image_data, cv::IMREAD_UNCHANGED));
+    std::shared_ptr<Frame> frame = _decoder->Decode(image_data);
+    if (!frame) {
+        // keep returning a frame with empty image, as callers expect.
+        return std::make_shared<Frame>(cv::Mat());
+    }
+    return frame;
+}
 
-    return std::make_shared<Frame>(image);
+std::future<std::shared_ptr<Frame>>
+FacePipelineImpl::DecodeAsync(std::vector<uint8_t> image_data) {
+    return _decoder->DecodeAsync(std::move(image_data));
 }
 
 std::shared_ptr<DetectResult> FacePipelineImpl::Detect(std::shared_ptr<Frame> frame) {
@@ -189,4 +288,290 @@ FacePipelineImpl::Extract(std::shared_ptr<AlignerResult> aligner_result) {
     return std::static_pointer_cast<FeatureResult>(output.valuePtr);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Batch
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::vector<BatchItem<Frame>>
+FacePipelineImpl::DecodeBatch(const std::vector<std::vector<uint8_t>>& images) {
+    std::vector<BatchItem<Frame>> results(images.size());
+    Executor::getInstance().ParallelFor(images.size(), [&](size_t i) {
+        results[i].result = _decoder->Decode(images[i]);
+        if (!results[i].result) {
+            results[i].ret = RET_ERR;
+            results[i].error = "cannot decode image";
+        }
+    });
+    return results;
+}
+
+std::vector<BatchItem<DetectResult>>
+FacePipelineImpl::DetectBatch(const std::vector<std::shared_ptr<Frame>>& frames) {
+    return run_batch<Frame, DetectResult>(_detectorProcessor.get(), "detector", ValueFrame,
+                                          ValueDetectResult, frames);
+}
+
+std::vector<BatchItem<LandmarksResult>>
+FacePipelineImpl::LandmarksBatch(const std::vector<std::shared_ptr<DetectResult>>& detect_results) {
+    return run_batch<DetectResult, LandmarksResult>(_landmarksProcessor.get(), "landmarks",
+                                                    ValueDetectResult, ValueLandmarksResult,
+                                                    detect_results);
+}
+
+std::vector<BatchItem<AlignerResult>>
+FacePipelineImpl::AlignBatch(
+    const std::vector<std::shared_ptr<LandmarksResult>>& landmarks_results) {
+    return run_batch<LandmarksResult, AlignerResult>(_alignerProcessor.get(), "aligner",
+                                                     ValueLandmarksResult, ValueAlignerResult,
+                                                     landmarks_results);
+}
+
+std::vector<BatchItem<FeatureResult>>
+FacePipelineImpl::ExtractBatch(const std::vector<std::shared_ptr<AlignerResult>>& aligner_results) {
+    return run_batch<AlignerResult, FeatureResult>(_featureProcessor.get(), "feature",
+                                                   ValueAlignerResult, ValueFeatureResult,
+                                                   aligner_results);
+}
+
+std::vector<BatchItem<FeatureResult>>
+FacePipelineImpl::ProcessImages(const std::vector<std::vector<uint8_t>>& images) {
+    auto frames = DecodeBatch(images);
+    auto detect_results = DetectBatch(results_of(frames));
+    carry_errors(frames, detect_results);
+
+    // images without faces are done, and skip later stages.
+    std::vector<std::shared_ptr<DetectResult>> with_faces = results_of(detect_results);
+    for (auto& detect_result : with_faces) {
+        if (detect_result && detect_result->faces.empty()) {
+            detect_result = nullptr;
+        }
+    }
+
+    auto landmarks_results = LandmarksBatch(with_faces);
+    carry_errors(detect_results, landmarks_results);
+    auto aligner_results = AlignBatch(results_of(landmarks_results));
+    carry_errors(landmarks_results, aligner_results);
+    auto feature_results = ExtractBatch(results_of(aligner_results));
+    carry_errors(aligner_results, feature_results);
+
+    for (size_t i = 0; i < detect_results.size(); i++) {
+        if (detect_results[i].ret == RET_OK && detect_results[i].result->faces.empty()) {
+            feature_results[i] = BatchItem<FeatureResult>{
+                .ret = RET_OK, .error = "", .result = std::make_shared<FeatureResult>()};
+        }
+    }
+
+    return feature_results;
+}
+
+std::vector<FaceTrack> FacePipelineImpl::Track(FaceTracker& tracker,
+                                               std::shared_ptr<Frame> frame) {
+    auto detect_result = Detect(frame);
+    if (!detect_result) {
+        spdlog::error("cannot detect frame, tracks are not updated");
+        return tracker.TakeEnded();
+    }
+    auto updates = tracker.Update(detect_result->faces);
+
+    // only faces of tracks which need a feature go through later stages.
+    auto selected = std::make_shared<DetectResult>();
+    selected->frame = frame;
+    std::vector<int> track_ids;
+    for (size_t i = 0; i < updates.size(); i++) {
+        if (updates[i].extract) {
+            selected->faces.push_back(detect_result->faces[i]);
+            track_ids.push_back(updates[i].track_id);
+        }
+    }
+    if (selected->faces.empty()) {
+        return tracker.TakeEnded();
+    }
+
+    auto landmarks_result = Landmarks(selected);
+    auto aligner_result = landmarks_result ? Align(landmarks_result) : nullptr;
+    auto feature_result = aligner_result ? Extract(aligner_result) : nullptr;
+    if (!feature_result || feature_result->face_features.size() != track_ids.size()) {
+        // tracks are extracted again with their next face.
+        spdlog::warn("cannot extract features of {} tracked faces", track_ids.size());
+        return tracker.TakeEnded();
+    }
+    for (size_t i = 0; i < track_ids.size(); i++) {
+        tracker.SetFeature(track_ids[i], feature_result->face_features[i]);
+    }
+
+    return tracker.TakeEnded();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Streaming
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RetCode FacePipelineImpl::StartStreaming(FeatureCallback callback) {
+    std::lock_guard<std::mutex> l(_stream_mu);
+    if (_is_streaming) {
+        spdlog::warn("pipeline is already streaming");
+        return RetCode::RET_ERR;
+    }
+
+    struct Stage {
+        std::string name;
+        Processor* processor;
+        ValueType output_type;
+    };
+    std::vector<Stage> stages{
+        {"detector", _detectorProcessor.get(), ValueDetectResult},
+        {"landmarks", _landmarksProcessor.get(), ValueLandmarksResult},
+        {"aligner", _alignerProcessor.get(), ValueAlignerResult},
+        {"feature", _featureProcessor.get(), ValueFeatureResult},
+    };
+    for (auto& stage : stages) {
+        if (!stage.processor || !stage.processor->IsInited()) {
+            spdlog::error("{} processor is not inited, cannot stream", stage.name);
+            return RetCode::RET_ERR;
+        }
+    }
+
+    size_t queue_size = 8;
+    if (_config.contains("streaming")) {
+        queue_size = _config["streaming"].value("queue_size", queue_size);
+    }
+
+    _callback = callback;
+    _stage_queues.clear();
+    for (size_t i = 0; i < stages.size(); i++) {
+        _stage_queues.push_back(std::make_shared<StreamQueue>(queue_size));
+    }
+
+    // as many threads as workers of the stage, so that all of them are kept busy.
+    _stage_threads.resize(stages.size());
+    for (size_t i = 0; i < stages.size(); i++) {
+        int concurrent = 1;
+        if (_config.contains(stages[i].name)) {
+            concurrent = _config[stages[i].name].value("concurrent", 1);
+        }
+        StreamQueue* in = _stage_queues[i].get();
+        StreamQueue* out = i + 1 < stages.size() ? _stage_queues[i + 1].get() : nullptr;
+        for (int t = 0; t < std::max(concurrent, 1); t++) {
+            _stage_threads[i].emplace_back(&FacePipelineImpl::stage_loop, this,
+                                           stages[i].processor, stages[i].output_type, in, out);
+        }
+    }
+
+    // decode threads in front of detector, for SubmitImage.
+    _decode_queue = std::make_shared<DecodeQueue>(queue_size);
+    for (int t = 0; t < _decoder->GetOptions().concurrent; t++) {
+        _decode_threads.emplace_back(&FacePipelineImpl::decode_loop, this, _decode_queue.get(),
+                                     _stage_queues[0].get());
+    }
+
+    _is_streaming = true;
+    spdlog::info("face pipeline starts streaming, queue_size: {}", queue_size);
+
+    return RetCode::RET_OK;
+}
+
+RetCode FacePipelineImpl::Submit(std::shared_ptr<Frame> frame, uint64_t tag) {
+    std::shared_ptr<StreamQueue> queue;
+    {
+        std::lock_guard<std::mutex> l(_stream_mu);
+        if (!_is_streaming) {
+            spdlog::error("pipeline is not streaming, call StartStreaming first");
+            return RetCode::RET_ERR;
+        }
+        queue = _stage_queues[0];
+    }
+
+    // Push blocks when queue is full, a concurrent StopStreaming closes it and fails the push.
+    if (!queue->Push(StreamItem{tag, frame, Value{ValueFrame, frame}})) {
+        return RetCode::RET_ERR;
+    }
+    return RetCode::RET_OK;
+}
+
+RetCode FacePipelineImpl::SubmitImage(std::vector<uint8_t> image_data, uint64_t tag) {
+    std::shared_ptr<DecodeQueue> queue;
+    {
+        std::lock_guard<std::mutex> l(_stream_mu);
+        if (!_is_streaming) {
+            spdlog::error("pipeline is not streaming, call StartStreaming first");
+            return RetCode::RET_ERR;
+        }
+        queue = _decode_queue;
+    }
+
+    if (!queue->Push(DecodeItem{tag, std::move(image_data)})) {
+        return RetCode::RET_ERR;
+    }
+    return RetCode::RET_OK;
+}
+
+RetCode FacePipelineImpl::StopStreaming() {
+    std::lock_guard<std::mutex> l(_stream_mu);
+    if (!_is_streaming) {
+        return RetCode::RET_OK;
+    }
+
+    // stop stages in order, each stage drains its queue before next one is closed.
+    _decode_queue->Close();
+    for (auto& t : _decode_threads) {
+        t.join();
+    }
+    _decode_threads.clear();
+    _decode_queue.reset();
+
+    for (size_t i = 0; i < _stage_queues.size(); i++) {
+        _stage_queues[i]->Close();
+        for (auto& t : _stage_threads[i]) {
+            t.join();
+        }
+    }
+
+    _stage_threads.clear();
+    _stage_queues.clear();
+    _callback = nullptr;
+    _is_streaming = false;
+
+    return RetCode::RET_OK;
+}
+
+void FacePipelineImpl::stage_loop(Processor* processor, ValueType output_type, StreamQueue* in,
+                                  StreamQueue* out) {
+    StreamItem item;
+    while (in->Pop(item)) {
+        // failed in previous stage, just pass it down.
+        Value output{output_type, nullptr};
+        if (item.value.valuePtr) {
+            RetCode ret = processor->Process(item.value, output);
+            if (ret != RET_OK) {
+                spdlog::warn("{} failed to process frame, ret: {}", processor->GetName(),
+                             int(ret));
+                output = Value{output_type, nullptr};
+            } else if (output.valueType != output_type) {
+                spdlog::error("{} output is not {}", processor->GetName(),
+                              format_value_type(output_type));
+                output = Value{output_type, nullptr};
+            }
+        }
+
+        if (out) {
+            out->Push(StreamItem{item.tag, item.frame, output});
+        } else if (_callback) {
+            _callback(item.tag, item.frame,
+                      std::static_pointer_cast<FeatureResult>(output.valuePtr));
+        }
+    }
+}
+
+void FacePipelineImpl::decode_loop(DecodeQueue* in, StreamQueue* out) {
+    DecodeItem item;
+    while (in->Pop(item)) {
+        std::shared_ptr<Frame> frame = _decoder->Decode(item.image_data);
+        if (!frame) {
+            spdlog::warn("cannot decode submitted image {} of {} bytes", item.tag,
+                         item.image_data.size());
+        }
+        out->Push(StreamItem{item.tag, frame, Value{ValueFrame, frame}});
+    }
+}
+
 } // namespace donde_toolkits::feature_extract
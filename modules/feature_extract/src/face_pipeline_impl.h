@@ -1,11 +1,19 @@
 #pragma once
 
+#include "donde/bounded_queue.h"
 #include "donde/definitions.h"
+#include "donde/feature_extract/face_pipeline.h"
 #include "donde/feature_extract/processor.h"
+#include "image_decoder.h"
 // #include "faiss/Index2Layer.h"
 #include "nlohmann/json.hpp"
 
+#include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 using namespace Poco;
 
@@ -26,6 +34,8 @@ class FacePipelineImpl {
 
     std::shared_ptr<Frame> Decode(const std::vector<uint8_t>& image_data);
 
+    std::future<std::shared_ptr<Frame>> DecodeAsync(std::vector<uint8_t> image_data);
+
     std::shared_ptr<DetectResult> Detect(const std::shared_ptr<Frame> frame);
 
     std::shared_ptr<LandmarksResult> Landmarks(const std::shared_ptr<DetectResult> detect_result);
@@ -34,9 +44,72 @@ class FacePipelineImpl {
 
     std::shared_ptr<FeatureResult> Extract(std::shared_ptr<AlignerResult> aligner_result);
 
+    std::vector<BatchItem<Frame>> DecodeBatch(const std::vector<std::vector<uint8_t>>& images);
+
+    std::vector<BatchItem<DetectResult>>
+    DetectBatch(const std::vector<std::shared_ptr<Frame>>& frames);
+
+    std::vector<BatchItem<LandmarksResult>>
+    LandmarksBatch(const std::vector<std::shared_ptr<DetectResult>>& detect_results);
+
+    std::vector<BatchItem<AlignerResult>>
+    AlignBatch(const std::vector<std::shared_ptr<LandmarksResult>>& landmarks_results);
+
+    std::vector<BatchItem<FeatureResult>>
+    ExtractBatch(const std::vector<std::shared_ptr<AlignerResult>>& aligner_results);
+
+    std::vector<BatchItem<FeatureResult>>
+    ProcessImages(const std::vector<std::vector<uint8_t>>& images);
+
+    std::vector<FaceTrack> Track(FaceTracker& tracker, std::shared_ptr<Frame> frame);
+
+    RetCode StartStreaming(FeatureCallback callback);
+
+    RetCode Submit(std::shared_ptr<Frame> frame, uint64_t tag);
+
+    RetCode SubmitImage(std::vector<uint8_t> image_data, uint64_t tag);
+
+    RetCode StopStreaming();
+
+  private:
+    // StreamItem is what flows between stages, value is the input of next stage.
+    struct StreamItem {
+        uint64_t tag;
+        std::shared_ptr<Frame> frame;
+        Value value;
+    };
+    using StreamQueue = BoundedQueue<StreamItem>;
+
+    // DecodeItem is a submitted image waiting for decode threads.
+    struct DecodeItem {
+        uint64_t tag;
+        std::vector<uint8_t> image_data;
+    };
+    using DecodeQueue = BoundedQueue<DecodeItem>;
+
+    // stage_loop pops items from in, processes them, and pushes outputs to out,
+    // the last stage (out is nullptr) hands features to callback.
+    void stage_loop(Processor* processor, ValueType output_type, StreamQueue* in,
+                    StreamQueue* out);
+
+    // decode_loop decodes submitted images, and pushes frames to detector queue.
+    void decode_loop(DecodeQueue* in, StreamQueue* out);
+
   private:
     json _config;
 
+    std::unique_ptr<ImageDecoder> _decoder;
+
+    // streaming, one input queue and threads per stage.
+    std::mutex _stream_mu;
+    std::atomic<bool> _is_streaming = false;
+    FeatureCallback _callback;
+    // queues are shared, so that Submit pushes to its copy out of _stream_mu.
+    std::vector<std::shared_ptr<StreamQueue>> _stage_queues;
+    std::vector<std::vector<std::thread>> _stage_threads;
+    std::shared_ptr<DecodeQueue> _decode_queue;
+    std::vector<std::thread> _decode_threads;
+
     std::shared_ptr<Processor> _detectorProcessor;
     std::shared_ptr<Processor> _landmarksProcessor;
     std::shared_ptr<Processor> _alignerProcessor;
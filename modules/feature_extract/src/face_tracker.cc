@@ -0,0 +1,174 @@
+#include "donde/feature_extract/face_tracker.h"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace donde_toolkits ::feature_extract {
+
+float face_quality(const FaceDetection& face) {
+    return face.confidence * std::sqrt((float)face.box.area());
+};
+
+float box_iou(const cv::Rect& a, const cv::Rect& b) {
+    int overlap = (a & b).area();
+    if (overlap <= 0) {
+        return 0;
+    }
+    return (float)overlap / (a.area() + b.area() - overlap);
+};
+
+FaceTracker::FaceTracker(const TrackerOptions& opts) : _opts(opts){};
+
+TrackerOptions FaceTracker::ParseTrackerOptions(const json& conf) {
+    TrackerOptions opts;
+    if (!conf.contains("tracker")) {
+        return opts;
+    }
+    const json& tracker = conf["tracker"];
+    opts.iou_threshold = tracker.value("iou_threshold", opts.iou_threshold);
+    opts.max_missed = std::max(0, tracker.value("max_missed", opts.max_missed));
+    opts.min_hits = std::max(1, tracker.value("min_hits", opts.min_hits));
+    opts.improve_ratio = tracker.value("improve_ratio", opts.improve_ratio);
+    opts.max_extractions = std::max(1, tracker.value("max_extractions", opts.max_extractions));
+
+    std::string extract = tracker.value("extract", "best");
+    if (extract == "start") {
+        opts.extract = EXTRACT_START;
+    } else if (extract == "best") {
+        opts.extract = EXTRACT_BEST;
+    } else {
+        spdlog::warn("unknown tracker extract policy {}, use best", extract);
+    }
+    return opts;
+};
+
+cv::Rect FaceTracker::predict(const TrackState& state) const {
+    // constant velocity, over the frames since face was last seen.
+    cv::Point2f shift = state.velocity * (float)(state.track.missed + 1);
+    return state.track.box + cv::Point((int)std::round(shift.x), (int)std::round(shift.y));
+};
+
+bool FaceTracker::should_extract(const TrackState& state) const {
+    const FaceTrack& track = state.track;
+    if (track.hits < _opts.min_hits) {
+        return false;
+    }
+    if (_opts.extract == EXTRACT_START) {
+        return track.extractions == 0;
+    }
+    return track.extractions == 0
+           || (track.extractions < _opts.max_extractions
+               && state.quality >= track.feature_quality * _opts.improve_ratio);
+};
+
+std::vector<TrackUpdate> FaceTracker::Update(const std::vector<FaceDetection>& faces) {
+    _frame_id++;
+
+    // greedy association, best overlapping pairs first.
+    struct Candidate {
+        float iou;
+        size_t track;
+        size_t face;
+    };
+    std::vector<Candidate> candidates;
+    for (size_t t = 0; t < _tracks.size(); t++) {
+        cv::Rect predicted = predict(_tracks[t]);
+        for (size_t f = 0; f < faces.size(); f++) {
+            float iou = box_iou(predicted, faces[f].box);
+            if (iou >= _opts.iou_threshold) {
+                candidates.push_back({iou, t, f});
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& a, const Candidate& b) { return a.iou > b.iou; });
+
+    std::vector<int> face_tracks(faces.size(), -1);
+    std::vector<bool> matched(_tracks.size(), false);
+    for (auto& c : candidates) {
+        if (face_tracks[c.face] < 0 && !matched[c.track]) {
+            face_tracks[c.face] = c.track;
+            matched[c.track] = true;
+        }
+    }
+
+    for (size_t t = 0; t < _tracks.size(); t++) {
+        if (!matched[t]) {
+            _tracks[t].track.missed++;
+        }
+    }
+
+    std::vector<TrackUpdate> updates(faces.size());
+    for (size_t f = 0; f < faces.size(); f++) {
+        if (face_tracks[f] < 0) {
+            TrackState state;
+            state.track.id = _next_track_id++;
+            state.track.box = faces[f].box;
+            state.track.first_frame = _frame_id;
+            face_tracks[f] = _tracks.size();
+            _tracks.push_back(state);
+        } else {
+            TrackState& state = _tracks[face_tracks[f]];
+            cv::Point2f moved = (cv::Point2f)(faces[f].box.tl() - state.track.box.tl())
+                                / (float)(state.track.missed + 1);
+            state.velocity = state.velocity * 0.5f + moved * 0.5f;
+            state.track.box = faces[f].box;
+            state.track.missed = 0;
+        }
+
+        TrackState& state = _tracks[face_tracks[f]];
+        state.track.hits++;
+        state.track.last_frame = _frame_id;
+        state.quality = face_quality(faces[f]);
+        updates[f] = TrackUpdate{.track_id = state.track.id, .extract = should_extract(state)};
+    }
+
+    // unconfirmed tracks are likely false detections, they end quietly.
+    auto lost = std::remove_if(_tracks.begin(), _tracks.end(), [this](const TrackState& state) {
+        if (state.track.missed <= _opts.max_missed) {
+            return false;
+        }
+        if (state.track.hits >= _opts.min_hits) {
+            _ended.push_back(state.track);
+        }
+        return true;
+    });
+    _tracks.erase(lost, _tracks.end());
+
+    return updates;
+};
+
+void FaceTracker::SetFeature(int track_id, const Feature& feature) {
+    for (auto& state : _tracks) {
+        if (state.track.id != track_id) {
+            continue;
+        }
+        FaceTrack& track = state.track;
+        track.extractions++;
+        if (!track.feature || state.quality > track.feature_quality) {
+            track.feature = std::make_shared<Feature>(feature);
+            track.feature_quality = state.quality;
+        }
+        return;
+    }
+};
+
+std::vector<FaceTrack> FaceTracker::TakeEnded() {
+    std::vector<FaceTrack> ended;
+    ended.swap(_ended);
+    return ended;
+};
+
+std::vector<FaceTrack> FaceTracker::Flush() {
+    for (auto& state : _tracks) {
+        if (state.track.hits >= _opts.min_hits) {
+            _ended.push_back(state.track);
+        }
+    }
+    _tracks.clear();
+    return TakeEnded();
+};
+
+} // namespace donde_toolkits::feature_extract
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "donde/definitions.h"
+#include "nlohmann/json.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace donde_toolkits ::feature_extract {
+
+// FanOutOptions, how a multi-face input is split across workers of a stage.
+//   "fan_out": {"faces_per_item": 1}
+// each work item carries at most faces_per_item faces, 0 disables fan-out.
+struct FanOutOptions {
+    size_t faces_per_item = 1;
+};
+
+inline FanOutOptions ParseFanOutOptions(const json& conf) {
+    FanOutOptions opts;
+    if (!conf.contains("fan_out")) {
+        return opts;
+    }
+    opts.faces_per_item
+        = std::max(0, conf["fan_out"].value("faces_per_item", (int)opts.faces_per_item));
+    return opts;
+};
+
+template <typename T>
+inline std::vector<T> slice(const std::vector<T>& v, size_t begin, size_t count) {
+    auto first = v.begin() + std::min(begin, v.size());
+    auto last = v.begin() + std::min(begin + count, v.size());
+    return std::vector<T>(first, last);
+};
+
+template <typename T>
+inline void append(std::vector<T>& to, const std::vector<T>& from) {
+    to.insert(to.end(), from.begin(), from.end());
+};
+
+// split_faces splits a per-frame input into items of at most faces_per_item faces, in face order.
+// inputs without faces (frames) or with few faces are returned as one item.
+inline std::vector<Value> split_faces(const Value& input, size_t faces_per_item) {
+    if (faces_per_item == 0 || !input.valuePtr) {
+        return {input};
+    }
+
+    std::vector<Value> items;
+    switch (input.valueType) {
+    case ValueDetectResult: {
+        auto result = std::static_pointer_cast<DetectResult>(input.valuePtr);
+        if (result->faces.size() <= faces_per_item) {
+            return {input};
+        }
+        for (size_t i = 0; i < result->faces.size(); i += faces_per_item) {
+            auto item = std::make_shared<DetectResult>();
+            item->frame = result->frame;
+            item->faces = slice(result->faces, i, faces_per_item);
+            items.push_back(Value{ValueDetectResult, item});
+        }
+        break;
+    }
+    case ValueLandmarksResult: {
+        auto result = std::static_pointer_cast<LandmarksResult>(input.valuePtr);
+        if (result->faces.size() <= faces_per_item) {
+            return {input};
+        }
+        for (size_t i = 0; i < result->faces.size(); i += faces_per_item) {
+            auto item = std::make_shared<LandmarksResult>();
+            item->faces = slice(result->faces, i, faces_per_item);
+            item->face_landmarks = slice(result->face_landmarks, i, faces_per_item);
+            items.push_back(Value{ValueLandmarksResult, item});
+        }
+        break;
+    }
+    case ValueAlignerResult: {
+        auto result = std::static_pointer_cast<AlignerResult>(input.valuePtr);
+        if (result->aligned_faces.size() <= faces_per_item) {
+            return {input};
+        }
+        for (size_t i = 0; i < result->aligned_faces.size(); i += faces_per_item) {
+            auto item = std::make_shared<AlignerResult>();
+            item->aligned_faces = slice(result->aligned_faces, i, faces_per_item);
+            items.push_back(Value{ValueAlignerResult, item});
+        }
+        break;
+    }
+    default:
+        return {input};
+    }
+
+    return items;
+};
+
+// merge_faces regathers outputs of split items into one per-frame output, in item order.
+// if any item failed, output has a nullptr value.
+inline Value merge_faces(const std::vector<Value>& outputs) {
+    if (outputs.size() == 1) {
+        return outputs[0];
+    }
+
+    ValueType output_type = outputs.empty() ? ValueFrame : outputs[0].valueType;
+    for (auto& output : outputs) {
+        if (!output.valuePtr || output.valueType != output_type) {
+            return Value{output_type, nullptr};
+        }
+    }
+
+    switch (output_type) {
+    case ValueLandmarksResult: {
+        auto merged = std::make_shared<LandmarksResult>();
+        for (auto& output : outputs) {
+            auto result = std::static_pointer_cast<LandmarksResult>(output.valuePtr);
+            append(merged->faces, result->faces);
+            append(merged->face_landmarks, result->face_landmarks);
+        }
+        return Value{ValueLandmarksResult, merged};
+    }
+    case ValueAlignerResult: {
+        auto merged = std::make_shared<AlignerResult>();
+        for (auto& output : outputs) {
+            auto result = std::static_pointer_cast<AlignerResult>(output.valuePtr);
+            append(merged->aligned_faces, result->aligned_faces);
+        }
+        return Value{ValueAlignerResult, merged};
+    }
+    case ValueFeatureResult: {
+        auto merged = std::make_shared<FeatureResult>();
+        for (auto& output : outputs) {
+            auto result = std::static_pointer_cast<FeatureResult>(output.valuePtr);
+            append(merged->face_features, result->face_features);
+        }
+        return Value{ValueFeatureResult, merged};
+    }
+    default:
+        return Value{output_type, nullptr};
+    }
+};
+
+} // namespace donde_toolkits::feature_extract
@@ -0,0 +1,110 @@
+#include "image_decoder.h"
+
+#include "executor.h"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/opencv.hpp>
+
+namespace donde_toolkits ::feature_extract {
+
+bool jpeg_size(const std::vector<uint8_t>& image_data, int& width, int& height) {
+    const size_t len = image_data.size();
+    const uint8_t* data = image_data.data();
+    if (len < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+        return false;
+    }
+
+    // walk markers until a start of frame, SOF0 .. SOF15 except DHT(C4), JPG(C8) and DAC(CC).
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (data[pos] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        size_t segment_len = (data[pos + 2] << 8) | data[pos + 3];
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8
+            && marker != 0xCC) {
+            if (pos + 9 > len) {
+                return false;
+            }
+            height = (data[pos + 5] << 8) | data[pos + 6];
+            width = (data[pos + 7] << 8) | data[pos + 8];
+            return width > 0 && height > 0;
+        }
+        pos += 2 + segment_len;
+    }
+    return false;
+}
+
+ImageDecoder::ImageDecoder(const DecoderOptions& opts)
+    : _opts(opts), _pool(MatPool::Create(std::max(0, opts.pool_size))){};
+
+DecoderOptions ImageDecoder::ParseDecoderOptions(const json& conf) {
+    DecoderOptions opts;
+    if (!conf.contains("decoder")) {
+        return opts;
+    }
+    const json& decoder = conf["decoder"];
+    opts.concurrent = std::max(1, decoder.value("concurrent", opts.concurrent));
+    opts.pool_size = std::max(0, decoder.value("pool_size", opts.pool_size));
+    opts.reduce_width = std::max(0, decoder.value("reduce_width", opts.reduce_width));
+    opts.reduce_height = std::max(0, decoder.value("reduce_height", opts.reduce_height));
+    return opts;
+};
+
+int ImageDecoder::decode_flag(const std::vector<uint8_t>& image_data) {
+    int width = 0, height = 0;
+    if (_opts.reduce_width <= 0 || _opts.reduce_height <= 0
+        || !jpeg_size(image_data, width, height)) {
+        return cv::IMREAD_UNCHANGED;
+    }
+
+    // largest scale which keeps image not smaller than reduce size.
+    const std::vector<std::pair<int, int>> scales{
+        {8, cv::IMREAD_REDUCED_COLOR_8},
+        {4, cv::IMREAD_REDUCED_COLOR_4},
+        {2, cv::IMREAD_REDUCED_COLOR_2},
+    };
+    for (auto& [scale, flag] : scales) {
+        if (width / scale >= _opts.reduce_width && height / scale >= _opts.reduce_height) {
+            return flag;
+        }
+    }
+    return cv::IMREAD_UNCHANGED;
+};
+
+std::shared_ptr<Frame> ImageDecoder::Decode(const std::vector<uint8_t>& image_data) {
+    if (image_data.empty()) {
+        return nullptr;
+    }
+
+    // imdecode reuses the buffer when size and type match, which is the common case of a stream.
+    cv::Mat image = _pool->Acquire();
+    cv::imdecode(image_data, decode_flag(image_data), &image);
+    if (image.empty()) {
+        return nullptr;
+    }
+
+    return _pool->MakeFrame(image);
+};
+
+std::future<std::shared_ptr<Frame>> ImageDecoder::DecodeAsync(std::vector<uint8_t> image_data) {
+    auto promise = std::make_shared<std::promise<std::shared_ptr<Frame>>>();
+    std::future<std::shared_ptr<Frame>> future = promise->get_future();
+
+    auto data = std::make_shared<std::vector<uint8_t>>(std::move(image_data));
+    Executor::getInstance().Submit(
+        [this, promise, data] { promise->set_value(Decode(*data)); });
+
+    return future;
+};
+
+size_t ImageDecoder::Pooled() { return _pool->Size(); };
+
+} // namespace donde_toolkits::feature_extract
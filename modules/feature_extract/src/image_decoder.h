@@ -0,0 +1,64 @@
+#pragma once
+
+#include "donde/definitions.h"
+#include "donde/mat_pool.h"
+#include "nlohmann/json.hpp"
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <opencv2/core/mat.hpp>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace donde_toolkits ::feature_extract {
+
+// DecoderOptions, from "decoder" block of pipeline config.
+//   "decoder": {
+//       "concurrent": 2,        // decode threads ahead of detector when streaming
+//       "pool_size": 8,         // decoded buffers kept for reuse, 0 disables pooling
+//       "reduce_width": 672,    // jpeg is decoded at 1/2, 1/4 or 1/8 size, as long as it is
+//       "reduce_height": 384    // still larger than this, 0 disables reduced decoding
+//   }
+// reduce size is usually the detector input. Faces are then found and cropped from the reduced
+// frame, so keep it large enough for the smallest face to be recognized.
+struct DecoderOptions {
+    int concurrent = 2;
+    int pool_size = 8;
+    int reduce_width = 0;
+    int reduce_height = 0;
+};
+
+// ImageDecoder decodes encoded images into frames, decoded buffers are pooled and reused once
+// their frames are released.
+class ImageDecoder {
+  public:
+    ImageDecoder(const DecoderOptions& opts);
+
+    static DecoderOptions ParseDecoderOptions(const json& conf);
+
+    // Decode image data into a frame, nullptr if it cannot be decoded.
+    std::shared_ptr<Frame> Decode(const std::vector<uint8_t>& image_data);
+
+    // DecodeAsync decodes on the shared executor.
+    std::future<std::shared_ptr<Frame>> DecodeAsync(std::vector<uint8_t> image_data);
+
+    inline const DecoderOptions& GetOptions() { return _opts; };
+
+    // buffers pooled for reuse now.
+    size_t Pooled();
+
+  private:
+    // imread flag to decode image_data with, reduced if it is a large jpeg.
+    int decode_flag(const std::vector<uint8_t>& image_data);
+
+  private:
+    DecoderOptions _opts;
+    std::shared_ptr<MatPool> _pool;
+};
+
+// jpeg_size reads image size from jpeg header, false if it is not a jpeg.
+bool jpeg_size(const std::vector<uint8_t>& image_data, int& width, int& height);
+
+} // namespace donde_toolkits::feature_extract
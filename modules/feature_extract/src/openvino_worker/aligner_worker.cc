@@ -82,13 +82,15 @@ RetCode AlignerWorker::process(const LandmarksResult& landmarks_result, AlignerR
         return RetCode::RET_ERR;
     }
 
-    for (size_t i = 0; i < landmarks_result.faces.size(); i++) {
-        cv::Mat aligned = align_face(landmarks_result.faces[i], landmarks_result.face_landmarks[i]);
-        result.aligned_faces.push_back(aligned);
+    // faces are aligned in parallel, on cores idle stages are not using.
+    result.aligned_faces.resize(landmarks_result.faces.size());
+    Executor::getInstance().ParallelFor(landmarks_result.faces.size(), [&](size_t i) {
+        result.aligned_faces[i]
+            = align_face(landmarks_result.faces[i], landmarks_result.face_landmarks[i]);
 
         // cv::imwrite("/tmp/face_" + std::to_string(i) + ".jpg", landmarks_result.faces[i]);
-        // cv::imwrite("/tmp/face_aligned_" + std::to_string(i) + ".jpg", aligned);
-    }
+        // cv::imwrite("/tmp/face_aligned_" + std::to_string(i) + ".jpg", result.aligned_faces[i]);
+    });
 
     return RetCode::RET_OK;
 }
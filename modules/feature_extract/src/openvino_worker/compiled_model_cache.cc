@@ -0,0 +1,87 @@
+#include "compiled_model_cache.h"
+
+#include "spdlog/spdlog.h"
+
+namespace donde_toolkits ::feature_extract ::openvino_worker {
+
+CompiledModelCache& CompiledModelCache::getInstance() {
+    static CompiledModelCache cache;
+    return cache;
+};
+
+std::shared_ptr<CompiledStage> CompiledModelCache::GetOrCompile(const json& conf,
+                                                                const std::string& device_id,
+                                                                ModelBuilder build) {
+    // whole stage config is the key, model/batch/performance all change the compiled model.
+    std::string key = device_id + ":" + conf.dump();
+
+    std::lock_guard<std::mutex> l(_mu);
+
+    auto iter = _stages.find(key);
+    if (iter != _stages.end()) {
+        if (auto stage = iter->second.lock()) {
+            spdlog::info("reuse compiled model on {}", device_id);
+            return stage;
+        }
+    }
+
+    auto stage = std::make_shared<CompiledStage>();
+    std::shared_ptr<ov::Model> model = build(_core, *stage);
+    ov::AnyMap properties = ParsePerformanceOptions(conf);
+
+    stage->compiled_model = _core.compile_model(model, device_id, properties);
+    _stages[key] = stage;
+    return stage;
+};
+
+ov::AnyMap CompiledModelCache::ParsePerformanceOptions(const json& conf) {
+    ov::AnyMap properties;
+    if (!conf.contains("performance")) {
+        return properties;
+    }
+    const json& perf = conf["performance"];
+
+    std::string hint = perf.value("hint", "");
+    if (hint == "THROUGHPUT") {
+        properties.insert(ov::hint::performance_mode(ov::hint::PerformanceMode::THROUGHPUT));
+    } else if (hint == "LATENCY") {
+        properties.insert(ov::hint::performance_mode(ov::hint::PerformanceMode::LATENCY));
+    } else if (!hint.empty()) {
+        spdlog::warn("unknown performance hint: {}, ignore it", hint);
+    }
+
+    int num_streams = perf.value("num_streams", 0);
+    if (num_streams > 0) {
+        properties.insert(ov::num_streams(num_streams));
+    }
+
+    int num_requests = perf.value("num_requests", 0);
+    if (num_requests > 0) {
+        properties.insert(ov::hint::num_requests(num_requests));
+    }
+
+    int inference_threads = perf.value("inference_threads", 0);
+    if (inference_threads > 0) {
+        properties.insert(ov::inference_num_threads(inference_threads));
+    }
+
+    if (perf.contains("cpu_pinning")) {
+        properties.insert(ov::hint::enable_cpu_pinning(perf["cpu_pinning"].get<bool>()));
+    }
+
+    std::string precision = perf.value("precision", "");
+    if (precision == "f32") {
+        properties.insert(ov::hint::inference_precision(ov::element::f32));
+    } else if (precision == "f16") {
+        properties.insert(ov::hint::inference_precision(ov::element::f16));
+    } else if (precision == "bf16") {
+        properties.insert(ov::hint::inference_precision(ov::element::bf16));
+    } else if (!precision.empty()) {
+        // int8 is decided by the model itself, use a quantized IR for it.
+        spdlog::warn("unsupported inference precision: {}, ignore it", precision);
+    }
+
+    return properties;
+};
+
+} // namespace donde_toolkits::feature_extract::openvino_worker
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "donde/definitions.h"
+#include "nlohmann/json.hpp"
+#include "openvino/openvino.hpp"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using json = nlohmann::json;
+
+namespace donde_toolkits ::feature_extract ::openvino_worker {
+
+// CompiledStage is the compiled model of a stage, with the input size of the network itself,
+// since resize is compiled into the model, its input tensor takes images of any size.
+struct CompiledStage {
+    ov::CompiledModel compiled_model;
+    size_t input_width = 0;
+    size_t input_height = 0;
+};
+
+// CompiledModelCache shares one ov::Core, and one compiled model per stage config.
+//
+// Workers of one ConcurrentProcessor have the same config, so the first one compiles the model
+// and others reuse it, instead of holding N copies of the weights. A compiled model is freed when
+// the last worker using it is gone.
+class CompiledModelCache {
+  public:
+    // ModelBuilder reads and preprocesses the model, and fills the network input size of stage.
+    // called only when it is not compiled yet.
+    using ModelBuilder
+        = std::function<std::shared_ptr<ov::Model>(ov::Core& core, CompiledStage& stage)>;
+
+    static CompiledModelCache& getInstance();
+
+    // GetOrCompile returns the compiled stage of this stage config.
+    std::shared_ptr<CompiledStage> GetOrCompile(const json& conf, const std::string& device_id,
+                                                ModelBuilder build);
+
+    // ParsePerformanceOptions converts "performance" block of stage config to compile properties,
+    // missing fields keep plugin defaults.
+    //   "performance": {
+    //       "hint": "THROUGHPUT",     // or "LATENCY"
+    //       "num_streams": 4,
+    //       "num_requests": 4,
+    //       "inference_threads": 8,
+    //       "cpu_pinning": true,
+    //       "precision": "bf16"       // f32, f16 or bf16
+    //   }
+    static ov::AnyMap ParsePerformanceOptions(const json& conf);
+
+  private:
+    CompiledModelCache() = default;
+
+  private:
+    ov::Core _core;
+
+    std::mutex _mu;
+    std::unordered_map<std::string, std::weak_ptr<CompiledStage>> _stages;
+};
+
+} // namespace donde_toolkits::feature_extract::openvino_worker
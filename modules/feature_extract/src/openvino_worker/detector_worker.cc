@@ -7,6 +7,7 @@
 #include "donde/message.h"
 #include "donde/utils.h"
 #include "opencv2/opencv.hpp"
+#include "compiled_model_cache.h"
 #include "openvino/openvino.hpp"
 #include "openvino_worker.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
@@ -14,6 +15,7 @@
 
 #include <cassert>
 #include <filesystem>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <opencv2/core/types.hpp>
@@ -38,7 +40,9 @@ DetectorWorker::~DetectorWorker() {
    conf:
    {
        "model": "../models/face-detection-adas-0001.xml",
-       "warmup": false
+       "warmup": false,
+       "batch": {"max_batch_size": 4, "max_wait_ms": 2},
+       "infer_requests": 0
    }
 
  */
@@ -87,46 +91,68 @@ RetCode DetectorWorker::Init(json conf, int i, std::string device_id) {
     _logger->info("loading model: {}", model_path);
     _logger->info("absolute path: {}", std::filesystem::canonical(model_path).string());
 
-    ov::Core core;
-    std::shared_ptr<ov::Model> model = core.read_model(model_path);
-    printInputAndOutputsInfo(*model);
-
-    OPENVINO_ASSERT(model->inputs().size() == 1, "Sample supports models with 1 input only");
-    OPENVINO_ASSERT(model->outputs().size() == 1, "Sample supports models with 1 output only");
-
-    ov::preprocess::PrePostProcessor ppp(model);
-    ov::preprocess::InputInfo& input_info = ppp.input();
-
     // input data is NHWC
     ov::Layout tensor_layout{"NHWC"};
-    input_info.tensor().set_element_type(ov::element::u8).set_layout(tensor_layout);
-    // but the model input need nchw, so the convertion begin.
-    input_info.model().set_layout("NCHW");
-    // model output is float32
-    ppp.output().tensor().set_element_type(ov::element::f32);
+    _batch = ParseBatchOptions(conf);
+
+    // called only by the first worker of this stage.
+    auto build_model = [&](ov::Core& core, CompiledStage& stage) {
+        std::shared_ptr<ov::Model> model = core.read_model(model_path);
+        printInputAndOutputsInfo(*model);
+
+        OPENVINO_ASSERT(model->inputs().size() == 1, "Sample supports models with 1 input only");
+        OPENVINO_ASSERT(model->outputs().size() == 1, "Sample supports models with 1 output only");
+
+        // the network takes NCHW of fixed size.
+        ov::Layout model_layout{"NCHW"};
+        ov::Shape model_shape = model->input().get_shape();
+        stage.input_width = model_shape[ov::layout::width_idx(model_layout)];
+        stage.input_height = model_shape[ov::layout::height_idx(model_layout)];
+
+        ov::preprocess::PrePostProcessor ppp(model);
+        ov::preprocess::InputInfo& input_info = ppp.input();
+
+        // input tensor is image of any size, resized by the model itself.
+        // opencv images are BGR as the models expect, so no color conversion.
+        input_info.tensor()
+            .set_element_type(ov::element::u8)
+            .set_layout(tensor_layout)
+            .set_spatial_dynamic_shape();
+        input_info.preprocess().resize(ov::preprocess::ResizeAlgorithm::RESIZE_LINEAR);
+        // but the model input need nchw, so the convertion begin.
+        input_info.model().set_layout(model_layout);
+        // model output is float32
+        ppp.output().tensor().set_element_type(ov::element::f32);
+
+        model = ppp.build();
+
+        if (_batch.max_batch_size > 1) {
+            // dynamic batch, each inference takes [1, max_batch_size] frames.
+            ov::set_batch(model, ov::Dimension(1, _batch.max_batch_size));
+        } else {
+            ov::set_batch(model, 1);
+        }
 
-    model = ppp.build();
+        return model;
+    };
 
-    _batch_size = 1;
-    ov::set_batch(model, _batch_size);
+    // workers of this stage share one compiled model.
+    _stage = CompiledModelCache::getInstance().GetOrCompile(conf, _device_id, build_model);
 
-    ov::Shape input_shape = model->input().get_shape();
-    _image_width = input_shape[ov::layout::width_idx(tensor_layout)];
-    _image_height = input_shape[ov::layout::height_idx(tensor_layout)];
+    _image_width = _stage->input_width;
+    _image_height = _stage->input_height;
 
     // output shape: [1, 1, N, 7],
-    // where N is the number of detected bounding boxes
+    // where N is the number of detected bounding boxes (of all frames in batch)
     // each batch in output tensor is a 7 floats array.
     // SEE
     // https://github.com/openvinotoolkit/open_model_zoo/blob/master/models/intel/face-detection-adas-0001/README.md
-    ov::Shape output_shape = model->output().get_shape();
-    _max_faces = output_shape[2];
-    _shape_dim = output_shape[3]; // 7
+    ov::PartialShape output_shape = _stage->compiled_model.output().get_partial_shape();
+    _shape_dim = output_shape[3].get_length(); // 7
 
-    _compiled_model
-        = std::make_shared<ov::CompiledModel>(std::move(core.compile_model(model, _device_id)));
-    _infer_request
-        = std::make_shared<ov::InferRequest>(std::move(_compiled_model->create_infer_request()));
+    // requests run asynchronously, 0 means optimal number of the device.
+    _infer_pool = std::make_unique<InferRequestPool>(_stage->compiled_model,
+                                                     conf.value("infer_requests", 0));
 
     if (conf.contains("warmup") && conf["warmup"]) {
         // warmup img
@@ -142,66 +168,111 @@ RetCode DetectorWorker::Init(json conf, int i, std::string device_id) {
 
 void DetectorWorker::run() {
     for (;;) {
-        // output is a blocking call.
-        Notification::Ptr pNf = _channel->waitDequeueNotification();
-        if (pNf.isNull()) {
+        // blocking call, returns up to max_batch_size messages.
+        std::vector<WorkMessage<Value>::Ptr> msgs = dequeue_batch(_batch);
+        if (msgs.empty()) {
             break;
         }
-        WorkMessage<Value>::Ptr msg = pNf.cast<WorkMessage<Value>>();
-        Value input = msg->getRequest();
-        if (input.valueType != ValueFrame) {
-            _logger->error("DetectorWorker input value is not a frame! wrong valueType: {}",
-                           int(input.valueType));
+
+        std::vector<WorkMessage<Value>::Ptr> batch_msgs;
+        std::vector<cv::Mat> frames;
+        std::vector<std::shared_ptr<DetectResult>> results;
+        std::vector<DetectResult*> result_ptrs;
+        for (auto& msg : msgs) {
+            Value input = msg->getRequest();
+            if (input.valueType != ValueFrame) {
+                _logger->error("DetectorWorker input value is not a frame! wrong valueType: {}",
+                               int(input.valueType));
+                continue;
+            }
+            std::shared_ptr<Frame> f = std::static_pointer_cast<Frame>(input.valuePtr);
+
+            std::shared_ptr<DetectResult> result = std::make_shared<DetectResult>();
+            // acquire! hold a reference to the frame.
+            result->frame = f;
+
+            batch_msgs.push_back(msg);
+            frames.push_back(f->image);
+            result_ptrs.push_back(result.get());
+            results.push_back(result);
+        }
+        if (batch_msgs.empty()) {
             continue;
         }
-        std::shared_ptr<Frame> f = std::static_pointer_cast<Frame>(input.valuePtr);
 
-        std::shared_ptr<DetectResult> result = std::make_shared<DetectResult>();
-        // acquire! hold a reference to the frame.
-        result->frame = f;
-
-        RetCode ret = process(f->image, *result);
-        _logger->debug("process ret: {}", int(ret));
-
-        Value output{ValueDetectResult, result};
-        msg->setResponse(output);
+        // responses are sent when inference is done, meanwhile next batch is prepared.
+        process_batch(frames, result_ptrs, [this, batch_msgs, results](RetCode ret) {
+            _logger->debug("process batch of {}, ret: {}", batch_msgs.size(), int(ret));
+
+            // a failed batch answers every message with null.
+            for (size_t i = 0; i < batch_msgs.size(); i++) {
+                Value output{ValueDetectResult, nullptr};
+                if (ret == RET_OK) {
+                    output.valuePtr = results[i];
+                }
+                batch_msgs[i]->setResponse(output);
+            }
+        });
     }
+
+    // in-flight batches still hold messages.
+    _infer_pool->WaitAll();
 }
 
 // resize input img, and do inference
 RetCode DetectorWorker::process(const cv::Mat& img, DetectResult& result) {
-    _logger->debug("resize image from [{} x {}] to [{} x {}] \n", img.cols, img.rows,
-                   (int)_image_width, (int)_image_height);
-
-    int orig_img_width = img.size().width;
-    int orig_img_height = img.size().height;
-
-    const size_t data_length = img.channels() * _image_width * _image_height;
-    std::shared_ptr<unsigned char> data_ptr;
-    data_ptr.reset(new unsigned char[data_length], std::default_delete<unsigned char[]>());
-
-    // size of each batch.
-    const size_t image_size = ov::shape_size(_compiled_model->input().get_shape()) / _batch_size;
-    assert(image_size == data_length);
+    std::promise<RetCode> promise;
+    std::future<RetCode> future = promise.get_future();
+    process_batch({img}, {&result}, [&promise](RetCode ret) { promise.set_value(ret); });
+    return future.get();
+}
 
-    cv::Size new_size(_image_width, _image_height);
-    cv::Mat resized_img(new_size, img.type(), data_ptr.get());
-    cv::resize(img, resized_img, new_size);
+RetCode DetectorWorker::process_batch(const std::vector<cv::Mat>& frames,
+                                      const std::vector<DetectResult*>& results,
+                                      ProcessCallback done) {
+    const size_t batch_size = frames.size();
+
+    std::vector<const cv::Mat*> imgs;
+    std::vector<cv::Size> frame_sizes;
+    imgs.reserve(batch_size);
+    frame_sizes.reserve(batch_size);
+    for (size_t b = 0; b < batch_size; b++) {
+        assert(frames[b].channels() == _color_channel);
+        imgs.push_back(&frames[b]);
+        frame_sizes.push_back(frames[b].size());
+    }
 
-    ov::Tensor input_tensor = _infer_request->get_input_tensor();
+    // frame is wrapped as is if it is alone, and resized by model. frames must be alive until
+    // inference is done, they are held by results.
+    ov::Tensor input_tensor = make_input_tensor(imgs, _image_width, _image_height);
 
-    std::memcpy(input_tensor.data<std::uint8_t>(), data_ptr.get(), image_size);
+    ov::InferRequest& request = _infer_pool->Acquire();
+    request.set_input_tensor(input_tensor);
 
-    _infer_request->infer();
+    _infer_pool->StartAsync(request, [this, frame_sizes, results, done](ov::InferRequest& req,
+                                                                       std::exception_ptr exc) {
+        if (exc) {
+            _logger->error("detector inference failed.");
+            done(RetCode::RET_ERR);
+            return;
+        }
+        const ov::Tensor output_tensor = req.get_output_tensor();
+        // debugOutputTensor(output_tensor);
+        parse_output(output_tensor, frame_sizes, results);
+        done(RetCode::RET_OK);
+    });
 
-    const ov::Tensor output_tensor = _infer_request->get_output_tensor();
-    // debugOutputTensor(output_tensor);
+    return RetCode::RET_OK;
+}
 
+void DetectorWorker::parse_output(const ov::Tensor& output_tensor,
+                                  const std::vector<cv::Size>& frame_sizes,
+                                  const std::vector<DetectResult*>& results) {
+    // boxes of all frames, image_id tells which frame the box belongs to.
+    const size_t max_faces = output_tensor.get_shape()[2];
     const float* tensor_data = output_tensor.data<float>();
-    std::vector<FaceDetection> detected;
-    detected.reserve(10);
 
-    for (size_t i = 0; i < _max_faces; i++) {
+    for (size_t i = 0; i < max_faces; i++) {
         int offset = i * _shape_dim;
 
         float image_id = tensor_data[offset + 0];
@@ -212,22 +283,25 @@ RetCode DetectorWorker::process(const cv::Mat& img, DetectResult& result) {
         float x_max = tensor_data[offset + 5];
         float y_max = tensor_data[offset + 6];
 
-        if (conf < _min_confidence) {
+        // image_id -1 means no more boxes.
+        if (image_id < 0) {
+            break;
+        }
+        if (conf < _min_confidence || (size_t)image_id >= frame_sizes.size()) {
             continue;
         }
 
+        int orig_img_width = frame_sizes[(size_t)image_id].width;
+        int orig_img_height = frame_sizes[(size_t)image_id].height;
+
         FaceDetection face;
 
         face.box = cv::Rect{(int)(x_min * orig_img_width), (int)(y_min * orig_img_height),
                             (int)((x_max - x_min) * orig_img_width),
                             (int)((y_max - y_min) * orig_img_height)};
         face.confidence = conf;
-        detected.emplace_back(face);
+        results[(size_t)image_id]->faces.emplace_back(face);
     }
-
-    result.faces = detected;
-
-    return RetCode::RET_OK;
 }
 
 } // namespace donde_toolkits::feature_extract::openvino_worker
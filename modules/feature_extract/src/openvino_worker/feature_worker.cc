@@ -7,13 +7,16 @@
 #include "donde/message.h"
 #include "donde/utils.h"
 #include "opencv2/opencv.hpp"
+#include "compiled_model_cache.h"
 #include "openvino/openvino.hpp"
 #include "openvino_worker.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
 
 #include <cassert>
+#include <atomic>
 #include <filesystem>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <opencv2/core/types.hpp>
@@ -37,7 +40,9 @@ FeatureWorker::~FeatureWorker() {
    conf:
    {
      "model": "../models/Sphereface.xml"
-     "warmup": false
+     "warmup": false,
+     "batch": {"max_batch_size": 16, "max_wait_ms": 2},
+     "infer_requests": 0
    }
 
  */
@@ -68,43 +73,66 @@ RetCode FeatureWorker::Init(json conf, int i, std::string device_id) {
     _logger->info("loading model: {}", model_path);
     _logger->info("absolute path: {}", std::filesystem::canonical(model_path).string());
 
-    ov::Core core;
-    std::shared_ptr<ov::Model> model = core.read_model(model_path);
-    printInputAndOutputsInfo(*model);
-
-    OPENVINO_ASSERT(model->inputs().size() == 1, "Sample supports models with 1 input only");
-    OPENVINO_ASSERT(model->outputs().size() == 1, "Sample supports models with 1 output only");
-
-    ov::preprocess::PrePostProcessor ppp(model);
-    ov::preprocess::InputInfo& input_info = ppp.input();
-
     // input data is NHWC
     ov::Layout tensor_layout{"NHWC"};
-    input_info.tensor().set_element_type(ov::element::u8).set_layout(tensor_layout);
-    // but the model input need nchw, so the convertion begin.
-    input_info.model().set_layout("NCHW");
-    // model output is float32
-    ppp.output().tensor().set_element_type(ov::element::f32);
+    _batch = ParseBatchOptions(conf);
+
+    // called only by the first worker of this stage.
+    auto build_model = [&](ov::Core& core, CompiledStage& stage) {
+        std::shared_ptr<ov::Model> model = core.read_model(model_path);
+        printInputAndOutputsInfo(*model);
+
+        OPENVINO_ASSERT(model->inputs().size() == 1, "Sample supports models with 1 input only");
+        OPENVINO_ASSERT(model->outputs().size() == 1, "Sample supports models with 1 output only");
+
+        // the network takes NCHW of fixed size.
+        ov::Layout model_layout{"NCHW"};
+        ov::Shape model_shape = model->input().get_shape();
+        stage.input_width = model_shape[ov::layout::width_idx(model_layout)];
+        stage.input_height = model_shape[ov::layout::height_idx(model_layout)];
+
+        ov::preprocess::PrePostProcessor ppp(model);
+        ov::preprocess::InputInfo& input_info = ppp.input();
+
+        // input tensor is image of any size, resized by the model itself.
+        // opencv images are BGR as the models expect, so no color conversion.
+        input_info.tensor()
+            .set_element_type(ov::element::u8)
+            .set_layout(tensor_layout)
+            .set_spatial_dynamic_shape();
+        input_info.preprocess().resize(ov::preprocess::ResizeAlgorithm::RESIZE_LINEAR);
+        // but the model input need nchw, so the convertion begin.
+        input_info.model().set_layout(model_layout);
+        // model output is float32
+        ppp.output().tensor().set_element_type(ov::element::f32);
+
+        model = ppp.build();
+
+        if (_batch.max_batch_size > 1) {
+            // dynamic batch, each inference takes [1, max_batch_size] faces.
+            ov::set_batch(model, ov::Dimension(1, _batch.max_batch_size));
+        } else {
+            ov::set_batch(model, 1);
+        }
 
-    model = ppp.build();
+        return model;
+    };
 
-    _batch_size = 1;
-    ov::set_batch(model, _batch_size);
+    // workers of this stage share one compiled model.
+    _stage = CompiledModelCache::getInstance().GetOrCompile(conf, _device_id, build_model);
 
-    ov::Shape input_shape = model->input().get_shape();
-    _image_width = input_shape[ov::layout::width_idx(tensor_layout)];
-    _image_height = input_shape[ov::layout::height_idx(tensor_layout)];
+    _image_width = _stage->input_width;
+    _image_height = _stage->input_height;
 
-    // Face embeddings, name - fc5, shape - 1, 512, output data format - B, C, where
+    // Face embeddings, name - fc5, shape - B, 512, output data format - B, C, where
     // SEE
     // https://github.com/openvinotoolkit/open_model_zoo/blob/master/models/public/Sphereface/README.md
-    ov::Shape output_shape = model->output().get_shape();
-    _feature_length = output_shape[1];
+    ov::PartialShape output_shape = _stage->compiled_model.output().get_partial_shape();
+    _feature_length = output_shape[1].get_length();
 
-    _compiled_model
-        = std::make_shared<ov::CompiledModel>(std::move(core.compile_model(model, _device_id)));
-    _infer_request
-        = std::make_shared<ov::InferRequest>(std::move(_compiled_model->create_infer_request()));
+    // requests run asynchronously, 0 means optimal number of the device.
+    _infer_pool = std::make_unique<InferRequestPool>(_stage->compiled_model,
+                                                     conf.value("infer_requests", 0));
 
     if (conf.contains("warmup") && conf["warmup"]) {
         // TODO
@@ -119,77 +147,143 @@ RetCode FeatureWorker::Init(json conf, int i, std::string device_id) {
 
 void FeatureWorker::run() {
     for (;;) {
-        // output is a blocking call.
-        Notification::Ptr pNf = _channel->waitDequeueNotification();
-        if (pNf.isNull()) {
+        // blocking call, returns up to max_batch_size messages.
+        std::vector<WorkMessage<Value>::Ptr> msgs = dequeue_batch(_batch);
+        if (msgs.empty()) {
             break;
         }
-        WorkMessage<Value>::Ptr msg = pNf.cast<WorkMessage<Value>>();
-        Value input = msg->getRequest();
-        if (input.valueType != ValueAlignerResult) {
-            _logger->error("FeatureWorker input value is not a ValueAlignerResult! wrong "
-                           "valueType: {}",
-                           format_value_type(input.valueType));
+
+        std::vector<WorkMessage<Value>::Ptr> batch_msgs;
+        std::vector<std::shared_ptr<AlignerResult>> aligner_results;
+        std::vector<const AlignerResult*> aligner_ptrs;
+        std::vector<std::shared_ptr<FeatureResult>> results;
+        std::vector<FeatureResult*> result_ptrs;
+        for (auto& msg : msgs) {
+            Value input = msg->getRequest();
+            if (input.valueType != ValueAlignerResult) {
+                _logger->error("FeatureWorker input value is not a ValueAlignerResult! wrong "
+                               "valueType: {}",
+                               format_value_type(input.valueType));
+                continue;
+            }
+            std::shared_ptr<AlignerResult> aligner_result
+                = std::static_pointer_cast<AlignerResult>(input.valuePtr);
+            std::shared_ptr<FeatureResult> result = std::make_shared<FeatureResult>();
+
+            batch_msgs.push_back(msg);
+            aligner_ptrs.push_back(aligner_result.get());
+            aligner_results.push_back(aligner_result);
+            result_ptrs.push_back(result.get());
+            results.push_back(result);
+        }
+        if (batch_msgs.empty()) {
             continue;
         }
-        std::shared_ptr<AlignerResult> aligner_result
-            = std::static_pointer_cast<AlignerResult>(input.valuePtr);
-        std::shared_ptr<FeatureResult> result = std::make_shared<FeatureResult>();
 
-        RetCode ret = process(*aligner_result, *result);
-        _logger->debug("process ret: {}", int(ret));
-
-        Value output{ValueFeatureResult, result};
-        msg->setResponse(output);
+        // responses are sent when inference is done, meanwhile next batch is prepared.
+        process_batch(aligner_ptrs, result_ptrs,
+                      [this, batch_msgs, aligner_results, results](RetCode ret) {
+                          _logger->debug("process batch of {}, ret: {}", batch_msgs.size(),
+                                         int(ret));
+
+                          // a failed batch answers every message with null.
+                          for (size_t i = 0; i < batch_msgs.size(); i++) {
+                              Value output{ValueFeatureResult, nullptr};
+                              if (ret == RET_OK) {
+                                  output.valuePtr = results[i];
+                              }
+                              batch_msgs[i]->setResponse(output);
+                          }
+                      });
     }
+
+    // in-flight batches still hold messages.
+    _infer_pool->WaitAll();
 }
 
 // resize input img, and do inference
 RetCode FeatureWorker::process(const AlignerResult& aligner_result, FeatureResult& result) {
-    result.face_features.reserve(aligner_result.aligned_faces.size());
-
-    for (const cv::Mat& face_img : aligner_result.aligned_faces) {
-
-        const size_t data_length = face_img.channels() * _image_width * _image_height;
-        std::shared_ptr<unsigned char> data_ptr;
-        data_ptr.reset(new unsigned char[data_length], std::default_delete<unsigned char[]>());
-
-        // size of each batch.
-        const size_t image_size
-            = ov::shape_size(_compiled_model->input().get_shape()) / _batch_size;
-        assert(image_size == data_length);
+    std::promise<RetCode> promise;
+    std::future<RetCode> future = promise.get_future();
+    process_batch({&aligner_result}, {&result},
+                  [&promise](RetCode ret) { promise.set_value(ret); });
+    return future.get();
+}
 
-        cv::Mat resized_img(face_img);
-        if (static_cast<int>(_image_width) != face_img.size().width
-            || static_cast<int>(_image_height) != face_img.size().height) {
-            cv::resize(face_img, resized_img, cv::Size(_image_width, _image_height));
+RetCode FeatureWorker::process_batch(const std::vector<const AlignerResult*>& aligner_results,
+                                     const std::vector<FeatureResult*>& results,
+                                     ProcessCallback done) {
+    // flatten faces, so that faces of one frame and of different frames share inferences.
+    // feature of each face is written back to its slot when its chunk is done.
+    std::vector<const cv::Mat*> faces;
+    std::vector<Feature*> slots;
+    for (size_t r = 0; r < aligner_results.size(); r++) {
+        results[r]->face_features.resize(aligner_results[r]->aligned_faces.size());
+        for (size_t i = 0; i < aligner_results[r]->aligned_faces.size(); i++) {
+            faces.push_back(&aligner_results[r]->aligned_faces[i]);
+            slots.push_back(&results[r]->face_features[i]);
         }
+    }
 
-        ov::Tensor input_tensor = _infer_request->get_input_tensor();
-
-        std::memcpy(input_tensor.data<std::uint8_t>(), data_ptr.get(), image_size);
-
-        _infer_request->infer();
+    if (faces.empty()) {
+        done(RetCode::RET_OK);
+        return RetCode::RET_OK;
+    }
 
-        const ov::Tensor output_tensor = _infer_request->get_output_tensor();
-        const float* tensor_data = output_tensor.data<float>();
+    const size_t max_batch_size = _batch.max_batch_size;
 
-        // debugOutputTensor(output_tensor);
+    auto pending = std::make_shared<std::atomic<size_t>>(
+        (faces.size() + max_batch_size - 1) / max_batch_size);
+    auto failed = std::make_shared<std::atomic<bool>>(false);
 
-        Feature ft;
-        ft.raw.reserve(_feature_length);
-        ft.version = 10000;
-        ft.model = "Sphereface";
+    for (size_t begin = 0; begin < faces.size(); begin += max_batch_size) {
+        const size_t batch_size = std::min(faces.size() - begin, max_batch_size);
 
-        // only one batch yet.
-        size_t batch_idx = 0;
-        size_t offset = batch_idx * _feature_length;
-        for (size_t i = 0; i < _feature_length; i++) {
-            float x = tensor_data[offset + i];
-            ft.raw.push_back(x);
+        std::vector<const cv::Mat*> imgs(faces.begin() + begin,
+                                         faces.begin() + begin + batch_size);
+        for (auto img : imgs) {
+            assert(img->channels() == _color_channel);
         }
 
-        result.face_features.push_back(ft);
+        // face is wrapped as is if it is alone, and resized by model. aligned faces must be
+        // alive until inference is done, they are held by caller.
+        ov::Tensor input_tensor = make_input_tensor(imgs, _image_width, _image_height);
+
+        ov::InferRequest& request = _infer_pool->Acquire();
+        request.set_input_tensor(input_tensor);
+
+        std::vector<Feature*> chunk_slots(slots.begin() + begin,
+                                          slots.begin() + begin + batch_size);
+        _infer_pool->StartAsync(request, [this, chunk_slots, pending, failed,
+                                          done](ov::InferRequest& req, std::exception_ptr exc) {
+            if (exc) {
+                _logger->error("feature inference failed.");
+                failed->store(true);
+            } else {
+                const ov::Tensor output_tensor = req.get_output_tensor();
+                const float* tensor_data = output_tensor.data<float>();
+
+                // debugOutputTensor(output_tensor);
+
+                for (size_t batch_idx = 0; batch_idx < chunk_slots.size(); batch_idx++) {
+                    Feature& ft = *chunk_slots[batch_idx];
+                    ft.raw.reserve(_feature_length);
+                    ft.version = 10000;
+                    ft.model = "Sphereface";
+
+                    size_t offset = batch_idx * _feature_length;
+                    for (size_t i = 0; i < _feature_length; i++) {
+                        float x = tensor_data[offset + i];
+                        ft.raw.push_back(x);
+                    }
+                }
+            }
+
+            // last chunk reports the whole batch.
+            if (pending->fetch_sub(1) == 1) {
+                done(failed->load() ? RetCode::RET_ERR : RetCode::RET_OK);
+            }
+        });
     }
 
     return RetCode::RET_OK;
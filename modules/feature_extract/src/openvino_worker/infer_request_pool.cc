@@ -0,0 +1,81 @@
+#include "infer_request_pool.h"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+
+namespace donde_toolkits ::feature_extract ::openvino_worker {
+
+InferRequestPool::InferRequestPool(ov::CompiledModel& compiled_model, size_t size) {
+    if (size == 0) {
+        size = compiled_model.get_property(ov::optimal_number_of_infer_requests);
+    }
+    size = std::max(size, (size_t)1);
+
+    _requests.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+        _requests.push_back(compiled_model.create_infer_request());
+        _started.push_back(false);
+        _idle.push_back(i);
+    }
+    spdlog::info("infer request pool created with {} requests", size);
+};
+
+InferRequestPool::~InferRequestPool() { WaitAll(); };
+
+ov::InferRequest& InferRequestPool::Acquire() {
+    std::unique_lock<std::mutex> l(_mu);
+    _cv.wait(l, [this] { return !_idle.empty(); });
+
+    size_t idx = _idle.back();
+    _idle.pop_back();
+    bool started = _started[idx];
+    l.unlock();
+
+    // released in callback, make sure plugin has done with it.
+    if (started) {
+        _requests[idx].wait();
+    }
+    return _requests[idx];
+};
+
+void InferRequestPool::StartAsync(ov::InferRequest& request, InferCallback done) {
+    size_t idx = &request - _requests.data();
+
+    request.set_callback([this, idx, done](std::exception_ptr exc) {
+        try {
+            done(_requests[idx], exc);
+        } catch (const std::exception& e) {
+            spdlog::error("infer callback throws: {}", e.what());
+        }
+        release(idx);
+    });
+
+    {
+        std::lock_guard<std::mutex> l(_mu);
+        _started[idx] = true;
+    }
+
+    try {
+        request.start_async();
+    } catch (const std::exception& e) {
+        spdlog::error("failed to start infer request: {}", e.what());
+        done(request, std::current_exception());
+        release(idx);
+    }
+};
+
+void InferRequestPool::WaitAll() {
+    std::unique_lock<std::mutex> l(_mu);
+    _cv.wait(l, [this] { return _idle.size() == _requests.size(); });
+};
+
+void InferRequestPool::release(size_t idx) {
+    {
+        std::lock_guard<std::mutex> l(_mu);
+        _idle.push_back(idx);
+    }
+    _cv.notify_all();
+};
+
+} // namespace donde_toolkits::feature_extract::openvino_worker
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "donde/definitions.h"
+#include "openvino/openvino.hpp"
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace donde_toolkits ::feature_extract ::openvino_worker {
+
+// InferRequestPool owns a fixed number of infer requests of one compiled model.
+//
+// Requests run with start_async, so the caller can prepare next input while the plugin is busy
+// with previous ones. A request is returned to the pool when its callback is done.
+class InferRequestPool {
+  public:
+    // InferCallback is called in plugin thread when inference is done, exc is set on failure.
+    using InferCallback = std::function<void(ov::InferRequest& request, std::exception_ptr exc)>;
+
+    // size 0 means ov::optimal_number_of_infer_requests of the compiled model.
+    InferRequestPool(ov::CompiledModel& compiled_model, size_t size = 0);
+
+    // dtor waits all running requests.
+    ~InferRequestPool();
+
+    // Acquire an idle request, blocks if all of them are running.
+    ov::InferRequest& Acquire();
+
+    // StartAsync run an acquired request, done is called when inference finished, and then
+    // the request is released.
+    void StartAsync(ov::InferRequest& request, InferCallback done);
+
+    // WaitAll blocks until no request is running.
+    void WaitAll();
+
+    inline size_t Size() { return _requests.size(); };
+
+  private:
+    void release(size_t idx);
+
+  private:
+    std::vector<ov::InferRequest> _requests;
+    // request ever started, only those can be waited.
+    std::vector<bool> _started;
+    std::vector<size_t> _idle;
+
+    std::mutex _mu;
+    std::condition_variable _cv;
+};
+
+} // namespace donde_toolkits::feature_extract::openvino_worker
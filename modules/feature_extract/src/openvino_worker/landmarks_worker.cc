@@ -7,13 +7,16 @@
 #include "donde/message.h"
 #include "donde/utils.h"
 #include "opencv2/opencv.hpp"
+#include "compiled_model_cache.h"
 #include "openvino/openvino.hpp"
 #include "openvino_worker.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
 
 #include <cassert>
+#include <atomic>
 #include <filesystem>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <opencv2/core/types.hpp>
@@ -36,7 +39,9 @@ LandmarksWorker::~LandmarksWorker() {
    conf:
    {
      "model": "../models/facial-landmarks-35-adas-0002.xml"
-     "warmup": false
+     "warmup": false,
+     "batch": {"max_batch_size": 16, "max_wait_ms": 2},
+     "infer_requests": 0
    }
 
  */
@@ -67,43 +72,66 @@ RetCode LandmarksWorker::Init(json conf, int i, std::string device_id) {
     _logger->info("loading model: {}", model_path);
     _logger->info("absolute path: {}", std::filesystem::canonical(model_path).string());
 
-    ov::Core core;
-    std::shared_ptr<ov::Model> model = core.read_model(model_path);
-    printInputAndOutputsInfo(*model);
-
-    OPENVINO_ASSERT(model->inputs().size() == 1, "Sample supports models with 1 input only");
-    OPENVINO_ASSERT(model->outputs().size() == 1, "Sample supports models with 1 output only");
-
-    ov::preprocess::PrePostProcessor ppp(model);
-    ov::preprocess::InputInfo& input_info = ppp.input();
-
     // input data is NHWC
     ov::Layout tensor_layout{"NHWC"};
-    input_info.tensor().set_element_type(ov::element::u8).set_layout(tensor_layout);
-    // but the model input need nchw, so the convertion begin.
-    input_info.model().set_layout("NCHW");
-    // model output is float32
-    ppp.output().tensor().set_element_type(ov::element::f32);
+    _batch = ParseBatchOptions(conf);
+
+    // called only by the first worker of this stage.
+    auto build_model = [&](ov::Core& core, CompiledStage& stage) {
+        std::shared_ptr<ov::Model> model = core.read_model(model_path);
+        printInputAndOutputsInfo(*model);
+
+        OPENVINO_ASSERT(model->inputs().size() == 1, "Sample supports models with 1 input only");
+        OPENVINO_ASSERT(model->outputs().size() == 1, "Sample supports models with 1 output only");
+
+        // the network takes NCHW of fixed size.
+        ov::Layout model_layout{"NCHW"};
+        ov::Shape model_shape = model->input().get_shape();
+        stage.input_width = model_shape[ov::layout::width_idx(model_layout)];
+        stage.input_height = model_shape[ov::layout::height_idx(model_layout)];
+
+        ov::preprocess::PrePostProcessor ppp(model);
+        ov::preprocess::InputInfo& input_info = ppp.input();
+
+        // input tensor is image of any size, resized by the model itself.
+        // opencv images are BGR as the models expect, so no color conversion.
+        input_info.tensor()
+            .set_element_type(ov::element::u8)
+            .set_layout(tensor_layout)
+            .set_spatial_dynamic_shape();
+        input_info.preprocess().resize(ov::preprocess::ResizeAlgorithm::RESIZE_LINEAR);
+        // but the model input need nchw, so the convertion begin.
+        input_info.model().set_layout(model_layout);
+        // model output is float32
+        ppp.output().tensor().set_element_type(ov::element::f32);
+
+        model = ppp.build();
+
+        if (_batch.max_batch_size > 1) {
+            // dynamic batch, each inference takes [1, max_batch_size] faces.
+            ov::set_batch(model, ov::Dimension(1, _batch.max_batch_size));
+        } else {
+            ov::set_batch(model, 1);
+        }
 
-    model = ppp.build();
+        return model;
+    };
 
-    _batch_size = 1;
-    ov::set_batch(model, _batch_size);
+    // workers of this stage share one compiled model.
+    _stage = CompiledModelCache::getInstance().GetOrCompile(conf, _device_id, build_model);
 
-    ov::Shape input_shape = model->input().get_shape();
-    _image_width = input_shape[ov::layout::width_idx(tensor_layout)];
-    _image_height = input_shape[ov::layout::height_idx(tensor_layout)];
+    _image_width = _stage->input_width;
+    _image_height = _stage->input_height;
 
-    // output shape: [1, 70], where 70 means [x0, y0, x1, y1....], 35 points
+    // output shape: [B, 70], where 70 means [x0, y0, x1, y1....], 35 points
     // SEE
     // https://github.com/openvinotoolkit/open_model_zoo/blob/master/models/intel/facial-landmarks-35-adas-0002/README.md
-    ov::Shape output_shape = model->output().get_shape();
-    _landmarks_length = output_shape[1];
+    ov::PartialShape output_shape = _stage->compiled_model.output().get_partial_shape();
+    _landmarks_length = output_shape[1].get_length();
 
-    _compiled_model
-        = std::make_shared<ov::CompiledModel>(std::move(core.compile_model(model, _device_id)));
-    _infer_request
-        = std::make_shared<ov::InferRequest>(std::move(_compiled_model->create_infer_request()));
+    // requests run asynchronously, 0 means optimal number of the device.
+    _infer_pool = std::make_unique<InferRequestPool>(_stage->compiled_model,
+                                                     conf.value("infer_requests", 0));
 
     if (conf.contains("warmup") && conf["warmup"]) {
         // warmup img
@@ -124,88 +152,149 @@ RetCode LandmarksWorker::Init(json conf, int i, std::string device_id) {
 
 void LandmarksWorker::run() {
     for (;;) {
-        // output is a blocking call.
-        Notification::Ptr pNf = _channel->waitDequeueNotification();
-        if (pNf.isNull()) {
+        // blocking call, returns up to max_batch_size messages.
+        std::vector<WorkMessage<Value>::Ptr> msgs = dequeue_batch(_batch);
+        if (msgs.empty()) {
             break;
         }
 
-        WorkMessage<Value>::Ptr msg = pNf.cast<WorkMessage<Value>>();
-        Value input = msg->getRequest();
-        if (input.valueType != ValueDetectResult) {
-            _logger->error("LandmarksWorker input value is not a ValueDetectResult! wrong "
-                           "valueType: {}",
-                           format_value_type(input.valueType));
+        std::vector<WorkMessage<Value>::Ptr> batch_msgs;
+        std::vector<std::shared_ptr<DetectResult>> detect_results;
+        std::vector<const DetectResult*> detect_ptrs;
+        std::vector<std::shared_ptr<LandmarksResult>> results;
+        std::vector<LandmarksResult*> result_ptrs;
+        for (auto& msg : msgs) {
+            Value input = msg->getRequest();
+            if (input.valueType != ValueDetectResult) {
+                _logger->error("LandmarksWorker input value is not a ValueDetectResult! wrong "
+                               "valueType: {}",
+                               format_value_type(input.valueType));
+                continue;
+            }
+            std::shared_ptr<DetectResult> detect_result
+                = std::static_pointer_cast<DetectResult>(input.valuePtr);
+            std::shared_ptr<LandmarksResult> result = std::make_shared<LandmarksResult>();
+
+            batch_msgs.push_back(msg);
+            detect_ptrs.push_back(detect_result.get());
+            detect_results.push_back(detect_result);
+            result_ptrs.push_back(result.get());
+            results.push_back(result);
+        }
+        if (batch_msgs.empty()) {
             continue;
         }
-        std::shared_ptr<DetectResult> detect_result
-            = std::static_pointer_cast<DetectResult>(input.valuePtr);
-        std::shared_ptr<LandmarksResult> result = std::make_shared<LandmarksResult>();
 
-        RetCode ret = process(*detect_result, *result);
-        _logger->debug("process ret: {}", int(ret));
-
-        Value output{ValueLandmarksResult, result};
-        msg->setResponse(output);
+        // responses are sent when inference is done, meanwhile next batch is prepared.
+        process_batch(detect_ptrs, result_ptrs,
+                      [this, batch_msgs, detect_results, results](RetCode ret) {
+                          _logger->debug("process batch of {}, ret: {}", batch_msgs.size(),
+                                         int(ret));
+
+                          // a failed batch answers every message with null.
+                          for (size_t i = 0; i < batch_msgs.size(); i++) {
+                              Value output{ValueLandmarksResult, nullptr};
+                              if (ret == RET_OK) {
+                                  output.valuePtr = results[i];
+                              }
+                              batch_msgs[i]->setResponse(output);
+                          }
+                      });
     }
+
+    // in-flight batches still hold messages.
+    _infer_pool->WaitAll();
 }
 
 // resize input img, and do inference
 RetCode LandmarksWorker::process(const DetectResult& detect_result, LandmarksResult& result) {
+    std::promise<RetCode> promise;
+    std::future<RetCode> future = promise.get_future();
+    process_batch({&detect_result}, {&result},
+                  [&promise](RetCode ret) { promise.set_value(ret); });
+    return future.get();
+}
 
-    result.faces.reserve(detect_result.faces.size());
-    result.face_landmarks.reserve(detect_result.faces.size());
-
-    for (auto& detect_face : detect_result.faces) {
-        // img is smallface, image(rect) => small image
-        cv::Mat face_img = (detect_result.frame->image)(detect_face.box);
-        result.faces.push_back(face_img);
-
-        const size_t data_length = face_img.channels() * _image_width * _image_height;
-
-        // size of each batch.
-        const size_t image_size
-            = ov::shape_size(_compiled_model->input().get_shape()) / _batch_size;
-        assert(image_size == data_length);
-
-        cv::Mat resized_img(face_img);
-        if (static_cast<int>(_image_width) != face_img.size().width
-            || static_cast<int>(_image_height) != face_img.size().height) {
-            cv::resize(face_img, resized_img, cv::Size(_image_width, _image_height));
+RetCode LandmarksWorker::process_batch(const std::vector<const DetectResult*>& detect_results,
+                                       const std::vector<LandmarksResult*>& results,
+                                       ProcessCallback done) {
+    // flatten faces, so that faces of one frame and of different frames share inferences.
+    // landmarks of each face are written back to its slot when its chunk is done.
+    std::vector<cv::Mat> faces;
+    std::vector<std::vector<cv::Point2f>*> slots;
+    for (size_t r = 0; r < detect_results.size(); r++) {
+        results[r]->faces.reserve(detect_results[r]->faces.size());
+        results[r]->face_landmarks.resize(detect_results[r]->faces.size());
+
+        for (size_t i = 0; i < detect_results[r]->faces.size(); i++) {
+            // img is smallface, image(rect) => small image
+            cv::Mat face_img = (detect_results[r]->frame->image)(detect_results[r]->faces[i].box);
+            results[r]->faces.push_back(face_img);
+
+            faces.push_back(face_img);
+            slots.push_back(&results[r]->face_landmarks[i]);
         }
+    }
 
-        ov::Tensor input_tensor = _infer_request->get_input_tensor();
-
-        std::memcpy(input_tensor.data<std::uint8_t>(), resized_img.data, image_size);
-
-        _infer_request->infer();
-
-        const ov::Tensor output_tensor = _infer_request->get_output_tensor();
-        const float* tensor_data = output_tensor.data<float>();
-
-        debugOutputTensor(output_tensor);
+    if (faces.empty()) {
+        done(RetCode::RET_OK);
+        return RetCode::RET_OK;
+    }
 
-        std::vector<cv::Point2f> lm(_landmarks_length / 2);
+    const size_t max_batch_size = _batch.max_batch_size;
 
-        // int face_img_width = face_img.size().width;
-        // int face_img_height = face_img.size().height;
+    auto pending = std::make_shared<std::atomic<size_t>>(
+        (faces.size() + max_batch_size - 1) / max_batch_size);
+    auto failed = std::make_shared<std::atomic<bool>>(false);
 
-        // only one batch yet.
-        size_t batch_idx = 0;
-        size_t offset = batch_idx * _landmarks_length;
-        for (size_t i = 0; i < _landmarks_length / 2; i++) {
-            float x = tensor_data[offset + 2 * i];
-            float y = tensor_data[offset + 2 * i + 1];
-            lm[i] = cv::Point2f(x, y);
+    for (size_t begin = 0; begin < faces.size(); begin += max_batch_size) {
+        const size_t batch_size = std::min(faces.size() - begin, max_batch_size);
 
-            // x, y is the real points in original big image. but we don't need them.
-            // int x = static_cast<int>(tensor_data[offset + 2 * i] * face_img_width
-            //                          + detect_face.box.tl().x);
-            // int y = static_cast<int>(tensor_data[offset + 2 * i + 1] * face_img_height
-            //                          + detect_face.box.tl().y);
+        std::vector<const cv::Mat*> imgs;
+        for (size_t b = 0; b < batch_size; b++) {
+            assert(faces[begin + b].channels() == _color_channel);
+            imgs.push_back(&faces[begin + b]);
         }
 
-        result.face_landmarks.push_back(lm);
+        // face is wrapped as is if it is alone and continuous, and resized by model.
+        ov::Tensor input_tensor = make_input_tensor(imgs, _image_width, _image_height);
+
+        ov::InferRequest& request = _infer_pool->Acquire();
+        request.set_input_tensor(input_tensor);
+
+        std::vector<std::vector<cv::Point2f>*> chunk_slots(slots.begin() + begin,
+                                                           slots.begin() + begin + batch_size);
+        _infer_pool->StartAsync(request, [this, chunk_slots, pending, failed,
+                                          done](ov::InferRequest& req, std::exception_ptr exc) {
+            if (exc) {
+                _logger->error("landmarks inference failed.");
+                failed->store(true);
+            } else {
+                const ov::Tensor output_tensor = req.get_output_tensor();
+                const float* tensor_data = output_tensor.data<float>();
+
+                // debugOutputTensor(output_tensor);
+
+                for (size_t batch_idx = 0; batch_idx < chunk_slots.size(); batch_idx++) {
+                    std::vector<cv::Point2f>& lm = *chunk_slots[batch_idx];
+                    const size_t points = _landmarks_length / 2;
+                    lm.resize(points);
+
+                    size_t offset = batch_idx * _landmarks_length;
+                    for (size_t i = 0; i < points; i++) {
+                        float x = tensor_data[offset + 2 * i];
+                        float y = tensor_data[offset + 2 * i + 1];
+                        // x, y are relative to face image, not the original big image.
+                        lm[i] = cv::Point2f(x, y);
+                    }
+                }
+            }
+
+            // last chunk reports the whole batch.
+            if (pending->fetch_sub(1) == 1) {
+                done(failed->load() ? RetCode::RET_ERR : RetCode::RET_OK);
+            }
+        });
     }
 
     return RetCode::RET_OK;
@@ -1,14 +1,21 @@
 #pragma once
 
+#include "../executor.h"
 #include "../worker.h"
 #include "Poco/NotificationQueue.h"
 #include "donde/definitions.h"
+#include "compiled_model_cache.h"
 #include "donde/message.h"
+#include "infer_request_pool.h"
 #include "nlohmann/json.hpp"
+#include "opencv2/opencv.hpp"
 #include "openvino/openvino.hpp"
 
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 using Poco::NotificationQueue;
 
@@ -18,6 +25,39 @@ using namespace Poco;
 
 namespace donde_toolkits ::feature_extract ::openvino_worker {
 
+// ProcessCallback is called when an async batch is processed.
+using ProcessCallback = std::function<void(RetCode)>;
+
+// make_input_tensor makes the [N, H, W, C] u8 input tensor of imgs, resize is done by the
+// preprocessing of compiled model.
+//
+// A single continuous image is wrapped without any copy. Images of a batch (or ROI) can not
+// share one tensor of their own, so they are resized on host into slots of a tensor of network
+// size (width x height), in parallel on the shared executor.
+inline ov::Tensor make_input_tensor(const std::vector<const cv::Mat*>& imgs, size_t width,
+                                    size_t height) {
+    const cv::Mat& first = *imgs[0];
+    const size_t channels = first.channels();
+    if (imgs.size() == 1 && first.isContinuous()) {
+        return ov::Tensor(ov::element::u8,
+                          ov::Shape{1, (size_t)first.rows, (size_t)first.cols, channels},
+                          first.data);
+    }
+
+    ov::Tensor input_tensor(ov::element::u8, ov::Shape{imgs.size(), height, width, channels});
+    std::uint8_t* input_data = input_tensor.data<std::uint8_t>();
+    const size_t image_size = channels * width * height;
+    Executor::getInstance().ParallelFor(imgs.size(), [&](size_t b) {
+        cv::Mat dst(cv::Size(width, height), first.type(), input_data + b * image_size);
+        if ((size_t)imgs[b]->cols != width || (size_t)imgs[b]->rows != height) {
+            cv::resize(*imgs[b], dst, dst.size());
+        } else {
+            imgs[b]->copyTo(dst);
+        }
+    });
+    return input_tensor;
+}
+
 class DetectorWorker : public WorkerBaseImpl {
   public:
     DetectorWorker(std::shared_ptr<MsgChannel> ch);
@@ -29,10 +69,15 @@ class DetectorWorker : public WorkerBaseImpl {
 
   private:
     RetCode process(const cv::Mat& frame, DetectResult& result);
+    // process_batch detect faces of all frames with one async inference, done is called when
+    // results are filled. results must be alive until then.
+    RetCode process_batch(const std::vector<cv::Mat>& frames,
+                          const std::vector<DetectResult*>& results, ProcessCallback done);
+    void parse_output(const ov::Tensor& output, const std::vector<cv::Size>& frame_sizes,
+                      const std::vector<DetectResult*>& results);
     void debugOutputTensor(const ov::Tensor& output);
 
-    int _batch_size = 1;
-    int _max_faces;
+    BatchOptions _batch;
     int _shape_dim;
     int _image_width;
     int _image_height;
@@ -40,8 +85,8 @@ class DetectorWorker : public WorkerBaseImpl {
 
     constexpr static const float _min_confidence = 0.3f;
 
-    std::shared_ptr<ov::CompiledModel> _compiled_model;
-    std::shared_ptr<ov::InferRequest> _infer_request;
+    std::shared_ptr<CompiledStage> _stage;
+    std::unique_ptr<InferRequestPool> _infer_pool;
 };
 
 class LandmarksWorker : public WorkerBaseImpl {
@@ -55,9 +100,13 @@ class LandmarksWorker : public WorkerBaseImpl {
 
   private:
     RetCode process(const DetectResult& detectResult, LandmarksResult& result);
+    // process_batch faces of all detect results are batched together, max_batch_size per
+    // async inference, done is called when all of them are done.
+    RetCode process_batch(const std::vector<const DetectResult*>& detect_results,
+                          const std::vector<LandmarksResult*>& results, ProcessCallback done);
     void debugOutputTensor(const ov::Tensor& output);
 
-    int _batch_size = 1;
+    BatchOptions _batch;
     int _landmarks_length;
     int _image_width;
     int _image_height;
@@ -65,8 +114,8 @@ class LandmarksWorker : public WorkerBaseImpl {
 
     constexpr static const float _min_confidence = 0.3f;
 
-    std::shared_ptr<ov::CompiledModel> _compiled_model;
-    std::shared_ptr<ov::InferRequest> _infer_request;
+    std::shared_ptr<CompiledStage> _stage;
+    std::unique_ptr<InferRequestPool> _infer_pool;
 };
 
 // class LandmarksWorker : public WorkerImpl {
@@ -111,15 +160,19 @@ class FeatureWorker : public WorkerBaseImpl {
   private:
     void debugOutputTensor(const ov::Tensor& output);
     RetCode process(const AlignerResult& aligner_result, FeatureResult& result);
+    // process_batch faces of all aligner results are batched together, max_batch_size per
+    // async inference, done is called when all of them are done.
+    RetCode process_batch(const std::vector<const AlignerResult*>& aligner_results,
+                          const std::vector<FeatureResult*>& results, ProcessCallback done);
 
-    int _batch_size = 1;
+    BatchOptions _batch;
     int _feature_length;
     int _image_width;
     int _image_height;
     int _color_channel = 3;
 
-    std::shared_ptr<ov::CompiledModel> _compiled_model;
-    std::shared_ptr<ov::InferRequest> _infer_request;
+    std::shared_ptr<CompiledStage> _stage;
+    std::unique_ptr<InferRequestPool> _infer_pool;
 };
 
 //
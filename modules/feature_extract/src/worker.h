@@ -7,9 +7,12 @@
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <type_traits>
+#include <vector>
 
 
 
@@ -18,6 +21,14 @@ using json = nlohmann::json;
 
 namespace donde_toolkits::feature_extract {
 
+// BatchOptions, how many messages a worker drains from channel for one inference.
+//   "batch": {"max_batch_size": 8, "max_wait_ms": 2}
+// max_wait_ms is the longest time to wait for a batch to fill up, 0 means take what is queued.
+struct BatchOptions {
+    int max_batch_size = 1;
+    int max_wait_ms = 0;
+};
+
 class Worker : public Runnable {
   public:
     virtual ~Worker() = default;
@@ -53,6 +64,45 @@ class WorkerBaseImpl : public Worker {
 
     void run() override{};
 
+    // ParseBatchOptions from stage config, missing fields keep default values.
+    static BatchOptions ParseBatchOptions(const json& conf) {
+        BatchOptions opts;
+        if (!conf.contains("batch")) {
+            return opts;
+        }
+        const json& batch = conf["batch"];
+        opts.max_batch_size = std::max(1, batch.value("max_batch_size", opts.max_batch_size));
+        opts.max_wait_ms = std::max(0, batch.value("max_wait_ms", opts.max_wait_ms));
+        return opts;
+    };
+
+    // dequeue_batch blocks for the first message, then drains up to max_batch_size messages,
+    // waiting at most max_wait_ms in total. empty result means channel is woken up to quit.
+    std::vector<WorkMessage<Value>::Ptr> dequeue_batch(const BatchOptions& opts) {
+        std::vector<WorkMessage<Value>::Ptr> batch;
+
+        Notification::Ptr pNf = _channel->waitDequeueNotification();
+        if (pNf.isNull()) {
+            return batch;
+        }
+        batch.push_back(pNf.cast<WorkMessage<Value>>());
+
+        auto deadline = std::chrono::steady_clock::now()
+                        + std::chrono::milliseconds(opts.max_wait_ms);
+        while ((int)batch.size() < opts.max_batch_size) {
+            long wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                               deadline - std::chrono::steady_clock::now())
+                               .count();
+            pNf = wait_ms > 0 ? _channel->waitDequeueNotification(wait_ms)
+                              : _channel->dequeueNotification();
+            if (pNf.isNull()) {
+                break;
+            }
+            batch.push_back(pNf.cast<WorkMessage<Value>>());
+        }
+        return batch;
+    };
+
   protected:
     std::shared_ptr<MsgChannel> _channel;
     int _id;
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "donde/definitions.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace donde_toolkits::feature_identity {
+
+// AlignedAllocator aligns vector storage to Alignment bytes, so rows can be loaded by aligned simd.
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&){};
+
+    T* allocate(size_t n) {
+        size_t bytes = (n * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+        void* p = std::aligned_alloc(Alignment, bytes);
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(p);
+    };
+    void deallocate(T* p, size_t) { std::free(p); };
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const {
+        return true;
+    };
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const {
+        return false;
+    };
+};
+
+//
+// IdentityStore is a small in-memory database for feature search, up to about 1000k features of
+// one model, typically for local devices or apps.
+//
+// Features are normalized once and kept row by row in one aligned block, rows are padded to 16
+// floats, so a search is a sequential simd scan of dot products.
+// Persisted file is the same layout, it is mmap'ed by LoadFromFile instead of read into memory,
+// so a large store costs page cache, which the kernel can drop, rather than heap.
+//
+class IdentityStore {
+  public:
+    IdentityStore(size_t db_size, std::string feature_model_, int feature_version_,
+                  int feature_dimension_);
+
+    ~IdentityStore();
+
+    // LoadFromFile maps features persisted in db_filepath, which is also where Save writes.
+    // A missing file is an empty store.
+    RetCode LoadFromFile(const std::string& db_filepath);
+
+    // Save persists all features to the file given to LoadFromFile.
+    RetCode Save();
+
+    // AddFeature fails if the store is full, or feature is not of store model, version and
+    // dimension.
+    RetCode AddFeature(const Feature& feature);
+
+    // SearchFeature returns topK most similar features, best first.
+    std::vector<Feature> SearchFeature(const Feature& target, int topK);
+
+    std::vector<FeatureScore> Search(const Feature& target, int topK);
+
+    size_t Size();
+
+  private:
+    void unmap();
+
+    inline const float* row(size_t i) const {
+        return i < mapped_count_ ? mapped_rows_ + i * stride_
+                                 : rows_.data() + (i - mapped_count_) * stride_;
+    };
+    inline float norm(size_t i) const {
+        return i < mapped_count_ ? mapped_norms_[i] : norms_[i - mapped_count_];
+    };
+
+    // restore original feature from its normalized row.
+    Feature restore(size_t i) const;
+
+  private:
+    std::string db_persist_filepath_;
+
+    // guards rows, searches share it.
+    std::shared_mutex mu_;
+    // serializes Save, which writes rows out under a shared lock of mu_, to one temp file.
+    std::mutex save_mu_;
+
+    size_t db_size_;
+
+    std::string feature_model_;
+    int feature_version_;
+    int feature_dimension_;
+    // floats a row, dimension padded to 16.
+    size_t stride_;
+
+    // rows of persisted file, mapped read only.
+    void* mapped_ = nullptr;
+    size_t mapped_size_ = 0;
+    const float* mapped_rows_ = nullptr;
+    const float* mapped_norms_ = nullptr;
+    size_t mapped_count_ = 0;
+
+    // rows added after load.
+    std::vector<float, AlignedAllocator<float>> rows_;
+    std::vector<float> norms_;
+};
+} // namespace donde_toolkits::feature_identity
@@ -1,7 +1,118 @@
 #include "donde/feature_identity/identity_store.h"
 
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <queue>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#    include <immintrin.h>
+#elif defined(__SSE__)
+#    include <xmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#    include <arm_neon.h>
+#endif
+
 namespace donde_toolkits::feature_identity {
 
+namespace {
+
+const uint32_t STORE_MAGIC = 0x53444944; // "DIDS"
+const uint32_t STORE_VERSION = 1;
+
+// rows are padded to this many floats, 64 bytes, so every row is aligned and has no tail.
+const size_t ROW_ALIGN = 16;
+
+// FileHeader is the first 128 bytes of a persisted store, followed by count rows of stride
+// floats, then count norms.
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dimension;
+    uint32_t stride;
+    uint64_t count;
+    int32_t feature_version;
+    uint32_t model_len;
+    char model[96];
+};
+static_assert(sizeof(FileHeader) == 128, "rows must start 64 bytes aligned");
+
+// dot of a and b, n is a multiple of ROW_ALIGN and both are 64 bytes aligned.
+inline float dot(const float* a, const float* b, size_t n) {
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (size_t i = 0; i < n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_load_ps(a + i), _mm256_load_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_load_ps(a + i + 8), _mm256_load_ps(b + i + 8), acc1);
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_hadd_ps(sum, sum);
+    sum = _mm_hadd_ps(sum, sum);
+    return _mm_cvtss_f32(sum);
+#elif defined(__SSE__)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    __m128 acc2 = _mm_setzero_ps();
+    __m128 acc3 = _mm_setzero_ps();
+    for (size_t i = 0; i < n; i += 16) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(a + i), _mm_load_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(a + i + 4), _mm_load_ps(b + i + 4)));
+        acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_load_ps(a + i + 8), _mm_load_ps(b + i + 8)));
+        acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_load_ps(a + i + 12), _mm_load_ps(b + i + 12)));
+    }
+    __m128 acc = _mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3));
+    __m128 shuf = _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(acc, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    float32x4_t acc0 = vdupq_n_f32(0);
+    float32x4_t acc1 = vdupq_n_f32(0);
+    float32x4_t acc2 = vdupq_n_f32(0);
+    float32x4_t acc3 = vdupq_n_f32(0);
+    for (size_t i = 0; i < n; i += 16) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        acc2 = vfmaq_f32(acc2, vld1q_f32(a + i + 8), vld1q_f32(b + i + 8));
+        acc3 = vfmaq_f32(acc3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+    }
+    return vaddvq_f32(vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3)));
+#else
+    float acc[4] = {0.f, 0.f, 0.f, 0.f};
+    for (size_t i = 0; i < n; i += 4) {
+        acc[0] += a[i] * b[i];
+        acc[1] += a[i + 1] * b[i + 1];
+        acc[2] += a[i + 2] * b[i + 2];
+        acc[3] += a[i + 3] * b[i + 3];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+float length(const std::vector<float>& raw) {
+    float len = 0.f;
+    for (float f : raw) {
+        len += f * f;
+    }
+    return sqrtf(len);
+}
+
+} // namespace
+
 //// public apis
 
 IdentityStore::IdentityStore(size_t db_size, std::string feature_model, int feature_version,
@@ -9,17 +120,238 @@ IdentityStore::IdentityStore(size_t db_size, std::string feature_model, int feat
     : db_size_(db_size),
       feature_model_(feature_model),
       feature_version_(feature_version),
-      feature_dimension_(feature_dimension) {}
+      feature_dimension_(feature_dimension),
+      stride_((std::max(feature_dimension, 1) + ROW_ALIGN - 1) / ROW_ALIGN * ROW_ALIGN) {}
+
+IdentityStore::~IdentityStore() { unmap(); }
 
 RetCode IdentityStore::LoadFromFile(const std::string& db_filepath) {
+    std::unique_lock<std::shared_mutex> l(mu_);
     db_persist_filepath_ = db_filepath;
-    return {};
+    unmap();
+    rows_.clear();
+    norms_.clear();
+
+    int fd = open(db_filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            spdlog::info("identity store {} not found, start empty.", db_filepath);
+            return RET_OK;
+        }
+        spdlog::error("cannot open identity store {}: {}", db_filepath, strerror(errno));
+        return RET_ERR;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FileHeader)) {
+        spdlog::error("identity store {} is broken.", db_filepath);
+        close(fd);
+        return RET_ERR;
+    }
+    size_t size = st.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        spdlog::error("cannot mmap identity store {}: {}", db_filepath, strerror(errno));
+        return RET_ERR;
+    }
+
+    const FileHeader* header = static_cast<const FileHeader*>(mapped);
+    size_t expect_size = sizeof(FileHeader) + header->count * (header->stride + 1) * sizeof(float);
+    if (header->magic != STORE_MAGIC || header->version != STORE_VERSION
+        || header->model_len > sizeof(header->model) || size < expect_size) {
+        spdlog::error("identity store {} is broken.", db_filepath);
+        munmap(mapped, size);
+        return RET_ERR;
+    }
+
+    std::string model(header->model, header->model_len);
+    if (header->dimension != (uint32_t)feature_dimension_ || header->stride != stride_
+        || model != feature_model_ || header->feature_version != feature_version_) {
+        spdlog::error("identity store {} has features of {} v{} dim {}, expect {} v{} dim {}.",
+                      db_filepath, model, header->feature_version, header->dimension,
+                      feature_model_, feature_version_, feature_dimension_);
+        munmap(mapped, size);
+        return RET_ERR;
+    }
+    if (header->count > db_size_) {
+        spdlog::error("identity store {} has {} features, more than db size {}.", db_filepath,
+                      header->count, db_size_);
+        munmap(mapped, size);
+        return RET_ERR;
+    }
+
+    // searches scan rows front to back.
+    madvise(mapped, size, MADV_SEQUENTIAL);
+
+    mapped_ = mapped;
+    mapped_size_ = size;
+    mapped_count_ = header->count;
+    mapped_rows_ = reinterpret_cast<const float*>(static_cast<const char*>(mapped)
+                                                  + sizeof(FileHeader));
+    mapped_norms_ = mapped_rows_ + mapped_count_ * stride_;
+
+    spdlog::info("identity store {} loaded, {} features.", db_filepath, mapped_count_);
+    return RET_OK;
+}
+
+RetCode IdentityStore::Save() {
+    // searches go on while saving, another Save waits rather than writing the same temp file.
+    std::lock_guard<std::mutex> save_lock(save_mu_);
+    std::shared_lock<std::shared_mutex> l(mu_);
+    if (db_persist_filepath_.empty()) {
+        spdlog::error("identity store has no file, call LoadFromFile first.");
+        return RET_ERR;
+    }
+    if (feature_model_.size() > sizeof(FileHeader::model)) {
+        spdlog::error("feature model name {} is too long to persist.", feature_model_);
+        return RET_ERR;
+    }
+
+    // written to a temp file and renamed, so a crash never leaves a partial store, and the
+    // mapped old file stays valid until it is unmapped.
+    std::string tmp = db_persist_filepath_ + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            spdlog::error("cannot open identity store {} for writing.", tmp);
+            return RET_ERR;
+        }
+
+        size_t count = mapped_count_ + norms_.size();
+        FileHeader header{};
+        header.magic = STORE_MAGIC;
+        header.version = STORE_VERSION;
+        header.dimension = feature_dimension_;
+        header.stride = stride_;
+        header.count = count;
+        header.feature_version = feature_version_;
+        header.model_len = feature_model_.size();
+        memcpy(header.model, feature_model_.data(), feature_model_.size());
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        out.write(reinterpret_cast<const char*>(mapped_rows_),
+                  mapped_count_ * stride_ * sizeof(float));
+        out.write(reinterpret_cast<const char*>(rows_.data()), rows_.size() * sizeof(float));
+        out.write(reinterpret_cast<const char*>(mapped_norms_), mapped_count_ * sizeof(float));
+        out.write(reinterpret_cast<const char*>(norms_.data()), norms_.size() * sizeof(float));
+
+        if (!out.good()) {
+            spdlog::error("cannot write identity store {}.", tmp);
+            return RET_ERR;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, db_persist_filepath_, ec);
+    if (ec) {
+        spdlog::error("cannot rename identity store {}: {}", tmp, ec.message());
+        return RET_ERR;
+    }
+    return RET_OK;
+}
+
+RetCode IdentityStore::AddFeature(const Feature& feature) {
+    if (feature.raw.size() != (size_t)feature_dimension_) {
+        spdlog::warn("feature has dim {}, expect {}.", feature.raw.size(), feature_dimension_);
+        return RET_ERR;
+    }
+    // features built from raw floats only carry no model.
+    if (!feature.model.empty()
+        && (feature.model != feature_model_ || feature.version != feature_version_)) {
+        spdlog::warn("feature is of {} v{}, expect {} v{}.", feature.model, feature.version,
+                     feature_model_, feature_version_);
+        return RET_ERR;
+    }
+
+    std::unique_lock<std::shared_mutex> l(mu_);
+    if (mapped_count_ + norms_.size() >= db_size_) {
+        spdlog::warn("identity store is full, db size {}.", db_size_);
+        return RET_ERR;
+    }
+
+    float len = length(feature.raw);
+    for (float f : feature.raw) {
+        rows_.push_back(len > 0 ? f / len : 0.f);
+    }
+    rows_.resize(rows_.size() + stride_ - feature_dimension_, 0.f);
+    norms_.push_back(len);
+    return RET_OK;
+}
+
+std::vector<FeatureScore> IdentityStore::Search(const Feature& target, int topK) {
+    if (topK <= 0 || target.raw.size() != (size_t)feature_dimension_) {
+        return {};
+    }
+
+    // query is padded and aligned as rows are.
+    std::vector<float, AlignedAllocator<float>> query(stride_, 0.f);
+    float len = length(target.raw);
+    for (int i = 0; i < feature_dimension_; i++) {
+        query[i] = len > 0 ? target.raw[i] / len : 0.f;
+    }
+
+    std::shared_lock<std::shared_mutex> l(mu_);
+
+    // min heap of (score, row), keeps best topK.
+    using Scored = std::pair<float, size_t>;
+    std::priority_queue<Scored, std::vector<Scored>, std::greater<Scored>> heap;
+
+    const size_t count = mapped_count_ + norms_.size();
+    for (size_t i = 0; i < count; i++) {
+        float score = dot(row(i), query.data(), stride_);
+        if ((int)heap.size() < topK) {
+            heap.emplace(score, i);
+        } else if (heap.top().first < score) {
+            heap.pop();
+            heap.emplace(score, i);
+        }
+    }
+
+    std::vector<FeatureScore> ret;
+    ret.reserve(heap.size());
+    while (!heap.empty()) {
+        auto [score, i] = heap.top();
+        ret.push_back(FeatureScore{.feature = restore(i), .score = score});
+        heap.pop();
+    }
+    std::reverse(ret.begin(), ret.end());
+    return ret;
 }
 
-RetCode IdentityStore::AddFeature(const Feature& feature) { return {}; }
+std::vector<Feature> IdentityStore::SearchFeature(const Feature& target, int topK) {
+    std::vector<Feature> features;
+    for (auto& scored : Search(target, topK)) {
+        features.push_back(std::move(scored.feature));
+    }
+    return features;
+}
 
-std::vector<Feature> IdentityStore::SearchFeature(const Feature& target, int topK) { return {}; }
+size_t IdentityStore::Size() {
+    std::shared_lock<std::shared_mutex> l(mu_);
+    return mapped_count_ + norms_.size();
+}
 
 //// private apis
 
+void IdentityStore::unmap() {
+    if (mapped_ != nullptr) {
+        munmap(mapped_, mapped_size_);
+    }
+    mapped_ = nullptr;
+    mapped_size_ = 0;
+    mapped_rows_ = nullptr;
+    mapped_norms_ = nullptr;
+    mapped_count_ = 0;
+}
+
+Feature IdentityStore::restore(size_t i) const {
+    const float* r = row(i);
+    std::vector<float> raw(r, r + feature_dimension_);
+    for (auto& f : raw) {
+        f *= norm(i);
+    }
+    return Feature(std::move(raw), std::string(feature_model_), feature_version_);
+}
+
 } // namespace donde_toolkits::feature_identity
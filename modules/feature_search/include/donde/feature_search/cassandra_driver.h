@@ -12,11 +12,13 @@
 #include <iterator>
 #include <map>
 #include <memory>
+#include <mutex>
 //// #include <msgpack.hpp>
 #include <nlohmann/json_fwd.hpp>
 #include <opencv2/core/hal/interface.h>
 #include <sstream>
 #include <stdexcept>
+#include <unordered_map>
 
 
 
@@ -34,7 +36,8 @@ namespace donde_toolkits ::feature_search {
 class CassandraDriver : public Driver {
 
   public:
-    CassandraDriver(std::string addr);
+    // load_concurrency bounds feature files LoadFeatures and AddFeatures have in flight.
+    CassandraDriver(std::string addr, int load_concurrency = 8);
 
     // the sqlite3 db ptr will auto release when destruct.
     ~CassandraDriver() = default;
@@ -54,12 +57,22 @@ class CassandraDriver : public Driver {
 
     std::string CreateShard(const std::string& db_id, const DBShard& shard) override;
 
+    RetCode UpdateShard(const std::string& db_id, const DBShard& shard) override;
+
+    std::string CloseShard(const std::string& db_id, const std::string& shard_id) override;
+
     PageData<FeatureDbItemList> ListFeatures(const std::string& db_id, uint page,
                                              uint perPage); // override;
 
+    // ListFeatures of the page after state, and moves state to its end. Unlike page numbers,
+    // scanning a db this way reads each row once, it is how shards load their features.
+    FeatureDbItemList ListFeatures(const std::string& db_id, uint perPage, PagingState& state);
+
+    // AddFeatures stores all features or none, no ids are returned if any of them fails.
     std::vector<std::string> AddFeatures(const std::string& db_id,
                                          const std::vector<FeatureDbItem>& features); // override;
 
+    // LoadFeatures returns nothing if any of the features cannot be loaded.
     std::vector<Feature> LoadFeatures(const std::string& db_id,
                                       const std::vector<std::string>& feature_ids); // override;
 
@@ -75,10 +88,28 @@ class CassandraDriver : public Driver {
 
     std::vector<DBItem> _cached_db_items;
 
+    // prepared statements by sql, reused instead of compiled every call.
+    std::unordered_map<std::string, std::unique_ptr<SQLite::Statement>> _statements;
+
+    // guards _statements, and each cached statement from prepare until it is reset.
+    std::mutex _statements_mu;
+
+    int _load_concurrency;
+
+    // for_each_concurrently calls fn(0..n-1) on at most _load_concurrency threads.
+    void for_each_concurrently(size_t n, const std::function<void(size_t)>& fn);
+
     //////////////////////////////////////////////////////////////////////////////////////////////////////////
     // SQLite3 operations.
     //////////////////////////////////////////////////////////////////////////////////////////////////////////
   private:
+    // statement returns the prepared statement of sql, reset and ready to bind. Callers hold
+    // _statements_mu until they are done with it.
+    SQLite::Statement& statement(const std::string& sql);
+
+    // evict_statements drops the cached statements of a deleted db.
+    void evict_statements(const std::string& db_id);
+
     ///
     /// DB management
     ///
@@ -98,7 +129,11 @@ class CassandraDriver : public Driver {
     ///
 
     RetCode insert_into_db_shards(const std::string& db_id, const std::string& shard_id,
-                                  uint64 capacity);
+                                  const DBShard& shard);
+
+    RetCode update_db_shard(const std::string& db_id, const DBShard& shard);
+
+    RetCode close_db_shard(const std::string& db_id, const std::string& shard_id);
 
     std::vector<DBShard> list_db_shards(const std::string& db_id);
     ///
@@ -113,6 +148,9 @@ class CassandraDriver : public Driver {
     std::vector<FeatureDbItem> list_features_from_db(const std::string& db_id, int start,
                                                      int limit);
 
+    std::vector<FeatureDbItem> list_features_from_db(const std::string& db_id, PagingState& state,
+                                                     int limit);
+
     RetCode insert_features_into_db(const std::string& db_id,
                                     const std::vector<std::string>& feature_ids,
                                     const std::vector<std::string>& metadatas);
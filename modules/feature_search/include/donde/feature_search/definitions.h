@@ -3,7 +3,12 @@
 #include "donde/definitions.h"
 #include "nlohmann/json.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <map>
 #include <opencv2/core/hal/interface.h>
+#include <string>
+#include <vector>
 
 namespace donde_toolkits {
 
@@ -30,6 +35,15 @@ struct PageData {
     };
 };
 
+// PagingState resumes a listing right after its last row, so reading page n does not scan the
+// n-1 pages before it as offset paging does.
+struct PagingState {
+    // id of the last row listed, 0 before the first page.
+    int64 last_id = 0;
+    // no more rows after last_id.
+    bool done = false;
+};
+
 struct DBItem {
     std::string db_id;
     std::string name;
@@ -43,6 +57,26 @@ struct WorkerItem {
     uint64 max_capacity;
 };
 
+// WorkerState, transitions: unknown -> online <-> suspect -> offline -> online.
+enum WorkerState {
+    WORKER_UNKNOWN,
+    WORKER_ONLINE,
+    // missed a probe or heartbeat, still used but may go offline soon.
+    WORKER_SUSPECT,
+    WORKER_OFFLINE,
+};
+
+// WorkerLoad is the telemetry a worker reports, used for shard placement.
+struct WorkerLoad {
+    double qps;
+    double scan_bytes_per_sec;
+    uint64 rss_bytes;
+    double p99_latency_ms;
+    uint64 free_space;
+    // false if the worker cannot report telemetry, the numbers above are unknown then.
+    bool reported = true;
+};
+
 const size_t DEFAULT_SHARD_CAPACITY = 1024 * 1024 * 1024;
 
 struct DBShard {
@@ -52,6 +86,12 @@ struct DBShard {
     uint64 capacity;
     uint64 used;
     bool is_closed;
+    // all workers serving this shard, worker_id is the first one (primary).
+    std::vector<std::string> replica_worker_ids;
+    // raw bytes of features stored, for size based rollover.
+    uint64 used_bytes;
+    // unix time in ms when the shard is created (or loaded), for age based rollover.
+    int64 created_at;
 };
 
 using DBItemPtr = std::shared_ptr<DBItem>;
@@ -83,6 +123,78 @@ struct FeatureDbItem {
 
 using FeatureDbItemList = std::vector<FeatureDbItem>;
 
+enum MetadataOp {
+    // value of key equals values[0].
+    META_EQ,
+    // value of key is one of values.
+    META_IN,
+    // value of key, as a number, is in [min, max].
+    META_RANGE,
+};
+
+// MetadataPredicate matches features by one key of their metadata.
+struct MetadataPredicate {
+    std::string key;
+    MetadataOp op = META_EQ;
+    std::vector<std::string> values;
+    double min = 0;
+    double max = 0;
+};
+
+// MetadataFilter matches features which match all its predicates, an empty filter matches all.
+// Searches apply it before ranking, so topk are the best of matched features.
+using MetadataFilter = std::vector<MetadataPredicate>;
+
+// parse_metadata_number parses a whole metadata value as a number.
+inline bool parse_metadata_number(const std::string& value, double& number) {
+    if (value.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    number = std::strtod(value.c_str(), &end);
+    return end == value.c_str() + value.size();
+};
+
+inline bool match_metadata(const MetadataPredicate& predicate,
+                           const std::map<std::string, std::string>& metadata) {
+    auto it = metadata.find(predicate.key);
+    if (it == metadata.end()) {
+        return false;
+    }
+    switch (predicate.op) {
+    case META_EQ:
+        return !predicate.values.empty() && it->second == predicate.values[0];
+    case META_IN:
+        return std::find(predicate.values.begin(), predicate.values.end(), it->second)
+               != predicate.values.end();
+    case META_RANGE: {
+        double number;
+        return parse_metadata_number(it->second, number) && number >= predicate.min
+               && number <= predicate.max;
+    }
+    }
+    return false;
+};
+
+inline bool match_metadata(const MetadataFilter& filter,
+                           const std::map<std::string, std::string>& metadata) {
+    for (const auto& predicate : filter) {
+        if (!match_metadata(predicate, metadata)) {
+            return false;
+        }
+    }
+    return true;
+};
+
+struct QueryCacheStats {
+    uint64 hits;
+    uint64 misses;
+    uint64 evictions;
+    uint64 invalidations;
+    uint64 entries;
+    uint64 bytes;
+};
+
 inline std::vector<std::string> convert_to_feature_ids(const FeatureDbItemList& lst) {
     std::vector<std::string> ret;
     for (const auto& item : lst) {
@@ -69,11 +69,21 @@ class Driver {
                                                      const std::string& shard_id = "")
         = 0;
 
+    // ListFeatures of the page right after state, and moves state to its end. Each row is read
+    // once, unlike page numbers which rescan all rows before the page.
+    virtual FeatureDbItemList ListFeatures(uint perPage, PagingState& state,
+                                           const std::string& db_id,
+                                           const std::string& shard_id = "")
+        = 0;
+
+    // AddFeatures keeps feature_id of an item if it is set, otherwise generates one.
+    // features are stored all or none, no ids are returned if any of them fails.
     virtual std::vector<std::string> AddFeatures(const std::vector<FeatureDbItem>& features,
                                                  const std::string& db_id,
                                                  const std::string& shard_id)
         = 0;
 
+    // LoadFeatures returns nothing if any of the features cannot be loaded.
     virtual std::vector<Feature> LoadFeatures(const std::vector<std::string>& feature_ids,
                                               const std::string& db_id, const std::string& shard_id)
         = 0;
@@ -31,6 +31,9 @@ class ICoordinator {
 
     virtual void ProbeWorkers(const WorkerFactory& factory) = 0;
 
+    // ReportHeartbeat is called when a worker pushes its heartbeat.
+    virtual void ReportHeartbeat(const std::string& worker_id) = 0;
+
     // std::vector<WorkerPtr> ListWorkers() = 0;
 
     virtual std::vector<DBItem> ListUserDBs() = 0;
@@ -49,6 +52,9 @@ class ICoordinator {
     virtual std::vector<FeatureSearchItem> SearchFeature(const std::string& db_id,
                                                          const Feature& query, int topk)
         = 0;
+
+    // hit/miss metrics of the query result cache, all zero if cache is disabled.
+    virtual QueryCacheStats GetQueryCacheStats() = 0;
 };
 
 class CoordinatorImpl;
@@ -65,6 +71,8 @@ class Coordinator : public ICoordinator {
 
     void ProbeWorkers(const WorkerFactory& factory) override;
 
+    void ReportHeartbeat(const std::string& worker_id) override;
+
     // std::vector<WorkerPtr> ListWorkers() override;
 
     std::vector<DBItem> ListUserDBs() override;
@@ -81,6 +89,8 @@ class Coordinator : public ICoordinator {
     std::vector<FeatureSearchItem> SearchFeature(const std::string& db_id, const Feature& query,
                                                  int topk) override;
 
+    QueryCacheStats GetQueryCacheStats() override;
+
     std::unique_ptr<CoordinatorImpl> pimpl;
 };
 
@@ -13,13 +13,13 @@ namespace donde_toolkits ::feature_search ::search_manager {
 // User should inherit this class.
 class WorkerFactory {
   public:
-    /*virtual*/ static Worker* CreateWorker(const std::string& worker_id,
-                                            const std::string& worker_address) {
-        throw "not implement";
-    };
-    /*virtual*/ static bool ProbeWorker(const std::string& worker_address) {
+    virtual ~WorkerFactory(){};
+
+    virtual Worker* CreateWorker(const std::string& worker_id,
+                                 const std::string& worker_address) const {
         throw "not implement";
     };
+    virtual bool ProbeWorker(const std::string& worker_address) const { throw "not implement"; };
 };
 
 } // namespace donde_toolkits::feature_search::search_manager
@@ -4,20 +4,34 @@
 #include "donde/feature_search/search_manager/worker_factory.h"
 #include "donde/feature_search/worker.h"
 
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <tuple>
 #include <unordered_map>
 
 
 
 namespace donde_toolkits ::feature_search ::search_manager {
 
+// WorkerStateCallback is called when worker transits from one state to another,
+// it runs on the probing thread, so don't block it for long.
+using WorkerStateCallback = std::function<void(Worker* worker, WorkerState from, WorkerState to)>;
+
 class IWorkerManager {
   public:
     virtual void Stop() = 0;
 
     virtual Worker* FindWritableWorker() = 0;
 
+    // FindWritableWorkers find at most `count` distinct workers for shard replicas,
+    // ordered by free space.
+    virtual std::vector<Worker*> FindWritableWorkers(size_t count) = 0;
+
+    // FindRebalancePair find a hot worker, and a cool one which its shard can be moved to.
+    // both are nullptr if workers are balanced.
+    virtual std::tuple<Worker*, Worker*> FindRebalancePair() = 0;
+
     virtual Worker* GetWorkerByID(const std::string& worker_id) = 0;
 
     virtual void AttachNewWorker(WorkerItem worker_item) = 0;
@@ -27,6 +41,16 @@ class IWorkerManager {
     virtual void LoadKnownWorkers() = 0;
 
     virtual void StartProbeWorkersInBackground(const WorkerFactory& factory) = 0;
+
+    // ReportHeartbeat is pushed by worker, keeps it online without waiting for probes.
+    virtual void ReportHeartbeat(const std::string& worker_id) = 0;
+
+    virtual WorkerState GetWorkerState(const std::string& worker_id) = 0;
+
+    // ListWorkerStates of all known workers, id -> state.
+    virtual std::unordered_map<std::string, WorkerState> ListWorkerStates() = 0;
+
+    virtual void SubscribeWorkerState(WorkerStateCallback callback) = 0;
 };
 
 class WorkerManagerImpl;
@@ -38,10 +62,17 @@ class WorkerManager : public IWorkerManager {
     void Stop() override;
 
     Worker* FindWritableWorker() override;
+    std::vector<Worker*> FindWritableWorkers(size_t count) override;
+    std::tuple<Worker*, Worker*> FindRebalancePair() override;
     void AttachNewWorker(WorkerItem worker_item) override;
+    Worker* GetWorkerByID(const std::string& worker_id) override;
     void LoadKnownWorkers() override;
     void StartProbeWorkersInBackground(const WorkerFactory& factory) override;
     std::vector<Worker*> ListWorkers(bool include_offline = false) override;
+    void ReportHeartbeat(const std::string& worker_id) override;
+    WorkerState GetWorkerState(const std::string& worker_id) override;
+    std::unordered_map<std::string, WorkerState> ListWorkerStates() override;
+    void SubscribeWorkerState(WorkerStateCallback callback) override;
 
     std::unique_ptr<WorkerManagerImpl> pimpl;
 };
@@ -22,7 +22,8 @@ class BruteForceWorker : public ISearchWorker {
   public:
     // Searcher contructor, doesn't own ShardManager and Driver, but reference to them.
     // The caller should clean ShardManager and Driver themself.
-    BruteForceWorker(Driver& driver);
+    // config may have a "seal" block, see MemoryShardImpl::ParseSealOptions.
+    BruteForceWorker(Driver& driver, const json& config = {});
 
     ~BruteForceWorker();
 
@@ -54,6 +55,11 @@ class BruteForceWorker : public ISearchWorker {
     std::vector<FeatureSearchItem> SearchFeature(const std::string& db_id, const Feature& query,
                                                  size_t topk) override;
 
+    // SearchFeature among features whose metadata match filter, predicates on keys which are
+    // not indexed (see "indexed_keys" of "seal") match nothing once shards are sealed.
+    std::vector<FeatureSearchItem> SearchFeature(const std::string& db_id, const Feature& query,
+                                                 size_t topk, const MetadataFilter& filter);
+
     std::vector<std::string> AddFeatures(const std::string& db_id,
                                          const std::vector<FeatureDbItem>& features) override;
 
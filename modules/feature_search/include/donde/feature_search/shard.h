@@ -20,9 +20,16 @@ class Shard {
     virtual void Start() = 0;
     virtual void Stop() = 0;
 
-    // Assign a worker for this shard.
+    // Assign a worker for this shard, each assigned worker serves one replica.
     virtual RetCode AssignWorker(Worker* worker) = 0;
 
+    // MigrateReplica move the replica served by `from` to `to`, writes are paused during
+    // migration, reads keep going to other replicas or `from` until cut over.
+    virtual RetCode MigrateReplica(Worker* from, Worker* to) = 0;
+
+    // DetachWorkers stop the shard and drop all replicas, called before their workers are freed.
+    virtual void DetachWorkers() = 0;
+
     // AddFeatures to this shard, delegate to worker client to do the actual storage.
     virtual std::vector<std::string> AddFeatures(const std::vector<Feature>& fts) = 0;
 
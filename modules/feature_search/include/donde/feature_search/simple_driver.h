@@ -72,6 +72,9 @@ class SimpleDriver : public Driver {
     PageData<FeatureDbItemList> ListFeatures(uint page, uint perPage, const std::string& db_id,
                                              const std::string& shard_id = "") override;
 
+    FeatureDbItemList ListFeatures(uint perPage, PagingState& state, const std::string& db_id,
+                                   const std::string& shard_id = "") override;
+
     std::vector<std::string> AddFeatures(const std::vector<FeatureDbItem>& features,
                                          const std::string& db_id,
                                          const std::string& shard_id) override;
@@ -115,7 +118,11 @@ class SimpleDriver : public Driver {
     ///
 
     RetCode insert_into_db_shards(const std::string& db_id, const std::string& shard_id,
-                                  uint64 capacity);
+                                  const DBShard& shard);
+
+    RetCode update_db_shard(const std::string& db_id, const DBShard& shard);
+
+    RetCode close_db_shard(const std::string& db_id, const std::string& shard_id);
 
     std::vector<DBShard> list_db_shards(const std::string& db_id);
 
@@ -135,6 +142,10 @@ class SimpleDriver : public Driver {
     std::vector<FeatureDbItem> list_features_from_db(int start, int limit, const std::string& db_id,
                                                      const std::string& shard_id = "");
 
+    std::vector<FeatureDbItem> list_features_from_db(PagingState& state, int limit,
+                                                     const std::string& db_id,
+                                                     const std::string& shard_id = "");
+
     uint64 count_features_in_db(const std::string& db_id, const std::string& shard_id = "");
 
     static inline std::string feature_table_name(const std::string& db_id) {
@@ -24,6 +24,9 @@ class Worker {
 
     virtual uint64 GetFreeSpace() = 0;
 
+    // GetLoad report recent load of this worker, with reported false if it cannot tell.
+    virtual WorkerLoad GetLoad() = 0;
+
     // ListShards report all shards this worker is serving.
     virtual std::vector<DBShard> ListShards() = 0;
 
@@ -33,10 +36,20 @@ class Worker {
     // CloseShard close db_id/shard_id.
     virtual RetCode CloseShard(const std::string& db_id, const std::string& shard_id) = 0;
 
-    // AddFeatures to db_id/shard_id, delegate to remote worker.
+    // ReleaseShard stop serving db_id/shard_id and free its memory, e.g. after migration.
+    virtual RetCode ReleaseShard(const std::string& db_id, const std::string& shard_id) = 0;
+
+    // AddFeatures to db_id/shard_id, delegate to remote worker. feature ids are assigned by the
+    // shard, so every replica stores fts under the same ids, and returns them.
     virtual std::vector<std::string> AddFeatures(const std::string& db_id,
                                                  const std::string& shard_id,
-                                                 const std::vector<Feature>& fts)
+                                                 const std::vector<FeatureDbItem>& fts)
+        = 0;
+
+    // ListFeatures of db_id/shard_id with their vectors by page, e.g. to copy a replica.
+    virtual PageData<FeatureDbItemList> ListFeatures(const std::string& db_id,
+                                                     const std::string& shard_id, uint page,
+                                                     uint perPage)
         = 0;
 
     // Search feature in the worker. worker can have multiple dbs, multiple shards.
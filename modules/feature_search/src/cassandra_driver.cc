@@ -1,20 +1,25 @@
 #include "donde/feature_search/cassandra_driver.h"
 
+#include "donde/feature_serialize.h"
 #include "donde/utils.h"
 #include "nlohmann/json.hpp"
 
 #include <SQLiteCpp/Database.h>
 #include <SQLiteCpp/Statement.h>
+#include <SQLiteCpp/Transaction.h>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <exception>
 #include <filesystem>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <ios>
 #include <iterator>
 #include <map>
 #include <memory>
-//// #include <msgpack.hpp>
+#include <mutex>
 #include <nlohmann/json_fwd.hpp>
 #include <opencv2/core/hal/interface.h>
 #include <sstream>
@@ -28,14 +33,43 @@ using fmt::format;
 
 namespace donde_toolkits ::feature_search {
 
+namespace {
+
+std::string features_table(const std::string& db_id) {
+    return "features_db_" + replace_underscore_for_uuid(db_id);
+};
+
+std::string insert_feature_sql(const std::string& db_id) {
+    return format("insert into {}(feature_id, metadata, version) values (?, ?, ?);",
+                  features_table(db_id));
+};
+
+std::string delete_feature_sql(const std::string& db_id) {
+    return format("delete from {} where feature_id = ?;", features_table(db_id));
+};
+
+std::string scan_features_sql(const std::string& db_id) {
+    return format("select id, feature_id, metadata from {} where id > ? order by id limit ?;",
+                  features_table(db_id));
+};
+
+std::string count_features_sql(const std::string& db_id) {
+    return format("select count(*) from {};", features_table(db_id));
+};
+
+} // namespace
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 //
 // CassandraDriver, db tables and features are stored in cassandra.
 //
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
-CassandraDriver::CassandraDriver(std::string db_dirpath)
-    : _db_dir(db_dirpath), _data_dir(_db_dir / "data"), _meta_dir(_db_dir / "meta") {
+CassandraDriver::CassandraDriver(std::string db_dirpath, int load_concurrency)
+    : _db_dir(db_dirpath),
+      _data_dir(_db_dir / "data"),
+      _meta_dir(_db_dir / "meta"),
+      _load_concurrency(std::max(1, load_concurrency)) {
 
     std::filesystem::create_directories(_data_dir);
     std::filesystem::create_directories(_meta_dir);
@@ -88,14 +122,32 @@ RetCode CassandraDriver::DeleteDB(std::string db_id) {
     _cached_db_items = {};
 
     delete_user_db(db_id);
+    evict_statements(db_id);
 
     return RetCode::RET_OK;
 };
 
-std::vector<DBShard> CassandraDriver::ListShards(const std::string& db_id) { return {}; };
+std::vector<DBShard> CassandraDriver::ListShards(const std::string& db_id) {
+    return list_db_shards(db_id);
+};
 
 std::string CassandraDriver::CreateShard(const std::string& db_id, const DBShard& shard) {
-    return {};
+    std::string shard_id = shard.shard_id.empty() ? generate_uuid() : shard.shard_id;
+    if (insert_into_db_shards(db_id, shard_id, shard) != RetCode::RET_OK) {
+        return {};
+    }
+    return shard_id;
+};
+
+RetCode CassandraDriver::UpdateShard(const std::string& db_id, const DBShard& shard) {
+    return update_db_shard(db_id, shard);
+};
+
+std::string CassandraDriver::CloseShard(const std::string& db_id, const std::string& shard_id) {
+    if (close_db_shard(db_id, shard_id) != RetCode::RET_OK) {
+        return {};
+    }
+    return shard_id;
 };
 
 PageData<FeatureDbItemList> CassandraDriver::ListFeatures(const std::string& db_id, uint page,
@@ -115,6 +167,14 @@ PageData<FeatureDbItemList> CassandraDriver::ListFeatures(const std::string& db_
     return ret;
 };
 
+FeatureDbItemList CassandraDriver::ListFeatures(const std::string& db_id, uint perPage,
+                                               PagingState& state) {
+    if (state.done || perPage == 0) {
+        return {};
+    }
+    return list_features_from_db(db_id, state, perPage);
+};
+
 RetCode CassandraDriver::Init(const std::vector<std::string>& initial_db_ids) {
     // init tables.
     for (const auto& id : initial_db_ids) {
@@ -125,75 +185,65 @@ RetCode CassandraDriver::Init(const std::vector<std::string>& initial_db_ids) {
 
 std::vector<std::string> CassandraDriver::AddFeatures(const std::string& db_id,
                                                       const std::vector<FeatureDbItem>& features) {
-    int count = features.size();
-    std::vector<std::string> feature_ids;
-    std::vector<std::string> metadatas;
-
-    for (auto& item : features) {
-        auto ft = item.feature;
-
-        std::string feature_id = generate_uuid();
-        // std::cout << "generated feature_id: " << feature_id << std::endl;
+    std::vector<std::string> feature_ids(features.size());
+    std::vector<std::string> metadatas(features.size(), "{}");
+    std::atomic<bool> failed{false};
+    for (size_t i = 0; i < features.size(); i++) {
+        feature_ids[i] = features[i].feature_id.empty() ? generate_uuid() : features[i].feature_id;
+    }
 
-        auto filepath = _data_dir / (feature_id + ".ft");
+    for_each_concurrently(features.size(), [&](size_t i) {
+        // metadata first, a row which cannot be dumped (e.g. not utf-8) leaves no file behind.
         try {
-            std::ofstream file(filepath, std::ios::binary | std::ios::out);
-            std::stringstream ss;
-            //// msgpack::pack(ss, ft);
-
-            //// // write to file
-            //// std::string data(ss.str());
-            //// file << data;
-
-            json j(item.metadata); // must use (), while not {}
-            std::string meta_str{j.dump()};
-            metadatas.push_back(meta_str);
-
-            // std::cout << "write data.size" << data.size() << std::endl;
-            feature_ids.push_back(feature_id);
+            json j(features[i].metadata); // must use (), while not {}
+            metadatas[i] = j.dump();
+        } catch (std::exception& exc) {
+            spdlog::error("cannot dump metadata of feature {}, exc: {}", feature_ids[i],
+                          exc.what());
+            failed.store(true);
+            return;
+        }
 
-        } catch (const std::exception& exc) {
-            spdlog::error("cannot save feature to : {}, exc: {}", filepath.string(), exc.what());
-            feature_ids.push_back("");
-            metadatas.push_back("{}");
+        auto filepath = _data_dir / (feature_ids[i] + ".ft");
+        std::ofstream file(filepath, std::ios::binary | std::ios::out);
+        if (WriteFeature(file, features[i].feature) != RET_OK) {
+            spdlog::error("cannot save feature to : {}", filepath.string());
+            failed.store(true);
         }
+    });
+
+    // insert feature to meta db, the batch is stored or not as a whole, a caller never gets
+    // ids of some features while others are missing.
+    if (failed.load() || insert_features_into_db(db_id, feature_ids, metadatas) != RET_OK) {
+        for (auto& feature_id : feature_ids) {
+            std::error_code ec;
+            std::filesystem::remove(_data_dir / (feature_id + ".ft"), ec);
+        }
+        return {};
     }
 
-    // insert feature to meta db.
-    insert_features_into_db(db_id, feature_ids, metadatas);
-
     return feature_ids;
 };
 
 std::vector<Feature> CassandraDriver::LoadFeatures(const std::string& db_id,
                                                    const std::vector<std::string>& feature_ids) {
-    int count = feature_ids.size();
-    std::vector<Feature> features;
+    std::vector<Feature> features(feature_ids.size());
+    std::atomic<bool> failed{false};
 
-    for (auto& feature_id : feature_ids) {
-        spdlog::debug("load feature_id: {}", feature_id);
+    for_each_concurrently(feature_ids.size(), [&](size_t i) {
+        spdlog::debug("load feature_id: {}", feature_ids[i]);
 
-        auto filepath = _data_dir / (feature_id + ".ft");
-        try {
-            // read to string
-            std::ifstream file(filepath, std::ios::binary | std::ios::in);
-            std::string data = std::string(std::istreambuf_iterator<char>(file),
-                                           std::istreambuf_iterator<char>());
-
-            // std::cout << "filepath: " << filepath << std::endl;
-            // std::cout << "data.size(): " << data.size() << std::endl;
-            //// auto oh = msgpack::unpack(data.data(), data.size());
-            //// Feature ft = oh.get().as<Feature>();
-            //// // ft.debugPrint();
-
-            //// features.push_back(ft);
-        } catch (const std::exception& exc) {
-            spdlog::error("cannot load feature, feature_path: {}, exc: {}", filepath.string(),
-                          exc.what());
-            features.push_back({});
+        auto filepath = _data_dir / (feature_ids[i] + ".ft");
+        std::ifstream file(filepath, std::ios::binary | std::ios::in);
+        if (ReadFeature(file, features[i]) != RET_OK) {
+            spdlog::error("cannot load feature, feature_path: {}", filepath.string());
+            failed.store(true);
         }
-    }
+    });
 
+    if (failed.load()) {
+        return {};
+    }
     return features;
 };
 
@@ -211,9 +261,48 @@ RetCode CassandraDriver::RemoveFeatures(const std::string& db_id,
     return delete_features_from_db(db_id, feature_ids);
 };
 
+void CassandraDriver::for_each_concurrently(size_t n, const std::function<void(size_t)>& fn) {
+    // each thread takes the next index, so at most _load_concurrency files are in flight, and
+    // a slow file does not hold back the others.
+    std::atomic<size_t> next{0};
+    auto run = [&]() {
+        for (size_t i = next++; i < n; i = next++) {
+            fn(i);
+        }
+    };
+
+    std::vector<std::future<void>> threads;
+    for (size_t t = 1; t < std::min<size_t>(_load_concurrency, n); t++) {
+        threads.push_back(std::async(std::launch::async, run));
+    }
+    run();
+    for (auto& thread : threads) {
+        thread.get();
+    }
+};
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////
 // SQLite3 operations.
 //////////////////////////////////////////////////////////////////////////////////////////////////////////
+SQLite::Statement& CassandraDriver::statement(const std::string& sql) {
+    auto it = _statements.find(sql);
+    if (it == _statements.end()) {
+        it = _statements.emplace(sql, std::make_unique<SQLite::Statement>(*db, sql)).first;
+    } else {
+        it->second->reset();
+        it->second->clearBindings();
+    }
+    return *it->second;
+};
+
+void CassandraDriver::evict_statements(const std::string& db_id) {
+    std::lock_guard<std::mutex> l(_statements_mu);
+    for (const auto& sql : {insert_feature_sql(db_id), delete_feature_sql(db_id),
+                            scan_features_sql(db_id), count_features_sql(db_id)}) {
+        _statements.erase(sql);
+    }
+};
+
 ///
 /// DB management
 ///
@@ -236,6 +325,27 @@ RetCode CassandraDriver::init_user_db_table() {
         return RetCode::RET_ERR;
     }
 
+    std::string sql2 = "create table if not exists db_shards("
+                       "id integer primary key autoincrement, "
+                       "shard_id char(64), "
+                       "db_id char(64), "
+                       "capacity integer, "
+                       "is_closed boolean, "
+                       "created_at datetime, "
+                       "updated_at datetime, "
+                       "deleted_at datetime, "
+                       "worker_id char(64), "
+                       "replica_worker_ids text, "
+                       "used integer, "
+                       "used_bytes integer "
+                       ");";
+    try {
+        db->exec(sql2);
+    } catch (std::exception& exc) {
+        spdlog::error("cannot create table db_shards, exc: {}", exc.what());
+        return RetCode::RET_ERR;
+    }
+
     return RetCode::RET_OK;
 };
 
@@ -341,26 +451,77 @@ RetCode CassandraDriver::delete_user_db(const std::string& db_id) {
 };
 
 RetCode CassandraDriver::insert_into_db_shards(const std::string& db_id,
-                                               const std::string& shard_id, uint64 capacity) {
+                                               const std::string& shard_id, const DBShard& shard) {
     try {
         std::string sql("insert into db_shards(db_id, shard_id, capacity, is_closed, "
-                        "created_at) values (?, ?, ?, ?, ?);");
+                        "created_at, worker_id, replica_worker_ids, used, used_bytes) "
+                        "values (?, ?, ?, ?, ?, ?, ?, ?, ?);");
 
-        time_t now = time(nullptr);
+        // created_at is kept in seconds like other tables, shards count their age in ms.
+        int64 created_at = shard.created_at > 0 ? shard.created_at / 1000 : time(nullptr);
 
         SQLite::Statement query(*db, sql);
 
         query.bind(1, db_id);
         query.bind(2, shard_id);
-        query.bind(3, int64(capacity));
+        query.bind(3, int64(shard.capacity));
 
         // sqlite3 treat boolean as int, so 0 is false.
-        query.bind(4, 0);
-        query.bind(5, int64(now));
+        query.bind(4, shard.is_closed ? 1 : 0);
+        query.bind(5, created_at);
+        query.bind(6, shard.worker_id);
+        query.bind(7, json(shard.replica_worker_ids).dump());
+        query.bind(8, int64(shard.used));
+        query.bind(9, int64(shard.used_bytes));
 
         query.exec();
     } catch (std::exception& exc) {
-        spdlog::error("cannot insert into dbs table, exc: {}", exc.what());
+        spdlog::error("cannot insert into db_shards table, exc: {}", exc.what());
+        return RetCode::RET_ERR;
+    }
+
+    return RetCode::RET_OK;
+};
+
+RetCode CassandraDriver::update_db_shard(const std::string& db_id, const DBShard& shard) {
+    try {
+        // is_closed is only set by close_db_shard, an update racing with closing must not
+        // open the shard again.
+        std::string sql("update db_shards set worker_id=?, replica_worker_ids=?, used=?, "
+                        "used_bytes=?, updated_at=? where db_id = ? and shard_id = ?;");
+
+        SQLite::Statement query(*db, sql);
+        query.bind(1, shard.worker_id);
+        query.bind(2, json(shard.replica_worker_ids).dump());
+        query.bind(3, int64(shard.used));
+        query.bind(4, int64(shard.used_bytes));
+        query.bind(5, int64(time(nullptr)));
+        query.bind(6, db_id);
+        query.bind(7, shard.shard_id);
+
+        query.exec();
+    } catch (std::exception& exc) {
+        spdlog::error("cannot update db_shards table, exc: {}", exc.what());
+        return RetCode::RET_ERR;
+    }
+
+    return RetCode::RET_OK;
+};
+
+RetCode CassandraDriver::close_db_shard(const std::string& db_id, const std::string& shard_id) {
+    try {
+        std::string sql("update db_shards set is_closed=?, updated_at=? "
+                        "where db_id = ? and shard_id = ?;");
+
+        SQLite::Statement query(*db, sql);
+        query.bind(1, 1);
+        query.bind(2, int64(time(nullptr)));
+        query.bind(3, db_id);
+        query.bind(4, shard_id);
+
+        query.exec();
+    } catch (std::exception& exc) {
+        spdlog::error("cannot update db_shards table, exc: {}", exc.what());
         return RetCode::RET_ERR;
     }
 
@@ -371,27 +532,40 @@ std::vector<DBShard> CassandraDriver::list_db_shards(const std::string& db_id) {
     std::vector<DBShard> shards;
 
     try {
-        std::string sql("select db_id, shard_id, capacity, is_closed from db_shards;");
+        std::string sql("select db_id, shard_id, capacity, is_closed, worker_id, "
+                        "replica_worker_ids, used, used_bytes, created_at from db_shards "
+                        "where db_id = ?;");
 
         SQLite::Statement query(*db, sql);
+        query.bind(1, db_id);
         while (query.executeStep()) {
-            std::string db_id = query.getColumn(0).getString();
-            std::string shard_id = query.getColumn(1).getText();
+            DBShard shard{};
+            shard.db_id = query.getColumn(0).getString();
+            shard.shard_id = query.getColumn(1).getText();
             // type convert, int64 => uint64, because we are sure that capacity will not
             // exceed int64, so that's fine
-            uint64 capacity = query.getColumn(2).getInt64();
+            shard.capacity = query.getColumn(2).getInt64();
             // sqlite3 treat boolean as int
-            bool is_closed = query.getColumn(3).getInt() == 1;
-
-            shards.push_back(DBShard{
-                .db_id = db_id,
-                .shard_id = shard_id,
-                .capacity = capacity,
-                .is_closed = is_closed,
-            });
+            shard.is_closed = query.getColumn(3).getInt() == 1;
+            shard.worker_id = query.getColumn(4).getText();
+
+            std::string replicas = query.getColumn(5).getText();
+            if (!replicas.empty()) {
+                shard.replica_worker_ids = json::parse(replicas).get<std::vector<std::string>>();
+            }
+            if (shard.replica_worker_ids.empty() && !shard.worker_id.empty()) {
+                shard.replica_worker_ids.push_back(shard.worker_id);
+            }
+
+            // usage is null in rows of older tables, which reads as 0.
+            shard.used = query.getColumn(6).getInt64();
+            shard.used_bytes = query.getColumn(7).getInt64();
+            shard.created_at = query.getColumn(8).getInt64() * 1000;
+
+            shards.push_back(shard);
         }
     } catch (std::exception& exc) {
-        spdlog::error("cannot select from dbs table: {}", exc.what());
+        spdlog::error("cannot select from db_shards table: {}", exc.what());
     }
 
     return shards;
@@ -417,27 +591,34 @@ RetCode CassandraDriver::init_features_table_for_db(const std::string& db_id) {
         return RetCode::RET_ERR;
     }
 
+    // prepare statements of the db once, at Init or CreateDB, rather than on first features.
+    try {
+        std::lock_guard<std::mutex> l(_statements_mu);
+        statement(insert_feature_sql(db_id));
+        statement(delete_feature_sql(db_id));
+        statement(scan_features_sql(db_id));
+        statement(count_features_sql(db_id));
+    } catch (std::exception& exc) {
+        spdlog::error("cannot prepare statements of features_db_{}, exc: {}", db_id, exc.what());
+        return RetCode::RET_ERR;
+    }
+
     return RetCode::RET_OK;
 };
 
 RetCode CassandraDriver::delete_features_from_db(const std::string& db_id,
                                                  const std::vector<std::string>& feature_ids) {
     try {
-        std::string sql = "delete from features_db_{} where feature_id in (? ";
-        sql = format(sql, replace_underscore_for_uuid(db_id));
-
-        for (size_t i = 1; i < feature_ids.size(); i++) {
-            sql += ",? ";
+        std::lock_guard<std::mutex> l(_statements_mu);
+        SQLite::Transaction transaction(*db);
+        SQLite::Statement& query = statement(delete_feature_sql(db_id));
+        for (auto& feature_id : feature_ids) {
+            query.reset();
+            query.bind(1, feature_id);
+            query.exec();
         }
-        sql += ")";
-
-        SQLite::Statement query(*db, sql);
-
-        for (size_t i = 0; i < feature_ids.size(); i++) {
-            query.bind(i + 1, feature_ids[i]);
-        }
-
-        query.exec();
+        query.reset();
+        transaction.commit();
     } catch (std::exception& exc) {
         spdlog::error("cannot delete from features table: {}", exc.what());
         return RetCode::RET_ERR;
@@ -482,32 +663,59 @@ std::vector<FeatureDbItem> CassandraDriver::list_features_from_db(const std::str
     return feature_ids;
 };
 
+std::vector<FeatureDbItem> CassandraDriver::list_features_from_db(const std::string& db_id,
+                                                                  PagingState& state, int limit) {
+    std::vector<FeatureDbItem> feature_ids;
+
+    try {
+        // rows are listed by primary key, from right after the last page.
+        std::lock_guard<std::mutex> l(_statements_mu);
+        SQLite::Statement& query = statement(scan_features_sql(db_id));
+        query.bind(1, state.last_id);
+        query.bind(2, limit);
+
+        while (query.executeStep()) {
+            state.last_id = query.getColumn(0).getInt64();
+            std::string feature_id = query.getColumn(1).getString();
+            std::string meta_str = query.getColumn(2).getText();
+
+            json j(json::parse(meta_str));
+            std::map<std::string, std::string> meta_map = j;
+
+            feature_ids.push_back(FeatureDbItem{
+                .feature_id = feature_id,
+                .metadata = meta_map,
+            });
+        }
+        query.reset();
+    } catch (std::exception& exc) {
+        spdlog::error("cannot select from features table: {}", exc.what());
+        return feature_ids;
+    }
+
+    state.done = feature_ids.size() < size_t(limit);
+    return feature_ids;
+};
+
 RetCode CassandraDriver::insert_features_into_db(const std::string& db_id,
                                                  const std::vector<std::string>& feature_ids,
                                                  const std::vector<std::string>& metadatas) {
-    // TODO: batch control
     try {
         int version = 10000; // FIXME
-        std::string sql(
-            "insert into features_db_{}(feature_id, metadata, version) values (?, ?, ?)");
-        sql = format(sql, replace_underscore_for_uuid(db_id));
-
-        for (size_t i = 1; i < feature_ids.size(); i++) {
-            sql += ", (?, ?, ?)";
-        }
-        sql += ";";
 
-        SQLite::Statement query(*db, sql);
+        // one transaction a batch, sqlite commits to disk once rather than once a row.
+        std::lock_guard<std::mutex> l(_statements_mu);
+        SQLite::Transaction transaction(*db);
+        SQLite::Statement& query = statement(insert_feature_sql(db_id));
         for (size_t i = 0; i < feature_ids.size(); i++) {
-            auto feature_id = feature_ids[i];
-            auto metadata = metadatas[i];
-
-            query.bind(3 * i + 1, feature_id);
-            query.bind(3 * i + 2, metadata);
-            query.bind(3 * i + 3, version);
+            query.reset();
+            query.bind(1, feature_ids[i]);
+            query.bind(2, metadatas[i]);
+            query.bind(3, version);
+            query.exec();
         }
-
-        query.exec();
+        query.reset();
+        transaction.commit();
     } catch (std::exception& exc) {
         spdlog::error("cannot insert into features table: {}", exc.what());
         return RetCode::RET_ERR;
@@ -520,15 +728,11 @@ uint64 CassandraDriver::count_features_in_db(const std::string& db_id) {
     int count;
 
     try {
-        std::string sql("select count(*) from features_db_{};");
-        sql = format(sql, replace_underscore_for_uuid(db_id));
-
-        spdlog::debug("sql: {}", sql);
-
-        SQLite::Statement query(*db, sql);
-
+        std::lock_guard<std::mutex> l(_statements_mu);
+        SQLite::Statement& query = statement(count_features_sql(db_id));
         query.executeStep();
         count = query.getColumn(0);
+        query.reset();
     } catch (std::exception& exc) {
         spdlog::error("cannot count from features table: {}", exc.what());
         return -1;
@@ -27,6 +27,10 @@ void Coordinator::ProbeWorkers(const WorkerFactory& factory) {
     return pimpl->ProbeWorkers(factory);
 };
 
+void Coordinator::ReportHeartbeat(const std::string& worker_id) {
+    return pimpl->ReportHeartbeat(worker_id);
+};
+
 std::vector<DBItem> Coordinator::ListUserDBs() { return pimpl->ListUserDBs(); };
 
 // AddFeatures to this db, we need find proper shard to store these fts.
@@ -47,4 +51,6 @@ std::vector<FeatureSearchItem> Coordinator::SearchFeature(const std::string& db_
     return pimpl->SearchFeature(db_id, query, topk);
 };
 
+QueryCacheStats Coordinator::GetQueryCacheStats() { return pimpl->GetQueryCacheStats(); };
+
 } // namespace donde_toolkits::feature_search::search_manager
@@ -38,32 +38,42 @@ CoordinatorImpl::CoordinatorImpl(const json& coor_config) : config(coor_config)
 
     _driver = std::make_shared<SimpleDriver>((std::string)coor_config["cassandra"]["addr"]);
     _shard_factory = std::make_shared<ShardFactoryImpl>();
-    _shard_manager = std::make_shared<ShardManagerImpl>(*_driver, *_shard_factory);
+    // "rollover": {"max_vectors": 1000000, "max_bytes": 2147483648, "max_age_ms": 86400000}
+    ShardRolloverOptions rollover;
+    if (coor_config.contains("rollover")) {
+        rollover = ShardManagerImpl::ParseRolloverOptions(coor_config["rollover"]);
+    }
+    _shard_manager = std::make_shared<ShardManagerImpl>(*_driver, *_shard_factory, rollover);
 
     // TODO, how to set worker factory & manager?
     // _worker_factory = std::make_shared<WorkerFactory>();
-    _worker_manager = std::make_shared<WorkerManagerImpl>(*_driver);
-
-    // check worker_maanger is ready in the background.
-    std::thread([&]() mutable {
-        while (true) {
-            auto workers = _worker_manager->ListWorkers(true);
-            bool all_ready = true;
-            for (const auto& w : workers) {
-                if (!w->Ready()) {
-                    all_ready = false;
-                    break;
-                }
-            }
-            if (all_ready) {
-                std::cout << "worker manager is ready!" << std::endl;
-                _worker_manager_ready.store(true);
-                return;
-            }
-            std::cout << "worker manager still no ready..." << std::endl;
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-        }
-    }).detach();
+    // "placement": {"qps_weight": 1.0, ..., "rebalance": true, "rebalance_interval_ms": 60000}
+    if (coor_config.contains("placement")) {
+        _placement = PlacementPolicy::ParseOptions(coor_config["placement"]);
+    }
+    // "health": {"probe_interval_ms": 5000, "suspect_after_ms": 10000, ...}
+    WorkerHealthOptions health;
+    if (coor_config.contains("health")) {
+        health = WorkerManagerImpl::ParseHealthOptions(coor_config["health"]);
+    }
+    _worker_manager = std::make_shared<WorkerManagerImpl>(*_driver, _placement, health);
+
+    // each new shard is served by this many workers.
+    _replicas = coor_config.value("replicas", 1);
+    if (_replicas < 1) {
+        throw "json config replicas must be at least 1.";
+    }
+
+    // "query_cache": {"enabled": true, "max_entries": 10000, "ttl_ms": 5000, ...}
+    if (coor_config.contains("query_cache") && coor_config["query_cache"].value("enabled", false)) {
+        _query_cache
+            = std::make_unique<QueryCache>(QueryCache::ParseOptions(coor_config["query_cache"]));
+    }
+
+    // react to worker state changes, instead of polling.
+    _worker_manager->SubscribeWorkerState([this](Worker* worker, WorkerState from, WorkerState to) {
+        on_worker_state_changed(worker, from, to);
+    });
 };
 
 CoordinatorImpl::~CoordinatorImpl(){};
@@ -71,14 +81,46 @@ CoordinatorImpl::~CoordinatorImpl(){};
 void CoordinatorImpl::Start() {
     load_user_dbs();
     load_known_shards();
+
+    if (_placement.rebalance) {
+        _rebalance_stopped.store(false);
+        _rebalance_thread = std::thread(&CoordinatorImpl::rebalance_loop, std::ref(*this));
+    }
 };
 
-void CoordinatorImpl::Stop() { deinitialize_workers(); };
+void CoordinatorImpl::Stop() {
+    _rebalance_stopped.store(true);
+    if (_rebalance_thread.joinable()) {
+        _rebalance_thread.join();
+    }
+    deinitialize_workers();
+};
 
 void CoordinatorImpl::ProbeWorkers(const WorkerFactory& factory) {
     _worker_manager->StartProbeWorkersInBackground(factory);
 };
 
+void CoordinatorImpl::ReportHeartbeat(const std::string& worker_id) {
+    _worker_manager->ReportHeartbeat(worker_id);
+};
+
+void CoordinatorImpl::deinitialize_workers() {
+    _worker_manager->Stop();
+
+    // shards keep raw pointers of workers, drop them before workers are freed.
+    for (auto& db : list_db_items()) {
+        std::vector<Shard*> shards;
+        try {
+            shards = _shard_manager->ListShards(db.db_id);
+        } catch (const char* exc) {
+            continue;
+        }
+        for (auto shard : shards) {
+            shard->DetachWorkers();
+        }
+    }
+};
+
 std::vector<DBItem> CoordinatorImpl::ListUserDBs() { return {}; };
 
 // AddFeatures to this db, we need find proper shard to store these fts.
@@ -86,29 +128,56 @@ std::vector<std::string> CoordinatorImpl::AddFeatures(const std::string& db_id,
                                                       const std::vector<Feature>& fts) {
     auto [shard, new_created] = _shard_manager->FindOrCreateWritableShard(db_id, fts.size());
 
-    // if newly created shard, it doesn't have a worker.
-    if (new_created) {
-        Worker* worker = _worker_manager->FindWritableWorker();
-        if (worker == nullptr) {
+    // if newly created shard, it doesn't have a worker, neither does one which found no
+    // writable worker last time.
+    if (new_created || !shard->HasWorker()) {
+        auto workers = _worker_manager->FindWritableWorkers(_replicas);
+        if (workers.empty()) {
             spdlog::error("cannot find a worker for shard: {}", shard->GetShardID());
             return {};
         }
-        worker->ServeShard(*shard);
+        if (workers.size() < _replicas) {
+            spdlog::warn("shard {} wants {} replicas, but only {} workers are writable.",
+                         shard->GetShardID(), _replicas, workers.size());
+        }
+        // bidirectional bound.
+        for (auto worker : workers) {
+            worker->ServeShard(*shard);
+            shard->AssignWorker(worker);
+        }
     }
 
-    return shard->AddFeatures(fts);
+    auto feature_ids = shard->AddFeatures(fts);
+    if (_query_cache) {
+        _query_cache->Invalidate(db_id);
+    }
+    return feature_ids;
 };
 
 // RemoveFeatures from this db
 RetCode CoordinatorImpl::RemoveFeatures(const std::string& db_id,
                                         const std::vector<std::string>& feature_ids) {
     // TODO
+    if (_query_cache) {
+        _query_cache->Invalidate(db_id);
+    }
     return RetCode::RET_OK;
 };
 
 // SearchFeatures in this db. delegate to shards.
 std::vector<FeatureSearchItem> CoordinatorImpl::SearchFeature(const std::string& db_id,
                                                               const Feature& query, int topk) {
+    std::vector<FeatureSearchItem> ret;
+
+    // read generation before fan out, so that adds during the search keep this result uncached.
+    uint64 generation = 0;
+    if (_query_cache) {
+        if (_query_cache->Lookup(db_id, query, topk, ret)) {
+            return ret;
+        }
+        generation = _query_cache->Generation(db_id);
+    }
+
     // enlarge search area
     int enlarge_topk = topk * 2;
 
@@ -124,44 +193,163 @@ std::vector<FeatureSearchItem> CoordinatorImpl::SearchFeature(const std::string&
         rank.FeedIn(searched);
     }
 
-    std::vector<FeatureSearchItem> ret = rank.SortOut();
+    ret = rank.SortOut();
+
+    if (_query_cache) {
+        _query_cache->Insert(db_id, query, topk, generation, ret);
+    }
 
     return ret;
 };
 
-void CoordinatorImpl::load_user_dbs() { _db_items = _driver->ListDBs(); }
+QueryCacheStats CoordinatorImpl::GetQueryCacheStats() {
+    if (!_query_cache) {
+        return {};
+    }
+    return _query_cache->GetStats();
+};
+
+void CoordinatorImpl::rebalance_loop() {
+    auto interval = std::chrono::milliseconds(_placement.rebalance_interval_ms);
+    auto next = std::chrono::steady_clock::now() + interval;
 
-void CoordinatorImpl::load_known_shards() {
-    std::vector<Shard*> known_shards;
-    for (auto& db : _db_items) {
-        auto shards = _shard_manager->ListShards(db.db_id);
-        known_shards.insert(known_shards.end(), shards.begin(), shards.end());
-    }
-
-    // start a new thread to check.
-    // note we capture the vector by reference.
-    std::thread async_check_known_shards([&]() mutable {
-        for (auto it = known_shards.begin(); it != known_shards.end(); it++) {
-            auto shard = *it;
-            Worker* worker = _worker_manager->GetWorkerByID(shard->GetShardInfo().worker_id);
-            if (worker == nullptr) {
-                spdlog::error("cannot find a worker for shard: {}", shard->GetShardID());
+    while (!_rebalance_stopped.load()) {
+        // sleep in small steps, so Stop is not blocked for a whole interval.
+        if (std::chrono::steady_clock::now() < next) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        rebalance_once();
+        next = std::chrono::steady_clock::now() + interval;
+    }
+};
+
+void CoordinatorImpl::rebalance_once() {
+    auto [hot, cool] = _worker_manager->FindRebalancePair();
+    if (hot == nullptr || cool == nullptr) {
+        return;
+    }
+
+    std::string hot_id = hot->GetWorkerID();
+    std::string cool_id = cool->GetWorkerID();
+
+    // move the biggest shard on the hot worker, it's most likely the one taking the load,
+    // e.g. a fast growing db.
+    Shard* candidate = nullptr;
+    uint64 most_used = 0;
+    for (auto& db : list_db_items()) {
+        std::vector<Shard*> shards;
+        try {
+            shards = _shard_manager->ListShards(db.db_id);
+        } catch (const char* exc) {
+            continue;
+        }
+        for (auto shard : shards) {
+            auto info = shard->GetShardInfo();
+            auto& ids = info.replica_worker_ids;
+            if (std::find(ids.begin(), ids.end(), hot_id) == ids.end()
+                || std::find(ids.begin(), ids.end(), cool_id) != ids.end()) {
                 continue;
             }
-            if (!worker->Ready()) {
-                spdlog::error("worker: {} addr: {} is not ready.", worker->GetWorkerID(),
-                              worker->GetAddress());
-                continue;
+            if (candidate == nullptr || info.used > most_used) {
+                candidate = shard;
+                most_used = info.used;
             }
-            // bidirectional bound.
-            worker->ServeShard(*shard);
-            shard->AssignWorker(worker);
-            known_shards.erase(it);
         }
-    });
-    // as the operation is not heavy loaded, just detach it, let it running foever
-    // (it will stop by itself.)
-    async_check_known_shards.detach();
+    }
+
+    if (candidate == nullptr) {
+        return;
+    }
+
+    spdlog::info("worker {} is hot, migrate shard {} to worker {}.", hot_id,
+                 candidate->GetShardID(), cool_id);
+    if (candidate->MigrateReplica(hot, cool) != RetCode::RET_OK) {
+        spdlog::error("migrate shard {} failed.", candidate->GetShardID());
+    }
+};
+
+void CoordinatorImpl::load_user_dbs() {
+    auto db_items = _driver->ListDBs();
+    std::lock_guard<std::mutex> l(_db_mu);
+    _db_items.swap(db_items);
+};
+
+std::vector<DBItem> CoordinatorImpl::list_db_items() {
+    std::lock_guard<std::mutex> l(_db_mu);
+    return _db_items;
+};
+
+void CoordinatorImpl::load_known_shards() {
+    std::vector<std::tuple<Worker*, Shard*>> to_assign;
+    auto db_items = list_db_items();
+    {
+        std::lock_guard<std::mutex> l(_pending_mu);
+        for (auto& db : db_items) {
+            for (auto shard : _shard_manager->ListShards(db.db_id)) {
+                auto shard_info = shard->GetShardInfo();
+                auto worker_ids = shard_info.replica_worker_ids;
+                if (worker_ids.empty()) {
+                    worker_ids.push_back(shard_info.worker_id);
+                }
+                // worker state is checked under _pending_mu, so a worker coming online right
+                // now either is seen here or picks the shard from _pending_shards.
+                for (const auto& worker_id : worker_ids) {
+                    Worker* worker = _worker_manager->GetWorkerByID(worker_id);
+                    if (worker != nullptr
+                        && _worker_manager->GetWorkerState(worker_id) == WORKER_ONLINE) {
+                        to_assign.push_back({worker, shard});
+                    } else {
+                        _pending_shards[worker_id].push_back(shard);
+                    }
+                }
+            }
+        }
+    }
+
+    for (auto& [worker, shard] : to_assign) {
+        assign_shard(worker, shard);
+    }
+};
+
+void CoordinatorImpl::assign_shard(Worker* worker, Shard* shard) {
+    // bidirectional bound.
+    if (worker->ServeShard(*shard) != RetCode::RET_OK) {
+        spdlog::error("worker: {} addr: {} cannot serve shard: {}", worker->GetWorkerID(),
+                      worker->GetAddress(), shard->GetShardID());
+        return;
+    }
+    shard->AssignWorker(worker);
+};
+
+void CoordinatorImpl::on_worker_state_changed(Worker* worker, WorkerState from, WorkerState to) {
+    if (to == WORKER_OFFLINE) {
+        spdlog::warn("worker: {} is offline.", worker ? worker->GetWorkerID() : "");
+    }
+
+    if (to == WORKER_ONLINE && worker != nullptr) {
+        // assign shards which are waiting for this worker immediately.
+        std::vector<Shard*> shards;
+        {
+            std::lock_guard<std::mutex> l(_pending_mu);
+            auto found = _pending_shards.find(worker->GetWorkerID());
+            if (found != _pending_shards.end()) {
+                shards.swap(found->second);
+                _pending_shards.erase(found);
+            }
+        }
+        for (auto shard : shards) {
+            assign_shard(worker, shard);
+        }
+    }
+
+    // ready once every known worker has come online.
+    auto states = _worker_manager->ListWorkerStates();
+    bool all_ready = std::all_of(states.begin(), states.end(),
+                                 [](const auto& it) { return it.second == WORKER_ONLINE; });
+    if (all_ready && !_worker_manager_ready.exchange(true)) {
+        spdlog::info("worker manager is ready!");
+    }
 };
 
 } // namespace donde_toolkits::feature_search::search_manager
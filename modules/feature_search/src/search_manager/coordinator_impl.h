@@ -6,6 +6,8 @@
 #include "donde/feature_search/search_manager/worker_manager.h"
 #include "donde/feature_search/shard.h"
 #include "donde/feature_search/worker.h"
+#include "placement.h"
+#include "query_cache.h"
 #include "shard_factory.h"
 
 // #include "spdlog/spdlog.h"
@@ -14,6 +16,7 @@
 #include <atomic>
 #include <cstdio>
 #include <iostream>
+#include <mutex>
 #include <thread>
 #include <unordered_map>
 
@@ -39,6 +42,9 @@ class CoordinatorImpl : public ICoordinator {
     // User must call this method to build connections with known  workers.
     void ProbeWorkers(const WorkerFactory& factory) override;
 
+    // ReportHeartbeat from worker, keeps it online, or brings it online quickly.
+    void ReportHeartbeat(const std::string& worker_id) override;
+
     // std::vector<WorkerPtr> ListWorkers();
 
     std::vector<DBItem> ListUserDBs() override;
@@ -55,17 +61,31 @@ class CoordinatorImpl : public ICoordinator {
     std::vector<FeatureSearchItem> SearchFeature(const std::string& db_id, const Feature& query,
                                                  int topk) override;
 
+    QueryCacheStats GetQueryCacheStats() override;
+
   private:
     void initialize_workers();
     void deinitialize_workers();
     void load_known_shards();
 
+    void assign_shard(Worker* worker, Shard* shard);
+
+    void on_worker_state_changed(Worker* worker, WorkerState from, WorkerState to);
+
     void load_user_dbs();
+    // a copy of _db_items, taken under _db_mu.
+    std::vector<DBItem> list_db_items();
+
+    // rebalance_loop periodically moves one shard off the hottest worker.
+    void rebalance_loop();
+    void rebalance_once();
 
   private:
     const json& config;
 
+    // _db_items is read by the rebalance thread, guarded by _db_mu.
     std::vector<DBItem> _db_items;
+    std::mutex _db_mu;
 
     std::vector<std::string> _worker_addrs;
     std::vector<std::string> _invalid_worker_addrs;
@@ -83,6 +103,20 @@ class CoordinatorImpl : public ICoordinator {
     std::shared_ptr<IWorkerManager> _worker_manager;
     std::atomic<bool> _worker_manager_ready = false;
 
+    // worker id -> known shards waiting for that worker to come online.
+    std::unordered_map<std::string, std::vector<Shard*>> _pending_shards;
+    std::mutex _pending_mu;
+
+    // replicas per shard, from config "replicas".
+    size_t _replicas = 1;
+
+    PlacementOptions _placement;
+    std::thread _rebalance_thread;
+    std::atomic<bool> _rebalance_stopped = true;
+
+    // optional, nullptr if "query_cache" is not enabled in config.
+    std::unique_ptr<QueryCache> _query_cache;
+
     // spdlog::Logger& logger;
 };
 
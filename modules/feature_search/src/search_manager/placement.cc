@@ -0,0 +1,121 @@
+#include "placement.h"
+
+#include "donde/feature_search/definitions.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace donde_toolkits ::feature_search ::search_manager {
+
+namespace {
+
+inline double ratio(double value, double peak) { return peak > 0 ? value / peak : 0; }
+
+} // namespace
+
+PlacementPolicy::PlacementPolicy(const PlacementOptions& opts) : _opts(opts){};
+
+PlacementOptions PlacementPolicy::ParseOptions(const json& conf) {
+    PlacementOptions opts;
+    opts.qps_weight = conf.value("qps_weight", opts.qps_weight);
+    opts.scan_weight = conf.value("scan_weight", opts.scan_weight);
+    opts.rss_weight = conf.value("rss_weight", opts.rss_weight);
+    opts.p99_weight = conf.value("p99_weight", opts.p99_weight);
+    opts.hot_ratio = conf.value("hot_ratio", opts.hot_ratio);
+    opts.min_hot_pressure = conf.value("min_hot_pressure", opts.min_hot_pressure);
+    opts.rebalance = conf.value("rebalance", opts.rebalance);
+    opts.rebalance_interval_ms = conf.value("rebalance_interval_ms", opts.rebalance_interval_ms);
+    return opts;
+};
+
+std::vector<double> PlacementPolicy::Pressures(const std::vector<WorkerLoad>& loads) {
+    WorkerLoad peak{};
+    for (const auto& load : loads) {
+        if (!load.reported) {
+            continue;
+        }
+        peak.qps = std::max(peak.qps, load.qps);
+        peak.scan_bytes_per_sec = std::max(peak.scan_bytes_per_sec, load.scan_bytes_per_sec);
+        peak.rss_bytes = std::max(peak.rss_bytes, load.rss_bytes);
+        peak.p99_latency_ms = std::max(peak.p99_latency_ms, load.p99_latency_ms);
+    }
+
+    double total_weight = _opts.qps_weight + _opts.scan_weight + _opts.rss_weight + _opts.p99_weight;
+    if (total_weight <= 0) {
+        total_weight = 1;
+    }
+
+    std::vector<double> ret;
+    for (const auto& load : loads) {
+        if (!load.reported) {
+            ret.push_back(0);
+            continue;
+        }
+        double pressure = _opts.qps_weight * ratio(load.qps, peak.qps)
+                          + _opts.scan_weight
+                                * ratio(load.scan_bytes_per_sec, peak.scan_bytes_per_sec)
+                          + _opts.rss_weight * ratio(load.rss_bytes, peak.rss_bytes)
+                          + _opts.p99_weight * ratio(load.p99_latency_ms, peak.p99_latency_ms);
+        ret.push_back(pressure / total_weight);
+    }
+    return ret;
+};
+
+std::vector<size_t> PlacementPolicy::Rank(const std::vector<WorkerLoad>& loads) {
+    auto pressures = Pressures(loads);
+
+    std::vector<size_t> ret, unreported;
+    for (size_t i = 0; i < loads.size(); i++) {
+        if (!loads[i].reported) {
+            unreported.push_back(i);
+        } else if (loads[i].free_space > 0) {
+            ret.push_back(i);
+        }
+    }
+
+    // less pressure first, then more free space.
+    std::stable_sort(ret.begin(), ret.end(), [&](size_t lhs, size_t rhs) {
+        if (pressures[lhs] != pressures[rhs]) {
+            return pressures[lhs] < pressures[rhs];
+        }
+        return loads[lhs].free_space > loads[rhs].free_space;
+    });
+
+    // not known to be full either, but nothing tells which of them is better.
+    ret.insert(ret.end(), unreported.begin(), unreported.end());
+    return ret;
+};
+
+std::tuple<int, int> PlacementPolicy::FindRebalancePair(const std::vector<WorkerLoad>& loads) {
+    // an unreported worker looks idle, moving shards onto it, or off it, would be a guess.
+    std::vector<WorkerLoad> reported;
+    std::vector<int> index;
+    for (size_t i = 0; i < loads.size(); i++) {
+        if (loads[i].reported) {
+            reported.push_back(loads[i]);
+            index.push_back(i);
+        }
+    }
+    if (reported.size() < 2) {
+        return {-1, -1};
+    }
+
+    auto pressures = Pressures(reported);
+    double avg = std::accumulate(pressures.begin(), pressures.end(), 0.0) / pressures.size();
+
+    int hot = std::max_element(pressures.begin(), pressures.end()) - pressures.begin();
+    if (pressures[hot] < _opts.min_hot_pressure || pressures[hot] <= avg * _opts.hot_ratio) {
+        return {-1, -1};
+    }
+
+    // coolest worker which can still take a shard.
+    auto ranked = Rank(reported);
+    for (auto idx : ranked) {
+        if ((int)idx != hot && pressures[idx] < avg) {
+            return {index[hot], index[idx]};
+        }
+    }
+    return {-1, -1};
+};
+
+} // namespace donde_toolkits::feature_search::search_manager
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "donde/definitions.h"
+#include "donde/feature_search/definitions.h"
+#include "nlohmann/json.hpp"
+
+#include <tuple>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace donde_toolkits ::feature_search ::search_manager {
+
+struct PlacementOptions {
+    // weights of each telemetry when computing worker pressure.
+    double qps_weight = 1.0;
+    double scan_weight = 1.0;
+    double rss_weight = 0.5;
+    double p99_weight = 1.0;
+
+    // a worker is hot when its pressure is above cluster average * hot_ratio,
+    double hot_ratio = 1.5;
+    // and above this floor, so an idle cluster is not shuffled around.
+    double min_hot_pressure = 0.3;
+
+    // rebalancer migrates at most one shard per interval.
+    bool rebalance = false;
+    int64 rebalance_interval_ms = 60 * 1000;
+};
+
+// PlacementPolicy scores workers by their reported WorkerLoad.
+//
+// Each metric is normalized by the max in the cluster, then weighted into a pressure in
+// [0, 1], new shards go to the least pressured workers which still have free space.
+// Workers which do not report telemetry are only placed on after those which do, and never
+// take part in rebalancing.
+class PlacementPolicy {
+  public:
+    PlacementPolicy(const PlacementOptions& opts = {});
+
+    // ParseOptions from json config, missing fields keep default values.
+    //   {"qps_weight": 1.0, "hot_ratio": 1.5, "rebalance": true, "rebalance_interval_ms": 60000}
+    static PlacementOptions ParseOptions(const json& conf);
+
+    inline const PlacementOptions& GetOptions() { return _opts; };
+
+    // Pressure of each worker, in the same order as loads, 0 for those not reported.
+    std::vector<double> Pressures(const std::vector<WorkerLoad>& loads);
+
+    // Rank worker indices for placing a new shard, best first, full workers are excluded, and
+    // those not reported come last in their order.
+    std::vector<size_t> Rank(const std::vector<WorkerLoad>& loads);
+
+    // FindRebalancePair find the hottest worker and the coolest one to move a shard to among
+    // reported ones, returns {-1, -1} if cluster is balanced.
+    std::tuple<int, int> FindRebalancePair(const std::vector<WorkerLoad>& loads);
+
+  private:
+    PlacementOptions _opts;
+};
+
+} // namespace donde_toolkits::feature_search::search_manager
@@ -0,0 +1,184 @@
+#include "query_cache.h"
+
+#include "donde/definitions.h"
+#include "donde/feature_search/definitions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <spdlog/spdlog.h>
+
+namespace donde_toolkits ::feature_search ::search_manager {
+
+namespace {
+
+// FNV-1a
+inline size_t hash_bytes(size_t seed, const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < len; i++) {
+        seed ^= p[i];
+        seed *= 1099511628211ULL;
+    }
+    return seed;
+}
+
+// approximate memory held by search results.
+inline size_t estimate_bytes(const std::vector<FeatureSearchItem>& items) {
+    size_t bytes = sizeof(FeatureSearchItem) * items.size();
+    for (const auto& item : items) {
+        bytes += item.target.raw.size() * sizeof(float) + item.target.model.size();
+    }
+    return bytes;
+}
+
+} // namespace
+
+QueryCache::QueryCache(const QueryCacheOptions& opts) : _opts(opts) {
+    if (_opts.quantize_step <= 0) {
+        spdlog::warn("query cache quantize_step {} is invalid, use default.", _opts.quantize_step);
+        _opts.quantize_step = QueryCacheOptions{}.quantize_step;
+    }
+};
+
+QueryCacheOptions QueryCache::ParseOptions(const json& conf) {
+    QueryCacheOptions opts;
+    if (conf.contains("max_entries")) {
+        opts.max_entries = conf["max_entries"];
+    }
+    if (conf.contains("max_bytes")) {
+        opts.max_bytes = conf["max_bytes"];
+    }
+    if (conf.contains("ttl_ms")) {
+        opts.ttl_ms = conf["ttl_ms"];
+    }
+    if (conf.contains("quantize_step")) {
+        opts.quantize_step = conf["quantize_step"];
+    }
+    return opts;
+};
+
+uint64 QueryCache::Generation(const std::string& db_id) {
+    std::lock_guard<std::mutex> l(_mu);
+    return _generations[db_id];
+};
+
+bool QueryCache::Lookup(const std::string& db_id, const Feature& query, int topk,
+                        std::vector<FeatureSearchItem>& result) {
+    CacheKey key = make_key(db_id, query, topk);
+
+    std::lock_guard<std::mutex> l(_mu);
+
+    auto found = _index.find(key);
+    if (found == _index.end()) {
+        _stats.misses++;
+        return false;
+    }
+
+    auto it = found->second;
+    if (it->generation != _generations[db_id]
+        || it->expire_at < std::chrono::steady_clock::now()) {
+        // stale, drop it now rather than waiting for lru eviction.
+        erase_entry(it);
+        _stats.misses++;
+        return false;
+    }
+
+    // move to front, most recently used.
+    _lru.splice(_lru.begin(), _lru, it);
+
+    result = it->items;
+    _stats.hits++;
+    return true;
+};
+
+void QueryCache::Insert(const std::string& db_id, const Feature& query, int topk,
+                        uint64 generation, const std::vector<FeatureSearchItem>& result) {
+    CacheKey key = make_key(db_id, query, topk);
+    size_t bytes = estimate_bytes(result) + key.codes.size() * sizeof(int16_t);
+
+    if (bytes > _opts.max_bytes) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> l(_mu);
+
+    // db changed while we were searching, the result may already be outdated.
+    if (generation != _generations[db_id]) {
+        return;
+    }
+
+    auto found = _index.find(key);
+    if (found != _index.end()) {
+        erase_entry(found->second);
+    }
+
+    _lru.push_front(CacheEntry{
+        .key = key,
+        .generation = generation,
+        .expire_at = std::chrono::steady_clock::now() + std::chrono::milliseconds(_opts.ttl_ms),
+        .items = result,
+        .bytes = bytes,
+    });
+    _index.insert({key, _lru.begin()});
+    _bytes += bytes;
+
+    evict_if_needed();
+};
+
+void QueryCache::Invalidate(const std::string& db_id) {
+    std::lock_guard<std::mutex> l(_mu);
+    // stale entries are lazily dropped by Lookup or evicted by lru.
+    _generations[db_id]++;
+    _stats.invalidations++;
+};
+
+QueryCacheStats QueryCache::GetStats() {
+    std::lock_guard<std::mutex> l(_mu);
+    QueryCacheStats stats = _stats;
+    stats.entries = _lru.size();
+    stats.bytes = _bytes;
+    return stats;
+};
+
+QueryCache::CacheKey QueryCache::make_key(const std::string& db_id, const Feature& query,
+                                          int topk) const {
+    CacheKey key{.db_id = db_id, .topk = topk, .codes = {}, .hash = 0};
+
+    const std::vector<float> norm = query.normalize(query.raw);
+    const float lo = std::numeric_limits<int16_t>::min();
+    const float hi = std::numeric_limits<int16_t>::max();
+
+    key.codes.resize(norm.size());
+    for (size_t i = 0; i < norm.size(); i++) {
+        float v = std::nearbyint(norm[i] / _opts.quantize_step);
+        // zero-length query gets NaN after normalize.
+        if (std::isnan(v)) {
+            v = 0;
+        }
+        key.codes[i] = static_cast<int16_t>(std::clamp(v, lo, hi));
+    }
+
+    size_t h = 14695981039346656037ULL;
+    h = hash_bytes(h, db_id.data(), db_id.size());
+    h = hash_bytes(h, &topk, sizeof(topk));
+    h = hash_bytes(h, key.codes.data(), key.codes.size() * sizeof(int16_t));
+    key.hash = h;
+
+    return key;
+};
+
+void QueryCache::erase_entry(EntryList::iterator it) {
+    _bytes -= it->bytes;
+    _index.erase(it->key);
+    _lru.erase(it);
+};
+
+void QueryCache::evict_if_needed() {
+    while (!_lru.empty() && (_lru.size() > _opts.max_entries || _bytes > _opts.max_bytes)) {
+        erase_entry(std::prev(_lru.end()));
+        _stats.evictions++;
+    }
+};
+
+} // namespace donde_toolkits::feature_search::search_manager
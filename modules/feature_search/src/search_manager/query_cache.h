@@ -0,0 +1,106 @@
+#pragma once
+
+#include "donde/definitions.h"
+#include "donde/feature_search/definitions.h"
+#include "nlohmann/json.hpp"
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace donde_toolkits ::feature_search ::search_manager {
+
+struct QueryCacheOptions {
+    // max cached queries, lru entry is evicted when exceeded.
+    size_t max_entries = 10000;
+    // memory cap for cached results (approximately, counted by feature floats).
+    size_t max_bytes = 64 * 1024 * 1024;
+    // entries older than ttl are treated as miss.
+    int64 ttl_ms = 5000;
+    // normalized query is rounded to multiples of this step before hashing,
+    // so that the same face seen by several cameras hits the same entry.
+    float quantize_step = 1.0f / 128;
+};
+
+// QueryCache caches SearchFeature results in coordinator, keyed by
+// (db_id, topk, quantized normalized query).
+//
+// Each db has a generation counter, AddFeatures/RemoveFeatures on the db bump it, and entries
+// created under an older generation are dropped on lookup.
+class QueryCache {
+  public:
+    QueryCache(const QueryCacheOptions& opts);
+    ~QueryCache() = default;
+
+    // ParseOptions from json config, missing fields keep default values.
+    //   {"max_entries": 10000, "max_bytes": 67108864, "ttl_ms": 5000, "quantize_step": 0.0078}
+    static QueryCacheOptions ParseOptions(const json& conf);
+
+    // Generation of this db, caller should read it before searching shards, and pass it to
+    // Insert, so that results searched before an invalidation will not be cached.
+    uint64 Generation(const std::string& db_id);
+
+    bool Lookup(const std::string& db_id, const Feature& query, int topk,
+                std::vector<FeatureSearchItem>& result);
+
+    void Insert(const std::string& db_id, const Feature& query, int topk, uint64 generation,
+                const std::vector<FeatureSearchItem>& result);
+
+    // Invalidate all cached queries of this db.
+    void Invalidate(const std::string& db_id);
+
+    QueryCacheStats GetStats();
+
+  private:
+    struct CacheKey {
+        std::string db_id;
+        int topk;
+        std::vector<int16_t> codes;
+        size_t hash;
+
+        bool operator==(const CacheKey& other) const {
+            return hash == other.hash && topk == other.topk && db_id == other.db_id
+                   && codes == other.codes;
+        };
+    };
+
+    struct CacheKeyHash {
+        size_t operator()(const CacheKey& key) const { return key.hash; };
+    };
+
+    struct CacheEntry {
+        CacheKey key;
+        uint64 generation;
+        std::chrono::steady_clock::time_point expire_at;
+        std::vector<FeatureSearchItem> items;
+        size_t bytes;
+    };
+
+    using EntryList = std::list<CacheEntry>;
+
+    CacheKey make_key(const std::string& db_id, const Feature& query, int topk) const;
+
+    // caller must hold _mu.
+    void erase_entry(EntryList::iterator it);
+    void evict_if_needed();
+
+  private:
+    QueryCacheOptions _opts;
+
+    // front is the most recently used.
+    EntryList _lru;
+    std::unordered_map<CacheKey, EntryList::iterator, CacheKeyHash> _index;
+    std::unordered_map<std::string, uint64> _generations;
+
+    size_t _bytes = 0;
+    QueryCacheStats _stats{};
+
+    std::mutex _mu;
+};
+
+} // namespace donde_toolkits::feature_search::search_manager
@@ -16,6 +16,8 @@ bool RemoteWorker::Ready() { return pimpl->Ready(); };
 
 uint64 RemoteWorker::GetFreeSpace() { return pimpl->GetFreeSpace(); };
 
+WorkerLoad RemoteWorker::GetLoad() { return pimpl->GetLoad(); };
+
 // ListShards report all shards this worker is serving.
 std::vector<DBShard> RemoteWorker::ListShards() { return pimpl->ListShards(); };
 
@@ -27,13 +29,25 @@ RetCode RemoteWorker::CloseShard(const std::string& db_id, const std::string& sh
     return pimpl->CloseShard(db_id, shard_id);
 };
 
+// ReleaseShard stop serving db_id/shard_id.
+RetCode RemoteWorker::ReleaseShard(const std::string& db_id, const std::string& shard_id) {
+    return pimpl->ReleaseShard(db_id, shard_id);
+};
+
 // AddFeatures to db_id/shard_id, delegate to remote worker.
 std::vector<std::string> RemoteWorker::AddFeatures(const std::string& db_id,
                                                    const std::string& shard_id,
-                                                   const std::vector<Feature>& fts) {
+                                                   const std::vector<FeatureDbItem>& fts) {
     return pimpl->AddFeatures(db_id, shard_id, fts);
 };
 
+// ListFeatures of db_id/shard_id with their vectors by page.
+PageData<FeatureDbItemList> RemoteWorker::ListFeatures(const std::string& db_id,
+                                                       const std::string& shard_id, uint page,
+                                                       uint perPage) {
+    return pimpl->ListFeatures(db_id, shard_id, page, perPage);
+};
+
 // Search feature in the worker. worker can have multiple dbs, multiple shards.
 // only search in the requested db.
 std::vector<FeatureSearchItem> RemoteWorker::SearchFeature(const std::string& db_id,
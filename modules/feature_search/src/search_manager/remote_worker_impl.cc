@@ -13,6 +13,19 @@ bool RemoteWorkerImpl::Ready() { return false; };
 
 uint64 RemoteWorkerImpl::GetFreeSpace() { return {}; };
 
+// telemetry is not reported over rpc yet, say so rather than report zeros, which placement would
+// take for a full and idle worker.
+WorkerLoad RemoteWorkerImpl::GetLoad() {
+    return WorkerLoad{
+        .qps = 0,
+        .scan_bytes_per_sec = 0,
+        .rss_bytes = 0,
+        .p99_latency_ms = 0,
+        .free_space = 0,
+        .reported = false,
+    };
+};
+
 // ListShards report all shards this worker is serving.
 std::vector<DBShard> RemoteWorkerImpl::ListShards() { return {}; };
 
@@ -24,9 +37,21 @@ RetCode RemoteWorkerImpl::CloseShard(const std::string& db_id, const std::string
     return {};
 };
 
+// ReleaseShard stop serving db_id/shard_id.
+RetCode RemoteWorkerImpl::ReleaseShard(const std::string& db_id, const std::string& shard_id) {
+    return {};
+};
+
 // AddFeatures to db_id/shard_id, delegate to remote worker.
 std::vector<std::string> AddFeatures(const std::string& db_id, const std::string& shard_id,
-                                     const std::vector<Feature>& fts) {
+                                     const std::vector<FeatureDbItem>& fts) {
+    return {};
+};
+
+// ListFeatures of db_id/shard_id with their vectors by page.
+PageData<FeatureDbItemList> RemoteWorkerImpl::ListFeatures(const std::string& db_id,
+                                                           const std::string& shard_id, uint page,
+                                                           uint perPage) {
     return {};
 };
 
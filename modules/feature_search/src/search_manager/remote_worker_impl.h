@@ -17,6 +17,8 @@ class RemoteWorkerImpl : public Worker {
 
     uint64 GetFreeSpace() override;
 
+    WorkerLoad GetLoad() override;
+
     // ListShards report all shards this worker is serving.
     std::vector<DBShard> ListShards() override;
 
@@ -26,9 +28,16 @@ class RemoteWorkerImpl : public Worker {
     // CloseShard close db_id/shard_id.
     RetCode CloseShard(const std::string& db_id, const std::string& shard_id) override;
 
+    // ReleaseShard stop serving db_id/shard_id.
+    RetCode ReleaseShard(const std::string& db_id, const std::string& shard_id) override;
+
     // AddFeatures to db_id/shard_id, delegate to remote worker.
     std::vector<std::string> AddFeatures(const std::string& db_id, const std::string& shard_id,
-                                         const std::vector<Feature>& fts) override;
+                                         const std::vector<FeatureDbItem>& fts) override;
+
+    // ListFeatures of db_id/shard_id with their vectors by page.
+    PageData<FeatureDbItemList> ListFeatures(const std::string& db_id, const std::string& shard_id,
+                                             uint page, uint perPage) override;
 
     // Search feature in the worker. worker can have multiple dbs, multiple shards.
     // only search in the requested db.
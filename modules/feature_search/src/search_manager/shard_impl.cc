@@ -1,17 +1,43 @@
 #include "shard_impl.h"
 
 #include "donde/definitions.h"
+#include "donde/utils.h"
 #include "shard_manager.h"
 
+#include <algorithm>
+#include <chrono>
 #include <exception>
 #include <memory>
 #include <mutex>
 #include <spdlog/spdlog.h>
+#include <thread>
 
 namespace donde_toolkits ::feature_search ::search_manager {
 
 const int WAIT_MSG_INTERVAL_MS = 3000;
 
+// weight of the newest sample in replica latency EWMA.
+const double LATENCY_EWMA_ALPHA = 0.2;
+
+// how long a migrated or detached replica waits for its inflight searches before released.
+const int DRAIN_REPLICA_TIMEOUT_MS = 10 * 1000;
+
+// features copied from the source replica per page when migrating.
+const uint MIGRATE_PAGE_SIZE = 1000;
+
+// a replica which failed a search is only picked after healthy ones within this time.
+const int64 FAILED_REPLICA_BACKOFF_MS = 5 * 1000;
+
+namespace {
+
+inline int64 steady_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+} // namespace
+
 Shard* ShardFactoryImpl::CreateShard(ShardManager* mgr, DBShard shard_info) {
     return new ShardImpl(mgr, shard_info);
 };
@@ -41,9 +67,9 @@ void ShardImpl::Start() {
         return;
     }
 
-    // create new thread
-    _loop_thread.reset(new std::thread(&ShardImpl::loop, std::ref(*this)));
+    // create new thread, channel must be ready before the loop reads it.
     _channel.reset(new MsgChannel());
+    _loop_thread.reset(new std::thread(&ShardImpl::loop, std::ref(*this)));
 
     _is_stopped.store(false);
 };
@@ -88,6 +114,20 @@ RetCode ShardImpl::Close() {
         spdlog::warn("shard already is closed, double Close??.");
         return RET_ERR;
     }
+
+    auto replicas = ListReplicas();
+    if (replicas.empty()) {
+        spdlog::error("shard has no worker, AssignWorker first.");
+        return RET_ERR;
+    }
+
+    // every replica stops accepting writes.
+    for (auto& replica : replicas) {
+        replica->worker->CloseShard(_db_id, _shard_id);
+    }
+    _shard_mgr->CloseShard(_db_id, _shard_id);
+
+    _shard_info.is_closed = true;
     _is_closed.store(true);
     return RetCode::RET_OK;
 };
@@ -103,21 +143,89 @@ RetCode ShardImpl::AssignWorker(Worker* worker) {
         return RetCode::RET_ERR;
     }
 
-    if (HasWorker()) {
-        spdlog::error("shard already has worker, double AssignWorker.");
-        return RetCode::RET_ERR;
-    }
     if (worker == nullptr) {
         spdlog::error("assigned null worker?");
         return RetCode::RET_ERR;
     }
 
-    _worker = worker;
-    _worker_id = worker->GetWorkerID();
+    DBShard changed;
+    {
+        std::unique_lock<std::shared_mutex> l(_replica_mu);
+
+        for (const auto& replica : _replicas) {
+            if (replica->worker == worker) {
+                spdlog::error("worker already serves this shard, double AssignWorker.");
+                return RetCode::RET_ERR;
+            }
+        }
+
+        auto replica = std::make_shared<ShardReplica>();
+        replica->worker = worker;
+        replica->worker_id = worker->GetWorkerID();
+        _replicas.push_back(replica);
 
+        // a loaded shard knows its replicas already, workers coming back are not new ones.
+        auto& ids = _shard_info.replica_worker_ids;
+        if (std::find(ids.begin(), ids.end(), replica->worker_id) != ids.end()) {
+            return RetCode::RET_OK;
+        }
+        ids.push_back(replica->worker_id);
+        if (_shard_info.worker_id.empty()) {
+            _shard_info.worker_id = replica->worker_id;
+        }
+        changed = _shard_info;
+    }
+
+    // persist placement, so the shard finds its replicas after a restart.
+    _shard_mgr->UpdateShard(changed);
     return RetCode::RET_OK;
 };
 
+RetCode ShardImpl::MigrateReplica(Worker* from, Worker* to) {
+    if (_is_stopped.load()) {
+        spdlog::info("shard is already stopped!");
+        return RetCode::RET_ERR;
+    }
+    if (from == nullptr || to == nullptr || from == to) {
+        spdlog::error("invalid migration of shard {}.", _shard_id);
+        return RetCode::RET_ERR;
+    }
+
+    auto msg = NewWorkMessage(shardOp{
+        .valueType = migrateReplicaReqType,
+        .valuePtr = std::shared_ptr<migrateReplicaReq>(new migrateReplicaReq{from, to}),
+    });
+    _channel->enqueueNotification(msg);
+    auto output = msg->waitResponse();
+    auto value = std::static_pointer_cast<migrateReplicaRsp>(output.valuePtr);
+    return value->ret;
+};
+
+void ShardImpl::DetachWorkers() {
+    if (!_is_stopped.load()) {
+        Stop();
+    }
+
+    std::vector<ShardReplicaPtr> detached;
+    {
+        std::unique_lock<std::shared_mutex> l(_replica_mu);
+        detached.swap(_replicas);
+    }
+
+    auto deadline
+        = std::chrono::steady_clock::now() + std::chrono::milliseconds(DRAIN_REPLICA_TIMEOUT_MS);
+    for (auto& replica : detached) {
+        while (replica->inflight.load() > 0 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+};
+
+std::vector<ShardReplicaPtr> ShardImpl::ListReplicas() {
+    std::shared_lock<std::shared_mutex> l(_replica_mu);
+    return _replicas;
+};
+
 // AddFeatures to this shard, delegate to worker client to do the actual storage.
 std::vector<std::string> ShardImpl::AddFeatures(const std::vector<Feature>& fts) {
     if (_is_stopped.load() || _is_closed.load()) {
@@ -150,20 +258,85 @@ std::vector<FeatureSearchItem> ShardImpl::SearchFeature(const Feature& query, in
         return {};
     }
 
-    if (!HasWorker()) {
-        spdlog::error("shard has no worker, AssignWorker first.");
-        return {};
+    // one dead replica must not fail the query, try the others before giving up.
+    std::vector<ShardReplicaPtr> tried;
+    for (;;) {
+        auto replica = pick_replica(tried);
+        if (!replica) {
+            spdlog::error("shard {} has no available replica, {} failed.", _shard_id,
+                          tried.size());
+            return {};
+        }
+        tried.push_back(replica);
+
+        std::vector<FeatureSearchItem> ret;
+        if (search_replica(*replica, query, topk, ret)) {
+            replica->failed_at_ms.store(0);
+            return ret;
+        }
+        spdlog::warn("worker {} failed to search shard {}, try next replica.",
+                     replica->worker_id, _shard_id);
+        replica->failed_at_ms.store(steady_now_ms());
     }
+};
 
-    auto msg = NewWorkMessage(shardOp{
-        .valueType = searchFeatureReqType,
-        .valuePtr = std::shared_ptr<searchFeatureReq>(new searchFeatureReq{query, topk}),
-    });
-    _channel->enqueueNotification(msg);
-    auto output = msg->waitResponse();
-    auto value = std::static_pointer_cast<searchFeatureRsp>(output.valuePtr);
+bool ShardImpl::search_replica(ShardReplica& replica, const Feature& query, int topk,
+                               std::vector<FeatureSearchItem>& ret) {
+    replica.inflight++;
+    auto start = std::chrono::steady_clock::now();
 
-    return std::move(value->fts);
+    bool ok = true;
+    try {
+        ret = replica.worker->SearchFeature(_db_id, query, topk);
+    } catch (const std::exception& exc) {
+        spdlog::error("worker {} search exc: {}", replica.worker_id, exc.what());
+        ok = false;
+    }
+
+    double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    replica.inflight--;
+
+    // racy update is fine, it's only a hint for balancing.
+    double prev = replica.latency_us.load();
+    replica.latency_us.store(prev == 0 ? elapsed
+                                       : prev * (1 - LATENCY_EWMA_ALPHA)
+                                             + elapsed * LATENCY_EWMA_ALPHA);
+
+    // workers answer errors with nothing, which a shard holding features never does.
+    return ok && (!ret.empty() || topk <= 0 || _shard_info.used == 0);
+};
+
+ShardReplicaPtr ShardImpl::pick_replica(const std::vector<ShardReplicaPtr>& tried) {
+    auto replicas = ListReplicas();
+    int64 now = steady_now_ms();
+
+    ShardReplicaPtr best = nullptr;
+    bool best_ready = false;
+    double best_cost = 0;
+
+    for (auto& replica : replicas) {
+        if (replica->is_stale.load()
+            || std::find(tried.begin(), tried.end(), replica) != tried.end()) {
+            continue;
+        }
+        int64 failed_at = replica->failed_at_ms.load();
+        bool ready = replica->worker->Ready()
+                     && (failed_at == 0 || now - failed_at >= FAILED_REPLICA_BACKOFF_MS);
+        // expected waiting time if we queue behind inflight requests.
+        double cost = (replica->inflight.load() + 1) * replica->latency_us.load();
+
+        // a ready replica always beats one not ready, a worker which is still probing, or
+        // failed lately, is only used when nothing else is left.
+        if (best == nullptr || (ready && !best_ready)
+            || (ready == best_ready && cost < best_cost)) {
+            best = replica;
+            best_ready = ready;
+            best_cost = cost;
+        }
+    }
+    return best;
 };
 
 void ShardImpl::loop() {
@@ -190,8 +363,8 @@ void ShardImpl::loop() {
             msg->setResponse(output);
             break;
         }
-        case searchFeatureReqType: {
-            auto output = do_search_feature(input);
+        case migrateReplicaReqType: {
+            auto output = do_migrate_replica(input);
             msg->setResponse(output);
             break;
         }
@@ -210,10 +383,37 @@ shardOp ShardImpl::do_add_features(const shardOp& input) {
     auto req = std::static_pointer_cast<addFeaturesReq>(input.valuePtr);
     auto rsp = std::make_shared<addFeaturesRsp>();
 
-    // delegate to worker.
-    auto ret = _worker->AddFeatures(_db_id, _shard_id, req->fts);
+    // ids are assigned once here, so that every replica stores features under the ids the caller
+    // gets, and searches or removes served by any replica agree on them.
+    FeatureDbItemList items;
+    std::vector<std::string> assigned;
+    for (const auto& ft : req->fts) {
+        items.push_back(
+            FeatureDbItem{.feature_id = generate_uuid(), .feature = ft, .metadata = {}});
+        assigned.push_back(items.back().feature_id);
+    }
+
+    std::vector<std::string> ret;
+    for (auto& replica : ListReplicas()) {
+        if (replica->is_stale.load()) {
+            continue;
+        }
+        auto ids = replica->worker->AddFeatures(_db_id, _shard_id, items);
+        if (ids != assigned) {
+            // replica lost this write, stop reading from it until it is rebuilt.
+            spdlog::error("worker {} failed to add features to shard {}, mark replica stale.",
+                          replica->worker_id, _shard_id);
+            replica->is_stale.store(true);
+            continue;
+        }
+        ret = assigned;
+    }
+
     if (ret.size() > 0) {
         _shard_info.used += req->fts.size();
+        for (const auto& ft : req->fts) {
+            _shard_info.used_bytes += ft.raw.size() * sizeof(float);
+        }
         _shard_mgr->UpdateShard(_shard_info);
         rsp->feature_ids = ret;
     }
@@ -225,19 +425,102 @@ shardOp ShardImpl::do_add_features(const shardOp& input) {
     return output;
 };
 
-shardOp ShardImpl::do_search_feature(const shardOp& input) {
-    auto req = std::static_pointer_cast<searchFeatureReq>(input.valuePtr);
-    auto rsp = std::make_shared<searchFeatureRsp>();
-
-    // TODO: what about _worker api error?
-    auto ret = _worker->SearchFeature(_shard_info.db_id, req->query, req->topk);
-    rsp->fts.swap(ret);
+shardOp ShardImpl::do_migrate_replica(const shardOp& input) {
+    auto req = std::static_pointer_cast<migrateReplicaReq>(input.valuePtr);
+    auto rsp = std::make_shared<migrateReplicaRsp>();
+    rsp->ret = RetCode::RET_ERR;
 
     shardOp output{
-        .valueType = searchFeatureRspType,
+        .valueType = migrateReplicaRspType,
         .valuePtr = rsp,
     };
+
+    ShardReplicaPtr source = nullptr;
+    for (auto& replica : ListReplicas()) {
+        if (replica->worker == req->to) {
+            spdlog::error("worker {} already serves shard {}.", replica->worker_id, _shard_id);
+            return output;
+        }
+        if (replica->worker == req->from) {
+            source = replica;
+        }
+    }
+    if (source == nullptr) {
+        spdlog::error("worker is not serving shard {}, cannot migrate.", _shard_id);
+        return output;
+    }
+
+    // 1. target serves the shard, no write can happen now since we are in the loop.
+    if (req->to->ServeShard(*this) != RetCode::RET_OK) {
+        spdlog::error("worker {} cannot serve shard {}, abort migration.",
+                      req->to->GetWorkerID(), _shard_id);
+        return output;
+    }
+
+    // workers keep features in their own store, so the target starts empty, copy features
+    // from the source before it is released, or the shard loses them.
+    if (copy_replica(req->from, req->to) != RetCode::RET_OK) {
+        spdlog::error("cannot copy shard {} to worker {}, abort migration.", _shard_id,
+                      req->to->GetWorkerID());
+        req->to->ReleaseShard(_db_id, _shard_id);
+        return output;
+    }
+
+    // 2. cut over, new searches will not pick the source anymore.
+    auto target = std::make_shared<ShardReplica>();
+    target->worker = req->to;
+    target->worker_id = req->to->GetWorkerID();
+    {
+        std::unique_lock<std::shared_mutex> l(_replica_mu);
+        std::replace(_replicas.begin(), _replicas.end(), source, target);
+        std::replace(_shard_info.replica_worker_ids.begin(), _shard_info.replica_worker_ids.end(),
+                     source->worker_id, target->worker_id);
+        _shard_info.worker_id = _shard_info.replica_worker_ids.front();
+    }
+    _shard_mgr->UpdateShard(_shard_info);
+
+    // 3. wait searches already on the source, then release it.
+    auto deadline
+        = std::chrono::steady_clock::now() + std::chrono::milliseconds(DRAIN_REPLICA_TIMEOUT_MS);
+    while (source->inflight.load() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    source->worker->ReleaseShard(_db_id, _shard_id);
+
+    spdlog::info("shard {} migrated from worker {} to {}.", _shard_id, source->worker_id,
+                 target->worker_id);
+
+    rsp->ret = RetCode::RET_OK;
     return output;
 };
 
+RetCode ShardImpl::copy_replica(Worker* from, Worker* to) {
+    uint64 copied = 0;
+    for (uint page = 0;; page++) {
+        auto listed = from->ListFeatures(_db_id, _shard_id, page, MIGRATE_PAGE_SIZE);
+        if (listed.data.empty()) {
+            break;
+        }
+
+        // keep the ids, the caller knows features by them.
+        auto ids = to->AddFeatures(_db_id, _shard_id, listed.data);
+        if (ids != convert_to_feature_ids(listed.data)) {
+            return RetCode::RET_ERR;
+        }
+        copied += listed.data.size();
+        if (page + 1 >= listed.totalPage) {
+            break;
+        }
+    }
+
+    if (copied == 0 && _shard_info.used > 0) {
+        spdlog::error("worker {} listed no features of shard {}, which has {}.",
+                      from->GetWorkerID(), _shard_id, _shard_info.used);
+        return RetCode::RET_ERR;
+    }
+    spdlog::info("copied {} features of shard {} to worker {}.", copied, _shard_id,
+                 to->GetWorkerID());
+    return RetCode::RET_OK;
+};
+
 } // namespace donde_toolkits::feature_search::search_manager
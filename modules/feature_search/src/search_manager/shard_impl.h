@@ -8,7 +8,9 @@
 #include "shard_manager.h"
 
 #include <Poco/Thread.h>
+#include <atomic>
 #include <memory>
+#include <shared_mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
@@ -31,12 +33,12 @@ struct addFeaturesRsp {
 struct closeShardReq {};
 struct closeShardRsp {};
 
-struct searchFeatureReq {
-    Feature query;
-    int topk;
+struct migrateReplicaReq {
+    Worker* from;
+    Worker* to;
 };
-struct searchFeatureRsp {
-    std::vector<FeatureSearchItem> fts;
+struct migrateReplicaRsp {
+    RetCode ret;
 };
 
 enum shardOpType {
@@ -49,9 +51,8 @@ enum shardOpType {
     closeShardReqType,
     closeShardRspType,
 
-    searchFeatureRspType,
-    searchFeatureReqType,
-
+    migrateReplicaReqType,
+    migrateReplicaRspType,
 };
 
 struct shardOp {
@@ -59,6 +60,23 @@ struct shardOp {
     std::shared_ptr<void> valuePtr;
 };
 
+// ShardReplica is one worker serving the shard, with its load stats for read balancing.
+struct ShardReplica {
+    Worker* worker;
+    std::string worker_id;
+
+    // searches currently running on this replica.
+    std::atomic<int> inflight = 0;
+    // EWMA of search latency in microseconds, 0 means not measured yet.
+    std::atomic<double> latency_us = 0;
+    // replica missed some writes, it should not serve reads anymore.
+    std::atomic<bool> is_stale = false;
+    // steady clock ms of the last failed search, it is tried after healthy ones for a while.
+    std::atomic<int64> failed_at_ms = 0;
+};
+
+using ShardReplicaPtr = std::shared_ptr<ShardReplica>;
+
 class ShardImpl : public Shard {
 
   public:
@@ -72,13 +90,23 @@ class ShardImpl : public Shard {
     // those items will be drained. i.e. wait for them to finish.
     void Stop() override;
 
-    // Assign a worker for this shard.
+    // Assign a worker for this shard, each call adds a replica on a different worker.
     RetCode AssignWorker(Worker* worker) override;
 
-    // AddFeatures to this shard, delegate to worker client to do the actual storage.
+    // MigrateReplica from one worker to another, serialized with AddFeatures by the loop,
+    // so the target loads a snapshot which will not miss any write.
+    RetCode MigrateReplica(Worker* from, Worker* to) override;
+
+    // DetachWorkers stop the shard, so no write uses the workers anymore, and drop replicas
+    // after searches running on them finish. placement in shard info is kept.
+    void DetachWorkers() override;
+
+    // AddFeatures to this shard, fan out to all replicas, feature ids from the primary
+    // are returned.
     std::vector<std::string> AddFeatures(const std::vector<Feature>& fts) override;
 
-    // SearchFeature in this shard, delegate to worker client to do the actual search.
+    // SearchFeature in this shard, on the least loaded healthy replica, the next one is tried
+    // if it fails. Unlike AddFeatures, searches are not serialized by the loop thread.
     std::vector<FeatureSearchItem> SearchFeature(const Feature& query, int topk) override;
 
     // Open the shard for writing operation
@@ -87,7 +115,10 @@ class ShardImpl : public Shard {
     RetCode Close() override;
 
     // check the shard has been assigned worker or not.
-    inline bool HasWorker() override { return _worker != nullptr; };
+    inline bool HasWorker() override {
+        std::shared_lock<std::shared_mutex> l(_replica_mu);
+        return !_replicas.empty();
+    };
 
     // check the shard is closed or not.
     inline bool IsClosed() override { return _shard_info.is_closed; };
@@ -99,13 +130,26 @@ class ShardImpl : public Shard {
 
     inline DBShard GetShardInfo() override { return _shard_info; };
 
+    std::vector<ShardReplicaPtr> ListReplicas();
+
   private:
     void loop();
 
+    // pick the replica with least inflight * latency, healthy ones first, except those tried.
+    ShardReplicaPtr pick_replica(const std::vector<ShardReplicaPtr>& tried = {});
+
+    // search_replica search on replica into ret, false if it fails or answers nothing while the
+    // shard has features.
+    bool search_replica(ShardReplica& replica, const Feature& query, int topk,
+                        std::vector<FeatureSearchItem>& ret);
+
     shardOp do_assign_worker(const shardOp& input);
     shardOp do_add_features(const shardOp& input);
-    shardOp do_search_feature(const shardOp& input);
     shardOp do_close_shard(const shardOp& input);
+    shardOp do_migrate_replica(const shardOp& input);
+
+    // copy_replica copy all features of this shard from a worker to another.
+    RetCode copy_replica(Worker* from, Worker* to);
 
   private:
     DBShard _shard_info;
@@ -113,8 +157,8 @@ class ShardImpl : public Shard {
     std::string _shard_id;
     std::string _db_id;
 
-    std::string _worker_id;
-    Worker* _worker = nullptr;
+    std::vector<ShardReplicaPtr> _replicas;
+    std::shared_mutex _replica_mu;
 
     ShardManager* _shard_mgr = nullptr;
 
@@ -2,19 +2,39 @@
 
 #include "shard_impl.h"
 
+#include <chrono>
 #include <spdlog/spdlog.h>
 
 namespace donde_toolkits ::feature_search ::search_manager {
 
+namespace {
+
+inline int64 now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+} // namespace
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// ShardManager
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-ShardManagerImpl::ShardManagerImpl(Driver& driver, ShardFactory& factory)
-    : _driver(driver), _shard_factory(factory) {
+ShardManagerImpl::ShardManagerImpl(Driver& driver, ShardFactory& factory,
+                                   const ShardRolloverOptions& rollover)
+    : _driver(driver), _shard_factory(factory), _rollover(rollover) {
     load_db_shards();
 };
 
+ShardRolloverOptions ShardManagerImpl::ParseRolloverOptions(const json& conf) {
+    ShardRolloverOptions opts;
+    opts.max_vectors = conf.value("max_vectors", opts.max_vectors);
+    opts.max_bytes = conf.value("max_bytes", opts.max_bytes);
+    opts.max_age_ms = conf.value("max_age_ms", opts.max_age_ms);
+    return opts;
+};
+
 std::tuple<Shard*, bool> ShardManagerImpl::FindOrCreateWritableShard(std::string db_id,
                                                                      uint64 fts_count) {
     // if db_id not exists, this will throw 404.
@@ -23,11 +43,18 @@ std::tuple<Shard*, bool> ShardManagerImpl::FindOrCreateWritableShard(std::string
     for (auto shard : shards) {
         if (!shard->IsClosed()) {
             auto shard_info = shard->GetShardInfo();
-            if (shard_info.capacity - shard_info.used > fts_count) {
+            if (!should_rollover(shard_info, fts_count)) {
                 return {shard, false};
             } else {
-                // TODO close now?
-                shard->Close();
+                // roll over, workers seal the closed shard in background.
+                spdlog::info("shard {} of db {} rolls over, used: {}, bytes: {}.",
+                             shard_info.shard_id, db_id, shard_info.used, shard_info.used_bytes);
+                if (shard->Close() != RetCode::RET_OK) {
+                    // a new shard for every add would leak shards, keep writing to this one.
+                    spdlog::error("cannot close shard {} of db {}, keep it writable.",
+                                  shard_info.shard_id, db_id);
+                    return {shard, false};
+                }
                 break;
             }
         }
@@ -36,9 +63,11 @@ std::tuple<Shard*, bool> ShardManagerImpl::FindOrCreateWritableShard(std::string
     // create new shard;
     DBShard shard_info{
         .db_id = db_id,
-        .capacity = DEFAULT_SHARD_CAPACITY,
+        .capacity = _rollover.max_vectors > 0 ? _rollover.max_vectors : DEFAULT_SHARD_CAPACITY,
         .used = 0,
         .is_closed = false,
+        .used_bytes = 0,
+        .created_at = now_ms(),
     };
 
     std::string shard_id = CreateShard(shard_info);
@@ -55,6 +84,10 @@ void ShardManagerImpl::LoadShards(std::string db_id) {
     std::vector<Shard*> shards;
     std::vector<DBShard> shard_infos = _driver.ListShards(db_id);
     for (auto& shard_info : shard_infos) {
+        // rows written before creation time was persisted count their age from loading.
+        if (shard_info.created_at == 0) {
+            shard_info.created_at = now_ms();
+        }
         _db_shards[db_id].push_back(_shard_factory.CreateShard(this, shard_info));
     }
 };
@@ -81,6 +114,22 @@ RetCode ShardManagerImpl::UpdateShard(DBShard shard_info) {
     return _driver.UpdateShard(shard_info.db_id, shard_info);
 };
 
+bool ShardManagerImpl::should_rollover(const DBShard& shard_info, uint64 fts_count) {
+    if (shard_info.used + fts_count > shard_info.capacity) {
+        return true;
+    }
+    if (_rollover.max_vectors > 0 && shard_info.used + fts_count > _rollover.max_vectors) {
+        return true;
+    }
+    if (_rollover.max_bytes > 0 && shard_info.used_bytes >= _rollover.max_bytes) {
+        return true;
+    }
+    if (_rollover.max_age_ms > 0 && now_ms() - shard_info.created_at >= _rollover.max_age_ms) {
+        return true;
+    }
+    return false;
+};
+
 RetCode ShardManagerImpl::load_db_shards() {
     std::vector<DBItem> user_dbs = _driver.ListDBs();
 
@@ -91,6 +140,10 @@ RetCode ShardManagerImpl::load_db_shards() {
         std::vector<Shard*> shards;
         std::vector<DBShard> shard_infos = _driver.ListShards(db.db_id);
         for (auto& shard_info : shard_infos) {
+            // rows written before creation time was persisted count their age from loading.
+            if (shard_info.created_at == 0) {
+                shard_info.created_at = now_ms();
+            }
             shards.push_back(_shard_factory.CreateShard(this, shard_info));
 
             // this will be more efficient?
@@ -3,6 +3,7 @@
 #include "donde/definitions.h"
 #include "donde/feature_search/driver.h"
 #include "donde/feature_search/shard.h"
+#include "nlohmann/json.hpp"
 #include "shard_factory.h"
 #include "shard_manager.h"
 
@@ -12,12 +13,23 @@
 
 
 
+using json = nlohmann::json;
+
 namespace donde_toolkits ::feature_search ::search_manager {
 
+// ShardRolloverOptions, writable shard is closed and a new one is created when any limit is hit,
+// 0 means no limit.
+struct ShardRolloverOptions {
+    uint64 max_vectors = DEFAULT_SHARD_CAPACITY;
+    uint64 max_bytes = 0;
+    int64 max_age_ms = 0;
+};
+
 class ShardManagerImpl : public ShardManager {
 
   public:
-    ShardManagerImpl(Driver& driver, ShardFactory& factory);
+    ShardManagerImpl(Driver& driver, ShardFactory& factory,
+                     const ShardRolloverOptions& rollover = {});
     ~ShardManagerImpl() = default;
 
     std::tuple<Shard*, bool> FindOrCreateWritableShard(std::string db_id,
@@ -34,9 +46,16 @@ class ShardManagerImpl : public ShardManager {
 
     RetCode UpdateShard(DBShard shard_info) override;
 
+    // ParseRolloverOptions from json config, missing fields keep default values.
+    //   {"max_vectors": 1000000, "max_bytes": 2147483648, "max_age_ms": 86400000}
+    static ShardRolloverOptions ParseRolloverOptions(const json& conf);
+
   private:
     RetCode load_db_shards();
 
+    // should_rollover check if shard can not take fts_count more features.
+    bool should_rollover(const DBShard& shard_info, uint64 fts_count);
+
   private:
     std::unordered_map<std::string, std::vector<Shard*>> _db_shards;
 
@@ -44,6 +63,8 @@ class ShardManagerImpl : public ShardManager {
 
     Driver& _driver;
     ShardFactory& _shard_factory;
+
+    ShardRolloverOptions _rollover;
 };
 
 } // namespace donde_toolkits::feature_search::search_manager
@@ -16,14 +16,35 @@ WorkerManager::WorkerManager(Driver& driver, WorkerFactory& factory)
     : pimpl(std::make_unique<WorkerManagerImpl>(driver)){};
 WorkerManager::~WorkerManager(){};
 Worker* WorkerManager::FindWritableWorker() { return pimpl->FindWritableWorker(); };
+std::vector<Worker*> WorkerManager::FindWritableWorkers(size_t count) {
+    return pimpl->FindWritableWorkers(count);
+};
+std::tuple<Worker*, Worker*> WorkerManager::FindRebalancePair() {
+    return pimpl->FindRebalancePair();
+};
 void WorkerManager::Stop() { return pimpl->Stop(); };
 void WorkerManager::AttachNewWorker(WorkerItem worker_item) {
     return pimpl->AttachNewWorker(worker_item);
 };
+Worker* WorkerManager::GetWorkerByID(const std::string& worker_id) {
+    return pimpl->GetWorkerByID(worker_id);
+};
 void WorkerManager::LoadKnownWorkers() { pimpl->LoadKnownWorkers(); };
 void WorkerManager::StartProbeWorkersInBackground(const WorkerFactory& factory) { pimpl->StartProbeWorkersInBackground(factory); };
 std::vector<Worker*> WorkerManager::ListWorkers(bool include_offline) {
     return pimpl->ListWorkers(include_offline);
 };
+void WorkerManager::ReportHeartbeat(const std::string& worker_id) {
+    pimpl->ReportHeartbeat(worker_id);
+};
+WorkerState WorkerManager::GetWorkerState(const std::string& worker_id) {
+    return pimpl->GetWorkerState(worker_id);
+};
+std::unordered_map<std::string, WorkerState> WorkerManager::ListWorkerStates() {
+    return pimpl->ListWorkerStates();
+};
+void WorkerManager::SubscribeWorkerState(WorkerStateCallback callback) {
+    pimpl->SubscribeWorkerState(callback);
+};
 
 } // namespace donde_toolkits::feature_search::search_manager
@@ -7,11 +7,14 @@
 #include "donde/feature_search/worker.h"
 #include "remote_worker_impl.h"
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <ostream>
+#include <spdlog/spdlog.h>
 #include <thread>
 #include <unordered_map>
 
@@ -19,85 +22,361 @@
 
 namespace donde_toolkits ::feature_search ::search_manager {
 
-WorkerManagerImpl::WorkerManagerImpl(Driver& driver) : _driver(driver) {
+// probing thread wakes up at least this often to check timeouts.
+const int PROBE_TICK_MS = 100;
+
+WorkerManagerImpl::WorkerManagerImpl(Driver& driver, const PlacementOptions& placement,
+                                     const WorkerHealthOptions& health)
+    : _driver(driver), _placement(placement), _health(health) {
     auto workers_in_db = _driver.ListWorkers();
     for (auto& worker : workers_in_db) {
-        _known_workers.insert({worker.worker_id, worker});
+        _workers.insert({worker.worker_id, WorkerEntry{.item = worker}});
+    }
+};
+
+WorkerManagerImpl::~WorkerManagerImpl() {
+    Stop();
+
+    // free Worker*, they are created by factory, shards must have detached them by now.
+    std::lock_guard<std::mutex> l(_mu);
+    for (auto& it : _workers) {
+        delete it.second.worker;
+        it.second.worker = nullptr;
     }
 };
 
-WorkerManagerImpl::~WorkerManagerImpl() {}
+WorkerHealthOptions WorkerManagerImpl::ParseHealthOptions(const json& conf) {
+    WorkerHealthOptions opts;
+    opts.probe_interval_ms = conf.value("probe_interval_ms", opts.probe_interval_ms);
+    opts.suspect_after_ms = conf.value("suspect_after_ms", opts.suspect_after_ms);
+    opts.offline_after_ms = conf.value("offline_after_ms", opts.offline_after_ms);
+    opts.min_backoff_ms = conf.value("min_backoff_ms", opts.min_backoff_ms);
+    opts.max_backoff_ms = conf.value("max_backoff_ms", opts.max_backoff_ms);
+    opts.max_concurrent_probes = conf.value("max_concurrent_probes", opts.max_concurrent_probes);
+    if (opts.max_concurrent_probes == 0) {
+        opts.max_concurrent_probes = 1;
+    }
+    return opts;
+};
 
 void WorkerManagerImpl::StartProbeWorkersInBackground(const WorkerFactory& factory) {
-    _ping_thread = std::thread(&WorkerManagerImpl::ping_workers, std::ref(*this), factory);
+    // factory must outlive Stop(), it is used by probes.
+    _ping_thread
+        = std::thread(&WorkerManagerImpl::ping_workers, std::ref(*this), std::cref(factory));
 }
 
 void WorkerManagerImpl::Stop() {
-    stopped = true;
-    for (const auto& it : _online_workers) {
-        // free Worker*, they are created by factory
-        delete it.second;
+    {
+        std::lock_guard<std::mutex> l(_mu);
+        _stopped = true;
     }
+    _cv.notify_all();
+
     if (_ping_thread.joinable()) {
         _ping_thread.join();
     }
 };
 
 Worker* WorkerManagerImpl::FindWritableWorker() {
-    uint64_t most_free = 0;
-    std::string id;
-    for (const auto& it : _online_workers) {
-        auto space = it.second->GetFreeSpace();
-        if (space > most_free) {
-            most_free = space;
-            id = it.first;
+    auto workers = FindWritableWorkers(1);
+    if (workers.empty()) {
+        return nullptr;
+    }
+    return workers[0];
+};
+
+std::vector<Worker*> WorkerManagerImpl::FindWritableWorkers(size_t count) {
+    // GetLoad may be a remote call, don't hold the lock.
+    std::vector<Worker*> workers = online_workers();
+    std::vector<WorkerLoad> loads;
+    for (auto worker : workers) {
+        loads.push_back(worker->GetLoad());
+    }
+
+    std::vector<Worker*> ret;
+    for (auto idx : _placement.Rank(loads)) {
+        if (ret.size() >= count) {
+            break;
         }
+        ret.push_back(workers[idx]);
     }
-    if (id == "") {
-        return nullptr;
+    return ret;
+};
+
+std::tuple<Worker*, Worker*> WorkerManagerImpl::FindRebalancePair() {
+    std::vector<Worker*> workers = online_workers();
+    std::vector<WorkerLoad> loads;
+    for (auto worker : workers) {
+        loads.push_back(worker->GetLoad());
     }
-    return _online_workers[id];
+
+    auto [hot, cool] = _placement.FindRebalancePair(loads);
+    if (hot < 0 || cool < 0) {
+        return {nullptr, nullptr};
+    }
+    return {workers[hot], workers[cool]};
 };
 
 void WorkerManagerImpl::AttachNewWorker(WorkerItem worker_item) {
     std::string id = worker_item.worker_id;
 
-    auto found_offline = _known_workers.find(id);
-    if (found_offline != _known_workers.end()) {
-        std::cerr << "this worker " << id << " is already known." << std::endl;
-        return;
+    {
+        std::lock_guard<std::mutex> l(_mu);
+        auto found = _workers.find(id);
+        if (found != _workers.end()) {
+            spdlog::warn("this worker {} is already known.", id);
+            return;
+        }
+
+        // probe it right away.
+        _workers.insert({id, WorkerEntry{.item = worker_item}});
     }
+    _cv.notify_all();
+};
 
-    _known_workers.insert({id, worker_item});
+Worker* WorkerManagerImpl::GetWorkerByID(const std::string& worker_id) {
+    std::lock_guard<std::mutex> l(_mu);
+    auto found = _workers.find(worker_id);
+    if (found == _workers.end()) {
+        return nullptr;
+    }
+    return found->second.worker;
 };
 
-// TODO
-Worker* WorkerManagerImpl::GetWorkerByID(const std::string& worker_id) { return {}; };
+std::vector<Worker*> WorkerManagerImpl::ListWorkers(bool include_offline) {
+    if (!include_offline) {
+        return online_workers();
+    }
 
-std::vector<Worker*> WorkerManagerImpl::ListWorkers(bool include_offline) { return {}; };
+    std::lock_guard<std::mutex> l(_mu);
+    std::vector<Worker*> ret;
+    for (const auto& it : _workers) {
+        if (it.second.worker != nullptr) {
+            ret.push_back(it.second.worker);
+        }
+    }
+    return ret;
+};
 
 // Lazy boy's implementation: wait workers come up by themselves
 void WorkerManagerImpl::LoadKnownWorkers(){};
 
-void WorkerManagerImpl::ping_workers(const WorkerFactory& factory) {
-    while (true) {
-        if (stopped) {
-            break;
+void WorkerManagerImpl::ReportHeartbeat(const std::string& worker_id) {
+    std::vector<StateChange> changes;
+    {
+        std::lock_guard<std::mutex> l(_mu);
+        auto found = _workers.find(worker_id);
+        if (found == _workers.end()) {
+            spdlog::warn("heartbeat from unknown worker {}, attach it first.", worker_id);
+            return;
+        }
+
+        auto& entry = found->second;
+        auto now = Clock::now();
+        if (entry.worker == nullptr) {
+            // never connected, let the probing thread create it.
+            entry.next_probe = now;
+        } else {
+            entry.last_seen = now;
+            entry.failures = 0;
+            entry.next_probe = now + std::chrono::milliseconds(_health.probe_interval_ms);
+            set_state(entry, WORKER_ONLINE, changes);
         }
-        if (!_known_workers.empty()) {
-            auto item = _known_workers.begin();
-            const std::string& id = item->first;
-            const WorkerItem& worker = item->second;
-            std::cout << "ping worker " << id << " with address: " << worker.address << std::endl;
-            // if ping success
-            if (factory.ProbeWorker(worker.address)) {
-                _known_workers.erase(id);
-                _online_workers.insert(
-                    {id, factory.CreateWorker(worker.worker_id, worker.address)});
+    }
+    _cv.notify_all();
+    notify(changes);
+};
+
+WorkerState WorkerManagerImpl::GetWorkerState(const std::string& worker_id) {
+    std::lock_guard<std::mutex> l(_mu);
+    auto found = _workers.find(worker_id);
+    if (found == _workers.end()) {
+        return WORKER_UNKNOWN;
+    }
+    return found->second.state;
+};
+
+std::unordered_map<std::string, WorkerState> WorkerManagerImpl::ListWorkerStates() {
+    std::lock_guard<std::mutex> l(_mu);
+    std::unordered_map<std::string, WorkerState> ret;
+    for (const auto& it : _workers) {
+        ret.insert({it.first, it.second.state});
+    }
+    return ret;
+};
+
+void WorkerManagerImpl::SubscribeWorkerState(WorkerStateCallback callback) {
+    std::lock_guard<std::mutex> l(_mu);
+    _callbacks.push_back(callback);
+};
+
+void WorkerManagerImpl::ping_workers(const WorkerFactory& factory) {
+    for (;;) {
+        std::vector<StateChange> changes;
+        {
+            std::unique_lock<std::mutex> l(_mu);
+            _cv.wait_for(l, std::chrono::milliseconds(PROBE_TICK_MS));
+            if (_stopped) {
+                break;
             }
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+            check_timeouts(Clock::now(), changes);
         }
+        notify(changes);
+
+        collect_probes();
+        probe_due_workers(factory);
     }
+
+    // wait probes still running, they use factory, drop what they created.
+    for (auto& future : _probes) {
+        delete future.get().created;
+    }
+    _probes.clear();
 }
 
+void WorkerManagerImpl::probe_due_workers(const WorkerFactory& factory) {
+    std::vector<WorkerItem> due;
+    std::vector<bool> need_create;
+    {
+        std::lock_guard<std::mutex> l(_mu);
+        auto now = Clock::now();
+        for (auto& it : _workers) {
+            auto& entry = it.second;
+            if (_probes.size() + due.size() >= _health.max_concurrent_probes) {
+                break;
+            }
+            if (entry.probing || entry.next_probe > now) {
+                continue;
+            }
+            entry.probing = true;
+            due.push_back(entry.item);
+            need_create.push_back(entry.worker == nullptr);
+        }
+    }
+
+    for (size_t i = 0; i < due.size(); i++) {
+        // need_create[i] is a proxy into need_create, capture the bool itself.
+        bool create = need_create[i];
+        _probes.push_back(std::async(std::launch::async, [&factory, item = due[i], create]() {
+            ProbeResult result{.worker_id = item.worker_id, .ok = false, .created = nullptr};
+            try {
+                result.ok = factory.ProbeWorker(item.address);
+                if (result.ok && create) {
+                    result.created = factory.CreateWorker(item.worker_id, item.address);
+                    result.ok = result.created != nullptr;
+                }
+            } catch (...) {
+                result.ok = false;
+            }
+            return result;
+        }));
+    }
+};
+
+void WorkerManagerImpl::collect_probes() {
+    std::vector<StateChange> changes;
+    for (auto it = _probes.begin(); it != _probes.end();) {
+        if (it->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            it++;
+            continue;
+        }
+        auto result = it->get();
+        it = _probes.erase(it);
+
+        std::lock_guard<std::mutex> l(_mu);
+        apply_probe(result, changes);
+    }
+    notify(changes);
+};
+
+void WorkerManagerImpl::apply_probe(const ProbeResult& result, std::vector<StateChange>& changes) {
+    auto& entry = _workers[result.worker_id];
+    entry.probing = false;
+
+    auto now = Clock::now();
+    if (result.ok) {
+        if (entry.worker == nullptr) {
+            entry.worker = result.created;
+        } else {
+            // someone else created it in the meantime.
+            delete result.created;
+        }
+        entry.last_seen = now;
+        entry.failures = 0;
+        entry.next_probe = now + std::chrono::milliseconds(_health.probe_interval_ms);
+        set_state(entry, WORKER_ONLINE, changes);
+    } else {
+        entry.failures++;
+        entry.next_probe = now + backoff(entry.failures);
+        spdlog::info("probe worker {} at {} failed {} times.", result.worker_id,
+                     entry.item.address, entry.failures);
+        if (entry.state == WORKER_ONLINE) {
+            set_state(entry, WORKER_SUSPECT, changes);
+        } else if (entry.state == WORKER_UNKNOWN) {
+            set_state(entry, WORKER_OFFLINE, changes);
+        }
+    }
+};
+
+void WorkerManagerImpl::check_timeouts(Clock::time_point now, std::vector<StateChange>& changes) {
+    for (auto& it : _workers) {
+        auto& entry = it.second;
+        auto silence = now - entry.last_seen;
+        if (entry.state == WORKER_ONLINE
+            && silence > std::chrono::milliseconds(_health.suspect_after_ms)) {
+            set_state(entry, WORKER_SUSPECT, changes);
+        }
+        if (entry.state == WORKER_SUSPECT
+            && silence > std::chrono::milliseconds(_health.offline_after_ms)) {
+            set_state(entry, WORKER_OFFLINE, changes);
+        }
+    }
+};
+
+void WorkerManagerImpl::set_state(WorkerEntry& entry, WorkerState to,
+                                  std::vector<StateChange>& changes) {
+    if (entry.state == to) {
+        return;
+    }
+    spdlog::info("worker {} state {} -> {}.", entry.item.worker_id, (int)entry.state, (int)to);
+    changes.push_back(StateChange{.worker = entry.worker, .from = entry.state, .to = to});
+    entry.state = to;
+};
+
+void WorkerManagerImpl::notify(const std::vector<StateChange>& changes) {
+    if (changes.empty()) {
+        return;
+    }
+
+    std::vector<WorkerStateCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> l(_mu);
+        callbacks = _callbacks;
+    }
+    for (const auto& change : changes) {
+        for (const auto& callback : callbacks) {
+            callback(change.worker, change.from, change.to);
+        }
+    }
+};
+
+WorkerManagerImpl::Clock::duration WorkerManagerImpl::backoff(int failures) {
+    int64 ms = _health.min_backoff_ms;
+    for (int i = 1; i < failures && ms < _health.max_backoff_ms; i++) {
+        ms *= 2;
+    }
+    return std::chrono::milliseconds(std::min(ms, _health.max_backoff_ms));
+};
+
+std::vector<Worker*> WorkerManagerImpl::online_workers() {
+    std::lock_guard<std::mutex> l(_mu);
+    std::vector<Worker*> ret;
+    for (const auto& it : _workers) {
+        if (it.second.state == WORKER_ONLINE && it.second.worker != nullptr) {
+            ret.push_back(it.second.worker);
+        }
+    }
+    return ret;
+};
+
 } // namespace donde_toolkits::feature_search::search_manager
@@ -5,24 +5,53 @@
 #include "donde/feature_search/driver.h"
 #include "donde/feature_search/search_manager/worker_manager.h"
 #include "donde/feature_search/worker.h"
+#include "placement.h"
 
+#include <chrono>
+#include <condition_variable>
+#include <future>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 
 
 
 namespace donde_toolkits ::feature_search ::search_manager {
 
+struct WorkerHealthOptions {
+    // online workers are probed at this interval, unless they sent heartbeat recently.
+    int64 probe_interval_ms = 5000;
+    // online worker without any probe/heartbeat for this long becomes suspect,
+    int64 suspect_after_ms = 10 * 1000;
+    // and then offline.
+    int64 offline_after_ms = 30 * 1000;
+    // failed probes are retried with exponential backoff in [min, max].
+    int64 min_backoff_ms = 500;
+    int64 max_backoff_ms = 60 * 1000;
+    // probes running at the same time.
+    size_t max_concurrent_probes = 16;
+};
+
 class WorkerManagerImpl : public IWorkerManager {
   public:
-    WorkerManagerImpl(Driver& driver);
+    WorkerManagerImpl(Driver& driver, const PlacementOptions& placement = {},
+                      const WorkerHealthOptions& health = {});
+    // ~WorkerManagerImpl stops probing and frees workers.
     ~WorkerManagerImpl();
 
+    // Stop probing, workers are still alive, shards may keep using them until detached.
     void Stop() override;
 
     Worker* FindWritableWorker() override;
 
+    // FindWritableWorkers, replicas of one shard must be placed on different workers.
+    // workers are ranked by their load, see PlacementPolicy.
+    std::vector<Worker*> FindWritableWorkers(size_t count) override;
+
+    std::tuple<Worker*, Worker*> FindRebalancePair() override;
+
     // AttachNewWorker
     void AttachNewWorker(WorkerItem worker_item) override;
 
@@ -36,19 +65,81 @@ class WorkerManagerImpl : public IWorkerManager {
 
     void StartProbeWorkersInBackground(const WorkerFactory& factory) override;
 
+    void ReportHeartbeat(const std::string& worker_id) override;
+
+    WorkerState GetWorkerState(const std::string& worker_id) override;
+
+    std::unordered_map<std::string, WorkerState> ListWorkerStates() override;
+
+    void SubscribeWorkerState(WorkerStateCallback callback) override;
+
+    // ParseHealthOptions from json config, missing fields keep default values.
+    //   {"probe_interval_ms": 5000, "suspect_after_ms": 10000, "offline_after_ms": 30000}
+    static WorkerHealthOptions ParseHealthOptions(const json& conf);
+
   private:
+    using Clock = std::chrono::steady_clock;
+
+    struct WorkerEntry {
+        WorkerItem item;
+        // created by factory when worker first comes online, owned by us.
+        Worker* worker = nullptr;
+        WorkerState state = WORKER_UNKNOWN;
+        // consecutive failed probes.
+        int failures = 0;
+        bool probing = false;
+        Clock::time_point last_seen{};
+        Clock::time_point next_probe{};
+    };
+
+    struct StateChange {
+        Worker* worker;
+        WorkerState from;
+        WorkerState to;
+    };
+
+    struct ProbeResult {
+        std::string worker_id;
+        bool ok;
+        Worker* created;
+    };
+
     void ping_workers(const WorkerFactory& factory);
 
+    // start probes of due workers, they run concurrently and are collected on later ticks.
+    void probe_due_workers(const WorkerFactory& factory);
+
+    // apply results of finished probes, a slow probe never holds back the tick.
+    void collect_probes();
+    void apply_probe(const ProbeResult& result, std::vector<StateChange>& changes);
+
+    // caller must hold _mu, changes are notified after _mu is released.
+    void set_state(WorkerEntry& entry, WorkerState to, std::vector<StateChange>& changes);
+    void check_timeouts(Clock::time_point now, std::vector<StateChange>& changes);
+    void notify(const std::vector<StateChange>& changes);
+
+    Clock::duration backoff(int failures);
+
+    // online workers, suspect ones are not given new shards.
+    std::vector<Worker*> online_workers();
+
   private:
     Driver& _driver;
 
-    // id -> Worker*
-    std::unordered_map<std::string, Worker*> _online_workers;
-    // id -> address
-    std::unordered_map<std::string, WorkerItem> _known_workers;
+    PlacementPolicy _placement;
+    WorkerHealthOptions _health;
+
+    // id -> worker and its state.
+    std::unordered_map<std::string, WorkerEntry> _workers;
+    std::vector<WorkerStateCallback> _callbacks;
+    std::mutex _mu;
+    std::condition_variable _cv;
 
     std::thread _ping_thread;
-    bool stopped = false;
+    bool _stopped = false;
+
+    // probes in flight, only touched by the probing thread.
+    std::vector<std::future<ProbeResult>> _probes;
 };
 
 } // namespace donde_toolkits::feature_search::search_manager
@@ -19,8 +19,8 @@ using json = nlohmann::json;
 
 namespace donde_toolkits ::feature_search ::search_worker {
 
-BruteForceWorker::BruteForceWorker(Driver& driver)
-    : ISearchWorker(), pimpl(std::make_unique<BruteForceWorkerImpl>(driver)){};
+BruteForceWorker::BruteForceWorker(Driver& driver, const json& config)
+    : ISearchWorker(), pimpl(std::make_unique<BruteForceWorkerImpl>(driver, config)){};
 
 BruteForceWorker::~BruteForceWorker(){};
 
@@ -37,6 +37,12 @@ std::vector<FeatureSearchItem> BruteForceWorker::SearchFeature(const std::string
     return pimpl->SearchFeature(db_id, query, topk);
 };
 
+std::vector<FeatureSearchItem> BruteForceWorker::SearchFeature(const std::string& db_id,
+                                                               const Feature& query, size_t topk,
+                                                               const MetadataFilter& filter) {
+    return pimpl->SearchFeature(db_id, query, topk, filter);
+};
+
 std::vector<std::string> BruteForceWorker::AddFeatures(const std::string& db_id,
                                                        const std::vector<FeatureDbItem>& features) {
     return pimpl->AddFeatures(db_id, features);
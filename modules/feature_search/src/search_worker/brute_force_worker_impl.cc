@@ -20,15 +20,19 @@ using json = nlohmann::json;
 
 namespace donde_toolkits ::feature_search ::search_worker {
 
-BruteForceWorkerImpl::BruteForceWorkerImpl(Driver& driver)
-    : ISearchWorker(), _shard_mgr(std::make_unique<ShardManagerImpl>(driver)), _driver(driver){};
+BruteForceWorkerImpl::BruteForceWorkerImpl(Driver& driver, const json& config)
+    : ISearchWorker(),
+      _config(config),
+      _shard_mgr(std::make_unique<ShardManagerImpl>(driver)),
+      _driver(driver){};
 
 BruteForceWorkerImpl::~BruteForceWorkerImpl(){};
 
 RetCode BruteForceWorkerImpl::ServeShards(const std::vector<DBShard>& shard_infos) {
+    auto seal = MemoryShardImpl::ParseSealOptions(_config.value("seal", json::object()));
     for (auto& s : shard_infos) {
         // remove ShardImpl dependency ?
-        Shard* shard = new MemoryShardImpl(*_shard_mgr, _driver, s);
+        Shard* shard = new MemoryShardImpl(*_shard_mgr, _driver, s, seal);
         _shard_mgr->ManageShard(s.db_id, shard);
     }
     return RetCode::RET_OK;
@@ -43,6 +47,13 @@ RetCode BruteForceWorkerImpl::CloseShards(const std::vector<DBShard>& shard_info
 
 std::vector<FeatureSearchItem>
 BruteForceWorkerImpl::SearchFeature(const std::string& db_id, const Feature& query, size_t topk) {
+    return SearchFeature(db_id, query, topk, {});
+};
+
+std::vector<FeatureSearchItem> BruteForceWorkerImpl::SearchFeature(const std::string& db_id,
+                                                                   const Feature& query,
+                                                                   size_t topk,
+                                                                   const MetadataFilter& filter) {
     auto shards = _shard_mgr->ListShards(db_id);
     if (shards.empty()) {
         spdlog::error("search err: no shards in db[{}]", db_id);
@@ -53,7 +64,7 @@ BruteForceWorkerImpl::SearchFeature(const std::string& db_id, const Feature& que
 
     // search across evey shard, and merge results.
     for (auto& s : shards) {
-        std::vector<FeatureSearchItem> searched = s->SearchFeature(query, topk);
+        std::vector<FeatureSearchItem> searched = s->SearchFeature(query, topk, filter);
         // merge
         rank.FeedIn(searched);
     }
@@ -22,7 +22,7 @@ class BruteForceWorkerImpl : public ISearchWorker {
   public:
     // Searcher contructor, doesn't own ShardManager and Driver, but reference to them.
     // The caller should clean ShardManager and Driver themself.
-    BruteForceWorkerImpl(Driver& driver);
+    BruteForceWorkerImpl(Driver& driver, const json& config = {});
 
     ~BruteForceWorkerImpl();
 
@@ -54,6 +54,9 @@ class BruteForceWorkerImpl : public ISearchWorker {
     std::vector<FeatureSearchItem> SearchFeature(const std::string& db_id, const Feature& query,
                                                  size_t topk) override;
 
+    std::vector<FeatureSearchItem> SearchFeature(const std::string& db_id, const Feature& query,
+                                                 size_t topk, const MetadataFilter& filter);
+
     std::vector<std::string> AddFeatures(const std::string& db_id,
                                          const std::vector<FeatureDbItem>& features) override;
 
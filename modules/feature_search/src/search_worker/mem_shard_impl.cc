@@ -4,7 +4,10 @@
 #include "donde/feature_search/definitions.h"
 #include "donde/feature_search/feature_topk_rank.h"
 
+#include <algorithm>
 #include <exception>
+#include <filesystem>
+#include <fstream>
 #include <memory>
 #include <mutex>
 #include <spdlog/spdlog.h>
@@ -18,13 +21,16 @@ const int WAIT_MSG_INTERVAL_MS = 3000;
 /// Shard
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-MemoryShardImpl::MemoryShardImpl(ShardManager& manager, Driver& driver, DBShard shard_info)
+MemoryShardImpl::MemoryShardImpl(ShardManager& manager, Driver& driver, DBShard shard_info,
+                                 const SealOptions& seal)
     : Shard(manager, shard_info),
       _shard_info(shard_info),
       _shard_id(shard_info.shard_id),
       _db_id(shard_info.db_id),
       _shard_mgr(manager),
       _driver(driver),
+      _seal(seal),
+      _is_sealed(false),
       _is_loaded(false),
       _is_stopped(true) {
 
@@ -34,6 +40,14 @@ MemoryShardImpl::MemoryShardImpl(ShardManager& manager, Driver& driver, DBShard
 
 MemoryShardImpl::~MemoryShardImpl() { Stop(); };
 
+SealOptions MemoryShardImpl::ParseSealOptions(const json& conf) {
+    SealOptions opts;
+    opts.segment_dir = conf.value("segment_dir", opts.segment_dir);
+    opts.compact_ratio = conf.value("compact_ratio", opts.compact_ratio);
+    opts.indexed_keys = conf.value("indexed_keys", opts.indexed_keys);
+    return opts;
+};
+
 void MemoryShardImpl::Start() {
     std::lock_guard<std::mutex> l(_thread_mu);
 
@@ -42,9 +56,9 @@ void MemoryShardImpl::Start() {
         return;
     }
 
-    // create new thread
-    _loop_thread.reset(new std::thread(&MemoryShardImpl::loop, std::ref(*this)));
+    // create new thread, channel must be ready before the loop reads it.
     _channel.reset(new MsgChannel());
+    _loop_thread.reset(new std::thread(&MemoryShardImpl::loop, std::ref(*this)));
 
     _is_stopped.store(false);
 };
@@ -69,6 +83,15 @@ void MemoryShardImpl::Stop() {
     } catch (const std::exception& exc) {
         spdlog::warn("catch exc when join thread {}.", exc.what());
     }
+
+    // sealing thread reports to the channel, wait it before releasing channel.
+    {
+        std::lock_guard<std::mutex> seal_lock(_seal_mu);
+        if (_seal_thread.joinable()) {
+            _seal_thread.join();
+        }
+    }
+
     // release channel
     _channel.reset();
 
@@ -129,10 +152,6 @@ std::vector<std::string> MemoryShardImpl::AddFeatures(const std::vector<FeatureD
 
 // RemoveFeatures from this shard
 RetCode MemoryShardImpl::RemoveFeatures(const std::vector<std::string>& feature_ids) {
-    if (IsClosed()) {
-        spdlog::warn("shard is closed...");
-        return {};
-    }
     if (!IsLoaded()) {
         spdlog::warn("shard is not loaded...");
         return {};
@@ -154,8 +173,13 @@ RetCode MemoryShardImpl::RemoveFeatures(const std::vector<std::string>& feature_
     return RetCode::RET_OK;
 };
 
-// SearchFeature in this shard, delegate to worker client to do the actual search.
 std::vector<FeatureSearchItem> MemoryShardImpl::SearchFeature(const Feature& query, int topk) {
+    return SearchFeature(query, topk, {});
+};
+
+// SearchFeature in this shard, among features matching filter.
+std::vector<FeatureSearchItem> MemoryShardImpl::SearchFeature(const Feature& query, int topk,
+                                                              const MetadataFilter& filter) {
     if (!IsLoaded()) {
         spdlog::warn("shard is not loaded...");
         return {};
@@ -163,7 +187,7 @@ std::vector<FeatureSearchItem> MemoryShardImpl::SearchFeature(const Feature& que
 
     auto input = shardOp{
         .valueType = searchFeatureReqType,
-        .valuePtr = std::shared_ptr<searchFeatureReq>(new searchFeatureReq{query, topk}),
+        .valuePtr = std::shared_ptr<searchFeatureReq>(new searchFeatureReq{query, topk, filter}),
     };
 
     auto msg = WorkMessage<shardOp>::Ptr(new WorkMessage(input));
@@ -195,10 +219,7 @@ RetCode MemoryShardImpl::Close() {
     msg->giveReceipt();
     auto value = std::static_pointer_cast<closeShardRsp>(output.valuePtr);
 
-    _shard_info.is_closed = true;
-
-    Stop();
-
+    // closed shard still serves search, so keep the loop running.
     return RetCode::RET_OK;
 };
 
@@ -245,6 +266,11 @@ void MemoryShardImpl::loop() {
             msg->setResponse(output);
             break;
         }
+        case sealDoneReqType: {
+            auto output = do_seal_done(input);
+            msg->setResponse(output);
+            break;
+        }
         default:
             spdlog::error("shard loop input value is not valid! wrong valueType: ");
             continue;
@@ -260,15 +286,41 @@ shardOp MemoryShardImpl::do_load_features(const shardOp& input) {
     auto req = std::static_pointer_cast<loadFeaturesReq>(input.valuePtr);
     auto rsp = std::make_shared<loadFeaturesRsp>();
 
+    // closed shard may have been sealed before, load the segment directly. A missing, broken or
+    // stale one is resealed from the driver below.
+    if (_shard_info.is_closed && !_seal.segment_dir.empty()) {
+        auto segment = SealedSegment::Load(segment_path());
+        if (segment) {
+            spdlog::info("shard {} loaded from sealed segment, size: {}.", _shard_id,
+                         segment->Size());
+            _segment = segment;
+            load_tombstones();
+            _is_sealed.store(true);
+            _is_loaded.store(true);
+            if (_tombstones.size() > _segment->Size() * _seal.compact_ratio) {
+                start_sealing();
+            }
+            return shardOp{
+                .valueType = loadFeaturesRspType,
+                .valuePtr = rsp,
+            };
+        }
+    }
+
     ShardError error = ShardError::OK;
     std::unordered_map<std::string, Feature> cached;
+    std::unordered_map<std::string, Metadata> cached_meta;
 
-    uint page = 0;
+    // pages are read by key, each row once, offsets would rescan the pages before.
     uint perPage = 10;
-    PageData<FeatureDbItemList> pageData = _driver.ListFeatures(page, perPage, _db_id, _shard_id);
+    PagingState state;
+    while (!state.done) {
+        FeatureDbItemList items = _driver.ListFeatures(perPage, state, _db_id, _shard_id);
+        if (items.empty()) {
+            break;
+        }
 
-    while (pageData.data.size() > 0) {
-        std::vector<std::string> feature_ids = convert_to_feature_ids(pageData.data);
+        std::vector<std::string> feature_ids = convert_to_feature_ids(items);
         std::vector<Feature> fts = _driver.LoadFeatures(feature_ids, _db_id, _shard_id);
 
         if (feature_ids.size() != fts.size()) {
@@ -280,10 +332,8 @@ shardOp MemoryShardImpl::do_load_features(const shardOp& input) {
         // cached them in memory! that's why we are called 'MemoryShardImpl'
         for (size_t i = 0; i < feature_ids.size(); i++) {
             cached[feature_ids[i]] = fts[i];
+            cached_meta[feature_ids[i]] = items[i].metadata;
         }
-
-        // read next page, caution: copy assignment here!
-        pageData = _driver.ListFeatures(++page, perPage, _db_id, _shard_id);
     }
 
     if (error != ShardError::OK) {
@@ -291,7 +341,11 @@ shardOp MemoryShardImpl::do_load_features(const shardOp& input) {
         rsp->err_msg = "cannot load features.";
     } else {
         _cached_fts.swap(cached);
+        _cached_meta.swap(cached_meta);
         _is_loaded.store(true);
+        if (_shard_info.is_closed) {
+            start_sealing();
+        }
     }
 
     shardOp output{
@@ -305,9 +359,11 @@ shardOp MemoryShardImpl::do_add_features(const shardOp& input) {
     auto req = std::static_pointer_cast<addFeaturesReq>(input.valuePtr);
     auto rsp = std::make_shared<addFeaturesRsp>();
 
-    _driver.AddFeatures(req->fts, _db_id, _shard_id);
-    for (auto& ft : req->fts) {
-        _cached_fts[ft.feature_id] = ft.feature;
+    // features are cached by ids the driver gives them, none if the batch fails.
+    rsp->feature_ids = _driver.AddFeatures(req->fts, _db_id, _shard_id);
+    for (size_t i = 0; i < rsp->feature_ids.size() && i < req->fts.size(); i++) {
+        _cached_fts[rsp->feature_ids[i]] = req->fts[i].feature;
+        _cached_meta[rsp->feature_ids[i]] = req->fts[i].metadata;
     }
 
     shardOp output{
@@ -321,9 +377,27 @@ shardOp MemoryShardImpl::do_remove_features(const shardOp& input) {
     auto req = std::static_pointer_cast<removeFeaturesReq>(input.valuePtr);
     auto rsp = std::make_shared<removeFeaturesRsp>();
 
-    _driver.RemoveFeatures(req->feature_ids, _db_id);
+    bool tombstoned = false;
     for (auto& feature_id : req->feature_ids) {
         _cached_fts.erase(feature_id);
+        _cached_meta.erase(feature_id);
+        // segment is immutable, mark it as removed.
+        if (_segment && _segment->Contains(feature_id)) {
+            tombstoned |= _tombstones.insert(feature_id).second;
+        }
+        if (_is_sealing) {
+            _removed_while_sealing.insert(feature_id);
+        }
+    }
+    // tombstones are saved before the driver forgets the features, a crash in between leaves
+    // them removed rather than back in results.
+    if (tombstoned) {
+        save_tombstones();
+    }
+    _driver.RemoveFeatures(req->feature_ids, _db_id);
+
+    if (_segment && _tombstones.size() > _segment->Size() * _seal.compact_ratio) {
+        start_sealing();
     }
 
     shardOp output{
@@ -340,6 +414,26 @@ shardOp MemoryShardImpl::do_search_feature(const shardOp& input) {
 
     const Feature& query = req->query;
     const int topk = req->topk;
+    const MetadataFilter& filter = req->filter;
+
+    // checked before either path, so a filter means the same before and after sealing.
+    if (!is_indexed(filter)) {
+        spdlog::error("filter of shard {} has keys which are not indexed, matches nothing.",
+                      _shard_id);
+        return shardOp{
+            .valueType = searchFeatureRspType,
+            .valuePtr = rsp,
+        };
+    }
+
+    if (_segment) {
+        auto sorted = _segment->Search(query, topk, _tombstones, filter);
+        rsp->fts.swap(sorted);
+        return shardOp{
+            .valueType = searchFeatureRspType,
+            .valuePtr = rsp,
+        };
+    }
 
     FeatureTopkRanking rank(query, topk);
 
@@ -347,6 +441,13 @@ shardOp MemoryShardImpl::do_search_feature(const shardOp& input) {
     for (auto it = _cached_fts.begin(); it != _cached_fts.end(); it++) {
         const std::string& feature_id = it->first;
         const Feature& ft = it->second;
+        // filtered before ranking, so unmatched features never take topk slots.
+        if (!filter.empty()) {
+            auto meta = _cached_meta.find(feature_id);
+            if (meta == _cached_meta.end() || !match_metadata(filter, meta->second)) {
+                continue;
+            }
+        }
         rank.FeedIn(ft);
     }
 
@@ -365,7 +466,9 @@ shardOp MemoryShardImpl::do_close_shard(const shardOp& input) {
     auto req = std::static_pointer_cast<closeShardReq>(input.valuePtr);
     auto rsp = std::make_shared<closeShardRsp>();
 
-    // TODO
+    // no more writes, seal it.
+    _shard_info.is_closed = true;
+    start_sealing();
 
     shardOp output{
         .valueType = closeShardRspType,
@@ -374,4 +477,136 @@ shardOp MemoryShardImpl::do_close_shard(const shardOp& input) {
     return output;
 };
 
+shardOp MemoryShardImpl::do_seal_done(const shardOp& input) {
+    auto req = std::static_pointer_cast<sealDoneReq>(input.valuePtr);
+    auto rsp = std::make_shared<sealDoneRsp>();
+
+    // removes happened while building, are tombstones of the new segment.
+    std::unordered_set<std::string> tombstones;
+    for (const auto& feature_id : _removed_while_sealing) {
+        if (req->segment->Contains(feature_id)) {
+            tombstones.insert(feature_id);
+        }
+    }
+
+    _segment = req->segment;
+    _tombstones.swap(tombstones);
+    _removed_while_sealing.clear();
+    _is_sealing = false;
+    // tombstones of the previous segment are compacted away.
+    save_tombstones();
+
+    // features are in segment now, free the cache.
+    std::unordered_map<std::string, Feature>().swap(_cached_fts);
+    std::unordered_map<std::string, Metadata>().swap(_cached_meta);
+    _is_sealed.store(true);
+
+    spdlog::info("shard {} sealed, size: {}, tombstones: {}.", _shard_id, _segment->Size(),
+                 _tombstones.size());
+
+    shardOp output{
+        .valueType = sealDoneRspType,
+        .valuePtr = rsp,
+    };
+    return output;
+};
+
+bool MemoryShardImpl::is_indexed(const MetadataFilter& filter) {
+    const auto& keys = _seal.indexed_keys;
+    if (keys.empty()) {
+        return true;
+    }
+    for (const auto& predicate : filter) {
+        if (std::find(keys.begin(), keys.end(), predicate.key) == keys.end()) {
+            return false;
+        }
+    }
+    return true;
+};
+
+void MemoryShardImpl::start_sealing() {
+    if (_is_sealing) {
+        return;
+    }
+    _is_sealing = true;
+
+    // snapshot in loop, so that building does not race with adds/removes.
+    auto segment = _segment;
+    auto tombstones = _tombstones;
+    auto cached = segment ? std::unordered_map<std::string, Feature>{} : _cached_fts;
+    auto cached_meta = segment ? std::unordered_map<std::string, Metadata>{} : _cached_meta;
+    auto indexed_keys = _seal.indexed_keys;
+    std::string path = _seal.segment_dir.empty() ? "" : segment_path();
+
+    std::lock_guard<std::mutex> l(_seal_mu);
+    if (_seal_thread.joinable()) {
+        _seal_thread.join();
+    }
+
+    _seal_thread = std::thread([this, segment, tombstones, cached = std::move(cached),
+                                cached_meta = std::move(cached_meta), indexed_keys, path]() {
+        // compact existing segment, or build from cached features.
+        SealedSegmentPtr sealed = segment ? SealedSegment::Compact(*segment, tombstones)
+                                          : SealedSegment::Build(cached, {}, cached_meta,
+                                                                 indexed_keys);
+        if (!path.empty()) {
+            sealed->Save(path);
+        }
+
+        auto msg = NewWorkMessage(shardOp{
+            .valueType = sealDoneReqType,
+            .valuePtr = std::shared_ptr<sealDoneReq>(new sealDoneReq{sealed}),
+        });
+        _channel->enqueueNotification(msg);
+    });
+};
+
+std::string MemoryShardImpl::segment_path() {
+    return (std::filesystem::path(_seal.segment_dir) / (_db_id + "_" + _shard_id + ".seg"))
+        .string();
+};
+
+std::string MemoryShardImpl::tombstones_path() { return segment_path() + ".tombstones"; };
+
+RetCode MemoryShardImpl::save_tombstones() {
+    if (_seal.segment_dir.empty()) {
+        return RetCode::RET_OK;
+    }
+
+    // one feature id per line, written to a temp file and renamed like the segment.
+    std::string path = tombstones_path();
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        for (const auto& feature_id : _tombstones) {
+            out << feature_id << "\n";
+        }
+        if (!out.good()) {
+            spdlog::error("cannot write tombstones of shard {} to {}.", _shard_id, tmp);
+            return RetCode::RET_ERR;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        spdlog::error("cannot rename tombstones file {}: {}", tmp, ec.message());
+        return RetCode::RET_ERR;
+    }
+    return RetCode::RET_OK;
+};
+
+void MemoryShardImpl::load_tombstones() {
+    _tombstones.clear();
+
+    std::ifstream in(tombstones_path());
+    std::string feature_id;
+    while (std::getline(in, feature_id)) {
+        if (_segment->Contains(feature_id)) {
+            _tombstones.insert(feature_id);
+        }
+    }
+    spdlog::info("shard {} loaded {} tombstones.", _shard_id, _tombstones.size());
+};
+
 } // namespace donde_toolkits::feature_search::search_worker
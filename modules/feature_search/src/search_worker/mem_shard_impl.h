@@ -3,15 +3,21 @@
 #include "donde/feature_search/definitions.h"
 #include "donde/feature_search/driver.h"
 #include "donde/message.h"
+#include "nlohmann/json.hpp"
+#include "sealed_segment.h"
 #include "shard.h"
 
 #include <Poco/Thread.h>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+using json = nlohmann::json;
+
 namespace donde_toolkits ::feature_search ::search_worker {
 
 class ShardManagerImpl;
@@ -43,9 +49,15 @@ struct removeFeaturesRsp {};
 struct closeShardReq {};
 struct closeShardRsp {};
 
+struct sealDoneReq {
+    SealedSegmentPtr segment;
+};
+struct sealDoneRsp {};
+
 struct searchFeatureReq {
     Feature query;
     int topk;
+    MetadataFilter filter;
 };
 struct searchFeatureRsp {
     std::vector<FeatureSearchItem> fts;
@@ -67,6 +79,8 @@ enum shardOpType {
     searchFeatureRspType,
     searchFeatureReqType,
 
+    sealDoneReqType,
+    sealDoneRspType,
 };
 
 struct shardOp {
@@ -74,10 +88,27 @@ struct shardOp {
     std::shared_ptr<void> valuePtr;
 };
 
+struct SealOptions {
+    // sealed segments are written here, and loaded instead of driver next time.
+    // empty means segments are only kept in memory.
+    std::string segment_dir;
+    // compact the segment when tombstones exceed this ratio of it.
+    float compact_ratio = 0.2;
+    // metadata keys sealed segments index for filtered search, empty indexes all keys.
+    // filters on other keys match nothing, whether the shard is sealed or not.
+    std::vector<std::string> indexed_keys;
+};
+
+// MemoryShardImpl caches features of the shard in memory.
+//
+// Once the shard is closed, it's sealed in background into an immutable SealedSegment,
+// removes after that are tombstones, which are compacted when there are too many of them.
+// With a segment_dir, both the segment and its tombstones are saved there and loaded on restart.
 class MemoryShardImpl : public Shard {
 
   public:
-    MemoryShardImpl(ShardManager& shard_manager, Driver& driver, DBShard shard_info);
+    MemoryShardImpl(ShardManager& shard_manager, Driver& driver, DBShard shard_info,
+                    const SealOptions& seal = {});
     ~MemoryShardImpl();
 
     // Load features from driver; load index if needed.
@@ -90,10 +121,14 @@ class MemoryShardImpl : public Shard {
 
     // AddFeatures to this shard
     std::vector<std::string> AddFeatures(const std::vector<FeatureDbItem>& fts) override;
-    // RemoveFeatures from this shard
+    // RemoveFeatures from this shard, closed shard is still removable.
     RetCode RemoveFeatures(const std::vector<std::string>& feature_ids) override;
-    // SearchFeature in this shard, delegate to worker client to do the actual search.
+    // SearchFeature in this shard, among all features.
     std::vector<FeatureSearchItem> SearchFeature(const Feature& query, int topk) override;
+    // SearchFeature in this shard, among features matching filter. A filter on keys which are
+    // not indexed matches nothing, as sealed segments keep no metadata of those keys.
+    std::vector<FeatureSearchItem> SearchFeature(const Feature& query, int topk,
+                                                 const MetadataFilter& filter) override;
 
     // Close this shard, cannot add features from this shard, but still can search.
     RetCode Close() override;
@@ -108,6 +143,14 @@ class MemoryShardImpl : public Shard {
     // any api calls (add/search etc.)
     bool IsStopped() override { return _is_stopped.load(); };
 
+    // IsSealed return true if features are in sealed segment.
+    bool IsSealed() { return _is_sealed.load(); };
+
+    // ParseSealOptions from json config, missing fields keep default values.
+    //   {"segment_dir": "/var/lib/donde/segments", "compact_ratio": 0.2,
+    //    "indexed_keys": ["camera", "day"]}
+    static SealOptions ParseSealOptions(const json& conf);
+
     // Quick methods
     std::string GetShardID() override { return _shard_id; };
     DBShard GetShardInfo() override { return _shard_info; };
@@ -123,6 +166,21 @@ class MemoryShardImpl : public Shard {
 
     shardOp do_search_feature(const shardOp& input);
     shardOp do_close_shard(const shardOp& input);
+    shardOp do_seal_done(const shardOp& input);
+
+    // start_sealing build (or compact) segment in background, called in loop.
+    void start_sealing();
+
+    // is_indexed check every key of filter is indexed when sealed.
+    bool is_indexed(const MetadataFilter& filter);
+
+    std::string segment_path();
+
+    // tombstones of the segment are persisted next to it, so removed features stay removed
+    // when the segment is loaded again.
+    std::string tombstones_path();
+    RetCode save_tombstones();
+    void load_tombstones();
 
   private:
     DBShard _shard_info;
@@ -134,7 +192,20 @@ class MemoryShardImpl : public Shard {
     Driver& _driver;
 
     std::unordered_map<std::string, Feature> _cached_fts;
-
+    // metadata of cached features, filters unsealed searches, and is indexed when sealed.
+    std::unordered_map<std::string, Metadata> _cached_meta;
+
+    SealOptions _seal;
+    // following are only touched in loop.
+    SealedSegmentPtr _segment;
+    std::unordered_set<std::string> _tombstones;
+    // removed during sealing, become tombstones of the new segment.
+    std::unordered_set<std::string> _removed_while_sealing;
+    bool _is_sealing = false;
+    std::thread _seal_thread;
+    std::mutex _seal_mu;
+
+    std::atomic<bool> _is_sealed;
     std::atomic<bool> _is_loaded;
     std::atomic<bool> _is_stopped;
     std::shared_ptr<MsgChannel> _channel;
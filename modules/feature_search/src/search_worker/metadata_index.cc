@@ -0,0 +1,110 @@
+#include "metadata_index.h"
+
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace donde_toolkits ::feature_search ::search_worker {
+
+MetadataIndex::MetadataIndex(const std::vector<std::string>& keys)
+    : _keys(keys), _key_set(keys.begin(), keys.end()){};
+
+bool MetadataIndex::Indexed(const std::string& key) const {
+    return _key_set.empty() || _key_set.count(key) > 0;
+};
+
+void MetadataIndex::Add(uint32_t row, const std::map<std::string, std::string>& metadata) {
+    for (const auto& it : metadata) {
+        if (!Indexed(it.first)) {
+            continue;
+        }
+        KeyIndex& index = _index[it.first];
+        index.values[it.second].Add(row);
+
+        double number;
+        if (parse_metadata_number(it.second, number)) {
+            index.numbers[number].Add(row);
+        }
+    }
+};
+
+bool MetadataIndex::Evaluate(const MetadataFilter& filter, RowBitmap& rows) const {
+    std::vector<RowBitmap> matched;
+    for (const auto& predicate : filter) {
+        if (!Indexed(predicate.key)) {
+            spdlog::warn("metadata key {} is not indexed, cannot filter by it.", predicate.key);
+            return false;
+        }
+        matched.push_back(evaluate(predicate));
+        if (matched.back().Empty()) {
+            rows = RowBitmap();
+            return true;
+        }
+    }
+
+    // intersect from the smallest, so that intermediate results stay small.
+    std::sort(matched.begin(), matched.end(), [](const RowBitmap& a, const RowBitmap& b) {
+        return a.Cardinality() < b.Cardinality();
+    });
+    rows = matched.empty() ? RowBitmap() : std::move(matched[0]);
+    for (size_t i = 1; i < matched.size() && !rows.Empty(); i++) {
+        rows = RowBitmap::And(rows, matched[i]);
+    }
+    return true;
+};
+
+RowBitmap MetadataIndex::evaluate(const MetadataPredicate& predicate) const {
+    auto key_it = _index.find(predicate.key);
+    if (key_it == _index.end()) {
+        return {};
+    }
+    const KeyIndex& index = key_it->second;
+
+    std::vector<const RowBitmap*> postings;
+    switch (predicate.op) {
+    case META_EQ:
+    case META_IN: {
+        size_t count = predicate.op == META_EQ ? std::min<size_t>(1, predicate.values.size())
+                                               : predicate.values.size();
+        for (size_t i = 0; i < count; i++) {
+            auto it = index.values.find(predicate.values[i]);
+            if (it != index.values.end()) {
+                postings.push_back(&it->second);
+            }
+        }
+        break;
+    }
+    case META_RANGE: {
+        if (predicate.min > predicate.max) {
+            break;
+        }
+        auto end = index.numbers.upper_bound(predicate.max);
+        for (auto it = index.numbers.lower_bound(predicate.min); it != end; it++) {
+            postings.push_back(&it->second);
+        }
+        break;
+    }
+    }
+
+    if (postings.size() <= 2) {
+        RowBitmap rows;
+        for (auto posting : postings) {
+            rows = RowBitmap::Or(rows, *posting);
+        }
+        return rows;
+    }
+
+    // a wide range may cover many values, merging them one by one would copy the result for
+    // each value, so collect their rows and sort once.
+    std::vector<uint32_t> merged;
+    for (auto posting : postings) {
+        posting->ForEach([&merged](uint32_t row) { merged.push_back(row); });
+    }
+    std::sort(merged.begin(), merged.end());
+    RowBitmap rows;
+    for (uint32_t row : merged) {
+        rows.Add(row);
+    }
+    return rows;
+};
+
+} // namespace donde_toolkits::feature_search::search_worker
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "donde/feature_search/definitions.h"
+#include "row_bitmap.h"
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace donde_toolkits ::feature_search ::search_worker {
+
+// MetadataIndex keeps, for each indexed metadata key, posting lists of rows by value, so a
+// filter is evaluated into the rows to scan before any vector is touched.
+class MetadataIndex {
+  public:
+    // keys to index, empty indexes all keys.
+    MetadataIndex(const std::vector<std::string>& keys = {});
+
+    // Add metadata of row, rows must be added in increasing order.
+    void Add(uint32_t row, const std::map<std::string, std::string>& metadata);
+
+    // Evaluate filter into rows, false if it has a predicate on a key which is not indexed.
+    bool Evaluate(const MetadataFilter& filter, RowBitmap& rows) const;
+
+    bool Indexed(const std::string& key) const;
+
+    const std::vector<std::string>& Keys() const { return _keys; };
+
+  private:
+    struct KeyIndex {
+        std::map<std::string, RowBitmap> values;
+        // rows of values which are numbers, for ranges.
+        std::map<double, RowBitmap> numbers;
+    };
+
+    RowBitmap evaluate(const MetadataPredicate& predicate) const;
+
+  private:
+    std::vector<std::string> _keys;
+    std::unordered_set<std::string> _key_set;
+    std::unordered_map<std::string, KeyIndex> _index;
+};
+
+} // namespace donde_toolkits::feature_search::search_worker
@@ -0,0 +1,193 @@
+#include "row_bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace donde_toolkits ::feature_search ::search_worker {
+
+namespace {
+
+// a container turns into a bitset beyond this many rows, where the array outgrows 8KB.
+const uint32_t ARRAY_MAX = 4096;
+const size_t BITSET_WORDS = 65536 / 64;
+
+} // namespace
+
+void RowBitmap::Add(uint32_t row) {
+    uint16_t key = row >> 16;
+    uint16_t low = row & 0xffff;
+
+    if (_containers.empty() || _containers.back().key != key) {
+        _containers.emplace_back();
+        _containers.back().key = key;
+    }
+    Container& c = _containers.back();
+
+    if (c.bits.empty()) {
+        if (!c.array.empty() && c.array.back() >= low) {
+            return;
+        }
+        c.array.push_back(low);
+        c.cardinality++;
+        if (c.cardinality > ARRAY_MAX) {
+            to_bits(c);
+        }
+        return;
+    }
+
+    uint64_t mask = 1ull << (low % 64);
+    if ((c.bits[low / 64] & mask) == 0) {
+        c.bits[low / 64] |= mask;
+        c.cardinality++;
+    }
+};
+
+bool RowBitmap::Contains(uint32_t row) const {
+    uint16_t key = row >> 16;
+    uint16_t low = row & 0xffff;
+
+    auto it = std::lower_bound(_containers.begin(), _containers.end(), key,
+                               [](const Container& c, uint16_t k) { return c.key < k; });
+    if (it == _containers.end() || it->key != key) {
+        return false;
+    }
+    if (it->bits.empty()) {
+        return std::binary_search(it->array.begin(), it->array.end(), low);
+    }
+    return (it->bits[low / 64] >> (low % 64)) & 1;
+};
+
+size_t RowBitmap::Cardinality() const {
+    size_t cardinality = 0;
+    for (const auto& c : _containers) {
+        cardinality += c.cardinality;
+    }
+    return cardinality;
+};
+
+size_t RowBitmap::Bytes() const {
+    size_t bytes = 0;
+    for (const auto& c : _containers) {
+        bytes += sizeof(Container) + c.array.capacity() * sizeof(uint16_t)
+                 + c.bits.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+};
+
+RowBitmap RowBitmap::And(const RowBitmap& a, const RowBitmap& b) {
+    RowBitmap ret;
+    auto ia = a._containers.begin();
+    auto ib = b._containers.begin();
+    while (ia != a._containers.end() && ib != b._containers.end()) {
+        if (ia->key < ib->key) {
+            ia++;
+        } else if (ib->key < ia->key) {
+            ib++;
+        } else {
+            Container c = and_containers(*ia++, *ib++);
+            if (c.cardinality > 0) {
+                ret._containers.push_back(std::move(c));
+            }
+        }
+    }
+    return ret;
+};
+
+RowBitmap RowBitmap::Or(const RowBitmap& a, const RowBitmap& b) {
+    RowBitmap ret;
+    auto ia = a._containers.begin();
+    auto ib = b._containers.begin();
+    while (ia != a._containers.end() || ib != b._containers.end()) {
+        if (ib == b._containers.end() || (ia != a._containers.end() && ia->key < ib->key)) {
+            ret._containers.push_back(*ia++);
+        } else if (ia == a._containers.end() || ib->key < ia->key) {
+            ret._containers.push_back(*ib++);
+        } else {
+            ret._containers.push_back(or_containers(*ia++, *ib++));
+        }
+    }
+    return ret;
+};
+
+//// private apis
+
+void RowBitmap::to_bits(Container& c) {
+    c.bits.assign(BITSET_WORDS, 0);
+    for (uint16_t low : c.array) {
+        c.bits[low / 64] |= 1ull << (low % 64);
+    }
+    std::vector<uint16_t>().swap(c.array);
+};
+
+void RowBitmap::shrink(Container& c) {
+    if (c.bits.empty() || c.cardinality > ARRAY_MAX) {
+        return;
+    }
+    c.array.reserve(c.cardinality);
+    for (size_t w = 0; w < c.bits.size(); w++) {
+        uint64_t word = c.bits[w];
+        while (word != 0) {
+            c.array.push_back(w * 64 + __builtin_ctzll(word));
+            word &= word - 1;
+        }
+    }
+    std::vector<uint64_t>().swap(c.bits);
+};
+
+RowBitmap::Container RowBitmap::and_containers(const Container& a, const Container& b) {
+    Container c;
+    c.key = a.key;
+    if (a.bits.empty() && b.bits.empty()) {
+        std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                              std::back_inserter(c.array));
+    } else if (a.bits.empty() || b.bits.empty()) {
+        const Container& sparse = a.bits.empty() ? a : b;
+        const Container& dense = a.bits.empty() ? b : a;
+        for (uint16_t low : sparse.array) {
+            if ((dense.bits[low / 64] >> (low % 64)) & 1) {
+                c.array.push_back(low);
+            }
+        }
+    } else {
+        c.bits.resize(BITSET_WORDS);
+        for (size_t w = 0; w < BITSET_WORDS; w++) {
+            c.bits[w] = a.bits[w] & b.bits[w];
+            c.cardinality += __builtin_popcountll(c.bits[w]);
+        }
+        shrink(c);
+        return c;
+    }
+    c.cardinality = c.array.size();
+    return c;
+};
+
+RowBitmap::Container RowBitmap::or_containers(const Container& a, const Container& b) {
+    Container c;
+    c.key = a.key;
+    if (a.bits.empty() && b.bits.empty() && a.cardinality + b.cardinality <= ARRAY_MAX) {
+        std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                       std::back_inserter(c.array));
+        c.cardinality = c.array.size();
+        return c;
+    }
+
+    c.bits.assign(BITSET_WORDS, 0);
+    for (const Container* src : {&a, &b}) {
+        if (src->bits.empty()) {
+            for (uint16_t low : src->array) {
+                c.bits[low / 64] |= 1ull << (low % 64);
+            }
+        } else {
+            for (size_t w = 0; w < BITSET_WORDS; w++) {
+                c.bits[w] |= src->bits[w];
+            }
+        }
+    }
+    for (uint64_t word : c.bits) {
+        c.cardinality += __builtin_popcountll(word);
+    }
+    shrink(c);
+    return c;
+};
+
+} // namespace donde_toolkits::feature_search::search_worker
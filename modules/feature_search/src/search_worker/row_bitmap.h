@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace donde_toolkits ::feature_search ::search_worker {
+
+// RowBitmap is a compressed set of segment rows, in the way of roaring bitmaps.
+//
+// Rows are grouped by their high 16 bits into containers, a container keeps its low 16 bits as a
+// sorted array while it has at most 4096 rows, and as a 65536 bits bitset after that, so a
+// sparse posting list costs 2 bytes a row and a dense one 8KB a container.
+class RowBitmap {
+  public:
+    // Add row, rows must be added in increasing order, as segments are built.
+    void Add(uint32_t row);
+
+    bool Contains(uint32_t row) const;
+
+    size_t Cardinality() const;
+
+    bool Empty() const { return _containers.empty(); };
+
+    // memory of containers.
+    size_t Bytes() const;
+
+    static RowBitmap And(const RowBitmap& a, const RowBitmap& b);
+    static RowBitmap Or(const RowBitmap& a, const RowBitmap& b);
+
+    // ForEach calls fn(row) for each row, in increasing order.
+    template <typename Fn>
+    void ForEach(Fn&& fn) const {
+        for (const auto& c : _containers) {
+            uint32_t high = (uint32_t)c.key << 16;
+            if (c.bits.empty()) {
+                for (uint16_t low : c.array) {
+                    fn(high | low);
+                }
+                continue;
+            }
+            for (size_t w = 0; w < c.bits.size(); w++) {
+                uint64_t word = c.bits[w];
+                while (word != 0) {
+                    fn(high | (uint32_t)(w * 64 + __builtin_ctzll(word)));
+                    word &= word - 1;
+                }
+            }
+        }
+    }
+
+  private:
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        // sorted low bits while sparse, empty once converted to bits.
+        std::vector<uint16_t> array;
+        // BITSET_WORDS words once dense.
+        std::vector<uint64_t> bits;
+    };
+
+    static void to_bits(Container& c);
+    // convert back to array, if it is sparse again.
+    static void shrink(Container& c);
+
+    static Container and_containers(const Container& a, const Container& b);
+    static Container or_containers(const Container& a, const Container& b);
+
+  private:
+    // sorted by key.
+    std::vector<Container> _containers;
+};
+
+} // namespace donde_toolkits::feature_search::search_worker
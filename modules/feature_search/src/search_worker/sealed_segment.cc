@@ -0,0 +1,346 @@
+#include "sealed_segment.h"
+
+#include "donde/definitions.h"
+#include "donde/feature_search/definitions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <spdlog/spdlog.h>
+
+namespace donde_toolkits ::feature_search ::search_worker {
+
+namespace {
+
+const uint32_t SEGMENT_MAGIC = 0x47455344; // "DSEG"
+// version 2 appends indexed metadata. version 1 segments have none, they are not loaded but
+// resealed from the driver, rather than searched with an index that matches nothing.
+const uint32_t SEGMENT_VERSION = 2;
+
+template <typename T>
+inline void write_pod(std::ofstream& out, const T& v) {
+    out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+inline bool read_pod(std::ifstream& in, T& v) {
+    in.read(reinterpret_cast<char*>(&v), sizeof(T));
+    return in.good();
+}
+
+inline void write_string(std::ofstream& out, const std::string& s) {
+    write_pod(out, (uint32_t)s.size());
+    out.write(s.data(), s.size());
+}
+
+// bytes left in the file of size, lengths read from it are never trusted beyond that.
+inline uint64_t remaining(std::ifstream& in, uint64_t size) {
+    auto pos = in.tellg();
+    return pos < 0 || (uint64_t)pos > size ? 0 : size - (uint64_t)pos;
+}
+
+inline bool read_string(std::ifstream& in, std::string& s, uint64_t size) {
+    uint32_t len = 0;
+    if (!read_pod(in, len) || len > remaining(in, size)) {
+        return false;
+    }
+    s.resize(len);
+    in.read(s.data(), len);
+    return in.good();
+}
+
+} // namespace
+
+SealedSegmentPtr SealedSegment::Build(const std::unordered_map<std::string, Feature>& fts,
+                                      const std::unordered_set<std::string>& tombstones,
+                                      const std::unordered_map<std::string, Metadata>& metadata,
+                                      const std::vector<std::string>& indexed_keys) {
+    std::shared_ptr<SealedSegment> segment(new SealedSegment());
+    segment->_index = MetadataIndex(indexed_keys);
+
+    for (const auto& it : fts) {
+        if (tombstones.count(it.first) > 0) {
+            continue;
+        }
+        const Feature& ft = it.second;
+        if (segment->_dim == 0) {
+            segment->_dim = ft.raw.size();
+            segment->_data.reserve(fts.size() * segment->_dim);
+        }
+        if (ft.raw.size() != segment->_dim) {
+            spdlog::warn("feature {} has dim {}, expect {}, skip it.", it.first, ft.raw.size(),
+                         segment->_dim);
+            continue;
+        }
+
+        float len = 0.f;
+        for (float f : ft.raw) {
+            len += f * f;
+        }
+        len = sqrtf(len);
+
+        // keep indexed keys only.
+        Metadata meta;
+        auto meta_it = metadata.find(it.first);
+        if (meta_it != metadata.end()) {
+            for (const auto& kv : meta_it->second) {
+                if (segment->_index.Indexed(kv.first)) {
+                    meta.insert(kv);
+                }
+            }
+        }
+        segment->_index.Add(segment->_ids.size(), meta);
+        segment->_metadata.push_back(std::move(meta));
+
+        segment->_rows[it.first] = segment->_ids.size();
+        segment->_ids.push_back(it.first);
+        segment->_norms.push_back(len);
+        segment->_models.push_back(ft.model);
+        segment->_versions.push_back(ft.version);
+        for (float f : ft.raw) {
+            segment->_data.push_back(len > 0 ? f / len : 0.f);
+        }
+    }
+
+    return segment;
+};
+
+SealedSegmentPtr SealedSegment::Compact(const SealedSegment& segment,
+                                        const std::unordered_set<std::string>& tombstones) {
+    std::shared_ptr<SealedSegment> compacted(new SealedSegment());
+    compacted->_dim = segment._dim;
+    compacted->_index = MetadataIndex(segment._index.Keys());
+
+    for (size_t row = 0; row < segment.Size(); row++) {
+        const std::string& id = segment._ids[row];
+        if (tombstones.count(id) > 0) {
+            continue;
+        }
+        compacted->_index.Add(compacted->_ids.size(), segment._metadata[row]);
+        compacted->_metadata.push_back(segment._metadata[row]);
+        compacted->_rows[id] = compacted->_ids.size();
+        compacted->_ids.push_back(id);
+        compacted->_norms.push_back(segment._norms[row]);
+        compacted->_models.push_back(segment._models[row]);
+        compacted->_versions.push_back(segment._versions[row]);
+        compacted->_data.insert(compacted->_data.end(),
+                                segment._data.begin() + row * segment._dim,
+                                segment._data.begin() + (row + 1) * segment._dim);
+    }
+
+    return compacted;
+};
+
+RetCode SealedSegment::Save(const std::string& filepath) const {
+    std::string tmp = filepath + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            spdlog::error("cannot open segment file {} for writing.", tmp);
+            return RetCode::RET_ERR;
+        }
+
+        write_pod(out, SEGMENT_MAGIC);
+        write_pod(out, SEGMENT_VERSION);
+        write_pod(out, (uint64_t)Size());
+        write_pod(out, (uint64_t)_dim);
+        for (size_t row = 0; row < Size(); row++) {
+            write_string(out, _ids[row]);
+            write_string(out, _models[row]);
+            write_pod(out, (int32_t)_versions[row]);
+            write_pod(out, _norms[row]);
+        }
+        out.write(reinterpret_cast<const char*>(_data.data()), _data.size() * sizeof(float));
+
+        write_pod(out, (uint32_t)_index.Keys().size());
+        for (const auto& key : _index.Keys()) {
+            write_string(out, key);
+        }
+        for (const auto& meta : _metadata) {
+            write_pod(out, (uint32_t)meta.size());
+            for (const auto& kv : meta) {
+                write_string(out, kv.first);
+                write_string(out, kv.second);
+            }
+        }
+
+        if (!out.good()) {
+            spdlog::error("cannot write segment file {}.", tmp);
+            return RetCode::RET_ERR;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, filepath, ec);
+    if (ec) {
+        spdlog::error("cannot rename segment file {}: {}", tmp, ec.message());
+        return RetCode::RET_ERR;
+    }
+    return RetCode::RET_OK;
+};
+
+SealedSegmentPtr SealedSegment::Load(const std::string& filepath) {
+    std::ifstream in(filepath, std::ios::binary);
+    if (!in.is_open()) {
+        return nullptr;
+    }
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(filepath, ec);
+    if (ec) {
+        return nullptr;
+    }
+
+    uint32_t magic = 0, version = 0;
+    uint64_t rows = 0, dim = 0;
+    if (!read_pod(in, magic) || !read_pod(in, version) || magic != SEGMENT_MAGIC) {
+        spdlog::error("segment file {} is broken.", filepath);
+        return nullptr;
+    }
+    if (version != SEGMENT_VERSION) {
+        spdlog::warn("segment file {} is version {} rather than {}, it is stale.", filepath,
+                     version, SEGMENT_VERSION);
+        return nullptr;
+    }
+    if (!read_pod(in, rows) || !read_pod(in, dim)) {
+        spdlog::error("segment file {} is broken.", filepath);
+        return nullptr;
+    }
+
+    // rows and dim are checked against the file before anything is allocated by them, each
+    // row takes at least two string lengths, version, norm, and dim floats.
+    const uint64_t min_row_bytes = 2 * sizeof(uint32_t) + sizeof(int32_t) + sizeof(float);
+    uint64_t left = remaining(in, size);
+    if (rows > left / min_row_bytes
+        || (rows > 0 && dim > (left - rows * min_row_bytes) / sizeof(float) / rows)) {
+        spdlog::error("segment file {} is broken, {} rows of dim {} in {} bytes.", filepath,
+                      rows, dim, size);
+        return nullptr;
+    }
+
+    std::shared_ptr<SealedSegment> segment(new SealedSegment());
+    segment->_dim = dim;
+    for (uint64_t row = 0; row < rows; row++) {
+        std::string id, model;
+        int32_t ver = 0;
+        float norm = 0.f;
+        if (!read_string(in, id, size) || !read_string(in, model, size) || !read_pod(in, ver)
+            || !read_pod(in, norm)) {
+            spdlog::error("segment file {} is broken.", filepath);
+            return nullptr;
+        }
+        segment->_rows[id] = row;
+        segment->_ids.push_back(std::move(id));
+        segment->_models.push_back(std::move(model));
+        segment->_versions.push_back(ver);
+        segment->_norms.push_back(norm);
+    }
+
+    segment->_data.resize(rows * dim);
+    in.read(reinterpret_cast<char*>(segment->_data.data()), segment->_data.size() * sizeof(float));
+    if (!in.good()) {
+        spdlog::error("segment file {} is broken.", filepath);
+        return nullptr;
+    }
+
+    segment->_metadata.resize(rows);
+    uint32_t key_count = 0;
+    std::vector<std::string> keys;
+    bool ok = read_pod(in, key_count) && key_count <= remaining(in, size);
+    for (uint32_t i = 0; ok && i < key_count; i++) {
+        keys.emplace_back();
+        ok = read_string(in, keys.back(), size);
+    }
+    for (uint64_t row = 0; ok && row < rows; row++) {
+        uint32_t pairs = 0;
+        ok = read_pod(in, pairs) && pairs <= remaining(in, size);
+        for (uint32_t i = 0; ok && i < pairs; i++) {
+            std::string key, value;
+            ok = read_string(in, key, size) && read_string(in, value, size);
+            segment->_metadata[row][key] = value;
+        }
+    }
+    if (!ok) {
+        spdlog::error("segment file {} is broken.", filepath);
+        return nullptr;
+    }
+    segment->_index = MetadataIndex(keys);
+    for (uint64_t row = 0; row < rows; row++) {
+        segment->_index.Add(row, segment->_metadata[row]);
+    }
+
+    return segment;
+};
+
+std::vector<FeatureSearchItem>
+SealedSegment::Search(const Feature& query, int topk,
+                      const std::unordered_set<std::string>& tombstones,
+                      const MetadataFilter& filter) const {
+    if (topk <= 0 || Size() == 0 || query.raw.size() != _dim) {
+        return {};
+    }
+
+    // rows selected by filter, evaluated on bitmaps before any vector is read.
+    RowBitmap selected;
+    if (!filter.empty() && (!_index.Evaluate(filter, selected) || selected.Empty())) {
+        return {};
+    }
+
+    std::vector<float> norm_query = query.normalize(query.raw);
+
+    // min heap of (score, row), keeps best topk.
+    using Scored = std::pair<float, size_t>;
+    std::priority_queue<Scored, std::vector<Scored>, std::greater<Scored>> heap;
+
+    auto scan = [&](size_t row) {
+        const float* row_ptr = _data.data() + row * _dim;
+        float score = 0.f;
+        for (size_t i = 0; i < _dim; i++) {
+            score += row_ptr[i] * norm_query[i];
+        }
+
+        if ((int)heap.size() < topk) {
+            if (tombstones.empty() || tombstones.count(_ids[row]) == 0) {
+                heap.emplace(score, row);
+            }
+        } else if (heap.top().first < score) {
+            if (tombstones.empty() || tombstones.count(_ids[row]) == 0) {
+                heap.pop();
+                heap.emplace(score, row);
+            }
+        }
+    };
+
+    if (filter.empty()) {
+        for (size_t row = 0; row < Size(); row++) {
+            scan(row);
+        }
+    } else {
+        selected.ForEach(scan);
+    }
+
+    std::vector<FeatureSearchItem> ret;
+    ret.reserve(heap.size());
+    while (!heap.empty()) {
+        ret.emplace_back(restore(heap.top().second), heap.top().first);
+        heap.pop();
+    }
+    std::reverse(ret.begin(), ret.end());
+    return ret;
+};
+
+bool SealedSegment::Contains(const std::string& feature_id) const {
+    return _rows.count(feature_id) > 0;
+};
+
+Feature SealedSegment::restore(size_t row) const {
+    std::vector<float> raw(_data.begin() + row * _dim, _data.begin() + (row + 1) * _dim);
+    for (auto& f : raw) {
+        f *= _norms[row];
+    }
+    return Feature(std::move(raw), std::string(_models[row]), _versions[row]);
+};
+
+} // namespace donde_toolkits::feature_search::search_worker
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "donde/definitions.h"
+#include "donde/feature_search/definitions.h"
+#include "metadata_index.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace donde_toolkits ::feature_search ::search_worker {
+
+class SealedSegment;
+using SealedSegmentPtr = std::shared_ptr<const SealedSegment>;
+
+using Metadata = std::map<std::string, std::string>;
+
+// SealedSegment is the immutable, read optimized form of a closed shard.
+//
+// Features are normalized once and stored row by row in one contiguous buffer, so a search is a
+// sequential scan of dot products instead of normalizing both vectors per compare.
+// Removed features are tombstones kept by the owner, and dropped when the segment is compacted.
+// Metadata of indexed keys is kept as posting bitmaps in row order, a filtered search scans
+// only the rows they select.
+class SealedSegment {
+  public:
+    // Build segment from features, those in tombstones are skipped. metadata of features by id
+    // is indexed for indexed_keys, all keys if it is empty.
+    static SealedSegmentPtr Build(const std::unordered_map<std::string, Feature>& fts,
+                                  const std::unordered_set<std::string>& tombstones = {},
+                                  const std::unordered_map<std::string, Metadata>& metadata = {},
+                                  const std::vector<std::string>& indexed_keys = {});
+
+    // Compact rebuild the segment without tombstones.
+    static SealedSegmentPtr Compact(const SealedSegment& segment,
+                                    const std::unordered_set<std::string>& tombstones);
+
+    // Save segment to filepath, written to a temp file and renamed, so readers never see a
+    // partial segment.
+    RetCode Save(const std::string& filepath) const;
+
+    // Load segment from filepath, nullptr if file is missing, broken or of an older version.
+    static SealedSegmentPtr Load(const std::string& filepath);
+
+    // Search topk of rows matching filter. A filter on keys which are not indexed matches
+    // nothing.
+    std::vector<FeatureSearchItem> Search(const Feature& query, int topk,
+                                          const std::unordered_set<std::string>& tombstones,
+                                          const MetadataFilter& filter = {}) const;
+
+    bool Contains(const std::string& feature_id) const;
+
+    inline size_t Size() const { return _ids.size(); };
+    inline size_t Dimension() const { return _dim; };
+
+  private:
+    SealedSegment() = default;
+
+    // restore original feature from its normalized row.
+    Feature restore(size_t row) const;
+
+  private:
+    size_t _dim = 0;
+
+    std::vector<std::string> _ids;
+    std::unordered_map<std::string, size_t> _rows;
+
+    // per row meta, to restore original feature.
+    std::vector<float> _norms;
+    std::vector<std::string> _models;
+    std::vector<int> _versions;
+
+    // size() * _dim normalized floats.
+    std::vector<float> _data;
+
+    // per row metadata of indexed keys, for compaction and persistence.
+    std::vector<Metadata> _metadata;
+    MetadataIndex _index;
+};
+
+} // namespace donde_toolkits::feature_search::search_worker
@@ -35,9 +35,14 @@ class Shard {
     // RemoveFeatures from this shard
     virtual RetCode RemoveFeatures(const std::vector<std::string>& feature_ids) = 0;
 
-    // SearchFeature in this shard, delegate to worker client to do the actual search.
+    // SearchFeature in this shard, among all features.
     virtual std::vector<FeatureSearchItem> SearchFeature(const Feature& query, int topk) = 0;
 
+    // SearchFeature in this shard, among features matching filter.
+    virtual std::vector<FeatureSearchItem> SearchFeature(const Feature& query, int topk,
+                                                         const MetadataFilter& filter)
+        = 0;
+
     // Close this shard, cannot add features from this shard, but still can search.
     virtual RetCode Close() = 0;
 
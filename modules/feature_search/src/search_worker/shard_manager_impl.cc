@@ -43,6 +43,13 @@ RetCode ShardManagerImpl::ManageShard(std::string db_id, Shard* shard) {
 
 RetCode ShardManagerImpl::CloseShard(std::string db_id, std::string shard_id) {
     _driver.CloseShard(db_id, shard_id);
+
+    // closed shard is sealed in background, see MemoryShardImpl.
+    for (auto& s : ListShards(db_id)) {
+        if (s->GetShardID() == shard_id) {
+            s->Close();
+        }
+    }
     return {};
 };
 
@@ -1,5 +1,7 @@
 #include "donde/feature_search/simple_driver.h"
 
+#include "donde/feature_serialize.h"
+
 #include <SQLiteCpp/Database.h>
 #include <SQLiteCpp/Statement.h>
 #include <chrono>
@@ -11,7 +13,6 @@
 #include <iterator>
 #include <map>
 #include <memory>
-//// #include <msgpack.hpp>
 #include <nlohmann/json_fwd.hpp>
 #include <opencv2/core/hal/interface.h>
 
@@ -97,16 +98,27 @@ void SimpleDriver::CreateWorker(const std::string& worker_id, const WorkerItem&
 void SimpleDriver::UpdateWorker(const std::string& worker_id, const WorkerItem& worker){};
 
 // Shard management
-std::vector<DBShard> SimpleDriver::ListShards(const std::string& db_id) { return {}; };
+std::vector<DBShard> SimpleDriver::ListShards(const std::string& db_id) {
+    return list_db_shards(db_id);
+};
 
 std::string SimpleDriver::CreateShard(const std::string& db_id, const DBShard& shard) {
-    return {};
+    std::string shard_id = shard.shard_id.empty() ? generate_uuid() : shard.shard_id;
+    if (insert_into_db_shards(db_id, shard_id, shard) != RetCode::RET_OK) {
+        return {};
+    }
+    return shard_id;
 };
 
-RetCode SimpleDriver::UpdateShard(const std::string& db_id, const DBShard& shard) { return {}; };
+RetCode SimpleDriver::UpdateShard(const std::string& db_id, const DBShard& shard) {
+    return update_db_shard(db_id, shard);
+};
 
 std::string SimpleDriver::CloseShard(const std::string& db_id, const std::string& shard) {
-    return {};
+    if (close_db_shard(db_id, shard) != RetCode::RET_OK) {
+        return {};
+    }
+    return shard;
 };
 
 PageData<FeatureDbItemList> SimpleDriver::ListFeatures(uint page, uint perPage,
@@ -128,6 +140,15 @@ PageData<FeatureDbItemList> SimpleDriver::ListFeatures(uint page, uint perPage,
     return ret;
 };
 
+FeatureDbItemList SimpleDriver::ListFeatures(uint perPage, PagingState& state,
+                                             const std::string& db_id,
+                                             const std::string& shard_id) {
+    if (state.done || perPage == 0) {
+        return {};
+    }
+    return list_features_from_db(state, perPage, db_id, shard_id);
+};
+
 RetCode SimpleDriver::Init(const std::vector<std::string>& initial_db_ids) {
     // init tables.
     for (const auto& id : initial_db_ids) {
@@ -146,35 +167,41 @@ std::vector<std::string> SimpleDriver::AddFeatures(const std::vector<FeatureDbIt
     for (auto& item : features) {
         auto ft = item.feature;
 
-        std::string feature_id = generate_uuid();
+        // replicas of a shard are given the same ids by the coordinator.
+        std::string feature_id = item.feature_id.empty() ? generate_uuid() : item.feature_id;
         // std::cout << "generated feature_id: " << feature_id << std::endl;
 
         auto filepath = _data_dir / (feature_id + ".ft");
         try {
             std::ofstream file(filepath, std::ios::binary | std::ios::out);
-            std::stringstream ss;
-            //// msgpack::pack(ss, ft);
-
-            //// // write to file
-            //// std::string data(ss.str());
-            //// file << data;
+            if (WriteFeature(file, ft) != RET_OK) {
+                throw std::runtime_error("write feature failed");
+            }
 
             json j(item.metadata); // must use (), while not {}
             std::string meta_str{j.dump()};
             metadatas.push_back(meta_str);
 
-            // std::cout << "write data.size" << data.size() << std::endl;
             feature_ids.push_back(feature_id);
 
         } catch (const std::exception& exc) {
             spdlog::error("cannot save feature to : {}, exc: {}", filepath.string(), exc.what());
-            feature_ids.push_back("");
-            metadatas.push_back("{}");
+            std::error_code ec;
+            std::filesystem::remove(filepath, ec);
+            break;
         }
     }
 
-    // insert feature to meta db.
-    insert_features_into_db(feature_ids, metadatas, db_id, shard_id);
+    // insert feature to meta db, only if every file is written, the batch is stored or not as
+    // a whole, rows without features or ids are never left behind.
+    if (feature_ids.size() != features.size()
+        || insert_features_into_db(feature_ids, metadatas, db_id, shard_id) != RET_OK) {
+        for (auto& feature_id : feature_ids) {
+            std::error_code ec;
+            std::filesystem::remove(_data_dir / (feature_id + ".ft"), ec);
+        }
+        return {};
+    }
 
     return feature_ids;
 };
@@ -190,22 +217,16 @@ std::vector<Feature> SimpleDriver::LoadFeatures(const std::vector<std::string>&
 
         auto filepath = _data_dir / (feature_id + ".ft");
         try {
-            // read to string
             std::ifstream file(filepath, std::ios::binary | std::ios::in);
-            std::string data = std::string(std::istreambuf_iterator<char>(file),
-                                           std::istreambuf_iterator<char>());
-
-            // std::cout << "filepath: " << filepath << std::endl;
-            // std::cout << "data.size(): " << data.size() << std::endl;
-            //// auto oh = msgpack::unpack(data.data(), data.size());
-            //// Feature ft = oh.get().as<Feature>();
-            //// // ft.debugPrint();
-
-            //// features.push_back(ft);
+            Feature ft;
+            if (ReadFeature(file, ft) != RET_OK) {
+                throw std::runtime_error("read feature failed");
+            }
+            features.push_back(std::move(ft));
         } catch (const std::exception& exc) {
             spdlog::error("cannot load feature, feature_path: {}, exc: {}", filepath.string(),
                           exc.what());
-            features.push_back({});
+            return {};
         }
     }
 
@@ -259,7 +280,11 @@ RetCode SimpleDriver::init_user_db_table() {
                        "is_closed boolean, "
                        "created_at datetime, "
                        "updated_at datetime, "
-                       "deleted_at datetime "
+                       "deleted_at datetime, "
+                       "worker_id char(64), "
+                       "replica_worker_ids text, "
+                       "used integer, "
+                       "used_bytes integer "
                        ");";
     try {
         db->exec(sql2);
@@ -268,6 +293,16 @@ RetCode SimpleDriver::init_user_db_table() {
         return RetCode::RET_ERR;
     }
 
+    // tables created before replicas and usage were persisted miss their columns, sqlite fails
+    // to add a column which exists already, that's fine.
+    for (const char* column : {"worker_id char(64)", "replica_worker_ids text", "used integer",
+                               "used_bytes integer"}) {
+        try {
+            db->exec(std::string("alter table db_shards add column ") + column + ";");
+        } catch (std::exception&) {
+        }
+    }
+
     return RetCode::RET_OK;
 };
 
@@ -373,26 +408,77 @@ RetCode SimpleDriver::delete_user_db(const std::string& db_id) {
 };
 
 RetCode SimpleDriver::insert_into_db_shards(const std::string& db_id, const std::string& shard_id,
-                                            uint64 capacity) {
+                                            const DBShard& shard) {
     try {
         std::string sql("insert into db_shards(db_id, shard_id, capacity, is_closed, "
-                        "created_at) values (?, ?, ?, ?, ?);");
+                        "created_at, worker_id, replica_worker_ids, used, used_bytes) "
+                        "values (?, ?, ?, ?, ?, ?, ?, ?, ?);");
 
-        time_t now = time(nullptr);
+        // created_at is kept in seconds like other tables, shards count their age in ms.
+        int64 created_at = shard.created_at > 0 ? shard.created_at / 1000 : time(nullptr);
 
         SQLite::Statement query(*db, sql);
 
         query.bind(1, db_id);
         query.bind(2, shard_id);
-        query.bind(3, int64(capacity));
+        query.bind(3, int64(shard.capacity));
 
         // sqlite3 treat boolean as int, so 0 is false.
-        query.bind(4, 0);
-        query.bind(5, int64(now));
+        query.bind(4, shard.is_closed ? 1 : 0);
+        query.bind(5, created_at);
+        query.bind(6, shard.worker_id);
+        query.bind(7, json(shard.replica_worker_ids).dump());
+        query.bind(8, int64(shard.used));
+        query.bind(9, int64(shard.used_bytes));
 
         query.exec();
     } catch (std::exception& exc) {
-        spdlog::error("cannot insert into dbs table, exc: {}", exc.what());
+        spdlog::error("cannot insert into db_shards table, exc: {}", exc.what());
+        return RetCode::RET_ERR;
+    }
+
+    return RetCode::RET_OK;
+};
+
+RetCode SimpleDriver::update_db_shard(const std::string& db_id, const DBShard& shard) {
+    try {
+        // is_closed is only set by close_db_shard, an update racing with closing must not
+        // open the shard again.
+        std::string sql("update db_shards set worker_id=?, replica_worker_ids=?, used=?, "
+                        "used_bytes=?, updated_at=? where db_id = ? and shard_id = ?;");
+
+        SQLite::Statement query(*db, sql);
+        query.bind(1, shard.worker_id);
+        query.bind(2, json(shard.replica_worker_ids).dump());
+        query.bind(3, int64(shard.used));
+        query.bind(4, int64(shard.used_bytes));
+        query.bind(5, int64(time(nullptr)));
+        query.bind(6, db_id);
+        query.bind(7, shard.shard_id);
+
+        query.exec();
+    } catch (std::exception& exc) {
+        spdlog::error("cannot update db_shards table, exc: {}", exc.what());
+        return RetCode::RET_ERR;
+    }
+
+    return RetCode::RET_OK;
+};
+
+RetCode SimpleDriver::close_db_shard(const std::string& db_id, const std::string& shard_id) {
+    try {
+        std::string sql("update db_shards set is_closed=?, updated_at=? "
+                        "where db_id = ? and shard_id = ?;");
+
+        SQLite::Statement query(*db, sql);
+        query.bind(1, 1);
+        query.bind(2, int64(time(nullptr)));
+        query.bind(3, db_id);
+        query.bind(4, shard_id);
+
+        query.exec();
+    } catch (std::exception& exc) {
+        spdlog::error("cannot update db_shards table, exc: {}", exc.what());
         return RetCode::RET_ERR;
     }
 
@@ -403,27 +489,41 @@ std::vector<DBShard> SimpleDriver::list_db_shards(const std::string& db_id) {
     std::vector<DBShard> shards;
 
     try {
-        std::string sql("select db_id, shard_id, capacity, is_closed from db_shards;");
+        std::string sql("select db_id, shard_id, capacity, is_closed, worker_id, "
+                        "replica_worker_ids, used, used_bytes, created_at from db_shards "
+                        "where db_id = ?;");
 
         SQLite::Statement query(*db, sql);
+        query.bind(1, db_id);
         while (query.executeStep()) {
-            std::string db_id = query.getColumn(0).getString();
-            std::string shard_id = query.getColumn(1).getText();
+            DBShard shard{};
+            shard.db_id = query.getColumn(0).getString();
+            shard.shard_id = query.getColumn(1).getText();
             // type convert, int64 => uint64, because we are sure that capacity will not
             // exceed int64, so that's fine
-            uint64 capacity = query.getColumn(2).getInt64();
+            shard.capacity = query.getColumn(2).getInt64();
             // sqlite3 treat boolean as int
-            bool is_closed = query.getColumn(3).getInt() == 1;
-
-            shards.push_back(DBShard{
-                .db_id = db_id,
-                .shard_id = shard_id,
-                .capacity = capacity,
-                .is_closed = is_closed,
-            });
+            shard.is_closed = query.getColumn(3).getInt() == 1;
+            shard.worker_id = query.getColumn(4).getText();
+
+            // rows of older tables have no replicas, the primary is the only one then.
+            std::string replicas = query.getColumn(5).getText();
+            if (!replicas.empty()) {
+                shard.replica_worker_ids = json::parse(replicas).get<std::vector<std::string>>();
+            }
+            if (shard.replica_worker_ids.empty() && !shard.worker_id.empty()) {
+                shard.replica_worker_ids.push_back(shard.worker_id);
+            }
+
+            // usage is null in rows of older tables, which reads as 0.
+            shard.used = query.getColumn(6).getInt64();
+            shard.used_bytes = query.getColumn(7).getInt64();
+            shard.created_at = query.getColumn(8).getInt64() * 1000;
+
+            shards.push_back(shard);
         }
     } catch (std::exception& exc) {
-        spdlog::error("cannot select from dbs table: {}", exc.what());
+        spdlog::error("cannot select from db_shards table: {}", exc.what());
     }
 
     return shards;
@@ -576,6 +676,53 @@ std::vector<FeatureDbItem> SimpleDriver::list_features_from_db(int start, int li
     return feature_ids;
 };
 
+std::vector<FeatureDbItem> SimpleDriver::list_features_from_db(PagingState& state, int limit,
+                                                               const std::string& db_id,
+                                                               const std::string& shard_id) {
+    std::vector<FeatureDbItem> feature_ids;
+
+    try {
+        // rows are listed by primary key, from right after the last page.
+        std::stringstream ss;
+        ss << "select id, feature_id, metadata from " << feature_table_name(db_id);
+        if (shard_id.size() > 0) {
+            ss << " where id > ? and shard_id = ? order by id limit ? ;";
+        } else {
+            ss << " where id > ?                  order by id limit ? ;";
+        }
+
+        SQLite::Statement query(*db, ss.str());
+        query.bind(1, state.last_id);
+        if (shard_id.size() > 0) {
+            query.bind(2, shard_id);
+            query.bind(3, limit);
+        } else {
+            query.bind(2, limit);
+        }
+
+        while (query.executeStep()) {
+            state.last_id = query.getColumn(0).getInt64();
+            std::string feature_id = query.getColumn(1).getString();
+            std::string meta_str = query.getColumn(2).getText();
+
+            json j(json::parse(meta_str));
+            std::map<std::string, std::string> meta_map = j;
+
+            feature_ids.push_back(FeatureDbItem{
+                .feature_id = feature_id,
+                .metadata = meta_map,
+            });
+        }
+    } catch (std::exception& exc) {
+        spdlog::error("cannot select from features table {}: {}", feature_table_name(db_id),
+                      exc.what());
+        return feature_ids;
+    }
+
+    state.done = feature_ids.size() < size_t(limit);
+    return feature_ids;
+};
+
 uint64 SimpleDriver::count_features_in_db(const std::string& db_id, const std::string& shard_id) {
     int count;
 
@@ -0,0 +1,101 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace donde_toolkits ::video_process {
+
+template <typename T>
+struct AVTraits;
+
+template <>
+struct AVTraits<AVPacket> {
+    static AVPacket* alloc() { return av_packet_alloc(); };
+    static void unref(AVPacket* packet) { av_packet_unref(packet); };
+    static void free(AVPacket* packet) { av_packet_free(&packet); };
+};
+
+template <>
+struct AVTraits<AVFrame> {
+    static AVFrame* alloc() { return av_frame_alloc(); };
+    static void unref(AVFrame* frame) { av_frame_unref(frame); };
+    static void free(AVFrame* frame) { av_frame_free(&frame); };
+};
+
+// AVPool recycles AVPacket or AVFrame objects, instead of allocating one per packet or frame.
+//
+// A released object is unref'd, which hands its data buffers back to the decoder's own buffer
+// pools, and kept empty for the next Acquire.
+// It is held by shared_ptr, since objects may outlive their producer.
+template <typename T>
+class AVPool : public std::enable_shared_from_this<AVPool<T>> {
+  public:
+    static std::shared_ptr<AVPool> Create(size_t capacity) {
+        return std::shared_ptr<AVPool>(new AVPool(capacity));
+    };
+
+    ~AVPool() {
+        for (T* object : objects_) {
+            AVTraits<T>::free(object);
+        }
+    };
+
+    // Acquire an empty object, nullptr if it cannot be allocated. It goes back to pool when the
+    // last handle is released.
+    std::shared_ptr<T> Acquire() {
+        T* object = nullptr;
+        {
+            std::lock_guard<std::mutex> l(mu_);
+            if (!objects_.empty()) {
+                object = objects_.back();
+                objects_.pop_back();
+            }
+        }
+        if (object == nullptr) {
+            object = AVTraits<T>::alloc();
+            if (object == nullptr) {
+                return nullptr;
+            }
+        }
+
+        std::shared_ptr<AVPool> pool = this->shared_from_this();
+        return std::shared_ptr<T>(object, [pool](T* object) { pool->release(object); });
+    };
+
+    size_t Size() {
+        std::lock_guard<std::mutex> l(mu_);
+        return objects_.size();
+    };
+
+  private:
+    AVPool(size_t capacity) : capacity_(capacity){};
+
+    void release(T* object) {
+        AVTraits<T>::unref(object);
+        {
+            std::lock_guard<std::mutex> l(mu_);
+            if (objects_.size() < capacity_) {
+                objects_.push_back(object);
+                return;
+            }
+        }
+        AVTraits<T>::free(object);
+    };
+
+  private:
+    const size_t capacity_;
+    std::mutex mu_;
+    std::vector<T*> objects_;
+};
+
+using PacketPool = AVPool<AVPacket>;
+using FramePool = AVPool<AVFrame>;
+
+} // namespace donde_toolkits::video_process
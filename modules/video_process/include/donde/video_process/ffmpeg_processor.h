@@ -39,6 +39,7 @@ class FFmpegVideoProcessor : public VideoProcessor {
     FFmpegVideoProcessor();
 
     VideoStreamInfo OpenVideoContext(const std::string& filepath);
+    VideoStreamInfo OpenVideoContext(const std::string& filepath, const CodecOptions& opts);
     void Process(const ProcessOptions& opts);
 
     bool Register(const FFmpegVideoFrameProcessor& p);
@@ -7,9 +7,13 @@ extern "C" {
 #include <libswscale/swscale.h>
 }
 
+#include "av_pool.h"
 #include "ffmpeg_processor.h"
+#include "motion_gate.h"
 #include "msd/channel.hpp"
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <memory>
 #include <string>
@@ -17,11 +21,17 @@ extern "C" {
 
 namespace donde_toolkits ::video_process {
 
+// set_codec_threads must be called before the codec is opened.
+void set_codec_threads(AVCodecContext* codec_context, const CodecOptions& opts);
+
+void set_skip_mode(AVCodecContext* codec_context, SkipMode mode);
+
 class FFmpegVideoProcessorImpl {
   public:
     FFmpegVideoProcessorImpl();
 
-    VideoStreamInfo OpenVideoContext(const std::string& filepath);
+    VideoStreamInfo OpenVideoContext(const std::string& filepath,
+                                     const CodecOptions& opts = CodecOptions{});
 
     void Process(const ProcessOptions& opts);
 
@@ -48,8 +58,18 @@ class FFmpegVideoProcessorImpl {
 
     void monitor();
 
+    // pace waits until frame should be presented, in real time mode.
+    void pace(const AVFrame* frame);
+
+    // decoded frame and the id it is processed with.
+    struct DecodedFrame {
+        long id = 0;
+        std::shared_ptr<AVFrame> frame;
+    };
+
   private:
     std::string video_filepath_;
+    CodecOptions codec_opts_;
 
     AVFormatContext* format_context_ = nullptr;
     AVCodecContext* codec_context_ = nullptr;
@@ -59,7 +79,8 @@ class FFmpegVideoProcessorImpl {
     size_t video_width_ = 0;
     size_t video_height_ = 0;
 
-    bool quit_ = false;
+    // read by all threads, set by Stop.
+    std::atomic<bool> quit_ = false;
     bool pause_ = false;
 
     std::mutex demux_mu_;
@@ -85,10 +106,24 @@ class FFmpegVideoProcessorImpl {
     int warm_up_frames_ = 0;
     int skip_frames_ = 1;
 
-    // used to send demuxed packet, un-buffered
-    msd::channel<AVPacket*> packet_ch_{1};
-    // used to send decoded frame, un-buffered
-    msd::channel<AVFrame*> frame_ch_{1};
+    // pts and wall clock of the first paced frame, reset after pause.
+    bool pace_started_ = false;
+    double pace_speed_ = 1.0;
+    double pace_start_pts_ = 0;
+    std::chrono::steady_clock::time_point pace_start_time_;
+
+    // drops frames of a static scene, in decode thread.
+    std::unique_ptr<MotionGate> motion_gate_;
+
+    // packets and frames are recycled, instead of cloned and freed one by one.
+    std::shared_ptr<PacketPool> packet_pool_;
+    std::shared_ptr<FramePool> frame_pool_;
+
+    // used to send demuxed packet, created by Process with packet_queue_size.
+    std::unique_ptr<msd::channel<std::shared_ptr<AVPacket>>> packet_ch_;
+    // used to send decoded frame to be processed, created by Process with frame_queue_size.
+    // warm up and skipped frames are dropped by decode thread, before cloned.
+    std::unique_ptr<msd::channel<DecodedFrame>> frame_ch_;
 };
 
 } // namespace donde_toolkits::video_process
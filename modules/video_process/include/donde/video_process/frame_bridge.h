@@ -0,0 +1,61 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#include "donde/definitions.h"
+#include "donde/mat_pool.h"
+#include "ffmpeg_processor.h"
+
+#include <memory>
+#include <mutex>
+
+struct SwsContext;
+
+namespace donde_toolkits ::video_process {
+
+// FrameBridgeOptions
+// max_width and max_height scale frames down to fit, keeping aspect ratio, usually the detector
+// input size. 0 keeps the video size.
+struct FrameBridgeOptions {
+    int max_width = 0;
+    int max_height = 0;
+    int pool_size = 4;
+};
+
+// FrameBridge converts decoded video frames into BGR Frames for the face pipeline.
+//
+// Color conversion and scaling are done by one sws_scale, which writes straight into a pooled
+// cv::Mat, so the only copy of a frame is the conversion itself.
+//
+//   FrameBridge bridge({.max_width = 672, .max_height = 384});
+//   processor.Register([&](const FFmpegVideoFrame* f) {
+//       return pipeline.Submit(bridge.Convert(f)) == RET_OK;
+//   });
+class FrameBridge {
+  public:
+    FrameBridge(const FrameBridgeOptions& opts = {});
+    ~FrameBridge();
+
+    // Convert av_frame to a Frame, nullptr if it cannot be converted.
+    // The returned frame does not refer to av_frame, which can be freed right after.
+    std::shared_ptr<Frame> Convert(const AVFrame* av_frame);
+    std::shared_ptr<Frame> Convert(const FFmpegVideoFrame* frame);
+
+    // buffers pooled for reuse now.
+    size_t Pooled();
+
+  private:
+    cv::Size output_size(int width, int height) const;
+
+  private:
+    FrameBridgeOptions _opts;
+    std::shared_ptr<MatPool> _pool;
+
+    // sws context is not thread safe, it is recreated only when input or output changes.
+    std::mutex _mu;
+    SwsContext* _sws_context = nullptr;
+};
+
+} // namespace donde_toolkits::video_process
@@ -0,0 +1,50 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#include "processor.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace donde_toolkits ::video_process {
+
+// MotionGate tells frames with significant change from frames of a static scene, cheaply enough
+// to run on every decoded frame.
+//
+// It works on the luma plane of planar or semi planar yuv frames, which is what decoders output,
+// sampled down to a small grid. Frames of other pixel formats always pass.
+// It is not thread safe, use one gate a stream.
+class MotionGate {
+  public:
+    MotionGate(const MotionGateOptions& opts);
+
+    // Pass returns true if frame should be processed.
+    bool Pass(const AVFrame* frame);
+
+    inline uint64_t Passed() const { return passed_; };
+    inline uint64_t Gated() const { return gated_; };
+
+  private:
+    // sample luma of frame into cells, false if pixel format has no 8 bit luma plane.
+    bool sample(const AVFrame* frame, std::vector<int>& cells) const;
+    bool changed(const std::vector<int>& cells) const;
+
+  private:
+    MotionGateOptions opts_;
+
+    // cells of the last passed frame.
+    std::vector<int> reference_;
+    int reference_width_ = 0;
+    int reference_height_ = 0;
+    int since_passed_ = 0;
+
+    std::vector<int> cells_;
+
+    uint64_t passed_ = 0;
+    uint64_t gated_ = 0;
+};
+
+} // namespace donde_toolkits::video_process
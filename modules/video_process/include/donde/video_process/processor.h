@@ -5,11 +5,59 @@
 
 namespace donde_toolkits ::video_process {
 
+// SkipMode tells decoder which frames to drop before decoding them.
+enum SkipMode {
+    // decode every frame, skip_frames drops them after decoding.
+    SKIP_NONE = 0,
+    // drop frames no other frame refers to, usually b-frames.
+    SKIP_NONREF = 1,
+    // decode key frames only, one frame a gop.
+    SKIP_NONKEY = 2,
+};
+
+enum CodecThreadType {
+    THREAD_FRAME = 1,
+    THREAD_SLICE = 2,
+};
+
+// CodecOptions, applied when video context is opened.
+struct CodecOptions {
+    // decode threads, 0 for one a cpu.
+    int threads = 0;
+    // THREAD_FRAME and/or THREAD_SLICE. Frame threading scales better but delays output by a
+    // frame a thread, slice threading keeps latency low for live streams.
+    int thread_type = THREAD_FRAME | THREAD_SLICE;
+};
+
+// MotionGateOptions, frames of a static scene are dropped before any processor sees them.
+// A frame passes when changed_ratio of its cells differ from the last passed frame by more than
+// pixel_threshold luma levels, after overall brightness change is taken out.
+struct MotionGateOptions {
+    bool enable = false;
+    // luma is averaged down to grid_width x grid_height cells.
+    int grid_width = 32;
+    int grid_height = 18;
+    int pixel_threshold = 12;
+    double changed_ratio = 0.01;
+    // a frame passes at least every keep_alive_frames, 0 disables.
+    int keep_alive_frames = 50;
+};
+
 struct ProcessOptions {
     int warm_up_frames;
     int skip_frames;
     int decode_fps;
     bool loop_forever;
+    // frames dropped by skip_mode are never decoded, skip_frames then counts the frames left.
+    SkipMode skip_mode = SKIP_NONE;
+    // gates frames left after skipping.
+    MotionGateOptions motion_gate;
+    // offline decodes as fast as possible, for recorded footage. Otherwise frames are paced by
+    // their pts, at decode_fps / stream frame rate speed (real time if decode_fps is 0).
+    bool offline = false;
+    // bounded queues between demux, decode and process threads.
+    int packet_queue_size = 32;
+    int frame_queue_size = 8;
 };
 
 struct VideoStreamInfo {
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "ffmpeg_processor.h"
+#include "processor.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace donde_toolkits ::video_process {
+
+struct StreamManagerOptions {
+    // demux and decode threads shared by all streams, 0 for one a cpu.
+    int workers = 0;
+    // threads delivering decoded frames to consumers.
+    int consumers = 2;
+    // packets a stream demuxes and decodes in one turn, before the worker moves to next stream.
+    int packets_per_turn = 4;
+    // a stream without data to read waits this long for its next turn, instead of holding a
+    // worker, streams are read non-blocking.
+    int idle_wait_ms = 10;
+    // with many streams parallelism comes from streams, so every decoder is single threaded.
+    CodecOptions codec{.threads = 1, .thread_type = THREAD_SLICE};
+};
+
+struct StreamOptions {
+    // decoded frames waiting for consumer.
+    int frame_queue_size = 4;
+    // drop_stale drops the oldest frame when queue is full, for live cameras. Otherwise the stream
+    // is not demuxed until consumer catches up, for recorded files.
+    bool drop_stale = true;
+    SkipMode skip_mode = SKIP_NONE;
+    int skip_frames = 1;
+    MotionGateOptions motion_gate;
+    // open (connect and probe) fails after open_timeout_ms, and a read which still blocks, or a
+    // source which sends no data, for read_timeout_ms ends the stream, so a stalled source holds
+    // a shared worker no longer.
+    int open_timeout_ms = 5000;
+    int read_timeout_ms = 5000;
+};
+
+struct StreamStats {
+    // decoded and delivered frames a second, over the last second.
+    double fps_in = 0;
+    double fps_out = 0;
+    uint64_t frames_in = 0;
+    uint64_t frames_out = 0;
+    uint64_t dropped = 0;
+    // frames of a static scene, dropped by motion gate.
+    uint64_t gated = 0;
+    size_t queue_depth = 0;
+    // false once stream ended or failed.
+    bool running = false;
+};
+
+class VideoStreamManagerImpl;
+
+// VideoStreamManager multiplexes many video streams onto shared worker threads, instead of three
+// threads a stream as FFmpegVideoProcessor does.
+//
+// Streams take turns on workers round robin. Frames of a stream are delivered to its consumer in
+// order, one at a time, consumers of different streams run concurrently.
+//
+//   VideoStreamManager manager({.workers = 8});
+//   int id = manager.AddStream("rtsp://camera-1/live", [&](const FFmpegVideoFrame* f) {
+//       return pipeline.Submit(bridge.Convert(f)) == RET_OK;
+//   });
+class VideoStreamManager {
+  public:
+    VideoStreamManager(const StreamManagerOptions& opts = {});
+    ~VideoStreamManager();
+
+    // AddStream opens url on a worker and starts decoding, returns stream id.
+    int AddStream(const std::string& url, const FFmpegVideoFrameProcessor& consumer,
+                  const StreamOptions& opts = {});
+
+    // RemoveStream stops decoding and drops queued frames, false if id is unknown.
+    bool RemoveStream(int id);
+
+    bool GetStats(int id, StreamStats& stats);
+    std::map<int, StreamStats> GetStats();
+
+    size_t Size();
+
+    // Stop all streams and workers.
+    void Stop();
+
+  private:
+    std::unique_ptr<VideoStreamManagerImpl> impl;
+};
+
+} // namespace donde_toolkits::video_process
@@ -0,0 +1,168 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "av_pool.h"
+#include "motion_gate.h"
+#include "stream_manager.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace donde_toolkits ::video_process {
+
+// RateMeter counts events a second, over the last full second.
+class RateMeter {
+  public:
+    void Tick(std::chrono::steady_clock::time_point now);
+    double Rate(std::chrono::steady_clock::time_point now);
+
+  private:
+    void roll(std::chrono::steady_clock::time_point now);
+
+  private:
+    std::chrono::steady_clock::time_point start_;
+    uint64_t count_ = 0;
+    double rate_ = 0;
+};
+
+struct StreamContext {
+    StreamContext(int id, const std::string& url, const FFmpegVideoFrameProcessor& consumer,
+                  const StreamOptions& opts);
+    ~StreamContext();
+
+    const int id;
+    const std::string url;
+    const FFmpegVideoFrameProcessor consumer;
+    const StreamOptions opts;
+
+    // owned by the worker running a turn of the stream, a stream runs on one worker at a time.
+    AVFormatContext* format_context = nullptr;
+    AVCodecContext* codec_context = nullptr;
+    AVPacket* packet = nullptr;
+    AVFrame* frame = nullptr;
+    int video_stream_index = -1;
+    bool opened = false;
+    long frame_id = 0;
+    MotionGate motion_gate;
+    // queued frames are recycled once delivered or dropped.
+    std::shared_ptr<FramePool> frame_pool;
+
+    // checked by ffmpeg io, so blocking reads of a removed stream return.
+    std::atomic<bool> stopping = false;
+    // deadline of the blocking ffmpeg call in progress, checked by ffmpeg io too. Only the worker
+    // running a turn sets it, and ffmpeg checks it on the same thread.
+    std::chrono::steady_clock::time_point io_deadline;
+    // the turn ended without data, the stream is not run again before next_turn.
+    std::chrono::steady_clock::time_point next_turn;
+    // first read without data since the last packet, nonblocking reads never hit io_deadline,
+    // a source stalled longer than read_timeout_ms is ended from here.
+    std::chrono::steady_clock::time_point stalled_since;
+
+    // guards the rest.
+    std::mutex mu;
+
+    struct QueuedFrame {
+        long id = 0;
+        std::shared_ptr<AVFrame> frame;
+    };
+    std::deque<QueuedFrame> frames;
+
+    // a stream is in a queue or run by a worker, at most once a queue.
+    bool demux_scheduled = false;
+    bool deliver_scheduled = false;
+    // waiting for consumer, when queue is full and stale frames are kept.
+    bool parked = false;
+    bool running = true;
+
+    uint64_t frames_in = 0;
+    uint64_t frames_out = 0;
+    uint64_t dropped = 0;
+    uint64_t gated = 0;
+    RateMeter in_rate;
+    RateMeter out_rate;
+};
+
+// StreamQueue is a fifo of streams waiting for a worker, which makes turns round robin.
+class StreamQueue {
+  public:
+    // Push a stream, it is not popped before ready_at.
+    void Push(const std::shared_ptr<StreamContext>& stream,
+              std::chrono::steady_clock::time_point ready_at = {});
+
+    // Pop blocks until a stream is ready, the first ready one in push order. false once closed.
+    bool Pop(std::shared_ptr<StreamContext>& stream);
+
+    void Close();
+
+  private:
+    struct Entry {
+        std::shared_ptr<StreamContext> stream;
+        std::chrono::steady_clock::time_point ready_at;
+    };
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<Entry> streams_;
+    bool closed_ = false;
+};
+
+class VideoStreamManagerImpl {
+  public:
+    VideoStreamManagerImpl(const StreamManagerOptions& opts);
+    ~VideoStreamManagerImpl();
+
+    int AddStream(const std::string& url, const FFmpegVideoFrameProcessor& consumer,
+                  const StreamOptions& opts);
+    bool RemoveStream(int id);
+
+    bool GetStats(int id, StreamStats& stats);
+    std::map<int, StreamStats> GetStats();
+
+    size_t Size();
+
+    void Stop();
+
+  private:
+    void demux_loop_();
+    void deliver_loop_();
+
+    bool open_stream(StreamContext& stream);
+    // run_turn demuxes and decodes a few packets, true if stream should get another turn, not
+    // before stream->next_turn.
+    bool run_turn(const std::shared_ptr<StreamContext>& stream);
+    // decode_packet decodes packet and queues frames, nullptr flushes the decoder.
+    void decode_packet(const std::shared_ptr<StreamContext>& stream, AVPacket* packet);
+    void push_frame(const std::shared_ptr<StreamContext>& stream, long id,
+                    std::shared_ptr<AVFrame> frame);
+    void finish(StreamContext& stream);
+
+    std::shared_ptr<StreamContext> find(int id);
+    StreamStats stats_of(StreamContext& stream);
+
+  private:
+    StreamManagerOptions opts_;
+
+    std::mutex mu_;
+    std::map<int, std::shared_ptr<StreamContext>> streams_;
+    int next_id_ = 0;
+
+    StreamQueue demux_queue_;
+    StreamQueue deliver_queue_;
+
+    std::vector<std::thread> workers_;
+    std::atomic<bool> quit_ = false;
+};
+
+} // namespace donde_toolkits::video_process
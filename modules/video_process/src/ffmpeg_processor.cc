@@ -12,6 +12,11 @@ VideoStreamInfo FFmpegVideoProcessor::OpenVideoContext(const std::string& filepa
     return impl->OpenVideoContext(filepath);
 };
 
+VideoStreamInfo FFmpegVideoProcessor::OpenVideoContext(const std::string& filepath,
+                                                       const CodecOptions& opts) {
+    return impl->OpenVideoContext(filepath, opts);
+};
+
 void FFmpegVideoProcessor::Process(const ProcessOptions& opts) { impl->Process(opts); };
 
 bool FFmpegVideoProcessor::Register(const FFmpegVideoFrameProcessor& p) {
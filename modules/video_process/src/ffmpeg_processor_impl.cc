@@ -1,6 +1,7 @@
 #include "donde/defer.h"
 #include "msd/channel.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <memory>
@@ -22,11 +23,35 @@ extern "C" {
 
 namespace donde_toolkits ::video_process {
 
+void set_codec_threads(AVCodecContext* codec_context, const CodecOptions& opts) {
+    codec_context->thread_count = std::max(0, opts.threads);
+    codec_context->thread_type = 0;
+    if (opts.thread_type & THREAD_FRAME) {
+        codec_context->thread_type |= FF_THREAD_FRAME;
+    }
+    if (opts.thread_type & THREAD_SLICE) {
+        codec_context->thread_type |= FF_THREAD_SLICE;
+    }
+}
+
+void set_skip_mode(AVCodecContext* codec_context, SkipMode mode) {
+    switch (mode) {
+    case SKIP_NONREF:
+        codec_context->skip_frame = AVDISCARD_NONREF;
+        break;
+    case SKIP_NONKEY:
+        codec_context->skip_frame = AVDISCARD_NONKEY;
+        break;
+    default:
+        codec_context->skip_frame = AVDISCARD_DEFAULT;
+    }
+}
+
 FFmpegVideoProcessorImpl::FFmpegVideoProcessorImpl() {
     // monitor_thread_ = std::thread([&] { monitor(); });
 }
 
-FFmpegVideoProcessorImpl::~FFmpegVideoProcessorImpl() {}
+FFmpegVideoProcessorImpl::~FFmpegVideoProcessorImpl() { Stop(); }
 
 bool FFmpegVideoProcessorImpl::open_context() {
     int ret = avformat_open_input(&format_context_, video_filepath_.c_str(), nullptr, nullptr);
@@ -73,6 +98,8 @@ bool FFmpegVideoProcessorImpl::open_context() {
         return false;
     }
 
+    set_codec_threads(codec_context_, codec_opts_);
+
     ret = avcodec_open2(codec_context_, avcodec, nullptr);
     if (ret < 0) {
         std::cout << "cannot avcodec_open2, ret: " << av_err2str(ret) << std::endl;
@@ -118,16 +145,40 @@ bool FFmpegVideoProcessorImpl::Resume() {
 }
 
 bool FFmpegVideoProcessorImpl::Stop() {
-    quit_ = true;
-    if (pause_) {
+    {
+        std::lock_guard<std::mutex> lk(demux_mu_);
+        quit_ = true;
         pause_ = false;
-        demux_cv_.notify_all();
     }
+    demux_cv_.notify_all();
 
-    demux_thread_.join();
-    // decode_thread_.join();
-    // process_thread_.join();
+    if (!started_) {
+        return true;
+    }
 
+    // closing fails the next write, but does not wake a write blocked on a full channel, drain
+    // the channels so demux and decode threads get to it, and the process thread quits.
+    packet_ch_->close();
+    frame_ch_->close();
+    auto drain = [&] {
+        std::shared_ptr<AVPacket> packet;
+        while (!packet_ch_->empty()) {
+            *packet_ch_ >> packet;
+        }
+        DecodedFrame decoded;
+        while (!frame_ch_->empty()) {
+            *frame_ch_ >> decoded;
+        }
+    };
+    for (auto thread : {&demux_thread_, &decode_thread_, &process_thread_}) {
+        drain();
+        if (thread->joinable()) {
+            thread->join();
+        }
+    }
+    drain();
+
+    started_ = false;
     return true;
 }
 
@@ -136,8 +187,10 @@ bool FFmpegVideoProcessorImpl::Register(const FFmpegVideoFrameProcessor& p) {
     return true;
 }
 
-VideoStreamInfo FFmpegVideoProcessorImpl::OpenVideoContext(const std::string& filepath) {
+VideoStreamInfo FFmpegVideoProcessorImpl::OpenVideoContext(const std::string& filepath,
+                                                           const CodecOptions& opts) {
     video_filepath_ = filepath;
+    codec_opts_ = opts;
 
     bool succ = open_context();
     if (!succ) {
@@ -174,9 +227,35 @@ void FFmpegVideoProcessorImpl::Process(const ProcessOptions& opts) {
     processor_opts_ = opts;
     decode_fps_ = opts.decode_fps;
     warm_up_frames_ = opts.warm_up_frames;
-    skip_frames_ = opts.skip_frames;
+    skip_frames_ = std::max(1, opts.skip_frames);
     start_over_ = opts.loop_forever;
 
+    // deeper queues let demux and decode run ahead, instead of moving in lockstep.
+    int packet_queue_size = std::max(1, opts.packet_queue_size);
+    int frame_queue_size = std::max(1, opts.frame_queue_size);
+    packet_ch_ = std::make_unique<msd::channel<std::shared_ptr<AVPacket>>>(packet_queue_size);
+    frame_ch_ = std::make_unique<msd::channel<DecodedFrame>>(frame_queue_size);
+
+    // enough for full queues, plus the one each thread is working on.
+    packet_pool_ = PacketPool::Create(packet_queue_size + 2);
+    frame_pool_ = FramePool::Create(frame_queue_size + 2);
+
+    motion_gate_ = std::make_unique<MotionGate>(opts.motion_gate);
+
+    // decoder drops these frames before decoding, instead of decoding frames to throw away.
+    if (codec_context_) {
+        set_skip_mode(codec_context_, opts.skip_mode);
+    }
+
+    pace_started_ = false;
+    pace_speed_ = 1.0;
+    if (!opts.offline && decode_fps_ > 0 && format_context_) {
+        double stream_fps = av_q2d(format_context_->streams[video_stream_index_]->avg_frame_rate);
+        if (stream_fps > 0) {
+            pace_speed_ = decode_fps_ / stream_fps;
+        }
+    }
+
     demux_thread_ = std::thread([&] { demux_video_packet_(); });
     decode_thread_ = std::thread([&] { decode_video_frame_(); });
     process_thread_ = std::thread([&] { process_video_frame_(); });
@@ -199,19 +278,6 @@ void FFmpegVideoProcessorImpl::ScaleFrame(const AVFrame* originalFrame, AVFrame*
 // inner threads
 //
 void FFmpegVideoProcessorImpl::demux_video_packet_() {
-
-    AVPacket* packet = av_packet_alloc();
-    if (packet == nullptr) {
-        std::cerr << "cannot allocate packet" << std::endl;
-        return;
-    }
-
-    // default fps is 25, but may speed up by client.
-    if (decode_fps_ == 0) {
-        decode_fps_ = 25;
-    }
-    int sleep_ms = 1000 / decode_fps_;
-
     is_demuxing_ = true;
 
     while (true) {
@@ -226,38 +292,40 @@ void FFmpegVideoProcessorImpl::demux_video_packet_() {
             break;
         }
 
-        int ret = av_read_frame(format_context_, packet);
+        // read straight into a pooled packet, it goes back to pool unref'd once released.
+        std::shared_ptr<AVPacket> packet = packet_pool_->Acquire();
+        if (packet == nullptr) {
+            std::cerr << "cannot allocate packet" << std::endl;
+            break;
+        }
+        int ret = av_read_frame(format_context_, packet.get());
         if (ret < 0) {
             std::cerr << "cannot read frame from context, ret: " << av_err2str(ret) << std::endl;
             break;
         }
-        DEFER(av_packet_unref(packet));
 
         if (packet->stream_index == video_stream_index_) {
             frame_count++;
-            // create a new clone packet and make ref to src packet.
-            AVPacket* cloned = av_packet_clone(packet);
-            packet_ch_ << cloned;
-
-            // std::cout << "packet channel size: " << packet_ch_.size() << std::endl;
+            // blocks only when decoder is packet_queue_size packets behind, throws once Stop
+            // closes the channel.
+            try {
+                *packet_ch_ << packet;
+            } catch (const msd::closed_channel&) {
+                break;
+            }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
+            // std::cout << "packet channel size: " << packet_ch_->size() << std::endl;
 
             // // DEBUG: pause every 100 frames.
             // if (frame_count % 100 == 0) {
             //     pause_ = true;
             //     std::cout << "pause at " << frame_count << " frames. " << std::endl;
             // }
-        } else {
-            // unref explicitly, not really needed, because av_read_frame will unref it anyway.
-            // av_packet_unref(packet);
         }
     }
 
-    packet_ch_.close();
+    packet_ch_->close();
     is_demuxing_ = false;
-
-    av_packet_free(&packet);
 }
 
 void FFmpegVideoProcessorImpl::decode_video_frame_() {
@@ -266,15 +334,19 @@ void FFmpegVideoProcessorImpl::decode_video_frame_() {
     DEFER(av_frame_free(&frame))
     // std::shared_ptr<bool> defer(nullptr, [&](bool *) {  });
 
+    long frame_id = 0;
+
     is_decoding_ = true;
 
-    while (true) {
-        // copy out AVPacket from queue
-        AVPacket* packet;
-        packet_ch_ >> packet;
-        DEFER(av_packet_unref(packet));
+    while (!quit_) {
+        // copy out AVPacket from queue, nullptr when demux is done, which flushes frames left
+        // in decoder.
+        std::shared_ptr<AVPacket> packet;
+        *packet_ch_ >> packet;
+        bool flushing = packet == nullptr;
 
-        int ret = avcodec_send_packet(codec_context_, packet);
+        int ret = avcodec_send_packet(codec_context_, packet.get());
+        packet.reset();
         if (ret < 0) {
             std::cerr << "cannot avcodec_send_packet: ret: " << av_err2str(ret) << std::endl;
             break;
@@ -293,21 +365,46 @@ void FFmpegVideoProcessorImpl::decode_video_frame_() {
                 // std::cout << "got one new frame " << std::endl;
             }
 
-            // will alloc and ref-count a new frame.
-            // make the original frame ref-count + 1
-            // do we have to unref the original frame? no.
-            frame_ch_ << av_frame_clone(frame);
-            // std::cout << "frame channel size: " << frame_ch_.size() << std::endl;
+            if (frame_id <= warm_up_frames_) {
+                frame_id++;
+                continue;
+            }
+            if (frame_id % skip_frames_ != 0) {
+                frame_id++;
+                continue;
+            }
+            if (!motion_gate_->Pass(frame)) {
+                frame_id++;
+                continue;
+            }
+
+            // move the decoded frame into a pooled one, no new frame or ref is allocated.
+            std::shared_ptr<AVFrame> pooled = frame_pool_->Acquire();
+            if (pooled == nullptr) {
+                std::cerr << "cannot allocate frame" << std::endl;
+                break;
+            }
+            av_frame_move_ref(pooled.get(), frame);
+            try {
+                *frame_ch_ << DecodedFrame{++frame_id, pooled};
+            } catch (const msd::closed_channel&) {
+                // stopped, frames left in decoder are dropped.
+                flushing = true;
+                break;
+            }
+            // std::cout << "frame channel size: " << frame_ch_->size() << std::endl;
+        }
+
+        if (flushing) {
+            break;
         }
     }
 
-    frame_ch_.close();
+    frame_ch_->close();
     is_decoding_ = false;
 }
 
 void FFmpegVideoProcessorImpl::process_video_frame_() {
-    long frame_id = 0;
-
     is_processing_ = false;
 
     while (true) {
@@ -315,27 +412,56 @@ void FFmpegVideoProcessorImpl::process_video_frame_() {
             break;
         }
 
-        AVFrame* f;
-        frame_ch_ >> f;
-        DEFER(av_frame_free(&f));
-
-        if (frame_id <= warm_up_frames_) {
-            frame_id++;
-            continue;
+        // frame goes back to pool when decoded is released.
+        DecodedFrame decoded;
+        *frame_ch_ >> decoded;
+        if (decoded.frame == nullptr) {
+            break;
         }
-        if (frame_id % skip_frames_ != 0) {
-            frame_id++;
-            continue;
+
+        if (!processor_opts_.offline) {
+            pace(decoded.frame.get());
         }
 
+        // one wrapper shared by all processors.
+        FFmpegVideoFrame frame(decoded.id, decoded.frame.get());
         for (const auto& func : frame_processor_list_) {
-            func(std::make_unique<FFmpegVideoFrame>(++frame_id, f).get());
+            func(&frame);
         }
     }
 
     is_processing_ = false;
 }
 
+void FFmpegVideoProcessorImpl::pace(const AVFrame* frame) {
+    int64_t ts = frame->best_effort_timestamp;
+    if (ts == AV_NOPTS_VALUE) {
+        ts = frame->pts;
+    }
+    if (ts == AV_NOPTS_VALUE) {
+        return;
+    }
+    double pts = ts * av_q2d(format_context_->streams[video_stream_index_]->time_base);
+
+    auto now = std::chrono::steady_clock::now();
+    auto due = pace_start_time_
+               + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                   std::chrono::duration<double>((pts - pace_start_pts_) / pace_speed_));
+
+    // (re)start the clock at first frame, on pts going back (loop), and when far behind
+    // (pause, slow consumer), so lost time is not caught up by a burst of frames.
+    if (!pace_started_ || pts < pace_start_pts_ || now - due > std::chrono::seconds(1)) {
+        pace_started_ = true;
+        pace_start_pts_ = pts;
+        pace_start_time_ = now;
+        return;
+    }
+
+    if (due > now) {
+        std::this_thread::sleep_until(due);
+    }
+}
+
 void FFmpegVideoProcessorImpl::monitor() {
     while (true) {
         if (quit_) {
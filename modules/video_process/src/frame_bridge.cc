@@ -0,0 +1,77 @@
+#include "donde/video_process/frame_bridge.h"
+
+extern "C" {
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+}
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+
+namespace donde_toolkits ::video_process {
+
+FrameBridge::FrameBridge(const FrameBridgeOptions& opts)
+    : _opts(opts), _pool(MatPool::Create(std::max(0, opts.pool_size))){};
+
+FrameBridge::~FrameBridge() {
+    if (_sws_context) {
+        sws_freeContext(_sws_context);
+    }
+};
+
+cv::Size FrameBridge::output_size(int width, int height) const {
+    double scale = 1.0;
+    if (_opts.max_width > 0) {
+        scale = std::min(scale, (double)_opts.max_width / width);
+    }
+    if (_opts.max_height > 0) {
+        scale = std::min(scale, (double)_opts.max_height / height);
+    }
+    // no scaling keeps the video size, even if it is odd.
+    if (scale >= 1.0) {
+        return cv::Size(width, height);
+    }
+    // scaled sizes are even, some sws paths require it.
+    return cv::Size(std::max(2, (int)(width * scale) & ~1),
+                    std::max(2, (int)(height * scale) & ~1));
+};
+
+std::shared_ptr<Frame> FrameBridge::Convert(const FFmpegVideoFrame* frame) {
+    if (!frame) {
+        return nullptr;
+    }
+    return Convert(static_cast<const AVFrame*>(frame->getFrame()));
+};
+
+std::shared_ptr<Frame> FrameBridge::Convert(const AVFrame* av_frame) {
+    if (!av_frame || av_frame->width <= 0 || av_frame->height <= 0) {
+        return nullptr;
+    }
+
+    cv::Size size = output_size(av_frame->width, av_frame->height);
+    cv::Mat image = _pool->Acquire(size, CV_8UC3);
+
+    {
+        std::lock_guard<std::mutex> l(_mu);
+        _sws_context = sws_getCachedContext(_sws_context, av_frame->width, av_frame->height,
+                                            (AVPixelFormat)av_frame->format, size.width,
+                                            size.height, AV_PIX_FMT_BGR24, SWS_BILINEAR, nullptr,
+                                            nullptr, nullptr);
+        if (!_sws_context) {
+            spdlog::error("cannot get sws context for pixel format {}", av_frame->format);
+            return nullptr;
+        }
+
+        uint8_t* dst_data[4] = {image.data, nullptr, nullptr, nullptr};
+        int dst_linesize[4] = {(int)image.step, 0, 0, 0};
+        sws_scale(_sws_context, av_frame->data, av_frame->linesize, 0, av_frame->height,
+                  dst_data, dst_linesize);
+    }
+
+    return _pool->MakeFrame(image);
+};
+
+size_t FrameBridge::Pooled() { return _pool->Size(); };
+
+} // namespace donde_toolkits::video_process
@@ -0,0 +1,114 @@
+#include "donde/video_process/motion_gate.h"
+
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace donde_toolkits ::video_process {
+
+namespace {
+
+bool has_luma_plane(int format) {
+    switch (format) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+    case AV_PIX_FMT_YUV422P:
+    case AV_PIX_FMT_YUVJ422P:
+    case AV_PIX_FMT_YUV444P:
+    case AV_PIX_FMT_YUVJ444P:
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_NV21:
+    case AV_PIX_FMT_GRAY8:
+        return true;
+    default:
+        return false;
+    }
+};
+
+// samples taken along each side of a cell, averaging every pixel is not needed to see change.
+const int kSamplesPerSide = 4;
+
+} // namespace
+
+MotionGate::MotionGate(const MotionGateOptions& opts) : opts_(opts) {
+    opts_.grid_width = std::max(1, opts_.grid_width);
+    opts_.grid_height = std::max(1, opts_.grid_height);
+};
+
+bool MotionGate::sample(const AVFrame* frame, std::vector<int>& cells) const {
+    if (!has_luma_plane(frame->format) || frame->data[0] == nullptr) {
+        return false;
+    }
+
+    const int grid_width = std::min(opts_.grid_width, frame->width);
+    const int grid_height = std::min(opts_.grid_height, frame->height);
+    cells.assign(grid_width * grid_height, 0);
+
+    for (int gy = 0; gy < grid_height; gy++) {
+        const int y0 = gy * frame->height / grid_height;
+        const int y1 = (gy + 1) * frame->height / grid_height;
+        const int step_y = std::max(1, (y1 - y0) / kSamplesPerSide);
+
+        for (int gx = 0; gx < grid_width; gx++) {
+            const int x0 = gx * frame->width / grid_width;
+            const int x1 = (gx + 1) * frame->width / grid_width;
+            const int step_x = std::max(1, (x1 - x0) / kSamplesPerSide);
+
+            int sum = 0, count = 0;
+            for (int y = y0; y < y1; y += step_y) {
+                const uint8_t* row = frame->data[0] + (int64_t)y * frame->linesize[0];
+                for (int x = x0; x < x1; x += step_x) {
+                    sum += row[x];
+                    count++;
+                }
+            }
+            cells[gy * grid_width + gx] = count > 0 ? sum / count : 0;
+        }
+    }
+    return true;
+};
+
+bool MotionGate::changed(const std::vector<int>& cells) const {
+    // take out overall brightness change, so auto exposure and lights are not motion.
+    long shift = 0;
+    for (size_t i = 0; i < cells.size(); i++) {
+        shift += cells[i] - reference_[i];
+    }
+    shift /= (long)cells.size();
+
+    size_t changed_cells = 0;
+    for (size_t i = 0; i < cells.size(); i++) {
+        if (std::abs(cells[i] - reference_[i] - shift) > opts_.pixel_threshold) {
+            changed_cells++;
+        }
+    }
+    return changed_cells > 0 && changed_cells >= opts_.changed_ratio * cells.size();
+};
+
+bool MotionGate::Pass(const AVFrame* frame) {
+    if (!opts_.enable || frame == nullptr || !sample(frame, cells_)) {
+        passed_++;
+        return true;
+    }
+
+    since_passed_++;
+    bool pass = reference_.size() != cells_.size() || reference_width_ != frame->width
+                || reference_height_ != frame->height || changed(cells_)
+                || (opts_.keep_alive_frames > 0 && since_passed_ >= opts_.keep_alive_frames);
+    if (!pass) {
+        gated_++;
+        return false;
+    }
+
+    reference_.swap(cells_);
+    reference_width_ = frame->width;
+    reference_height_ = frame->height;
+    since_passed_ = 0;
+    passed_++;
+    return true;
+};
+
+} // namespace donde_toolkits::video_process
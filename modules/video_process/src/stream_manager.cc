@@ -0,0 +1,30 @@
+#include "donde/video_process/stream_manager.h"
+
+#include "donde/video_process/stream_manager_impl.h"
+
+namespace donde_toolkits ::video_process {
+
+VideoStreamManager::VideoStreamManager(const StreamManagerOptions& opts)
+    : impl(new VideoStreamManagerImpl(opts)) {}
+
+VideoStreamManager::~VideoStreamManager(){};
+
+int VideoStreamManager::AddStream(const std::string& url,
+                                  const FFmpegVideoFrameProcessor& consumer,
+                                  const StreamOptions& opts) {
+    return impl->AddStream(url, consumer, opts);
+};
+
+bool VideoStreamManager::RemoveStream(int id) { return impl->RemoveStream(id); };
+
+bool VideoStreamManager::GetStats(int id, StreamStats& stats) {
+    return impl->GetStats(id, stats);
+};
+
+std::map<int, StreamStats> VideoStreamManager::GetStats() { return impl->GetStats(); };
+
+size_t VideoStreamManager::Size() { return impl->Size(); };
+
+void VideoStreamManager::Stop() { impl->Stop(); };
+
+} // namespace donde_toolkits::video_process
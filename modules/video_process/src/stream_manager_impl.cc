@@ -0,0 +1,528 @@
+#include "donde/video_process/stream_manager_impl.h"
+
+#include "donde/defer.h"
+#include "donde/video_process/ffmpeg_processor_impl.h"
+#include "donde/video_process/utils.h"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+
+namespace donde_toolkits ::video_process {
+
+namespace {
+
+// interrupt_stream lets blocking ffmpeg io of a removed stream, or past its deadline, return.
+int interrupt_stream(void* opaque) {
+    auto stream = static_cast<StreamContext*>(opaque);
+    if (stream->stopping) {
+        return 1;
+    }
+    if (stream->io_deadline != std::chrono::steady_clock::time_point{}
+        && std::chrono::steady_clock::now() > stream->io_deadline) {
+        return 1;
+    }
+    return 0;
+};
+
+// deadline_after returns the deadline of a blocking call, none if timeout_ms is not positive.
+std::chrono::steady_clock::time_point deadline_after(int timeout_ms) {
+    if (timeout_ms <= 0) {
+        return {};
+    }
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+};
+
+size_t queue_capacity(const StreamContext& stream) {
+    return std::max(1, stream.opts.frame_queue_size);
+};
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////////////
+/// RateMeter
+
+void RateMeter::roll(std::chrono::steady_clock::time_point now) {
+    if (start_ == std::chrono::steady_clock::time_point{}) {
+        start_ = now;
+        return;
+    }
+    std::chrono::duration<double> elapsed = now - start_;
+    if (elapsed >= std::chrono::seconds(1)) {
+        rate_ = count_ / elapsed.count();
+        count_ = 0;
+        start_ = now;
+    }
+};
+
+void RateMeter::Tick(std::chrono::steady_clock::time_point now) {
+    roll(now);
+    count_++;
+};
+
+double RateMeter::Rate(std::chrono::steady_clock::time_point now) {
+    roll(now);
+    return rate_;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////
+/// StreamContext
+
+StreamContext::StreamContext(int id, const std::string& url,
+                             const FFmpegVideoFrameProcessor& consumer, const StreamOptions& opts)
+    : id(id), url(url), consumer(consumer), opts(opts), motion_gate(opts.motion_gate){};
+
+StreamContext::~StreamContext() {
+    frames.clear();
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    avcodec_free_context(&codec_context);
+    avformat_close_input(&format_context);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////
+/// StreamQueue
+
+void StreamQueue::Push(const std::shared_ptr<StreamContext>& stream,
+                       std::chrono::steady_clock::time_point ready_at) {
+    {
+        std::lock_guard<std::mutex> l(mu_);
+        if (closed_) {
+            return;
+        }
+        streams_.push_back({.stream = stream, .ready_at = ready_at});
+    }
+    cv_.notify_one();
+};
+
+bool StreamQueue::Pop(std::shared_ptr<StreamContext>& stream) {
+    std::unique_lock<std::mutex> l(mu_);
+    while (!closed_) {
+        auto now = std::chrono::steady_clock::now();
+        auto earliest = std::chrono::steady_clock::time_point::max();
+        for (auto it = streams_.begin(); it != streams_.end(); it++) {
+            if (it->ready_at <= now) {
+                stream = std::move(it->stream);
+                streams_.erase(it);
+                return true;
+            }
+            earliest = std::min(earliest, it->ready_at);
+        }
+
+        // waiting streams are all idle, wake up for the first one, or a new push.
+        if (streams_.empty()) {
+            cv_.wait(l);
+        } else {
+            cv_.wait_until(l, earliest);
+        }
+    }
+    return false;
+};
+
+void StreamQueue::Close() {
+    {
+        std::lock_guard<std::mutex> l(mu_);
+        closed_ = true;
+        streams_.clear();
+    }
+    cv_.notify_all();
+};
+
+////////////////////////////////////////////////////////////////////////////////////////
+/// VideoStreamManagerImpl
+
+VideoStreamManagerImpl::VideoStreamManagerImpl(const StreamManagerOptions& opts) : opts_(opts) {
+    int workers = opts_.workers > 0 ? opts_.workers : std::thread::hardware_concurrency();
+    for (int i = 0; i < std::max(1, workers); i++) {
+        workers_.emplace_back([this] { demux_loop_(); });
+    }
+    for (int i = 0; i < std::max(1, opts_.consumers); i++) {
+        workers_.emplace_back([this] { deliver_loop_(); });
+    }
+};
+
+VideoStreamManagerImpl::~VideoStreamManagerImpl() { Stop(); };
+
+int VideoStreamManagerImpl::AddStream(const std::string& url,
+                                      const FFmpegVideoFrameProcessor& consumer,
+                                      const StreamOptions& opts) {
+    std::shared_ptr<StreamContext> stream;
+    {
+        std::lock_guard<std::mutex> l(mu_);
+        if (quit_) {
+            return -1;
+        }
+        stream = std::make_shared<StreamContext>(next_id_++, url, consumer, opts);
+        streams_[stream->id] = stream;
+    }
+
+    {
+        std::lock_guard<std::mutex> l(stream->mu);
+        stream->demux_scheduled = true;
+    }
+    demux_queue_.Push(stream);
+    return stream->id;
+};
+
+bool VideoStreamManagerImpl::RemoveStream(int id) {
+    std::shared_ptr<StreamContext> stream;
+    {
+        std::lock_guard<std::mutex> l(mu_);
+        auto it = streams_.find(id);
+        if (it == streams_.end()) {
+            return false;
+        }
+        stream = it->second;
+        streams_.erase(it);
+    }
+
+    // workers holding the stream drop it at their next check, the last one frees it.
+    stream->stopping = true;
+    std::lock_guard<std::mutex> l(stream->mu);
+    stream->frames.clear();
+    stream->running = false;
+    return true;
+};
+
+std::shared_ptr<StreamContext> VideoStreamManagerImpl::find(int id) {
+    std::lock_guard<std::mutex> l(mu_);
+    auto it = streams_.find(id);
+    return it == streams_.end() ? nullptr : it->second;
+};
+
+StreamStats VideoStreamManagerImpl::stats_of(StreamContext& stream) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> l(stream.mu);
+    return StreamStats{
+        .fps_in = stream.in_rate.Rate(now),
+        .fps_out = stream.out_rate.Rate(now),
+        .frames_in = stream.frames_in,
+        .frames_out = stream.frames_out,
+        .dropped = stream.dropped,
+        .gated = stream.gated,
+        .queue_depth = stream.frames.size(),
+        .running = stream.running,
+    };
+};
+
+bool VideoStreamManagerImpl::GetStats(int id, StreamStats& stats) {
+    auto stream = find(id);
+    if (!stream) {
+        return false;
+    }
+    stats = stats_of(*stream);
+    return true;
+};
+
+std::map<int, StreamStats> VideoStreamManagerImpl::GetStats() {
+    std::vector<std::shared_ptr<StreamContext>> streams;
+    {
+        std::lock_guard<std::mutex> l(mu_);
+        for (auto& [id, stream] : streams_) {
+            streams.push_back(stream);
+        }
+    }
+
+    std::map<int, StreamStats> stats;
+    for (auto& stream : streams) {
+        stats[stream->id] = stats_of(*stream);
+    }
+    return stats;
+};
+
+size_t VideoStreamManagerImpl::Size() {
+    std::lock_guard<std::mutex> l(mu_);
+    return streams_.size();
+};
+
+void VideoStreamManagerImpl::Stop() {
+    std::map<int, std::shared_ptr<StreamContext>> streams;
+    {
+        std::lock_guard<std::mutex> l(mu_);
+        quit_ = true;
+        streams.swap(streams_);
+    }
+    for (auto& [id, stream] : streams) {
+        stream->stopping = true;
+    }
+
+    demux_queue_.Close();
+    deliver_queue_.Close();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+};
+
+////////////////////////////////////////////////////////////////////////////////////////
+/// workers
+
+void VideoStreamManagerImpl::demux_loop_() {
+    std::shared_ptr<StreamContext> stream;
+    while (demux_queue_.Pop(stream)) {
+        // to the back of the queue, behind streams waiting for their turn.
+        if (run_turn(stream)) {
+            demux_queue_.Push(stream, stream->next_turn);
+        }
+        stream.reset();
+    }
+};
+
+void VideoStreamManagerImpl::deliver_loop_() {
+    std::shared_ptr<StreamContext> stream;
+    while (deliver_queue_.Pop(stream)) {
+        StreamContext::QueuedFrame queued;
+        {
+            std::lock_guard<std::mutex> l(stream->mu);
+            if (!stream->stopping && !stream->frames.empty()) {
+                queued = std::move(stream->frames.front());
+                stream->frames.pop_front();
+            } else {
+                stream->deliver_scheduled = false;
+            }
+        }
+        if (queued.frame == nullptr) {
+            stream.reset();
+            continue;
+        }
+
+        // one frame a turn, so a slow consumer does not hold up other streams.
+        FFmpegVideoFrame frame(queued.id, queued.frame.get());
+        stream->consumer(&frame);
+        queued.frame.reset();
+
+        auto now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> l(stream->mu);
+            stream->frames_out++;
+            stream->out_rate.Tick(now);
+
+            if (stream->parked && !stream->stopping
+                && stream->frames.size() < queue_capacity(*stream)) {
+                stream->parked = false;
+                stream->demux_scheduled = true;
+                demux_queue_.Push(stream);
+            }
+
+            if (stream->frames.empty()) {
+                stream->deliver_scheduled = false;
+            } else {
+                deliver_queue_.Push(stream);
+            }
+        }
+        stream.reset();
+    }
+};
+
+bool VideoStreamManagerImpl::open_stream(StreamContext& stream) {
+    stream.format_context = avformat_alloc_context();
+    if (stream.format_context == nullptr) {
+        spdlog::error("stream {}: cannot alloc format context", stream.id);
+        return false;
+    }
+    stream.format_context->interrupt_callback.callback = interrupt_stream;
+    stream.format_context->interrupt_callback.opaque = &stream;
+
+    // connect and probe are bounded by open_timeout_ms, they may block for long otherwise.
+    stream.io_deadline = deadline_after(stream.opts.open_timeout_ms);
+    DEFER(stream.io_deadline = {});
+
+    // format context is freed by avformat_open_input on failure.
+    int ret = avformat_open_input(&stream.format_context, stream.url.c_str(), nullptr, nullptr);
+    if (ret < 0) {
+        spdlog::error("stream {}: cannot open {}, ret: {}", stream.id, stream.url, av_err2str(ret));
+        return false;
+    }
+
+    ret = avformat_find_stream_info(stream.format_context, nullptr);
+    if (ret < 0) {
+        spdlog::error("stream {}: cannot find stream info, ret: {}", stream.id, av_err2str(ret));
+        return false;
+    }
+    // av_read_frame returns EAGAIN instead of waiting for data, so the worker runs other streams.
+    stream.format_context->flags |= AVFMT_FLAG_NONBLOCK;
+
+    const AVCodec* avcodec = nullptr;
+    stream.video_stream_index
+        = av_find_best_stream(stream.format_context, AVMEDIA_TYPE_VIDEO, -1, -1, &avcodec, 0);
+    if (stream.video_stream_index < 0 || avcodec == nullptr) {
+        spdlog::error("stream {}: cannot find video stream or decoder", stream.id);
+        return false;
+    }
+
+    stream.codec_context = avcodec_alloc_context3(avcodec);
+    if (stream.codec_context == nullptr) {
+        spdlog::error("stream {}: cannot alloc avcodec context", stream.id);
+        return false;
+    }
+    auto codec_params = stream.format_context->streams[stream.video_stream_index]->codecpar;
+    ret = avcodec_parameters_to_context(stream.codec_context, codec_params);
+    if (ret < 0) {
+        spdlog::error("stream {}: cannot copy avcodec params, ret: {}", stream.id,
+                      av_err2str(ret));
+        return false;
+    }
+
+    set_codec_threads(stream.codec_context, opts_.codec);
+    ret = avcodec_open2(stream.codec_context, avcodec, nullptr);
+    if (ret < 0) {
+        spdlog::error("stream {}: cannot avcodec_open2, ret: {}", stream.id, av_err2str(ret));
+        return false;
+    }
+    set_skip_mode(stream.codec_context, stream.opts.skip_mode);
+
+    stream.frame_pool = FramePool::Create(queue_capacity(stream) + 1);
+    stream.packet = av_packet_alloc();
+    stream.frame = av_frame_alloc();
+    if (stream.packet == nullptr || stream.frame == nullptr) {
+        spdlog::error("stream {}: cannot alloc packet or frame", stream.id);
+        return false;
+    }
+
+    stream.opened = true;
+    spdlog::info("stream {}: opened {}, {}x{}", stream.id, stream.url,
+                 stream.codec_context->width, stream.codec_context->height);
+    return true;
+};
+
+bool VideoStreamManagerImpl::run_turn(const std::shared_ptr<StreamContext>& stream) {
+    if (stream->stopping) {
+        return false;
+    }
+    stream->next_turn = {};
+    if (!stream->opened && !open_stream(*stream)) {
+        finish(*stream);
+        return false;
+    }
+
+    for (int i = 0; i < std::max(1, opts_.packets_per_turn); i++) {
+        {
+            // backpressure, consumer takes the stream back once it catches up.
+            std::lock_guard<std::mutex> l(stream->mu);
+            if (!stream->opts.drop_stale && stream->frames.size() >= queue_capacity(*stream)) {
+                // waiting for the consumer is not a stall of the source.
+                stream->stalled_since = {};
+                stream->parked = true;
+                stream->demux_scheduled = false;
+                return false;
+            }
+        }
+
+        stream->io_deadline = deadline_after(stream->opts.read_timeout_ms);
+        int ret = av_read_frame(stream->format_context, stream->packet);
+        stream->io_deadline = {};
+        if (ret == AVERROR(EAGAIN)) {
+            auto now = std::chrono::steady_clock::now();
+            if (stream->stalled_since == std::chrono::steady_clock::time_point{}) {
+                stream->stalled_since = now;
+            }
+            if (stream->opts.read_timeout_ms > 0
+                && now - stream->stalled_since
+                       >= std::chrono::milliseconds(stream->opts.read_timeout_ms)) {
+                spdlog::warn("stream {}: no data longer than {} ms, ends stream", stream->id,
+                             stream->opts.read_timeout_ms);
+                decode_packet(stream, nullptr);
+                finish(*stream);
+                return false;
+            }
+            // no data yet, other streams take the worker meanwhile.
+            stream->next_turn = now + std::chrono::milliseconds(std::max(0, opts_.idle_wait_ms));
+            return true;
+        }
+        stream->stalled_since = {};
+        if (ret < 0) {
+            if (ret == AVERROR_EXIT && !stream->stopping) {
+                spdlog::warn("stream {}: read blocks longer than {} ms, ends stream", stream->id,
+                             stream->opts.read_timeout_ms);
+            } else if (ret != AVERROR_EOF && !stream->stopping) {
+                spdlog::warn("stream {}: cannot read frame, ret: {}", stream->id, av_err2str(ret));
+            }
+            decode_packet(stream, nullptr);
+            finish(*stream);
+            return false;
+        }
+        DEFER(av_packet_unref(stream->packet));
+
+        if (stream->packet->stream_index == stream->video_stream_index) {
+            decode_packet(stream, stream->packet);
+        }
+        if (stream->stopping) {
+            return false;
+        }
+    }
+    return true;
+};
+
+void VideoStreamManagerImpl::decode_packet(const std::shared_ptr<StreamContext>& stream,
+                                           AVPacket* packet) {
+    int ret = avcodec_send_packet(stream->codec_context, packet);
+    if (ret < 0) {
+        // a broken packet of a live stream, decoder recovers from next key frame.
+        spdlog::warn("stream {}: cannot avcodec_send_packet, ret: {}", stream->id,
+                     av_err2str(ret));
+        return;
+    }
+
+    int skip_frames = std::max(1, stream->opts.skip_frames);
+    while (true) {
+        ret = avcodec_receive_frame(stream->codec_context, stream->frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            break;
+        } else if (ret < 0) {
+            spdlog::warn("stream {}: cannot avcodec_receive_frame, ret: {}", stream->id,
+                         av_err2str(ret));
+            break;
+        }
+
+        long id = ++stream->frame_id;
+        if ((id - 1) % skip_frames != 0) {
+            continue;
+        }
+        if (!stream->motion_gate.Pass(stream->frame)) {
+            std::lock_guard<std::mutex> l(stream->mu);
+            stream->gated++;
+            continue;
+        }
+        std::shared_ptr<AVFrame> pooled = stream->frame_pool->Acquire();
+        if (pooled == nullptr) {
+            spdlog::error("stream {}: cannot alloc frame", stream->id);
+            break;
+        }
+        av_frame_move_ref(pooled.get(), stream->frame);
+        push_frame(stream, id, std::move(pooled));
+    }
+};
+
+void VideoStreamManagerImpl::push_frame(const std::shared_ptr<StreamContext>& stream, long id,
+                                        std::shared_ptr<AVFrame> frame) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> l(stream->mu);
+    if (stream->stopping) {
+        return;
+    }
+
+    // consumer is behind, the oldest frame is the stalest.
+    if (stream->opts.drop_stale && stream->frames.size() >= queue_capacity(*stream)) {
+        stream->frames.pop_front();
+        stream->dropped++;
+    }
+    stream->frames.push_back({.id = id, .frame = std::move(frame)});
+    stream->frames_in++;
+    stream->in_rate.Tick(now);
+
+    if (!stream->deliver_scheduled) {
+        stream->deliver_scheduled = true;
+        deliver_queue_.Push(stream);
+    }
+};
+
+void VideoStreamManagerImpl::finish(StreamContext& stream) {
+    std::lock_guard<std::mutex> l(stream.mu);
+    stream.running = false;
+    stream.demux_scheduled = false;
+    spdlog::info("stream {}: finished, {} frames decoded, {} dropped", stream.id,
+                 stream.frames_in, stream.dropped);
+};
+
+} // namespace donde_toolkits::video_process
@@ -0,0 +1,60 @@
+#include "donde/mat_pool.h"
+
+#include "donde/definitions.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <opencv2/core/mat.hpp>
+#include <vector>
+
+
+using donde_toolkits::Frame;
+using donde_toolkits::MatPool;
+
+TEST(Common, MatPoolReusesReleasedBuffers) {
+    auto pool = MatPool::Create(2);
+
+    cv::Mat image = pool->Acquire(cv::Size(64, 48), CV_8UC3);
+    uint8_t* data = image.data;
+    std::shared_ptr<Frame> frame = pool->MakeFrame(image);
+    image.release();
+    EXPECT_EQ(pool->Size(), 0);
+
+    // buffer is pooled when frame is released.
+    frame.reset();
+    EXPECT_EQ(pool->Size(), 1);
+
+    // only a buffer of the same shape is reused.
+    cv::Mat other = pool->Acquire(cv::Size(32, 24), CV_8UC3);
+    EXPECT_NE(other.data, data);
+    EXPECT_EQ(pool->Size(), 1);
+    cv::Mat same = pool->Acquire(cv::Size(64, 48), CV_8UC3);
+    EXPECT_EQ(same.data, data);
+    EXPECT_EQ(pool->Size(), 0);
+
+    // a buffer still referred to is not pooled.
+    frame = pool->MakeFrame(same);
+    frame.reset();
+    EXPECT_EQ(pool->Size(), 0);
+};
+
+TEST(Common, MatPoolKeepsAtMostCapacity) {
+    auto pool = MatPool::Create(2);
+    std::vector<std::shared_ptr<Frame>> frames;
+    for (int i = 0; i < 3; i++) {
+        frames.push_back(pool->MakeFrame(pool->Acquire(cv::Size(8, 8), CV_8UC3)));
+    }
+    frames.clear();
+    EXPECT_EQ(pool->Size(), 2);
+
+    // frames may outlive the pool.
+    std::shared_ptr<Frame> frame = pool->MakeFrame(pool->Acquire(cv::Size(8, 8), CV_8UC3));
+    pool.reset();
+    frame.reset();
+
+    // capacity 0 never pools.
+    auto no_pool = MatPool::Create(0);
+    frame = no_pool->MakeFrame(no_pool->Acquire(cv::Size(8, 8), CV_8UC3));
+    frame.reset();
+    EXPECT_EQ(no_pool->Size(), 0);
+};
@@ -6,6 +6,8 @@
 #include "src/feature_extract/openvino_worker/openvino_worker.h"
 
 #include <Poco/Logger.h>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <gmock/gmock-actions.h>
@@ -13,10 +15,12 @@
 #include <gtest/gtest.h>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <opencv2/core/types.hpp>
 #include <opencv2/imgproc.hpp>
 #include <string>
+#include <thread>
 
 
 using namespace donde_toolkits::feature_extract;
@@ -303,3 +307,329 @@ TEST(FeatureExtract, FacePipelineCanReleaseProcessorsLifecycle) {
 
     EXPECT_EQ("aa", "aa");
 };
+
+TEST(FeatureExtract, FacePipelineStreamingDeliversEveryFrame) {
+
+    json conf = R"(
+{
+  "detector": {
+    "concurrent": 1
+  },
+  "landmarks": {
+    "concurrent": 2
+  },
+  "aligner": {
+    "concurrent": 1
+  },
+  "feature": {
+    "concurrent": 2
+  },
+  "streaming": {
+    "queue_size": 2
+  }
+}
+)"_json;
+
+    // pipeline is responsible to release this pointers
+    std::vector<std::pair<MockProcessor*, donde_toolkits::ValueType>> stages{
+        {new MockProcessor(), donde_toolkits::ValueDetectResult},
+        {new MockProcessor(), donde_toolkits::ValueLandmarksResult},
+        {new MockProcessor(), donde_toolkits::ValueAlignerResult},
+        {new MockProcessor(), donde_toolkits::ValueFeatureResult},
+    };
+
+    for (auto& [processor, output_type] : stages) {
+        auto type = output_type;
+        EXPECT_CALL(*processor, Init).WillOnce(Return(RetCode::RET_OK));
+        EXPECT_CALL(*processor, IsInited).WillRepeatedly(Return(true));
+        EXPECT_CALL(*processor, GetName).WillRepeatedly(Return("mock"));
+        EXPECT_CALL(*processor, Process)
+            .WillRepeatedly([type](const donde_toolkits::Value& input,
+                                   donde_toolkits::Value& output) {
+                output.valueType = type;
+                if (type == donde_toolkits::ValueFeatureResult) {
+                    output.valuePtr = std::make_shared<FeatureResult>();
+                } else {
+                    output.valuePtr = input.valuePtr;
+                }
+                return RetCode::RET_OK;
+            });
+        EXPECT_CALL(*processor, Terminate).WillOnce(Return(RetCode::RET_OK));
+        EXPECT_CALL(*processor, Die);
+    }
+
+    const int frame_count = 20;
+    std::mutex mu;
+    std::vector<int> delivered(frame_count * 2, 0);
+
+    {
+        FacePipeline pipeline{conf};
+        pipeline.Init(stages[0].first, stages[1].first, stages[2].first, stages[3].first);
+
+        EXPECT_EQ(pipeline.Submit(std::make_shared<Frame>(), 0), RetCode::RET_ERR);
+
+        // frames are tagged 0 .. frame_count - 1, images which can not be decoded after them.
+        EXPECT_EQ(pipeline.StartStreaming([&](uint64_t tag, std::shared_ptr<Frame> frame,
+                                              std::shared_ptr<FeatureResult> result) {
+            ASSERT_LT(tag, delivered.size());
+            EXPECT_EQ(frame != nullptr, tag < uint64_t(frame_count));
+            EXPECT_EQ(result != nullptr, tag < uint64_t(frame_count));
+            std::lock_guard<std::mutex> l(mu);
+            delivered[tag]++;
+        }),
+                  RetCode::RET_OK);
+
+        for (int i = 0; i < frame_count; i++) {
+            EXPECT_EQ(pipeline.Submit(std::make_shared<Frame>(), i), RetCode::RET_OK);
+        }
+        for (int i = frame_count; i < frame_count * 2; i++) {
+            EXPECT_EQ(pipeline.SubmitImage({1, 2, 3}, i), RetCode::RET_OK);
+        }
+
+        // all submitted frames are drained before stop returns, each one once.
+        EXPECT_EQ(pipeline.StopStreaming(), RetCode::RET_OK);
+        EXPECT_EQ(delivered, std::vector<int>(frame_count * 2, 1));
+
+        pipeline.Terminate();
+    }
+};
+
+TEST(FeatureExtract, FacePipelineStreamingReportsFailedFrames) {
+
+    json conf = R"(
+{
+  "detector": {
+    "concurrent": 2
+  },
+  "streaming": {
+    "queue_size": 2
+  }
+}
+)"_json;
+
+    // pipeline is responsible to release this pointers
+    std::vector<std::pair<MockProcessor*, donde_toolkits::ValueType>> stages{
+        {new MockProcessor(), donde_toolkits::ValueDetectResult},
+        {new MockProcessor(), donde_toolkits::ValueLandmarksResult},
+        {new MockProcessor(), donde_toolkits::ValueAlignerResult},
+        {new MockProcessor(), donde_toolkits::ValueFeatureResult},
+    };
+
+    // detector fails frames of one col, though it still fills output.
+    for (auto& [processor, output_type] : stages) {
+        auto type = output_type;
+        EXPECT_CALL(*processor, Init).WillRepeatedly(Return(RetCode::RET_OK));
+        EXPECT_CALL(*processor, IsInited).WillRepeatedly(Return(true));
+        EXPECT_CALL(*processor, GetName).WillRepeatedly(Return("mock"));
+        EXPECT_CALL(*processor, Process)
+            .WillRepeatedly([type](const donde_toolkits::Value& input,
+                                   donde_toolkits::Value& output) {
+                output.valueType = type;
+                if (type == donde_toolkits::ValueFeatureResult) {
+                    output.valuePtr = std::make_shared<FeatureResult>();
+                    return RetCode::RET_OK;
+                }
+                output.valuePtr = input.valuePtr;
+                if (type == donde_toolkits::ValueDetectResult) {
+                    auto frame = std::static_pointer_cast<Frame>(input.valuePtr);
+                    return frame->image.cols == 1 ? RetCode::RET_ERR : RetCode::RET_OK;
+                }
+                return RetCode::RET_OK;
+            });
+        EXPECT_CALL(*processor, Terminate).WillOnce(Return(RetCode::RET_OK));
+        EXPECT_CALL(*processor, Die);
+    }
+
+    std::atomic<int> succeeded = 0;
+    std::atomic<int> failed = 0;
+
+    {
+        FacePipeline pipeline{conf};
+        pipeline.Init(stages[0].first, stages[1].first, stages[2].first, stages[3].first);
+
+        EXPECT_EQ(pipeline.StartStreaming([&](uint64_t tag, std::shared_ptr<Frame> frame,
+                                              std::shared_ptr<FeatureResult> result) {
+            EXPECT_EQ(result == nullptr, tag % 2 == 0);
+            result ? succeeded++ : failed++;
+        }),
+                  RetCode::RET_OK);
+
+        for (int i = 0; i < 10; i++) {
+            auto frame = std::make_shared<Frame>(cv::Mat(1, i % 2 + 1, CV_8UC3));
+            EXPECT_EQ(pipeline.Submit(frame, i), RetCode::RET_OK);
+        }
+        EXPECT_EQ(pipeline.StopStreaming(), RetCode::RET_OK);
+        EXPECT_EQ(succeeded, 5);
+        EXPECT_EQ(failed, 5);
+
+        // submitters racing with StopStreaming either get their frame delivered, or an error.
+        std::atomic<int> submitted = 0;
+        succeeded = 0;
+        failed = 0;
+        EXPECT_EQ(pipeline.StartStreaming([&](uint64_t tag, std::shared_ptr<Frame> frame,
+                                              std::shared_ptr<FeatureResult> result) {
+            result ? succeeded++ : failed++;
+        }),
+                  RetCode::RET_OK);
+        std::vector<std::thread> submitters;
+        for (int t = 0; t < 4; t++) {
+            submitters.emplace_back([&] {
+                auto frame = std::make_shared<Frame>(cv::Mat(1, 2, CV_8UC3));
+                while (pipeline.Submit(frame, t) == RetCode::RET_OK) {
+                    submitted++;
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        EXPECT_EQ(pipeline.StopStreaming(), RetCode::RET_OK);
+        for (auto& t : submitters) {
+            t.join();
+        }
+        EXPECT_GT(submitted, 0);
+        EXPECT_EQ(succeeded, submitted);
+        EXPECT_EQ(failed, 0);
+
+        pipeline.Terminate();
+    }
+};
+
+TEST(FeatureExtract, FacePipelineDetectBatchKeepsOrderAndReportsErrors) {
+
+    json conf = R"(
+{
+  "detector": {
+    "concurrent": 1
+  }
+}
+)"_json;
+
+    // pipeline is responsible to release this pointers
+    auto detector = new MockProcessor();
+
+    // detect result of a frame has as many faces as its image cols.
+    EXPECT_CALL(*detector, Init).WillOnce(Return(RetCode::RET_OK));
+    EXPECT_CALL(*detector, IsInited).WillRepeatedly(Return(true));
+    EXPECT_CALL(*detector, Process)
+        .WillRepeatedly([](const donde_toolkits::Value& input, donde_toolkits::Value& output) {
+            auto frame = std::static_pointer_cast<Frame>(input.valuePtr);
+            auto result = std::make_shared<DetectResult>();
+            result->frame = frame;
+            result->faces.resize(frame->image.cols);
+            output = donde_toolkits::Value{donde_toolkits::ValueDetectResult, result};
+            return RetCode::RET_OK;
+        });
+    EXPECT_CALL(*detector, Terminate).WillOnce(Return(RetCode::RET_OK));
+    EXPECT_CALL(*detector, Die);
+
+    {
+        FacePipeline pipeline{conf};
+        pipeline.Init(detector, nullptr, nullptr, nullptr);
+
+        std::vector<std::shared_ptr<Frame>> frames{
+            std::make_shared<Frame>(cv::Mat(1, 3, CV_8UC3)),
+            nullptr,
+            std::make_shared<Frame>(cv::Mat(1, 1, CV_8UC3)),
+        };
+        auto results = pipeline.DetectBatch(frames);
+
+        ASSERT_EQ(results.size(), 3);
+        EXPECT_EQ(results[0].ret, RetCode::RET_OK);
+        EXPECT_EQ(results[0].result->faces.size(), 3);
+        EXPECT_EQ(results[1].ret, RetCode::RET_ERR);
+        EXPECT_EQ(results[1].result, nullptr);
+        EXPECT_FALSE(results[1].error.empty());
+        EXPECT_EQ(results[2].ret, RetCode::RET_OK);
+        EXPECT_EQ(results[2].result->faces.size(), 1);
+
+        // stages not inited fail every input.
+        auto features = pipeline.ExtractBatch({std::make_shared<AlignerResult>()});
+        ASSERT_EQ(features.size(), 1);
+        EXPECT_EQ(features[0].ret, RetCode::RET_ERR);
+
+        pipeline.Terminate();
+    }
+};
+
+TEST(FeatureExtract, FacePipelineTrackExtractsOncePerTrack) {
+
+    json conf = R"(
+{
+  "detector": {
+    "concurrent": 1
+  },
+  "landmarks": {
+    "concurrent": 1
+  },
+  "aligner": {
+    "concurrent": 1
+  },
+  "feature": {
+    "concurrent": 1
+  }
+}
+)"_json;
+
+    // pipeline is responsible to release this pointers
+    std::vector<std::pair<MockProcessor*, donde_toolkits::ValueType>> stages{
+        {new MockProcessor(), donde_toolkits::ValueDetectResult},
+        {new MockProcessor(), donde_toolkits::ValueLandmarksResult},
+        {new MockProcessor(), donde_toolkits::ValueAlignerResult},
+        {new MockProcessor(), donde_toolkits::ValueFeatureResult},
+    };
+
+    // detector finds one face moving right, image cols is its x. later stages pass detect result
+    // through, and feature makes a feature per face.
+    std::atomic<int> extracted_faces = 0;
+    for (auto& [processor, output_type] : stages) {
+        auto type = output_type;
+        EXPECT_CALL(*processor, Init).WillOnce(Return(RetCode::RET_OK));
+        EXPECT_CALL(*processor, IsInited).WillRepeatedly(Return(true));
+        EXPECT_CALL(*processor, GetName).WillRepeatedly(Return("mock"));
+        EXPECT_CALL(*processor, Process)
+            .WillRepeatedly([type, &extracted_faces](const donde_toolkits::Value& input,
+                                                     donde_toolkits::Value& output) {
+                output.valueType = type;
+                if (type == donde_toolkits::ValueDetectResult) {
+                    auto frame = std::static_pointer_cast<Frame>(input.valuePtr);
+                    auto result = std::make_shared<DetectResult>();
+                    result->frame = frame;
+                    result->faces.push_back(
+                        FaceDetection{0.9, cv::Rect(frame->image.cols, 0, 100, 100)});
+                    output.valuePtr = result;
+                } else if (type == donde_toolkits::ValueFeatureResult) {
+                    auto detect_result = std::static_pointer_cast<DetectResult>(input.valuePtr);
+                    auto result = std::make_shared<FeatureResult>();
+                    for (auto& face : detect_result->faces) {
+                        result->face_features.push_back(Feature({1, 2, 3}));
+                        extracted_faces++;
+                    }
+                    output.valuePtr = result;
+                } else {
+                    output.valuePtr = input.valuePtr;
+                }
+                return RetCode::RET_OK;
+            });
+        EXPECT_CALL(*processor, Terminate).WillOnce(Return(RetCode::RET_OK));
+        EXPECT_CALL(*processor, Die);
+    }
+
+    {
+        FacePipeline pipeline{conf};
+        pipeline.Init(stages[0].first, stages[1].first, stages[2].first, stages[3].first);
+
+        FaceTracker tracker(TrackerOptions{.min_hits = 2, .extract = EXTRACT_START});
+        for (int i = 1; i <= 10; i++) {
+            auto frame = std::make_shared<Frame>(cv::Mat(1, i * 10, CV_8UC3));
+            EXPECT_TRUE(pipeline.Track(tracker, frame).empty());
+        }
+        EXPECT_EQ(extracted_faces, 1);
+
+        std::vector<FaceTrack> tracks = tracker.Flush();
+        ASSERT_EQ(tracks.size(), 1);
+        EXPECT_EQ(tracks[0].hits, 10);
+        ASSERT_NE(tracks[0].feature, nullptr);
+        EXPECT_EQ(tracks[0].feature->raw, std::vector<float>({1, 2, 3}));
+
+        pipeline.Terminate();
+    }
+};
@@ -0,0 +1,98 @@
+#include "donde/definitions.h"
+#include "donde/feature_extract/face_tracker.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+
+using donde_toolkits::FaceDetection;
+using donde_toolkits::Feature;
+using donde_toolkits::feature_extract::EXTRACT_BEST;
+using donde_toolkits::feature_extract::EXTRACT_START;
+using donde_toolkits::feature_extract::FaceTrack;
+using donde_toolkits::feature_extract::FaceTracker;
+using donde_toolkits::feature_extract::TrackerOptions;
+
+TEST(FeatureExtract, FaceTrackerFollowsMovingFacesAndEndsLostTracks) {
+    FaceTracker tracker(TrackerOptions{
+        .iou_threshold = 0.3, .max_missed = 2, .min_hits = 2, .extract = EXTRACT_START});
+
+    // two faces walk right, and a false detection shows up in one frame.
+    std::vector<int> ids;
+    for (int i = 0; i < 10; i++) {
+        std::vector<FaceDetection> faces{
+            FaceDetection{0.9, cv::Rect(i * 30, 0, 100, 100)},
+            FaceDetection{0.9, cv::Rect(500 + i * 30, 200, 100, 100)},
+        };
+        if (i == 3) {
+            faces.push_back(FaceDetection{0.5, cv::Rect(300, 400, 50, 50)});
+        }
+
+        auto updates = tracker.Update(faces);
+        ASSERT_EQ(updates.size(), faces.size());
+        if (i == 0) {
+            ids = {updates[0].track_id, updates[1].track_id};
+            EXPECT_NE(ids[0], ids[1]);
+        }
+        EXPECT_EQ(updates[0].track_id, ids[0]);
+        EXPECT_EQ(updates[1].track_id, ids[1]);
+
+        // extracted once, when confirmed by min_hits frames.
+        EXPECT_EQ(updates[0].extract, i == 1);
+        if (updates[0].extract) {
+            tracker.SetFeature(updates[0].track_id, Feature({1, 2, 3}));
+        }
+    }
+    EXPECT_TRUE(tracker.TakeEnded().empty());
+
+    // first face leaves, its track ends after max_missed frames. false detection ends quietly.
+    for (int i = 10; i < 13; i++) {
+        tracker.Update({FaceDetection{0.9, cv::Rect(500 + i * 30, 200, 100, 100)}});
+    }
+    std::vector<FaceTrack> ended = tracker.TakeEnded();
+    ASSERT_EQ(ended.size(), 1);
+    EXPECT_EQ(ended[0].id, ids[0]);
+    EXPECT_EQ(ended[0].first_frame, 1);
+    EXPECT_EQ(ended[0].last_frame, 10);
+    EXPECT_EQ(ended[0].hits, 10);
+    EXPECT_EQ(ended[0].extractions, 1);
+    ASSERT_NE(ended[0].feature, nullptr);
+    EXPECT_EQ(ended[0].feature->raw, std::vector<float>({1, 2, 3}));
+
+    ended = tracker.Flush();
+    ASSERT_EQ(ended.size(), 1);
+    EXPECT_EQ(ended[0].id, ids[1]);
+    EXPECT_EQ(ended[0].feature, nullptr);
+    EXPECT_EQ(tracker.Size(), 0);
+};
+
+TEST(FeatureExtract, FaceTrackerExtractsAgainOnlyForBetterFaces) {
+    FaceTracker tracker(TrackerOptions{.min_hits = 1,
+                                       .extract = EXTRACT_BEST,
+                                       .improve_ratio = 1.2,
+                                       .max_extractions = 2});
+
+    // confidence of a still face changes, so does its quality.
+    std::vector<float> confidences{0.5, 0.55, 0.9, 0.95, 0.99};
+    std::vector<bool> extracted;
+    for (float confidence : confidences) {
+        auto updates = tracker.Update({FaceDetection{confidence, cv::Rect(0, 0, 100, 100)}});
+        ASSERT_EQ(updates.size(), 1);
+        extracted.push_back(updates[0].extract);
+        if (updates[0].extract) {
+            tracker.SetFeature(updates[0].track_id, Feature({confidence}));
+        }
+    }
+    EXPECT_EQ(extracted, std::vector<bool>({true, false, true, false, false}));
+
+    std::vector<FaceTrack> ended = tracker.Flush();
+    ASSERT_EQ(ended.size(), 1);
+    EXPECT_EQ(ended[0].extractions, 2);
+    EXPECT_EQ(ended[0].feature->raw, std::vector<float>({0.9f}));
+
+    json conf = R"({"tracker": {"extract": "start", "min_hits": 3}})"_json;
+    TrackerOptions opts = FaceTracker::ParseTrackerOptions(conf);
+    EXPECT_EQ(opts.extract, EXTRACT_START);
+    EXPECT_EQ(opts.min_hits, 3);
+    EXPECT_EQ(opts.max_missed, TrackerOptions().max_missed);
+};
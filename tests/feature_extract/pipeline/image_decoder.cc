@@ -0,0 +1,59 @@
+#include "donde/definitions.h"
+#include "src/feature_extract/image_decoder.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+
+using donde_toolkits::Frame;
+using donde_toolkits::feature_extract::DecoderOptions;
+using donde_toolkits::feature_extract::ImageDecoder;
+using donde_toolkits::feature_extract::jpeg_size;
+
+TEST(FeatureExtract, JpegSizeReadsStartOfFrame) {
+    // SOI, APP0 of 4 bytes, SOF0 of 640x480.
+    std::vector<uint8_t> jpeg{0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x04, 0x00, 0x00, 0xFF,
+                              0xC0, 0x00, 0x11, 0x08, 0x01, 0xE0, 0x02, 0x80, 0x03};
+    int width = 0, height = 0;
+    EXPECT_TRUE(jpeg_size(jpeg, width, height));
+    EXPECT_EQ(width, 640);
+    EXPECT_EQ(height, 480);
+
+    std::vector<uint8_t> png{0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
+    EXPECT_FALSE(jpeg_size(png, width, height));
+    EXPECT_FALSE(jpeg_size({}, width, height));
+};
+
+TEST(FeatureExtract, ImageDecoderReducesAndPoolsBuffers) {
+    cv::Mat img(cv::Size(1600, 1200), CV_8UC3, cv::Scalar(0, 128, 255));
+    std::vector<uint8_t> jpeg;
+    ASSERT_TRUE(cv::imencode(".jpg", img, jpeg));
+
+    DecoderOptions opts{.concurrent = 1, .pool_size = 2, .reduce_width = 672, .reduce_height = 384};
+    ImageDecoder decoder(opts);
+
+    // 1600x1200 / 2 is the smallest not smaller than 672x384.
+    std::shared_ptr<Frame> frame = decoder.Decode(jpeg);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frame->image.cols, 800);
+    EXPECT_EQ(frame->image.rows, 600);
+
+    // buffer is pooled after frame is released, and reused by next decode.
+    uint8_t* data = frame->image.data;
+    frame.reset();
+    EXPECT_EQ(decoder.Pooled(), 1);
+
+    frame = decoder.Decode(jpeg);
+    EXPECT_EQ(frame->image.data, data);
+    EXPECT_EQ(decoder.Pooled(), 0);
+
+    // a crop still refers to buffer, it must not be reused.
+    cv::Mat crop = frame->image(cv::Rect(0, 0, 10, 10));
+    frame.reset();
+    EXPECT_EQ(decoder.Pooled(), 0);
+
+    EXPECT_EQ(decoder.Decode({1, 2, 3}), nullptr);
+};
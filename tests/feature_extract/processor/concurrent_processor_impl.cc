@@ -5,6 +5,7 @@
 #include "src/feature_extract/worker.h"
 
 #include <Poco/NotificationQueue.h>
+#include <atomic>
 #include <chrono>
 #include <gtest/gtest.h>
 #include <memory>
@@ -18,12 +19,18 @@ using Poco::Notification;
 
 using nlohmann::json;
 
+using donde_toolkits::DetectResult;
+using donde_toolkits::FaceDetection;
 using donde_toolkits::Feature;
 using donde_toolkits::Frame;
+using donde_toolkits::LandmarksResult;
 using donde_toolkits::Value;
+using donde_toolkits::ValueDetectResult;
 using donde_toolkits::ValueFeature;
 using donde_toolkits::ValueFrame;
+using donde_toolkits::ValueLandmarksResult;
 using donde_toolkits::feature_extract::ConcurrentProcessor;
+using donde_toolkits::feature_extract::BatchOptions;
 using donde_toolkits::feature_extract::WorkerBaseImpl;
 
 TEST(FeatureExtract, ConcurrentProcessorHasConcurrentWorkers) {
@@ -140,3 +147,191 @@ TEST(FeatureExtract, ConcurrentProcessorComunicateWithWorkerUsingChannel) {
 
     EXPECT_EQ("aa", "aa");
 };
+
+TEST(FeatureExtract, WorkerDequeueBatchDrainsChannel) {
+    class DummyWorker : public WorkerBaseImpl {
+      public:
+        DummyWorker(std::shared_ptr<MsgChannel> ch) : WorkerBaseImpl(ch){};
+    };
+
+    json conf = R"(
+{
+  "batch": {
+    "max_batch_size": 4,
+    "max_wait_ms": 10
+  }
+})"_json;
+
+    BatchOptions opts = WorkerBaseImpl::ParseBatchOptions(conf);
+    EXPECT_EQ(opts.max_batch_size, 4);
+    EXPECT_EQ(opts.max_wait_ms, 10);
+
+    // missing batch block keeps one message per inference.
+    EXPECT_EQ(WorkerBaseImpl::ParseBatchOptions(json::object()).max_batch_size, 1);
+
+    auto channel = std::make_shared<MsgChannel>();
+    DummyWorker worker(channel);
+
+    std::shared_ptr<Frame> f = std::make_shared<Frame>();
+    for (int i = 0; i < 6; i++) {
+        Value input{ValueFrame, f};
+        channel->enqueueNotification(WorkMessage<Value>::Ptr(new WorkMessage(input)));
+    }
+
+    // at most max_batch_size messages, and what is left when batch can not be filled in time.
+    EXPECT_EQ(worker.dequeue_batch(opts).size(), 4);
+    EXPECT_EQ(worker.dequeue_batch(opts).size(), 2);
+};
+
+TEST(FeatureExtract, ConcurrentProcessorFansOutFacesAcrossWorkers) {
+    static std::atomic<int> processedMsg = 0;
+
+    // landmarks of each face are its box.x, so order can be checked after regathering.
+    class DummyWorker : public WorkerBaseImpl {
+      public:
+        DummyWorker(std::shared_ptr<MsgChannel> ch) : WorkerBaseImpl(ch){};
+
+        void run() override {
+            for (;;) {
+                Notification::Ptr pNf = _channel->waitDequeueNotification();
+                if (pNf.isNull()) {
+                    break;
+                }
+
+                WorkMessage<Value>::Ptr msg = pNf.cast<WorkMessage<Value>>();
+                processedMsg++;
+
+                Value input = msg->getRequest();
+                EXPECT_EQ(input.valueType, ValueDetectResult);
+
+                auto detect_result = std::static_pointer_cast<DetectResult>(input.valuePtr);
+                EXPECT_LE(detect_result->faces.size(), 2);
+
+                std::shared_ptr<LandmarksResult> result = std::make_shared<LandmarksResult>();
+                for (auto& face : detect_result->faces) {
+                    result->faces.push_back(cv::Mat());
+                    result->face_landmarks.push_back({cv::Point2f(face.box.x, 0)});
+                }
+
+                Value output{ValueLandmarksResult, result};
+                msg->setResponse(output);
+            }
+        };
+    };
+
+    json conf = R"(
+{
+  "dummy": {
+    "concurrent": 3,
+    "device_id": "CPU",
+    "fan_out": {
+      "faces_per_item": 2
+    }
+  }
+})"_json;
+
+    ConcurrentProcessor<DummyWorker> processor;
+    processor.Init(conf["dummy"]);
+
+    std::shared_ptr<DetectResult> detect_result = std::make_shared<DetectResult>();
+    detect_result->frame = std::make_shared<Frame>();
+    for (int i = 0; i < 7; i++) {
+        detect_result->faces.push_back(FaceDetection{0.9, cv::Rect(i, 0, 10, 10)});
+    }
+
+    Value output;
+    processor.Process(Value{ValueDetectResult, detect_result}, output);
+
+    // 7 faces, 2 faces per item.
+    EXPECT_EQ(processedMsg, 4);
+
+    ASSERT_EQ(output.valueType, ValueLandmarksResult);
+    auto result = std::static_pointer_cast<LandmarksResult>(output.valuePtr);
+    ASSERT_EQ(result->faces.size(), 7);
+    ASSERT_EQ(result->face_landmarks.size(), 7);
+    for (int i = 0; i < 7; i++) {
+        EXPECT_EQ(result->face_landmarks[i][0].x, i);
+    }
+
+    processor.Terminate();
+};
+
+TEST(FeatureExtract, ConcurrentProcessorFailsInputOfFailedBatch) {
+    // batches having a face at box.x == 2 fail, and are answered with null like inference workers.
+    class FailingWorker : public WorkerBaseImpl {
+      public:
+        FailingWorker(std::shared_ptr<MsgChannel> ch) : WorkerBaseImpl(ch){};
+
+        void run() override {
+            for (;;) {
+                std::vector<WorkMessage<Value>::Ptr> msgs = dequeue_batch(BatchOptions{});
+                if (msgs.empty()) {
+                    break;
+                }
+
+                for (auto& msg : msgs) {
+                    auto detect_result
+                        = std::static_pointer_cast<DetectResult>(msg->getRequest().valuePtr);
+                    RetCode ret = RET_OK;
+                    std::shared_ptr<LandmarksResult> result = std::make_shared<LandmarksResult>();
+                    for (auto& face : detect_result->faces) {
+                        if (face.box.x == 2) {
+                            ret = RET_ERR;
+                        }
+                        result->faces.push_back(cv::Mat());
+                        result->face_landmarks.push_back({cv::Point2f(face.box.x, 0)});
+                    }
+
+                    Value output{ValueLandmarksResult, nullptr};
+                    if (ret == RET_OK) {
+                        output.valuePtr = result;
+                    }
+                    msg->setResponse(output);
+                }
+            }
+        };
+    };
+
+    json conf = R"(
+{
+  "dummy": {
+    "concurrent": 2,
+    "device_id": "CPU",
+    "fan_out": {
+      "faces_per_item": 1
+    }
+  }
+})"_json;
+
+    ConcurrentProcessor<FailingWorker> processor;
+    processor.Init(conf["dummy"]);
+
+    auto make_input = [](std::vector<int> xs) {
+        std::shared_ptr<DetectResult> detect_result = std::make_shared<DetectResult>();
+        detect_result->frame = std::make_shared<Frame>();
+        for (int x : xs) {
+            detect_result->faces.push_back(FaceDetection{0.9, cv::Rect(x, 0, 10, 10)});
+        }
+        return Value{ValueDetectResult, detect_result};
+    };
+
+    // one failed face fails its frame, never a partial result.
+    Value output;
+    EXPECT_EQ(processor.Process(make_input({0, 1, 2, 3}), output), RET_ERR);
+    EXPECT_EQ(output.valueType, ValueLandmarksResult);
+    EXPECT_EQ(output.valuePtr, nullptr);
+
+    // other frames of the same batch are not affected.
+    std::vector<Value> outputs;
+    EXPECT_EQ(processor.ProcessBatch({make_input({2}), make_input({0, 1})}, outputs), RET_ERR);
+    ASSERT_EQ(outputs.size(), 2);
+    EXPECT_EQ(outputs[0].valuePtr, nullptr);
+    ASSERT_NE(outputs[1].valuePtr, nullptr);
+    auto result = std::static_pointer_cast<LandmarksResult>(outputs[1].valuePtr);
+    EXPECT_EQ(result->face_landmarks.size(), 2);
+
+    EXPECT_EQ(processor.Process(make_input({0, 1}), output), RET_OK);
+    EXPECT_NE(output.valuePtr, nullptr);
+
+    processor.Terminate();
+};
@@ -0,0 +1,83 @@
+#include "src/feature_extract/executor.h"
+
+#include <atomic>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+
+using donde_toolkits::feature_extract::Executor;
+using donde_toolkits::feature_extract::WaitGroup;
+
+TEST(FeatureExtract, ExecutorParallelForRunsEveryIndex) {
+    Executor& executor = Executor::getInstance();
+    EXPECT_GT(executor.Size(), 0);
+
+    std::vector<int> hits(1000, 0);
+    executor.ParallelFor(hits.size(), [&](size_t i) { hits[i]++; });
+
+    for (size_t i = 0; i < hits.size(); i++) {
+        EXPECT_EQ(hits[i], 1);
+    }
+
+    // options can not be changed once started.
+    EXPECT_EQ(executor.Configure({.threads = 1}), donde_toolkits::RET_ERR);
+};
+
+TEST(FeatureExtract, ExecutorNestedParallelForDoesNotDeadlock) {
+    Executor& executor = Executor::getInstance();
+
+    // more outer tasks than threads, every thread waits on its inner tasks.
+    std::atomic<int> count = 0;
+    executor.ParallelFor(executor.Size() * 2, [&](size_t i) {
+        executor.ParallelFor(16, [&](size_t j) { count++; });
+    });
+
+    EXPECT_EQ(count, executor.Size() * 2 * 16);
+};
+
+TEST(FeatureExtract, ExecutorSubmitWithWaitGroup) {
+    Executor& executor = Executor::getInstance();
+
+    WaitGroup wg;
+    std::atomic<int> count = 0;
+    wg.Add(100);
+    for (int i = 0; i < 100; i++) {
+        executor.Submit([&] {
+            count++;
+            wg.Done();
+        });
+    }
+    wg.Wait();
+
+    EXPECT_EQ(count, 100);
+};
+
+TEST(FeatureExtract, ExecutorParallelForRethrowsAfterAllDone) {
+    Executor& executor = Executor::getInstance();
+
+    // the throwing task does not leave others running, nor the caller waiting forever.
+    std::atomic<int> count = 0;
+    EXPECT_THROW(executor.ParallelFor(100,
+                                      [&](size_t i) {
+                                          count++;
+                                          if (i % 10 == 3) {
+                                              throw std::runtime_error("task failed");
+                                          }
+                                      }),
+                 std::runtime_error);
+    EXPECT_EQ(count, 100);
+
+    // the caller's own task may throw too, and executor is still usable.
+    EXPECT_THROW(executor.ParallelFor(4,
+                                      [&](size_t i) {
+                                          if (i == 0) {
+                                              throw std::runtime_error("task failed");
+                                          }
+                                      }),
+                 std::runtime_error);
+    count = 0;
+    executor.ParallelFor(100, [&](size_t i) { count++; });
+    EXPECT_EQ(count, 100);
+};
@@ -0,0 +1,174 @@
+#include "donde/feature_identity/identity_store.h"
+
+#include "donde/definitions.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+
+using donde_toolkits::Feature;
+using donde_toolkits::gen_feature_dim;
+using donde_toolkits::RET_ERR;
+using donde_toolkits::RET_OK;
+using donde_toolkits::feature_identity::AlignedAllocator;
+using donde_toolkits::feature_identity::IdentityStore;
+
+namespace {
+
+// dimension is not a multiple of 16, so rows are padded.
+const int kDimension = 100;
+
+class FeatureIdentity_IdentityStore : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        std::filesystem::create_directories(store_dir);
+        for (int i = 0; i < feature_count; i++) {
+            fts.push_back(gen_feature_dim<kDimension>());
+        }
+    };
+
+    void TearDown() override { std::filesystem::remove_all(store_dir); };
+
+    const int feature_count = 200;
+    const std::string store_dir = "/tmp/test_identity_store";
+    const std::string store_path = store_dir + "/identity.db";
+    std::vector<Feature> fts;
+};
+
+TEST(FeatureIdentity, AlignedAllocatorAlignsRows) {
+    for (size_t n : {1, 15, 16, 17, 100, 1000}) {
+        std::vector<float, AlignedAllocator<float>> rows(n, 1.f);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(rows.data()) % 64, 0) << n;
+    }
+
+    // growing reallocates, still aligned.
+    std::vector<float, AlignedAllocator<float>> rows;
+    for (int i = 0; i < 1000; i++) {
+        rows.push_back(i);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(rows.data()) % 64, 0) << i;
+    }
+};
+
+TEST_F(FeatureIdentity_IdentityStore, SearchIsTopKOfBruteForce) {
+    IdentityStore store(1000, "test-model-face", 100, kDimension);
+    for (auto& ft : fts) {
+        ASSERT_EQ(store.AddFeature(ft), RET_OK);
+    }
+    EXPECT_EQ(store.Size(), feature_count);
+
+    auto& query = fts[42];
+    std::vector<float> expected;
+    for (auto& ft : fts) {
+        expected.push_back(ft.compare(query));
+    }
+    std::sort(expected.begin(), expected.end(), std::greater<float>());
+
+    auto results = store.Search(query, 10);
+    ASSERT_EQ(results.size(), 10);
+    EXPECT_NEAR(results[0].score, 1.0, 1e-4);
+    EXPECT_GT(results[0].feature.compare(query), 0.9999);
+    for (size_t i = 0; i < results.size(); i++) {
+        EXPECT_NEAR(results[i].score, expected[i], 1e-4) << i;
+    }
+
+    // restored features keep their length, model and version.
+    EXPECT_EQ(results[0].feature.model, "test-model-face");
+    EXPECT_EQ(results[0].feature.version, 100);
+    ASSERT_EQ(results[0].feature.raw.size(), kDimension);
+    for (int i = 0; i < kDimension; i++) {
+        EXPECT_NEAR(results[0].feature.raw[i], query.raw[i], 1e-4);
+    }
+
+    EXPECT_EQ(store.Search(query, feature_count * 2).size(), feature_count);
+    EXPECT_EQ(store.Search(query, 0).size(), 0);
+    EXPECT_EQ(store.Search(gen_feature_dim<kDimension + 1>(), 10).size(), 0);
+};
+
+TEST_F(FeatureIdentity_IdentityStore, RejectsWrongFeaturesAndFullStore) {
+    IdentityStore store(2, "test-model-face", 100, kDimension);
+    EXPECT_EQ(store.AddFeature(gen_feature_dim<kDimension + 1>()), RET_ERR);
+
+    Feature other = fts[0];
+    other.model = "other-model";
+    EXPECT_EQ(store.AddFeature(other), RET_ERR);
+
+    EXPECT_EQ(store.AddFeature(fts[0]), RET_OK);
+    EXPECT_EQ(store.AddFeature(fts[1]), RET_OK);
+    EXPECT_EQ(store.AddFeature(fts[2]), RET_ERR);
+    EXPECT_EQ(store.Size(), 2);
+};
+
+TEST_F(FeatureIdentity_IdentityStore, SaveAndLoad) {
+    IdentityStore store(1000, "test-model-face", 100, kDimension);
+    EXPECT_EQ(store.Save(), RET_ERR);
+
+    // a missing file is an empty store.
+    ASSERT_EQ(store.LoadFromFile(store_path), RET_OK);
+    EXPECT_EQ(store.Size(), 0);
+    for (int i = 0; i < feature_count / 2; i++) {
+        ASSERT_EQ(store.AddFeature(fts[i]), RET_OK);
+    }
+    ASSERT_EQ(store.Save(), RET_OK);
+
+    // mapped rows, and rows added after load, are searched and saved together.
+    IdentityStore loaded(1000, "test-model-face", 100, kDimension);
+    ASSERT_EQ(loaded.LoadFromFile(store_path), RET_OK);
+    EXPECT_EQ(loaded.Size(), feature_count / 2);
+    for (int i = feature_count / 2; i < feature_count; i++) {
+        ASSERT_EQ(loaded.AddFeature(fts[i]), RET_OK);
+    }
+    for (int i : {7, feature_count - 7}) {
+        auto results = loaded.Search(fts[i], 1);
+        ASSERT_EQ(results.size(), 1);
+        EXPECT_GT(results[0].feature.compare(fts[i]), 0.9999) << i;
+    }
+    ASSERT_EQ(loaded.Save(), RET_OK);
+
+    IdentityStore reloaded(1000, "test-model-face", 100, kDimension);
+    ASSERT_EQ(reloaded.LoadFromFile(store_path), RET_OK);
+    EXPECT_EQ(reloaded.Size(), feature_count);
+    auto expected = loaded.Search(fts[3], 20);
+    auto results = reloaded.Search(fts[3], 20);
+    ASSERT_EQ(results.size(), expected.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        EXPECT_FLOAT_EQ(results[i].score, expected[i].score);
+    }
+
+    // a store of another model, or smaller than the file, does not load it.
+    IdentityStore other_model(1000, "other-model", 100, kDimension);
+    EXPECT_EQ(other_model.LoadFromFile(store_path), RET_ERR);
+    IdentityStore small(10, "test-model-face", 100, kDimension);
+    EXPECT_EQ(small.LoadFromFile(store_path), RET_ERR);
+};
+
+TEST_F(FeatureIdentity_IdentityStore, ConcurrentSavesKeepFileWhole) {
+    IdentityStore store(1000, "test-model-face", 100, kDimension);
+    ASSERT_EQ(store.LoadFromFile(store_path), RET_OK);
+    for (int i = 0; i < feature_count; i++) {
+        ASSERT_EQ(store.AddFeature(fts[i]), RET_OK);
+    }
+
+    // saves share the temp file, they must not interleave.
+    std::vector<std::thread> savers;
+    for (int t = 0; t < 4; t++) {
+        savers.emplace_back([&] {
+            for (int i = 0; i < 5; i++) {
+                EXPECT_EQ(store.Save(), RET_OK);
+            }
+        });
+    }
+    for (auto& t : savers) {
+        t.join();
+    }
+
+    IdentityStore loaded(1000, "test-model-face", 100, kDimension);
+    ASSERT_EQ(loaded.LoadFromFile(store_path), RET_OK);
+    EXPECT_EQ(loaded.Size(), feature_count);
+    EXPECT_FALSE(std::filesystem::exists(store_path + ".tmp"));
+};
+
+} // namespace
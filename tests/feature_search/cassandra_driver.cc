@@ -0,0 +1,225 @@
+#include "donde/feature_search/cassandra_driver.h"
+
+#include "donde/definitions.h"
+#include "donde/feature_search/definitions.h"
+#include "donde/utils.h"
+
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using donde_toolkits::Feature;
+using donde_toolkits::gen_feature_dim;
+
+using donde_toolkits::RetCode;
+
+using donde_toolkits::feature_search::CassandraDriver;
+using donde_toolkits::feature_search::convert_to_feature_ids;
+using donde_toolkits::feature_search::DBItem;
+using donde_toolkits::feature_search::DBShard;
+using donde_toolkits::feature_search::FeatureDbItem;
+using donde_toolkits::feature_search::FeatureDbItemList;
+using donde_toolkits::feature_search::PageData;
+using donde_toolkits::feature_search::PagingState;
+using donde_toolkits::feature_search::WorkerItem;
+
+namespace {
+
+// TestCassandraDriver fills in the Driver apis CassandraDriver does not implement yet, tests only
+// call the ones it does.
+class TestCassandraDriver : public CassandraDriver {
+  public:
+    using CassandraDriver::AddFeatures;
+    using CassandraDriver::CassandraDriver;
+    using CassandraDriver::ListFeatures;
+    using CassandraDriver::LoadFeatures;
+    using CassandraDriver::RemoveFeatures;
+
+    std::vector<WorkerItem> ListWorkers() override { return {}; };
+    void CreateWorker(const std::string& worker_id, const WorkerItem& worker) override{};
+    void UpdateWorker(const std::string& worker_id, const WorkerItem& worker) override{};
+    PageData<FeatureDbItemList> ListFeatures(uint page, uint perPage, const std::string& db_id,
+                                             const std::string& shard_id) override {
+        return {};
+    };
+    FeatureDbItemList ListFeatures(uint perPage, PagingState& state, const std::string& db_id,
+                                   const std::string& shard_id) override {
+        return {};
+    };
+    std::vector<std::string> AddFeatures(const std::vector<FeatureDbItem>& features,
+                                         const std::string& db_id,
+                                         const std::string& shard_id) override {
+        return {};
+    };
+    std::vector<Feature> LoadFeatures(const std::vector<std::string>& feature_ids,
+                                      const std::string& db_id,
+                                      const std::string& shard_id) override {
+        return {};
+    };
+    RetCode RemoveFeatures(const std::vector<std::string>& feature_ids, const std::string& db_id,
+                           const std::string& shard_id) override {
+        return donde_toolkits::RET_ERR;
+    };
+};
+
+class SearchManager_CassandraDriver : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        store = std::make_unique<TestCassandraDriver>(store_dir, 4);
+        db_id = store->CreateDB(
+            DBItem{.db_id = "", .name = "test-db1", .size = 1024, .description = ""});
+    };
+
+    void TearDown() override { std::filesystem::remove_all(store_dir); };
+
+    std::vector<FeatureDbItem> generate_features(int feature_count) {
+        std::vector<FeatureDbItem> ret;
+        for (int i = 0; i < feature_count; i++) {
+            ret.push_back(FeatureDbItem{
+                .feature_id = "",
+                .feature = gen_feature_dim<512>(),
+                .metadata = {{"index", std::to_string(i)}},
+            });
+        }
+        return ret;
+    };
+
+    // scan lists all features of db by key, perPage a time.
+    std::vector<FeatureDbItemList> scan(uint perPage) {
+        std::vector<FeatureDbItemList> pages;
+        PagingState state;
+        while (!state.done) {
+            pages.push_back(store->ListFeatures(db_id, perPage, state));
+        }
+        return pages;
+    };
+
+    const std::string store_dir = "/tmp/test_cassandra_store";
+    std::unique_ptr<TestCassandraDriver> store;
+    std::string db_id;
+};
+
+TEST_F(SearchManager_CassandraDriver, KeyPaging) {
+    auto fts = generate_features(25);
+    std::vector<std::string> feature_ids = store->AddFeatures(db_id, fts);
+    ASSERT_EQ(feature_ids.size(), 25);
+
+    // a short page is the last one.
+    auto pages = scan(10);
+    ASSERT_EQ(pages.size(), 3);
+    EXPECT_EQ(pages[0].size(), 10);
+    EXPECT_EQ(pages[1].size(), 10);
+    EXPECT_EQ(pages[2].size(), 5);
+
+    std::vector<std::string> listed;
+    for (auto& page : pages) {
+        for (auto& item : page) {
+            EXPECT_EQ(item.metadata.at("index"), std::to_string(listed.size()));
+            listed.push_back(item.feature_id);
+        }
+    }
+    EXPECT_EQ(listed, feature_ids);
+
+    // removing rows mid scan does not shift the rest, as offsets would, no row is missed.
+    PagingState state;
+    auto first = store->ListFeatures(db_id, 10, state);
+    ASSERT_EQ(first.size(), 10);
+    ASSERT_EQ(store->RemoveFeatures(db_id, {feature_ids[0], feature_ids[12]}),
+              donde_toolkits::RET_OK);
+    auto second = store->ListFeatures(db_id, 10, state);
+    ASSERT_EQ(second.size(), 10);
+    EXPECT_EQ(second[0].feature_id, feature_ids[10]);
+    EXPECT_EQ(second[2].feature_id, feature_ids[13]);
+    EXPECT_FALSE(state.done);
+    EXPECT_EQ(store->ListFeatures(db_id, 10, state).size(), 4);
+    EXPECT_TRUE(state.done);
+
+    // a done state, or an empty page, lists nothing.
+    EXPECT_EQ(store->ListFeatures(db_id, 10, state).size(), 0);
+    PagingState fresh;
+    EXPECT_EQ(store->ListFeatures(db_id, 0, fresh).size(), 0);
+};
+
+TEST_F(SearchManager_CassandraDriver, DoneAtLastPage) {
+    // a full last page is only known to be the last one by the empty page after it.
+    store->AddFeatures(db_id, generate_features(20));
+    auto pages = scan(10);
+    ASSERT_EQ(pages.size(), 3);
+    EXPECT_EQ(pages[1].size(), 10);
+    EXPECT_EQ(pages[2].size(), 0);
+
+    // an empty db is done at once.
+    std::string empty_db = store->CreateDB(
+        DBItem{.db_id = "", .name = "test-db2", .size = 1024, .description = ""});
+    PagingState state;
+    EXPECT_EQ(store->ListFeatures(empty_db, 10, state).size(), 0);
+    EXPECT_TRUE(state.done);
+};
+
+TEST_F(SearchManager_CassandraDriver, FailedRowFailsBatch) {
+    auto fts = generate_features(4);
+    fts[0].feature_id = "ft-0";
+    // its file cannot be written.
+    fts[1].feature_id = "no-such-dir/ft-1";
+    // its metadata cannot be dumped, json strings are utf-8.
+    fts[2].feature_id = "ft-2";
+    fts[2].metadata = {{"name", "\xff\xfe"}};
+
+    // nothing of the batch is stored, not even the good rows.
+    EXPECT_TRUE(store->AddFeatures(db_id, fts).empty());
+    EXPECT_FALSE(std::filesystem::exists(store_dir + "/data/ft-0.ft"));
+    EXPECT_FALSE(std::filesystem::exists(store_dir + "/data/ft-2.ft"));
+    auto pages = scan(10);
+    ASSERT_EQ(pages.size(), 1);
+    EXPECT_TRUE(pages[0].empty());
+
+    std::vector<std::string> feature_ids = store->AddFeatures(db_id, {fts[0], fts[3]});
+    ASSERT_EQ(feature_ids.size(), 2);
+    std::vector<Feature> loaded = store->LoadFeatures(db_id, feature_ids);
+    ASSERT_EQ(loaded.size(), 2);
+    EXPECT_EQ(loaded[0].raw, fts[0].feature.raw);
+    EXPECT_EQ(loaded[1].raw, fts[3].feature.raw);
+
+    // a missing feature fails the load, rather than giving an empty one.
+    EXPECT_TRUE(store->LoadFeatures(db_id, {feature_ids[0], "no-such-feature"}).empty());
+};
+
+TEST_F(SearchManager_CassandraDriver, ConcurrentAddAndScan) {
+    // cached statements are shared by callers on different threads.
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; t++) {
+        writers.emplace_back([&] {
+            for (int i = 0; i < 5; i++) {
+                EXPECT_EQ(store->AddFeatures(db_id, generate_features(5)).size(), 5);
+                PagingState state;
+                store->ListFeatures(db_id, 7, state);
+            }
+        });
+    }
+    for (auto& t : writers) {
+        t.join();
+    }
+
+    size_t listed = 0;
+    for (auto& page : scan(7)) {
+        listed += page.size();
+    }
+    EXPECT_EQ(listed, 100);
+};
+
+TEST_F(SearchManager_CassandraDriver, DeletedDBCanBeCreatedAgain) {
+    store->AddFeatures(db_id, generate_features(3));
+    ASSERT_EQ(store->DeleteDB(db_id), donde_toolkits::RET_OK);
+    EXPECT_EQ(store->FindDB(db_id).db_id, "");
+
+    // statements of the deleted db are dropped, its table is prepared again on Init.
+    ASSERT_EQ(store->Init({db_id}), donde_toolkits::RET_OK);
+    auto pages = scan(10);
+    ASSERT_EQ(pages.size(), 1);
+    EXPECT_EQ(pages[0].size(), 3);
+};
+
+} // namespace
@@ -0,0 +1,77 @@
+#include "donde/definitions.h"
+#include "donde/feature_serialize.h"
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using donde_toolkits::DeserializeFeature;
+using donde_toolkits::DeserializeHeader;
+using donde_toolkits::Feature;
+using donde_toolkits::FeatureSerializeHeader;
+using donde_toolkits::gen_feature_dim;
+using donde_toolkits::ReadFeature;
+using donde_toolkits::RET_ERR;
+using donde_toolkits::RET_OK;
+using donde_toolkits::SerializeFeature;
+using donde_toolkits::SerializeHeader;
+using donde_toolkits::WriteFeature;
+
+TEST(FeatureSerialize, RoundTrip) {
+    Feature ft = gen_feature_dim<512>();
+    ft.version = 7;
+
+    // 4 bytes header, then little endian floats.
+    std::string data = SerializeFeature(ft);
+    ASSERT_EQ(data.size(), 4 + 512 * sizeof(float));
+    EXPECT_EQ((uint8_t)data[0], 7);
+    EXPECT_EQ((uint8_t)data[1], 0);
+    EXPECT_EQ((uint8_t)data[2], 512 & 0xff);
+    EXPECT_EQ((uint8_t)data[3], 512 >> 8);
+
+    Feature got;
+    ASSERT_EQ(DeserializeFeature(data, got), RET_OK);
+    EXPECT_EQ(got.version, 7);
+    EXPECT_EQ(got.dimension, 512);
+    EXPECT_EQ(got.raw, ft.raw);
+
+    // streams hold features back to back.
+    Feature ft2 = gen_feature_dim<128>();
+    ft2.version = 65535;
+    std::stringstream ss;
+    ASSERT_EQ(WriteFeature(ss, ft), RET_OK);
+    ASSERT_EQ(WriteFeature(ss, ft2), RET_OK);
+    EXPECT_EQ(ss.str().substr(0, data.size()), data);
+
+    Feature got1, got2, got3;
+    ASSERT_EQ(ReadFeature(ss, got1), RET_OK);
+    ASSERT_EQ(ReadFeature(ss, got2), RET_OK);
+    EXPECT_EQ(ReadFeature(ss, got3), RET_ERR);
+    EXPECT_EQ(got1.raw, ft.raw);
+    EXPECT_EQ(got2.raw, ft2.raw);
+    EXPECT_EQ(got2.version, 65535);
+};
+
+TEST(FeatureSerialize, RejectsWhatDoesNotFit) {
+    FeatureSerializeHeader header;
+    Feature large = gen_feature_dim<1024>();
+    large.version = 1;
+    EXPECT_EQ(SerializeHeader(large, header), RET_ERR);
+    EXPECT_EQ(SerializeFeature(large), "");
+
+    Feature ft = gen_feature_dim<16>();
+    ft.version = 65536;
+    EXPECT_EQ(SerializeHeader(ft, header), RET_ERR);
+
+    // reserved bits must be 0.
+    Feature got;
+    EXPECT_EQ(DeserializeHeader(FeatureSerializeHeader{1, 0, 16, 0x80}, got), RET_ERR);
+
+    // truncated body.
+    ft.version = 1;
+    std::string data = SerializeFeature(ft);
+    EXPECT_EQ(DeserializeFeature(data.substr(0, data.size() - 1), got), RET_ERR);
+    std::stringstream ss(data.substr(0, data.size() - 1));
+    EXPECT_EQ(ReadFeature(ss, got), RET_ERR);
+};
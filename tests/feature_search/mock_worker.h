@@ -19,6 +19,8 @@ class MockWorker : public Worker {
 
     MOCK_METHOD(uint64, GetFreeSpace, ());
 
+    MOCK_METHOD(WorkerLoad, GetLoad, ());
+
     // ListShards report all shards this worker is serving.
     MOCK_METHOD(std::vector<DBShard>, ListShards, ());
 
@@ -28,10 +30,17 @@ class MockWorker : public Worker {
     // CloseShard close db_id/shard_id.
     MOCK_METHOD(RetCode, CloseShard, (const std::string& db_id, const std::string& shard_id));
 
+    // ReleaseShard stop serving db_id/shard_id.
+    MOCK_METHOD(RetCode, ReleaseShard, (const std::string& db_id, const std::string& shard_id));
+
     // AddFeatures to db_id/shard_id, delegate to remote worker.
     MOCK_METHOD(std::vector<std::string>, AddFeatures,
                 (const std::string& db_id, const std::string& shard_id,
-                 const std::vector<Feature>& fts));
+                 const std::vector<FeatureDbItem>& fts));
+
+    // ListFeatures of db_id/shard_id with their vectors by page.
+    MOCK_METHOD(PageData<FeatureDbItemList>, ListFeatures,
+                (const std::string& db_id, const std::string& shard_id, uint page, uint perPage));
 
     // Search feature in the worker. worker can have multiple dbs, multiple shards.
     // only search in the requested db.
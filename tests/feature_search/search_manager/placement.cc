@@ -0,0 +1,120 @@
+#include "src/feature_search/search_manager/placement.h"
+
+#include "donde/definitions.h"
+#include "donde/feature_search/definitions.h"
+
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <vector>
+
+using nlohmann::json;
+
+using namespace donde_toolkits::feature_search;
+using namespace donde_toolkits::feature_search::search_manager;
+
+namespace search_manager {
+
+class TestPlacementPolicy : public ::testing::Test {
+  protected:
+    void SetUp() override{};
+
+    void TearDown() override{};
+
+    WorkerLoad gen_load(double qps, uint64 free_space) {
+        return WorkerLoad{
+            .qps = qps,
+            .scan_bytes_per_sec = qps * 1024,
+            .rss_bytes = 1024,
+            .p99_latency_ms = 10,
+            .free_space = free_space,
+            .reported = true,
+        };
+    };
+};
+
+TEST_F(TestPlacementPolicy, CanParseOptions) {
+    json conf = {{"qps_weight", 2.0}, {"rebalance", true}};
+    auto opts = PlacementPolicy::ParseOptions(conf);
+
+    EXPECT_EQ(opts.qps_weight, 2.0);
+    EXPECT_EQ(opts.rebalance, true);
+    // missing fields keep default values.
+    EXPECT_EQ(opts.hot_ratio, PlacementOptions{}.hot_ratio);
+};
+
+TEST_F(TestPlacementPolicy, RankLeastLoadedFirst) {
+    PlacementPolicy policy;
+
+    std::vector<WorkerLoad> loads{gen_load(100, 10), gen_load(10, 10), gen_load(50, 10)};
+    auto ranked = policy.Rank(loads);
+
+    ASSERT_EQ(ranked.size(), 3);
+    EXPECT_EQ(ranked[0], 1);
+    EXPECT_EQ(ranked[1], 2);
+    EXPECT_EQ(ranked[2], 0);
+};
+
+TEST_F(TestPlacementPolicy, RankSkipFullWorker) {
+    PlacementPolicy policy;
+
+    std::vector<WorkerLoad> loads{gen_load(100, 10), gen_load(10, 0)};
+    auto ranked = policy.Rank(loads);
+
+    ASSERT_EQ(ranked.size(), 1);
+    EXPECT_EQ(ranked[0], 0);
+};
+
+TEST_F(TestPlacementPolicy, FindHotWorker) {
+    PlacementPolicy policy;
+
+    // balanced cluster.
+    std::vector<WorkerLoad> balanced{gen_load(100, 10), gen_load(90, 10), gen_load(95, 10)};
+    auto [hot1, cool1] = policy.FindRebalancePair(balanced);
+    EXPECT_EQ(hot1, -1);
+    EXPECT_EQ(cool1, -1);
+
+    // worker 2 takes most of the traffic.
+    std::vector<WorkerLoad> skewed{gen_load(10, 10), gen_load(5, 10), gen_load(1000, 10)};
+    auto [hot2, cool2] = policy.FindRebalancePair(skewed);
+    EXPECT_EQ(hot2, 2);
+    EXPECT_EQ(cool2, 1);
+};
+
+TEST_F(TestPlacementPolicy, RankUnreportedWorkersLast) {
+    PlacementPolicy policy;
+
+    // workers without telemetry are not taken as full, nor as the least loaded.
+    WorkerLoad unreported{};
+    unreported.reported = false;
+    std::vector<WorkerLoad> loads{unreported, gen_load(100, 10), gen_load(10, 0), unreported};
+    auto ranked = policy.Rank(loads);
+
+    ASSERT_EQ(ranked.size(), 3);
+    EXPECT_EQ(ranked[0], 1);
+    EXPECT_EQ(ranked[1], 0);
+    EXPECT_EQ(ranked[2], 3);
+
+    // only unreported workers, they are still writable.
+    EXPECT_EQ(policy.Rank({unreported, unreported}).size(), 2);
+};
+
+TEST_F(TestPlacementPolicy, RebalanceIgnoresUnreportedWorkers) {
+    PlacementPolicy policy;
+
+    WorkerLoad unreported{};
+    unreported.reported = false;
+
+    // an unreported worker looks idle, it is never picked as the cool one.
+    std::vector<WorkerLoad> loads{gen_load(1000, 10), unreported, unreported};
+    auto [hot1, cool1] = policy.FindRebalancePair(loads);
+    EXPECT_EQ(hot1, -1);
+    EXPECT_EQ(cool1, -1);
+
+    // pairs among reported ones keep their indices in loads.
+    loads = {gen_load(10, 10), unreported, gen_load(5, 10), gen_load(1000, 10)};
+    auto [hot2, cool2] = policy.FindRebalancePair(loads);
+    EXPECT_EQ(hot2, 3);
+    EXPECT_EQ(cool2, 2);
+};
+
+} // namespace search_manager
@@ -0,0 +1,147 @@
+#include "src/feature_search/search_manager/query_cache.h"
+
+#include "donde/definitions.h"
+#include "donde/feature_search/definitions.h"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <thread>
+
+
+
+using nlohmann::json;
+
+using namespace donde_toolkits::feature_search;
+using namespace donde_toolkits::feature_search::search_manager;
+
+using donde_toolkits::Feature;
+using donde_toolkits::gen_feature_dim;
+
+namespace search_manager {
+
+class TestQueryCache : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        query = gen_feature_dim<512>();
+        for (int i = 0; i < 10; i++) {
+            result.emplace_back(gen_feature_dim<512>(), 0.9f - i * 0.01f);
+        }
+    };
+
+    void TearDown() override{};
+
+    Feature query;
+    std::vector<FeatureSearchItem> result;
+};
+
+TEST_F(TestQueryCache, CanHitAfterInsert) {
+    QueryCache cache(QueryCacheOptions{});
+
+    std::vector<FeatureSearchItem> got;
+    EXPECT_FALSE(cache.Lookup("db1", query, 10, got));
+
+    cache.Insert("db1", query, 10, cache.Generation("db1"), result);
+
+    EXPECT_TRUE(cache.Lookup("db1", query, 10, got));
+    EXPECT_EQ(got.size(), result.size());
+    EXPECT_EQ(got[0].score, result[0].score);
+
+    // different topk or db is another key.
+    EXPECT_FALSE(cache.Lookup("db1", query, 5, got));
+    EXPECT_FALSE(cache.Lookup("db2", query, 10, got));
+
+    auto stats = cache.GetStats();
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 3);
+    EXPECT_EQ(stats.entries, 1);
+};
+
+TEST_F(TestQueryCache, NearbyQueryHitsSameEntry) {
+    QueryCache cache(QueryCacheOptions{});
+    cache.Insert("db1", query, 10, cache.Generation("db1"), result);
+
+    // scaled query has the same normalized vector.
+    Feature scaled = query;
+    for (auto& f : scaled.raw) {
+        f *= 3.0f;
+    }
+
+    std::vector<FeatureSearchItem> got;
+    EXPECT_TRUE(cache.Lookup("db1", scaled, 10, got));
+};
+
+TEST_F(TestQueryCache, InvalidateByGeneration) {
+    QueryCache cache(QueryCacheOptions{});
+
+    uint64 generation = cache.Generation("db1");
+    cache.Insert("db1", query, 10, generation, result);
+    cache.Invalidate("db1");
+
+    std::vector<FeatureSearchItem> got;
+    EXPECT_FALSE(cache.Lookup("db1", query, 10, got));
+
+    // result searched under old generation will not be cached.
+    cache.Insert("db1", query, 10, generation, result);
+    EXPECT_FALSE(cache.Lookup("db1", query, 10, got));
+
+    // other db is not affected.
+    cache.Insert("db2", query, 10, cache.Generation("db2"), result);
+    cache.Invalidate("db1");
+    EXPECT_TRUE(cache.Lookup("db2", query, 10, got));
+};
+
+TEST_F(TestQueryCache, ExpireAfterTTL) {
+    QueryCacheOptions opts;
+    opts.ttl_ms = 100;
+    QueryCache cache(opts);
+
+    cache.Insert("db1", query, 10, cache.Generation("db1"), result);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::vector<FeatureSearchItem> got;
+    EXPECT_FALSE(cache.Lookup("db1", query, 10, got));
+};
+
+TEST_F(TestQueryCache, EvictLeastRecentlyUsed) {
+    QueryCacheOptions opts;
+    opts.max_entries = 2;
+    QueryCache cache(opts);
+
+    Feature q1 = gen_feature_dim<512>();
+    Feature q2 = gen_feature_dim<512>();
+    Feature q3 = gen_feature_dim<512>();
+
+    cache.Insert("db1", q1, 10, 0, result);
+    cache.Insert("db1", q2, 10, 0, result);
+
+    // touch q1, so q2 becomes the lru one.
+    std::vector<FeatureSearchItem> got;
+    EXPECT_TRUE(cache.Lookup("db1", q1, 10, got));
+
+    cache.Insert("db1", q3, 10, 0, result);
+
+    EXPECT_TRUE(cache.Lookup("db1", q1, 10, got));
+    EXPECT_FALSE(cache.Lookup("db1", q2, 10, got));
+    EXPECT_TRUE(cache.Lookup("db1", q3, 10, got));
+    EXPECT_EQ(cache.GetStats().evictions, 1);
+};
+
+TEST_F(TestQueryCache, RespectMemoryCap) {
+    QueryCacheOptions opts;
+    // roughly one result set of 10 * 512 floats.
+    opts.max_bytes = 30 * 1024;
+    QueryCache cache(opts);
+
+    for (int i = 0; i < 10; i++) {
+        cache.Insert("db1", gen_feature_dim<512>(), 10, 0, result);
+    }
+
+    auto stats = cache.GetStats();
+    EXPECT_LE(stats.bytes, opts.max_bytes);
+    EXPECT_EQ(stats.entries, 1);
+};
+
+} // namespace search_manager
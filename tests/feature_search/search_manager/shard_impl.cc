@@ -18,6 +18,7 @@
 #include <memory>
 #include <nlohmann/json.hpp>
 #include <ostream>
+#include <set>
 #include <thread>
 
 
@@ -31,6 +32,17 @@ using testing::NiceMock;
 
 namespace search_manager {
 
+// a worker which stores fts under the ids it is given, and records them.
+auto store_ids(std::vector<std::string>& stored) {
+    return [&stored](const std::string&, const std::string&, const FeatureDbItemList& fts) {
+        stored.clear();
+        for (const auto& ft : fts) {
+            stored.push_back(ft.feature_id);
+        }
+        return stored;
+    };
+};
+
 class TestShardImpl : public ::testing::Test {
   protected:
     void SetUp() override{
@@ -79,7 +91,7 @@ TEST_F(TestShardImpl, CanGetInfo) {
 };
 
 TEST_F(TestShardImpl, CanStartStop) {
-    DBShard shard_info;
+    DBShard shard_info{};
 
     MockShardManager mMgr;
     ShardImpl impl(&mMgr, shard_info);
@@ -104,7 +116,7 @@ TEST_F(TestShardImpl, CanStartStop) {
 };
 
 TEST_F(TestShardImpl, CanCloseShard) {
-    DBShard shard_info;
+    DBShard shard_info{};
 
     MockShardManager mMgr;
     ShardImpl impl(&mMgr, shard_info);
@@ -154,7 +166,7 @@ TEST_F(TestShardImpl, CanCloseShard) {
 // };
 
 TEST_F(TestShardImpl, CanAddFeatures) {
-    DBShard shard_info;
+    DBShard shard_info{};
 
     MockShardManager mMgr;
     ShardImpl impl(&mMgr, shard_info);
@@ -169,8 +181,8 @@ TEST_F(TestShardImpl, CanAddFeatures) {
     auto used1 = impl.GetShardInfo().used;
 
     // set expect.
-    std::vector<std::string> ft_ids(10);
-    EXPECT_CALL(mWorker, AddFeatures).WillOnce(testing::Return(ft_ids));
+    std::vector<std::string> ft_ids;
+    EXPECT_CALL(mWorker, AddFeatures).WillOnce(testing::Invoke(store_ids(ft_ids)));
     EXPECT_CALL(mMgr, UpdateShard).WillOnce(testing::Return(RetCode::RET_OK));
 
     // do api
@@ -185,7 +197,7 @@ TEST_F(TestShardImpl, CanAddFeatures) {
 };
 
 TEST_F(TestShardImpl, CanSearchFeature) {
-    DBShard shard_info;
+    DBShard shard_info{};
 
     MockShardManager mMgr;
     ShardImpl impl(&mMgr, shard_info);
@@ -200,8 +212,8 @@ TEST_F(TestShardImpl, CanSearchFeature) {
     auto used1 = impl.GetShardInfo().used;
 
     // set expect.
-    std::vector<std::string> ft_ids(10);
-    EXPECT_CALL(mWorker, AddFeatures).WillOnce(testing::Return(ft_ids));
+    std::vector<std::string> ft_ids;
+    EXPECT_CALL(mWorker, AddFeatures).WillOnce(testing::Invoke(store_ids(ft_ids)));
     EXPECT_CALL(mMgr, UpdateShard).WillOnce(testing::Return(RetCode::RET_OK));
 
     // do api
@@ -215,4 +227,286 @@ TEST_F(TestShardImpl, CanSearchFeature) {
     EXPECT_EQ(used1 + 10, used2);
 };
 
+TEST_F(TestShardImpl, CanFanOutAddFeaturesToReplicas) {
+    DBShard shard_info{};
+
+    NiceMock<MockShardManager> mMgr;
+    ShardImpl impl(&mMgr, shard_info);
+
+    NiceMock<MockWorker> mWorker1;
+    NiceMock<MockWorker> mWorker2;
+    ON_CALL(mWorker1, GetWorkerID).WillByDefault(testing::Return("w1"));
+    ON_CALL(mWorker2, GetWorkerID).WillByDefault(testing::Return("w2"));
+
+    EXPECT_EQ(impl.AssignWorker(&mWorker1), RetCode::RET_OK);
+    EXPECT_EQ(impl.AssignWorker(&mWorker2), RetCode::RET_OK);
+    // same worker can not serve two replicas.
+    EXPECT_EQ(impl.AssignWorker(&mWorker1), RetCode::RET_ERR);
+
+    EXPECT_EQ(impl.GetShardInfo().worker_id, "w1");
+    EXPECT_EQ(impl.GetShardInfo().replica_worker_ids.size(), 2);
+
+    std::vector<std::string> ft_ids1, ft_ids2;
+    EXPECT_CALL(mWorker1, AddFeatures).WillOnce(testing::Invoke(store_ids(ft_ids1)));
+    EXPECT_CALL(mWorker2, AddFeatures).WillOnce(testing::Invoke(store_ids(ft_ids2)));
+
+    // both replicas store the distinct ids the caller gets.
+    std::vector<Feature> fts(10);
+    auto ids = impl.AddFeatures(fts);
+    EXPECT_EQ(ids.size(), 10);
+    EXPECT_EQ(std::set<std::string>(ids.begin(), ids.end()).size(), 10);
+    EXPECT_EQ(ft_ids1, ids);
+    EXPECT_EQ(ft_ids2, ids);
+};
+
+TEST_F(TestShardImpl, CanSearchHealthyReplica) {
+    DBShard shard_info{};
+
+    NiceMock<MockShardManager> mMgr;
+    ShardImpl impl(&mMgr, shard_info);
+
+    NiceMock<MockWorker> mWorker1;
+    NiceMock<MockWorker> mWorker2;
+    ON_CALL(mWorker1, Ready).WillByDefault(testing::Return(false));
+    ON_CALL(mWorker2, Ready).WillByDefault(testing::Return(true));
+
+    impl.AssignWorker(&mWorker1);
+    impl.AssignWorker(&mWorker2);
+
+    // worker1 is not ready, all searches go to worker2.
+    EXPECT_CALL(mWorker1, SearchFeature).Times(0);
+    EXPECT_CALL(mWorker2, SearchFeature).Times(3);
+
+    Feature query;
+    for (int i = 0; i < 3; i++) {
+        impl.SearchFeature(query, 10);
+    }
+};
+
+TEST_F(TestShardImpl, CanSkipStaleReplica) {
+    DBShard shard_info{};
+
+    NiceMock<MockShardManager> mMgr;
+    ShardImpl impl(&mMgr, shard_info);
+
+    NiceMock<MockWorker> mWorker1;
+    NiceMock<MockWorker> mWorker2;
+    ON_CALL(mWorker1, Ready).WillByDefault(testing::Return(true));
+    ON_CALL(mWorker2, Ready).WillByDefault(testing::Return(true));
+
+    impl.AssignWorker(&mWorker1);
+    impl.AssignWorker(&mWorker2);
+
+    // worker1 stored the features under ids of its own, so it is stale.
+    std::vector<std::string> ft_ids, own_ids;
+    for (int i = 0; i < 10; i++) {
+        own_ids.push_back("w1-" + std::to_string(i));
+    }
+    EXPECT_CALL(mWorker1, AddFeatures).WillOnce(testing::Return(own_ids));
+    EXPECT_CALL(mWorker2, AddFeatures).WillOnce(testing::Invoke(store_ids(ft_ids)));
+
+    std::vector<Feature> fts(10);
+    EXPECT_EQ(impl.AddFeatures(fts), ft_ids);
+
+    EXPECT_CALL(mWorker1, SearchFeature).Times(0);
+    EXPECT_CALL(mWorker2, SearchFeature).Times(3);
+
+    Feature query;
+    for (int i = 0; i < 3; i++) {
+        impl.SearchFeature(query, 10);
+    }
+};
+
+TEST_F(TestShardImpl, CanMigrateReplica) {
+    DBShard shard_info{};
+
+    NiceMock<MockShardManager> mMgr;
+    ShardImpl impl(&mMgr, shard_info);
+
+    NiceMock<MockWorker> mWorker1;
+    NiceMock<MockWorker> mWorker2;
+    ON_CALL(mWorker1, GetWorkerID).WillByDefault(testing::Return("w1"));
+    ON_CALL(mWorker2, GetWorkerID).WillByDefault(testing::Return("w2"));
+    ON_CALL(mWorker1, Ready).WillByDefault(testing::Return(true));
+    ON_CALL(mWorker2, Ready).WillByDefault(testing::Return(true));
+
+    impl.AssignWorker(&mWorker1);
+
+    std::vector<std::string> ft_ids;
+    EXPECT_CALL(mWorker1, AddFeatures).WillOnce(testing::Invoke(store_ids(ft_ids)));
+    std::vector<Feature> fts(3);
+    impl.AddFeatures(fts);
+
+    // target serves the shard, gets features of the source under the same ids, then source is
+    // released.
+    FeatureDbItemList listed;
+    for (const auto& id : ft_ids) {
+        listed.push_back(FeatureDbItem{.feature_id = id, .feature = {}, .metadata = {}});
+    }
+    std::vector<std::string> copied_ids;
+    EXPECT_CALL(mWorker2, ServeShard).WillOnce(testing::Return(RetCode::RET_OK));
+    EXPECT_CALL(mWorker1, ListFeatures)
+        .WillOnce(testing::Return(PageData<FeatureDbItemList>(0, 1000, 1, listed)));
+    EXPECT_CALL(mWorker2, AddFeatures).WillOnce(testing::Invoke(store_ids(copied_ids)));
+    EXPECT_CALL(mWorker1, ReleaseShard).WillOnce(testing::Return(RetCode::RET_OK));
+    EXPECT_CALL(mMgr, UpdateShard).WillOnce(testing::Return(RetCode::RET_OK));
+
+    EXPECT_EQ(impl.MigrateReplica(&mWorker1, &mWorker2), RetCode::RET_OK);
+    EXPECT_EQ(impl.GetShardInfo().worker_id, "w2");
+    EXPECT_EQ(copied_ids, ft_ids);
+
+    // source no longer serves.
+    EXPECT_CALL(mWorker1, SearchFeature).Times(0);
+    EXPECT_CALL(mWorker2, SearchFeature).Times(1);
+
+    Feature query;
+    impl.SearchFeature(query, 10);
+
+    // worker1 is not serving anymore.
+    EXPECT_EQ(impl.MigrateReplica(&mWorker1, &mWorker2), RetCode::RET_ERR);
+};
+
+TEST_F(TestShardImpl, CanKeepSourceIfCopyFails) {
+    DBShard shard_info{};
+
+    NiceMock<MockShardManager> mMgr;
+    ShardImpl impl(&mMgr, shard_info);
+
+    NiceMock<MockWorker> mWorker1;
+    NiceMock<MockWorker> mWorker2;
+    ON_CALL(mWorker1, GetWorkerID).WillByDefault(testing::Return("w1"));
+    ON_CALL(mWorker2, GetWorkerID).WillByDefault(testing::Return("w2"));
+    ON_CALL(mWorker1, Ready).WillByDefault(testing::Return(true));
+    ON_CALL(mWorker2, Ready).WillByDefault(testing::Return(true));
+
+    impl.AssignWorker(&mWorker1);
+
+    std::vector<std::string> ft_ids;
+    EXPECT_CALL(mWorker1, AddFeatures).WillOnce(testing::Invoke(store_ids(ft_ids)));
+    std::vector<Feature> fts(3);
+    impl.AddFeatures(fts);
+
+    // source cannot list its features, the target is released instead and nothing moves.
+    EXPECT_CALL(mWorker2, ServeShard).WillOnce(testing::Return(RetCode::RET_OK));
+    EXPECT_CALL(mWorker1, ListFeatures)
+        .WillOnce(testing::Return(PageData<FeatureDbItemList>(0, 1000, 0, {})));
+    EXPECT_CALL(mWorker2, ReleaseShard).WillOnce(testing::Return(RetCode::RET_OK));
+    EXPECT_CALL(mWorker1, ReleaseShard).Times(0);
+
+    EXPECT_EQ(impl.MigrateReplica(&mWorker1, &mWorker2), RetCode::RET_ERR);
+    EXPECT_EQ(impl.GetShardInfo().replica_worker_ids, std::vector<std::string>{"w1"});
+};
+
+TEST_F(TestShardImpl, CanReassignLoadedReplicas) {
+    // loaded from the driver, replicas are known before workers come back.
+    DBShard shard_info{};
+    shard_info.worker_id = "w1";
+    shard_info.replica_worker_ids = {"w1", "w2"};
+
+    testing::StrictMock<MockShardManager> mMgr;
+    ShardImpl impl(&mMgr, shard_info);
+
+    NiceMock<MockWorker> mWorker1;
+    NiceMock<MockWorker> mWorker2;
+    NiceMock<MockWorker> mWorker3;
+    ON_CALL(mWorker1, GetWorkerID).WillByDefault(testing::Return("w1"));
+    ON_CALL(mWorker2, GetWorkerID).WillByDefault(testing::Return("w2"));
+    ON_CALL(mWorker3, GetWorkerID).WillByDefault(testing::Return("w3"));
+
+    EXPECT_EQ(impl.AssignWorker(&mWorker2), RetCode::RET_OK);
+    EXPECT_EQ(impl.AssignWorker(&mWorker1), RetCode::RET_OK);
+    EXPECT_EQ(impl.GetShardInfo().replica_worker_ids, (std::vector<std::string>{"w1", "w2"}));
+    EXPECT_EQ(impl.GetShardInfo().worker_id, "w1");
+    EXPECT_EQ(impl.ListReplicas().size(), 2);
+
+    // a new replica is persisted.
+    DBShard persisted;
+    EXPECT_CALL(mMgr, UpdateShard)
+        .WillOnce(testing::DoAll(testing::SaveArg<0>(&persisted), testing::Return(RET_OK)));
+    EXPECT_EQ(impl.AssignWorker(&mWorker3), RetCode::RET_OK);
+    EXPECT_EQ(persisted.replica_worker_ids, (std::vector<std::string>{"w1", "w2", "w3"}));
+    EXPECT_EQ(persisted.worker_id, "w1");
+};
+
+TEST_F(TestShardImpl, CanFailOverToNextReplica) {
+    DBShard shard_info{};
+    shard_info.used = 10;
+
+    NiceMock<MockShardManager> mMgr;
+    ShardImpl impl(&mMgr, shard_info);
+
+    NiceMock<MockWorker> mWorker1;
+    NiceMock<MockWorker> mWorker2;
+    ON_CALL(mWorker1, GetWorkerID).WillByDefault(testing::Return("w1"));
+    ON_CALL(mWorker2, GetWorkerID).WillByDefault(testing::Return("w2"));
+    ON_CALL(mWorker1, Ready).WillByDefault(testing::Return(true));
+    ON_CALL(mWorker2, Ready).WillByDefault(testing::Return(true));
+
+    impl.AssignWorker(&mWorker1);
+    impl.AssignWorker(&mWorker2);
+
+    // worker1 is picked first and fails, worker2 answers the same query.
+    Feature query;
+    std::vector<FeatureSearchItem> found{FeatureSearchItem(query, 0.9)};
+    EXPECT_CALL(mWorker1, SearchFeature)
+        .WillOnce(testing::Return(std::vector<FeatureSearchItem>{}));
+    EXPECT_CALL(mWorker2, SearchFeature).Times(3).WillRepeatedly(testing::Return(found));
+
+    EXPECT_EQ(impl.SearchFeature(query, 10).size(), 1);
+
+    // worker1 is backed off, it is not tried while worker2 is fine.
+    EXPECT_EQ(impl.SearchFeature(query, 10).size(), 1);
+    EXPECT_EQ(impl.SearchFeature(query, 10).size(), 1);
+};
+
+TEST_F(TestShardImpl, CanTryEveryReplicaOnce) {
+    DBShard shard_info{};
+    shard_info.used = 10;
+
+    NiceMock<MockShardManager> mMgr;
+    ShardImpl impl(&mMgr, shard_info);
+
+    NiceMock<MockWorker> mWorker1;
+    NiceMock<MockWorker> mWorker2;
+    ON_CALL(mWorker1, Ready).WillByDefault(testing::Return(true));
+    ON_CALL(mWorker2, Ready).WillByDefault(testing::Return(true));
+
+    impl.AssignWorker(&mWorker1);
+    impl.AssignWorker(&mWorker2);
+
+    // errors are thrown, or answered with nothing.
+    EXPECT_CALL(mWorker1, SearchFeature).WillOnce(testing::Throw(std::runtime_error("down")));
+    EXPECT_CALL(mWorker2, SearchFeature)
+        .WillOnce(testing::Return(std::vector<FeatureSearchItem>{}));
+
+    Feature query;
+    EXPECT_EQ(impl.SearchFeature(query, 10).size(), 0);
+};
+
+TEST_F(TestShardImpl, CanDetachWorkers) {
+    DBShard shard_info{};
+
+    NiceMock<MockShardManager> mMgr;
+    ShardImpl impl(&mMgr, shard_info);
+
+    NiceMock<MockWorker> mWorker;
+    ON_CALL(mWorker, GetWorkerID).WillByDefault(testing::Return("w1"));
+    ON_CALL(mWorker, Ready).WillByDefault(testing::Return(true));
+    impl.AssignWorker(&mWorker);
+
+    // the worker is going to be freed, the shard must not touch it anymore.
+    impl.DetachWorkers();
+    EXPECT_TRUE(impl.IsStopped());
+    EXPECT_FALSE(impl.HasWorker());
+
+    EXPECT_CALL(mWorker, SearchFeature).Times(0);
+    EXPECT_CALL(mWorker, AddFeatures).Times(0);
+    Feature query;
+    EXPECT_TRUE(impl.SearchFeature(query, 10).empty());
+    EXPECT_TRUE(impl.AddFeatures({query}).empty());
+
+    // placement is kept, so the shard finds its replica again after a restart.
+    EXPECT_EQ(impl.GetShardInfo().replica_worker_ids, std::vector<std::string>{"w1"});
+};
+
 } // namespace search_manager
@@ -0,0 +1,177 @@
+#include "src/feature_search/search_manager/worker_manager_impl.h"
+
+#include "../mock_worker.h"
+#include "donde/definitions.h"
+#include "donde/feature_search/definitions.h"
+#include "donde/feature_search/search_manager/worker_factory.h"
+#include "donde/feature_search/simple_driver.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace donde_toolkits::feature_search;
+using namespace donde_toolkits::feature_search::search_manager;
+
+using testing::NiceMock;
+
+namespace search_manager {
+
+// FakeWorkerFactory probes every address the same way, tests flip it up/down or make it hang.
+class FakeWorkerFactory : public WorkerFactory {
+  public:
+    Worker* CreateWorker(const std::string& worker_id,
+                         const std::string& worker_address) const override {
+        return new NiceMock<MockWorker>();
+    };
+
+    bool ProbeWorker(const std::string& worker_address) const override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(probe_delay_ms.load()));
+        return up.load();
+    };
+
+    std::atomic<bool> up{true};
+    std::atomic<int> probe_delay_ms{0};
+};
+
+class TestWorkerManager : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        driver = std::make_unique<SimpleDriver>(store_dir);
+        health = WorkerHealthOptions{
+            .probe_interval_ms = 50,
+            .suspect_after_ms = 300,
+            .offline_after_ms = 600,
+            .min_backoff_ms = 50,
+            .max_backoff_ms = 100,
+            .max_concurrent_probes = 4,
+        };
+    };
+
+    void TearDown() override { std::filesystem::remove_all(store_dir); };
+
+    // wait_state polls until worker is in state, or timeout.
+    bool wait_state(WorkerManagerImpl& mgr, WorkerState state, int timeout_ms = 2000) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (mgr.GetWorkerState(worker.worker_id) == state) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    };
+
+    std::string store_dir = "/tmp/test_worker_manager";
+    std::unique_ptr<SimpleDriver> driver;
+    WorkerHealthOptions health;
+    WorkerItem worker{.worker_id = "w1", .address = "127.0.0.1:9000", .max_capacity = 1024};
+};
+
+TEST_F(TestWorkerManager, CanProbeWorkerOnline) {
+    FakeWorkerFactory factory;
+    WorkerManagerImpl mgr(*driver, {}, health);
+    mgr.StartProbeWorkersInBackground(factory);
+
+    mgr.AttachNewWorker(worker);
+    EXPECT_TRUE(wait_state(mgr, WORKER_ONLINE));
+    EXPECT_EQ(mgr.ListWorkers().size(), 1);
+
+    mgr.Stop();
+};
+
+TEST_F(TestWorkerManager, CanRetryUnreachableWorker) {
+    FakeWorkerFactory factory;
+    factory.up = false;
+    WorkerManagerImpl mgr(*driver, {}, health);
+    mgr.StartProbeWorkersInBackground(factory);
+
+    mgr.AttachNewWorker(worker);
+    EXPECT_TRUE(wait_state(mgr, WORKER_OFFLINE));
+    EXPECT_EQ(mgr.ListWorkers().size(), 0);
+
+    // probes keep retrying with backoff, and bring it online once it is up.
+    factory.up = true;
+    EXPECT_TRUE(wait_state(mgr, WORKER_ONLINE));
+
+    mgr.Stop();
+};
+
+TEST_F(TestWorkerManager, CanEvictSilentWorker) {
+    FakeWorkerFactory factory;
+    WorkerManagerImpl mgr(*driver, {}, health);
+    mgr.StartProbeWorkersInBackground(factory);
+
+    std::vector<WorkerState> transitions;
+    std::mutex mu;
+    mgr.SubscribeWorkerState([&](Worker* w, WorkerState from, WorkerState to) {
+        std::lock_guard<std::mutex> l(mu);
+        transitions.push_back(to);
+    });
+
+    mgr.AttachNewWorker(worker);
+    ASSERT_TRUE(wait_state(mgr, WORKER_ONLINE));
+
+    // a failed probe makes it suspect, and silence makes it offline.
+    factory.up = false;
+    EXPECT_TRUE(wait_state(mgr, WORKER_SUSPECT));
+    EXPECT_TRUE(wait_state(mgr, WORKER_OFFLINE));
+    EXPECT_EQ(mgr.ListWorkers().size(), 0);
+
+    mgr.Stop();
+
+    std::lock_guard<std::mutex> l(mu);
+    EXPECT_EQ(transitions,
+              (std::vector<WorkerState>{WORKER_ONLINE, WORKER_SUSPECT, WORKER_OFFLINE}));
+};
+
+TEST_F(TestWorkerManager, CanEvictWorkerWhileProbeHangs) {
+    FakeWorkerFactory factory;
+    WorkerManagerImpl mgr(*driver, {}, health);
+    mgr.StartProbeWorkersInBackground(factory);
+
+    mgr.AttachNewWorker(worker);
+    ASSERT_TRUE(wait_state(mgr, WORKER_ONLINE));
+
+    // the next probe hangs, timeouts are still checked on every tick.
+    factory.probe_delay_ms = 3000;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(wait_state(mgr, WORKER_SUSPECT));
+    EXPECT_TRUE(wait_state(mgr, WORKER_OFFLINE));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(2000));
+
+    // heartbeat brings it back without waiting for the probe.
+    mgr.ReportHeartbeat(worker.worker_id);
+    EXPECT_EQ(mgr.GetWorkerState(worker.worker_id), WORKER_ONLINE);
+
+    // Stop waits for the hanging probe.
+    mgr.Stop();
+};
+
+TEST_F(TestWorkerManager, CanStopWithoutFreeingWorkers) {
+    FakeWorkerFactory factory;
+    {
+        WorkerManagerImpl mgr(*driver, {}, health);
+        mgr.StartProbeWorkersInBackground(factory);
+
+        mgr.AttachNewWorker(worker);
+        ASSERT_TRUE(wait_state(mgr, WORKER_ONLINE));
+
+        // shards may still hold the worker after Stop, it is freed with the manager.
+        mgr.Stop();
+        auto found = mgr.GetWorkerByID(worker.worker_id);
+        ASSERT_NE(found, nullptr);
+        EXPECT_EQ(found->GetWorkerID(), "");
+    }
+
+    // destroying a started manager stops probing itself.
+    WorkerManagerImpl mgr(*driver, {}, health);
+    mgr.StartProbeWorkersInBackground(factory);
+    mgr.AttachNewWorker(worker);
+    EXPECT_TRUE(wait_state(mgr, WORKER_ONLINE));
+};
+
+} // namespace search_manager
@@ -0,0 +1,169 @@
+#include "src/feature_search/search_worker/mem_shard_impl.h"
+
+#include "donde/definitions.h"
+#include "donde/feature_search/definitions.h"
+#include "donde/feature_search/simple_driver.h"
+#include "donde/utils.h"
+#include "src/feature_search/search_worker/shard_manager_impl.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+
+using donde_toolkits::feature_search::DBItem;
+using donde_toolkits::feature_search::DBShard;
+using donde_toolkits::feature_search::FeatureDbItem;
+using donde_toolkits::feature_search::META_EQ;
+using donde_toolkits::feature_search::MetadataFilter;
+using donde_toolkits::feature_search::SimpleDriver;
+using donde_toolkits::feature_search::search_worker::MemoryShardImpl;
+using donde_toolkits::feature_search::search_worker::SealOptions;
+using donde_toolkits::feature_search::search_worker::ShardManagerImpl;
+
+using donde_toolkits::Feature;
+using donde_toolkits::gen_feature_dim;
+
+namespace {
+
+class SearchWorker_MemoryShard : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        for (int i = 0; i < feature_count; i++) {
+            fts.emplace_back();
+            fts.back().feature = gen_feature_dim<512>();
+        }
+
+        driver = std::make_unique<SimpleDriver>(store_dir);
+        DBItem db1{};
+        db1.name = "test-db1";
+        db1.size = 1024;
+        db_id = driver->CreateDB(db1);
+
+        shard_info = DBShard{};
+        shard_info.db_id = db_id;
+        shard_info.shard_id = "shard-1";
+
+        // one removal never triggers compaction.
+        seal.segment_dir = store_dir;
+        seal.compact_ratio = 0.5;
+    };
+
+    void TearDown() override { std::filesystem::remove_all(store_dir); };
+
+    bool wait_sealed(MemoryShardImpl& shard) {
+        for (int i = 0; i < 300 && !shard.IsSealed(); i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return shard.IsSealed();
+    };
+
+    const int feature_count = 20;
+    const std::string store_dir = "/tmp/test_mem_shard";
+    std::vector<FeatureDbItem> fts;
+    std::unique_ptr<SimpleDriver> driver;
+    std::string db_id;
+    DBShard shard_info;
+    SealOptions seal;
+};
+
+TEST_F(SearchWorker_MemoryShard, TombstonesSurviveRestart) {
+    ShardManagerImpl mgr(*driver);
+    const Feature& removed = fts[0].feature;
+    {
+        MemoryShardImpl shard(mgr, *driver, shard_info, seal);
+        auto feature_ids = shard.AddFeatures(fts);
+        ASSERT_EQ(feature_ids.size(), feature_count);
+
+        shard.Close();
+        ASSERT_TRUE(wait_sealed(shard));
+
+        // the segment is immutable, the removed feature is a tombstone.
+        shard.RemoveFeatures({feature_ids[0]});
+        auto results = shard.SearchFeature(removed, 1);
+        ASSERT_EQ(results.size(), 1);
+        EXPECT_LT(results[0].score, 0.99);
+    }
+
+    // restarted shard loads the segment, and its tombstones.
+    shard_info.is_closed = true;
+    MemoryShardImpl shard(mgr, *driver, shard_info, seal);
+    ASSERT_TRUE(shard.IsSealed());
+    auto results = shard.SearchFeature(removed, 1);
+    ASSERT_EQ(results.size(), 1);
+    EXPECT_LT(results[0].score, 0.99);
+
+    // others are still there.
+    results = shard.SearchFeature(fts[1].feature, 1);
+    ASSERT_EQ(results.size(), 1);
+    EXPECT_GT(results[0].score, 0.99);
+};
+
+TEST_F(SearchWorker_MemoryShard, StaleSegmentIsResealed) {
+    ShardManagerImpl mgr(*driver);
+    for (int i = 0; i < feature_count; i++) {
+        fts[i].metadata = {{"camera", "cam-" + std::to_string(i % 2)}};
+    }
+    seal.indexed_keys = {"camera"};
+    std::string segment_path = store_dir + "/" + db_id + "_" + shard_info.shard_id + ".seg";
+    {
+        MemoryShardImpl shard(mgr, *driver, shard_info, seal);
+        ASSERT_EQ(shard.AddFeatures(fts).size(), feature_count);
+        shard.Close();
+        ASSERT_TRUE(wait_sealed(shard));
+    }
+
+    // make it a version 1 segment, which has no metadata.
+    auto patch_version = [&](uint32_t version) {
+        std::fstream file(segment_path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(4);
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    };
+    patch_version(1);
+
+    // the restarted shard loads features from the driver and seals them again.
+    shard_info.is_closed = true;
+    MemoryShardImpl shard(mgr, *driver, shard_info, seal);
+    ASSERT_TRUE(wait_sealed(shard));
+    MetadataFilter cam1{{.key = "camera", .op = META_EQ, .values = {"cam-1"}}};
+    auto results = shard.SearchFeature(fts[1].feature, 1, cam1);
+    ASSERT_EQ(results.size(), 1);
+    EXPECT_GT(results[0].score, 0.99);
+
+    // and the segment on disk is the current version.
+    std::ifstream file(segment_path, std::ios::binary);
+    uint32_t magic = 0, version = 0;
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    EXPECT_EQ(version, 2);
+};
+
+TEST_F(SearchWorker_MemoryShard, FilterMatchesSameWhenSealed) {
+    ShardManagerImpl mgr(*driver);
+    for (int i = 0; i < feature_count; i++) {
+        fts[i].metadata = {{"camera", "cam-" + std::to_string(i % 2)}, {"day", "mon"}};
+    }
+    seal.indexed_keys = {"camera"};
+    MemoryShardImpl shard(mgr, *driver, shard_info, seal);
+    ASSERT_EQ(shard.AddFeatures(fts).size(), feature_count);
+
+    MetadataFilter cam1{{.key = "camera", .op = META_EQ, .values = {"cam-1"}}};
+    MetadataFilter mon{{.key = "day", .op = META_EQ, .values = {"mon"}}};
+    auto search = [&]() {
+        return std::make_pair(shard.SearchFeature(fts[1].feature, 1, cam1).size(),
+                              shard.SearchFeature(fts[1].feature, 1, mon).size());
+    };
+
+    // day is not indexed, the unsealed shard does not match it either.
+    auto unsealed = search();
+    EXPECT_EQ(unsealed, std::make_pair(size_t(1), size_t(0)));
+
+    shard.Close();
+    ASSERT_TRUE(wait_sealed(shard));
+    EXPECT_EQ(search(), unsealed);
+    EXPECT_EQ(shard.SearchFeature(fts[1].feature, 1).size(), 1);
+};
+
+} // namespace
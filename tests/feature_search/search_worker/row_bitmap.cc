@@ -0,0 +1,66 @@
+#include "src/feature_search/search_worker/row_bitmap.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <vector>
+
+using donde_toolkits::feature_search::search_worker::RowBitmap;
+
+namespace {
+
+std::vector<uint32_t> rows_of(const RowBitmap& bitmap) {
+    std::vector<uint32_t> rows;
+    bitmap.ForEach([&rows](uint32_t row) { rows.push_back(row); });
+    return rows;
+};
+
+TEST(SearchWorker_RowBitmap, SparseAndDenseContainers) {
+    // first container dense (every other row), second sparse, third a single row.
+    RowBitmap evens, threes;
+    for (uint32_t row = 0; row < 20000; row += 2) {
+        evens.Add(row);
+    }
+    for (uint32_t row = 0; row < 20000; row += 3) {
+        threes.Add(row);
+    }
+    for (uint32_t row = 65536; row < 65536 + 300; row += 3) {
+        evens.Add(row);
+        threes.Add(row);
+    }
+    evens.Add(200000);
+
+    EXPECT_EQ(evens.Cardinality(), 10000 + 100 + 1);
+    EXPECT_TRUE(evens.Contains(19998));
+    EXPECT_FALSE(evens.Contains(19999));
+    EXPECT_TRUE(evens.Contains(65536 + 3));
+    EXPECT_FALSE(evens.Contains(65536 + 4));
+    EXPECT_TRUE(evens.Contains(200000));
+    EXPECT_FALSE(evens.Contains(300000));
+    // dense container is a bitset, much smaller than 4 bytes a row.
+    EXPECT_LT(evens.Bytes(), 10000 * 2);
+
+    std::vector<uint32_t> rows = rows_of(evens);
+    ASSERT_EQ(rows.size(), evens.Cardinality());
+    EXPECT_TRUE(std::is_sorted(rows.begin(), rows.end()));
+
+    // multiples of 6 below 20000, and the shared sparse rows.
+    RowBitmap both = RowBitmap::And(evens, threes);
+    EXPECT_EQ(both.Cardinality(), (19998 / 6 + 1) + 100);
+    for (uint32_t row : rows_of(both)) {
+        EXPECT_TRUE(row >= 65536 || row % 6 == 0);
+    }
+
+    RowBitmap either = RowBitmap::Or(evens, threes);
+    size_t expected = 0;
+    for (uint32_t row = 0; row < 20000; row++) {
+        expected += row % 2 == 0 || row % 3 == 0;
+    }
+    EXPECT_EQ(either.Cardinality(), expected + 100 + 1);
+    rows = rows_of(either);
+    EXPECT_TRUE(std::is_sorted(rows.begin(), rows.end()));
+
+    EXPECT_TRUE(RowBitmap::And(evens, RowBitmap()).Empty());
+    EXPECT_EQ(RowBitmap::Or(RowBitmap(), threes).Cardinality(), threes.Cardinality());
+}
+
+} // namespace
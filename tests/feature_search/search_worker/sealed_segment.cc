@@ -0,0 +1,205 @@
+#include "src/feature_search/search_worker/sealed_segment.h"
+
+#include "donde/definitions.h"
+#include "donde/feature_search/definitions.h"
+#include "donde/utils.h"
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+
+
+using donde_toolkits::feature_search::FeatureSearchItem;
+using donde_toolkits::feature_search::META_EQ;
+using donde_toolkits::feature_search::META_IN;
+using donde_toolkits::feature_search::META_RANGE;
+using donde_toolkits::feature_search::MetadataFilter;
+using donde_toolkits::feature_search::search_worker::Metadata;
+using donde_toolkits::feature_search::search_worker::SealedSegment;
+
+using donde_toolkits::Feature;
+using donde_toolkits::gen_feature_dim;
+
+namespace {
+
+class SearchWorker_SealedSegment : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        for (int i = 0; i < feature_count; i++) {
+            fts["ft-" + std::to_string(i)] = gen_feature_dim<512>();
+        }
+        std::filesystem::create_directories(segment_dir);
+    };
+
+    void TearDown() override { std::filesystem::remove_all(segment_dir); };
+
+    const int feature_count = 100;
+    const std::string segment_dir = "/tmp/test_segments";
+    std::unordered_map<std::string, Feature> fts;
+};
+
+TEST_F(SearchWorker_SealedSegment, SearchSameAsBruteForce) {
+    auto segment = SealedSegment::Build(fts);
+    EXPECT_EQ(segment->Size(), feature_count);
+    EXPECT_EQ(segment->Dimension(), 512);
+
+    auto& query = fts["ft-42"];
+    auto results = segment->Search(query, 10, {});
+    ASSERT_EQ(results.size(), 10);
+    // the query itself is the best one.
+    EXPECT_NEAR(results[0].score, 1.0, 1e-4);
+    EXPECT_NEAR(results[0].target.compare(query), 1.0, 1e-4);
+    for (size_t i = 1; i < results.size(); i++) {
+        EXPECT_GE(results[i - 1].score, results[i].score);
+    }
+}
+
+TEST_F(SearchWorker_SealedSegment, TombstonesAndCompact) {
+    auto segment = SealedSegment::Build(fts);
+    std::unordered_set<std::string> tombstones{"ft-42"};
+
+    auto results = segment->Search(fts["ft-42"], 1, tombstones);
+    ASSERT_EQ(results.size(), 1);
+    EXPECT_LT(results[0].score, 0.99);
+
+    auto compacted = SealedSegment::Compact(*segment, tombstones);
+    EXPECT_EQ(compacted->Size(), feature_count - 1);
+    EXPECT_FALSE(compacted->Contains("ft-42"));
+    EXPECT_TRUE(compacted->Contains("ft-1"));
+}
+
+TEST_F(SearchWorker_SealedSegment, SaveAndLoad) {
+    auto segment = SealedSegment::Build(fts);
+    std::string filepath = segment_dir + "/db_shard.seg";
+    EXPECT_EQ(segment->Save(filepath), donde_toolkits::RET_OK);
+
+    auto loaded = SealedSegment::Load(filepath);
+    ASSERT_NE(loaded, nullptr);
+    EXPECT_EQ(loaded->Size(), segment->Size());
+
+    auto& query = fts["ft-7"];
+    auto expected = segment->Search(query, 5, {});
+    auto results = loaded->Search(query, 5, {});
+    ASSERT_EQ(results.size(), expected.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        EXPECT_FLOAT_EQ(results[i].score, expected[i].score);
+    }
+
+    EXPECT_EQ(SealedSegment::Load(segment_dir + "/missing.seg"), nullptr);
+}
+
+TEST_F(SearchWorker_SealedSegment, LoadRejectsBrokenHeader) {
+    auto segment = SealedSegment::Build(fts);
+    std::string filepath = segment_dir + "/broken.seg";
+    ASSERT_EQ(segment->Save(filepath), donde_toolkits::RET_OK);
+
+    // rows and dim are checked against the file size before anything is allocated.
+    auto patch = [&](std::streamoff offset, uint64_t value) {
+        std::fstream file(filepath, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(offset);
+        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    patch(8, uint64_t(1) << 40);
+    EXPECT_EQ(SealedSegment::Load(filepath), nullptr);
+    patch(8, feature_count);
+    patch(16, uint64_t(1) << 40);
+    EXPECT_EQ(SealedSegment::Load(filepath), nullptr);
+    patch(16, 512);
+    EXPECT_NE(SealedSegment::Load(filepath), nullptr);
+
+    // a truncated file is broken too.
+    std::filesystem::resize_file(filepath, std::filesystem::file_size(filepath) / 2);
+    EXPECT_EQ(SealedSegment::Load(filepath), nullptr);
+}
+
+TEST_F(SearchWorker_SealedSegment, LoadRejectsOldVersion) {
+    std::unordered_map<std::string, Metadata> metadata{{"ft-1", {{"camera", "cam-1"}}}};
+    auto segment = SealedSegment::Build(fts, {}, metadata, {"camera"});
+    std::string filepath = segment_dir + "/v1.seg";
+    ASSERT_EQ(segment->Save(filepath), donde_toolkits::RET_OK);
+
+    // version 1 has no metadata, searching it with filters would silently match nothing.
+    uint32_t version = 1;
+    {
+        std::fstream file(filepath, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(4);
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    }
+    EXPECT_EQ(SealedSegment::Load(filepath), nullptr);
+}
+
+TEST_F(SearchWorker_SealedSegment, FilteredSearch) {
+    // ft-i is seen by camera i % 4 at hour i % 24.
+    std::unordered_map<std::string, Metadata> metadata;
+    for (int i = 0; i < feature_count; i++) {
+        metadata["ft-" + std::to_string(i)] = {{"camera", "cam-" + std::to_string(i % 4)},
+                                                {"hour", std::to_string(i % 24)},
+                                                {"note", "not indexed"}};
+    }
+    auto segment = SealedSegment::Build(fts, {}, metadata, {"camera", "hour"});
+
+    auto expect_all = [&](const std::vector<FeatureSearchItem>& results, size_t count,
+                          const std::function<bool(int)>& matched) {
+        ASSERT_EQ(results.size(), count);
+        for (const auto& r : results) {
+            bool found = false;
+            for (int i = 0; i < feature_count; i++) {
+                // restored features are close to, not bitwise equal to, the added ones.
+                if (r.target.compare(fts["ft-" + std::to_string(i)]) > 0.9999) {
+                    EXPECT_TRUE(matched(i)) << "ft-" << i;
+                    found = true;
+                }
+            }
+            EXPECT_TRUE(found);
+        }
+    };
+
+    // the query itself does not match, the best of matched ones are returned instead.
+    auto& query = fts["ft-42"];
+    MetadataFilter cam1{{.key = "camera", .op = META_EQ, .values = {"cam-1"}}};
+    auto results = segment->Search(query, 10, {}, cam1);
+    expect_all(results, 10, [](int i) { return i % 4 == 1; });
+    EXPECT_LT(results[0].score, 0.99);
+
+    MetadataFilter cams{{.key = "camera", .op = META_IN, .values = {"cam-1", "cam-2"}},
+                        {.key = "hour", .op = META_RANGE, .values = {}, .min = 10, .max = 12}};
+    results = segment->Search(query, 100, {}, cams);
+    int expected = 0;
+    auto cams_matched = [](int i) {
+        return (i % 4 == 1 || i % 4 == 2) && i % 24 >= 10 && i % 24 <= 12;
+    };
+    for (int i = 0; i < feature_count; i++) {
+        expected += cams_matched(i);
+    }
+    expect_all(results, expected, cams_matched);
+
+    // ft-1, ft-25, ... are cam-1 at hour 1, tombstones still apply to them, and keys which are
+    // not indexed match nothing.
+    std::unordered_set<std::string> tombstones{"ft-1"};
+    MetadataFilter hour1{{.key = "camera", .op = META_EQ, .values = {"cam-1"}},
+                         {.key = "hour", .op = META_RANGE, .values = {}, .min = 1, .max = 1}};
+    EXPECT_EQ(segment->Search(query, 10, {}, hour1).size(), feature_count / 24 + 1);
+    EXPECT_EQ(segment->Search(query, 10, tombstones, hour1).size(), feature_count / 24);
+    MetadataFilter note{{.key = "note", .op = META_EQ, .values = {"not indexed"}}};
+    EXPECT_EQ(segment->Search(query, 10, {}, note).size(), 0);
+
+    // the index survives compaction, save and load.
+    auto compacted = SealedSegment::Compact(*segment, tombstones);
+    EXPECT_EQ(compacted->Search(query, 10, {}, hour1).size(), feature_count / 24);
+
+    std::string filepath = segment_dir + "/filtered.seg";
+    EXPECT_EQ(compacted->Save(filepath), donde_toolkits::RET_OK);
+    auto loaded = SealedSegment::Load(filepath);
+    ASSERT_NE(loaded, nullptr);
+    EXPECT_EQ(loaded->Search(query, 10, {}, hour1).size(), feature_count / 24);
+    EXPECT_EQ(loaded->Search(query, 100, {}, cams).size(), expected);
+    EXPECT_EQ(loaded->Search(query, 10, {}, note).size(), 0);
+}
+
+} // namespace
@@ -19,12 +19,14 @@ using donde_toolkits::Feature;
 using donde_toolkits::gen_feature_dim;
 
 using donde_toolkits::feature_search::DBItem;
+using donde_toolkits::feature_search::DBShard;
 using donde_toolkits::feature_search::FeatureDbItem;
 using donde_toolkits::feature_search::FeatureDbItemList;
 using donde_toolkits::feature_search::SimpleDriver;
 ;
 using donde_toolkits::feature_search::convert_to_feature_ids;
 using donde_toolkits::feature_search::PageData;
+using donde_toolkits::feature_search::PagingState;
 
 namespace {
 
@@ -161,6 +163,72 @@ TEST_F(SearchManager_SimpleDriver, featureCrud) {
     }
 }
 
+TEST_F(SearchManager_SimpleDriver, KeepAssignedFeatureIds) {
+    // replicas are given ids by the coordinator, unassigned ones are generated.
+    fts[0].feature_id = "assigned-0";
+    fts[1].feature_id = "assigned-1";
+    std::vector<std::string> feature_ids = store->AddFeatures(fts, db_id, "fixme");
+    ASSERT_EQ(feature_ids.size(), feature_count);
+    EXPECT_EQ(feature_ids[0], "assigned-0");
+    EXPECT_EQ(feature_ids[1], "assigned-1");
+    EXPECT_FALSE(feature_ids[2].empty());
+
+    std::vector<Feature> loaded = store->LoadFeatures({"assigned-1"}, db_id, "fixme");
+    ASSERT_EQ(loaded.size(), 1);
+    EXPECT_EQ(loaded[0].raw, fts[1].feature.raw);
+}
+
+TEST_F(SearchManager_SimpleDriver, ShardsKeepReplicas) {
+    DBShard shard{};
+    shard.db_id = db_id;
+    shard.capacity = 1000;
+    std::string shard_id = store->CreateShard(db_id, shard);
+    ASSERT_FALSE(shard_id.empty());
+
+    shard.shard_id = shard_id;
+    shard.worker_id = "w1";
+    shard.replica_worker_ids = {"w1", "w2"};
+    EXPECT_EQ(store->UpdateShard(db_id, shard), donde_toolkits::RET_OK);
+    EXPECT_EQ(store->CloseShard(db_id, shard_id), shard_id);
+
+    // shards of other dbs are not listed.
+    std::string other_db = store->CreateDB(db1);
+    EXPECT_FALSE(store->CreateShard(other_db, DBShard{}).empty());
+
+    // placement survives a restart.
+    SimpleDriver reopened("/tmp/test_store");
+    auto shards = reopened.ListShards(db_id);
+    ASSERT_EQ(shards.size(), 1);
+    EXPECT_EQ(shards[0].shard_id, shard_id);
+    EXPECT_EQ(shards[0].capacity, 1000);
+    EXPECT_TRUE(shards[0].is_closed);
+    EXPECT_EQ(shards[0].worker_id, "w1");
+    EXPECT_EQ(shards[0].replica_worker_ids, (std::vector<std::string>{"w1", "w2"}));
+}
+
+TEST_F(SearchManager_SimpleDriver, ShardsKeepRolloverState) {
+    DBShard shard{};
+    shard.db_id = db_id;
+    shard.capacity = 1000;
+    shard.created_at = 1700000000000;
+    std::string shard_id = store->CreateShard(db_id, shard);
+    ASSERT_FALSE(shard_id.empty());
+
+    shard.shard_id = shard_id;
+    shard.used = 42;
+    shard.used_bytes = 42 * 512 * sizeof(float);
+    EXPECT_EQ(store->UpdateShard(db_id, shard), donde_toolkits::RET_OK);
+
+    // rollover goes on where it left off after a restart.
+    SimpleDriver reopened("/tmp/test_store");
+    auto shards = reopened.ListShards(db_id);
+    ASSERT_EQ(shards.size(), 1);
+    EXPECT_EQ(shards[0].used, 42);
+    EXPECT_EQ(shards[0].used_bytes, 42 * 512 * sizeof(float));
+    EXPECT_EQ(shards[0].created_at, 1700000000000);
+    EXPECT_FALSE(shards[0].is_closed);
+}
+
 TEST_F(SearchManager_SimpleDriver, Paging) {
     std::vector<std::string> feature_ids = store->AddFeatures(fts, db_id, "fixme");
     EXPECT_EQ(feature_ids.size(), feature_count);
@@ -241,4 +309,46 @@ TEST_F(SearchManager_SimpleDriver, Paging) {
     EXPECT_EQ(listed.perPage, perPage);
     EXPECT_EQ(listed.totalPage, (feature_count + perPage - 1) / perPage);
 }
+
+TEST_F(SearchManager_SimpleDriver, KeyPaging) {
+    std::vector<std::string> feature_ids = store->AddFeatures(fts, db_id, "shard-a");
+    ASSERT_EQ(feature_ids.size(), feature_count);
+    // rows of other shards are skipped.
+    ASSERT_EQ(store->AddFeatures(generate_features(5), db_id, "shard-b").size(), 5);
+
+    std::vector<std::string> listed;
+    PagingState state;
+    while (!state.done) {
+        auto items = store->ListFeatures(30, state, db_id, "shard-a");
+        for (auto& item : items) {
+            listed.push_back(item.feature_id);
+        }
+    }
+    EXPECT_EQ(listed, feature_ids);
+
+    // removing rows mid scan does not shift the rest, no row is missed.
+    PagingState scan;
+    ASSERT_EQ(store->ListFeatures(10, scan, db_id, "shard-a").size(), 10);
+    store->RemoveFeatures({feature_ids[0], feature_ids[1]}, db_id, "shard-a");
+    auto next = store->ListFeatures(10, scan, db_id, "shard-a");
+    ASSERT_EQ(next.size(), 10);
+    EXPECT_EQ(next[0].feature_id, feature_ids[10]);
+}
+
+TEST_F(SearchManager_SimpleDriver, FailedRowFailsBatch) {
+    auto batch = generate_features(3);
+    batch[0].feature_id = "ft-0";
+    // its file cannot be written.
+    batch[1].feature_id = "no-such-dir/ft-1";
+
+    EXPECT_TRUE(store->AddFeatures(batch, db_id, "shard-a").empty());
+    EXPECT_EQ(store->ListFeatures(0, 10, db_id, "shard-a").data.size(), 0);
+
+    auto feature_ids = store->AddFeatures({batch[0], batch[2]}, db_id, "shard-a");
+    ASSERT_EQ(feature_ids.size(), 2);
+    EXPECT_EQ(store->LoadFeatures(feature_ids, db_id, "shard-a").size(), 2);
+
+    // a missing feature fails the load, rather than giving an empty one.
+    EXPECT_TRUE(store->LoadFeatures({feature_ids[0], "no-such-feature"}, db_id, "shard-a").empty());
+}
 } // namespace
@@ -0,0 +1,88 @@
+#include "donde/video_process/frame_bridge.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include "donde/definitions.h"
+
+#include <cstring>
+#include <gtest/gtest.h>
+#include <memory>
+#include <opencv2/core.hpp>
+
+
+using donde_toolkits::Frame;
+using donde_toolkits::video_process::FrameBridge;
+using donde_toolkits::video_process::FrameBridgeOptions;
+
+namespace {
+
+// make_frame allocates a gray yuv420p frame, callers free it with av_frame_free.
+AVFrame* make_frame(int width, int height, uint8_t luma) {
+    AVFrame* frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    for (int y = 0; y < height; y++) {
+        std::memset(frame->data[0] + y * frame->linesize[0], luma, width);
+    }
+    for (int y = 0; y < (height + 1) / 2; y++) {
+        std::memset(frame->data[1] + y * frame->linesize[1], 128, (width + 1) / 2);
+        std::memset(frame->data[2] + y * frame->linesize[2], 128, (width + 1) / 2);
+    }
+    return frame;
+};
+
+} // namespace
+
+TEST(VideoProcess, FrameBridgeKeepsSizeWithoutScaling) {
+    FrameBridge bridge;
+    AVFrame* av_frame = make_frame(63, 47, 200);
+    ASSERT_NE(av_frame, nullptr);
+
+    std::shared_ptr<Frame> frame = bridge.Convert(av_frame);
+    av_frame_free(&av_frame);
+    ASSERT_NE(frame, nullptr);
+
+    // odd sizes are kept, frame does not refer to av_frame any more.
+    EXPECT_EQ(frame->image.cols, 63);
+    EXPECT_EQ(frame->image.rows, 47);
+    EXPECT_EQ(frame->image.type(), CV_8UC3);
+    cv::Vec3b pixel = frame->image.at<cv::Vec3b>(20, 30);
+    EXPECT_GT(pixel[0], 150);
+    EXPECT_NEAR(pixel[0], pixel[1], 2);
+    EXPECT_NEAR(pixel[1], pixel[2], 2);
+
+    EXPECT_EQ(bridge.Convert(static_cast<const AVFrame*>(nullptr)), nullptr);
+};
+
+TEST(VideoProcess, FrameBridgeScalesDownAndPoolsBuffers) {
+    FrameBridgeOptions opts{.max_width = 32, .max_height = 32, .pool_size = 1};
+    FrameBridge bridge(opts);
+    AVFrame* av_frame = make_frame(64, 48, 100);
+    ASSERT_NE(av_frame, nullptr);
+
+    // scaled down to fit, aspect ratio is kept.
+    std::shared_ptr<Frame> frame = bridge.Convert(av_frame);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frame->image.cols, 32);
+    EXPECT_EQ(frame->image.rows, 24);
+
+    // buffer goes back to pool with the frame, and next conversion writes into it.
+    uint8_t* data = frame->image.data;
+    frame.reset();
+    EXPECT_EQ(bridge.Pooled(), 1);
+    frame = bridge.Convert(av_frame);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frame->image.data, data);
+    EXPECT_EQ(bridge.Pooled(), 0);
+
+    av_frame_free(&av_frame);
+};
@@ -0,0 +1,148 @@
+#include "donde/video_process/motion_gate.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+
+using donde_toolkits::video_process::MotionGate;
+using donde_toolkits::video_process::MotionGateOptions;
+
+namespace {
+
+// GrayFrame is a gray8 frame of 64x64, every 16x16 block is one cell of a 4x4 grid.
+class GrayFrame {
+  public:
+    GrayFrame(uint8_t luma = 100) : pixels_(64 * 64, luma) {
+        frame_.format = AV_PIX_FMT_GRAY8;
+        frame_.width = 64;
+        frame_.height = 64;
+        frame_.data[0] = pixels_.data();
+        frame_.linesize[0] = 64;
+    };
+
+    void Fill(int cell_x, int cell_y, uint8_t luma) {
+        for (int y = cell_y * 16; y < (cell_y + 1) * 16; y++) {
+            for (int x = cell_x * 16; x < (cell_x + 1) * 16; x++) {
+                pixels_[y * 64 + x] = luma;
+            }
+        }
+    };
+
+    const AVFrame* Get() const { return &frame_; };
+
+  private:
+    std::vector<uint8_t> pixels_;
+    AVFrame frame_{};
+};
+
+MotionGateOptions grid_options() {
+    MotionGateOptions opts;
+    opts.enable = true;
+    opts.grid_width = 4;
+    opts.grid_height = 4;
+    opts.pixel_threshold = 12;
+    opts.changed_ratio = 0.01;
+    opts.keep_alive_frames = 0;
+    return opts;
+};
+
+} // namespace
+
+TEST(VideoProcess, MotionGateDropsStillScene) {
+    MotionGate gate(grid_options());
+    GrayFrame frame;
+
+    // the first frame is the reference, the same scene after it is gated.
+    EXPECT_TRUE(gate.Pass(frame.Get()));
+    for (int i = 0; i < 10; i++) {
+        EXPECT_FALSE(gate.Pass(frame.Get()));
+    }
+
+    // a brightness change of the whole scene is not motion.
+    GrayFrame brighter(140);
+    EXPECT_FALSE(gate.Pass(brighter.Get()));
+    EXPECT_EQ(gate.Passed(), 1);
+    EXPECT_EQ(gate.Gated(), 11);
+
+    // keep alive lets a still frame through now and then.
+    MotionGateOptions opts = grid_options();
+    opts.keep_alive_frames = 5;
+    MotionGate keep_alive(opts);
+    int passed = 0;
+    for (int i = 0; i < 21; i++) {
+        passed += keep_alive.Pass(frame.Get());
+    }
+    EXPECT_EQ(passed, 5);
+
+    // disabled gate, and frames without a luma plane, always pass.
+    opts.enable = false;
+    MotionGate disabled(opts);
+    EXPECT_TRUE(disabled.Pass(frame.Get()));
+    EXPECT_TRUE(disabled.Pass(frame.Get()));
+
+    AVFrame bgr{};
+    bgr.format = AV_PIX_FMT_BGR24;
+    bgr.width = 64;
+    bgr.height = 64;
+    EXPECT_TRUE(gate.Pass(&bgr));
+};
+
+TEST(VideoProcess, MotionGatePassesMovingScene) {
+    MotionGate gate(grid_options());
+
+    // a bright object moves one cell a frame, along the diagonal.
+    for (int i = 0; i < 4; i++) {
+        GrayFrame frame(50);
+        frame.Fill(i, i, 200);
+        EXPECT_TRUE(gate.Pass(frame.Get())) << "frame " << i;
+    }
+    EXPECT_EQ(gate.Gated(), 0);
+
+    // it stops, and so does the gate.
+    GrayFrame frame(50);
+    frame.Fill(3, 3, 200);
+    EXPECT_FALSE(gate.Pass(frame.Get()));
+
+    // a change of the size is always passed.
+    GrayFrame resized(50);
+    AVFrame smaller = *resized.Get();
+    smaller.width = 32;
+    smaller.height = 32;
+    EXPECT_TRUE(gate.Pass(&smaller));
+};
+
+TEST(VideoProcess, MotionGateThresholdBoundary) {
+    // one cell of 16 changes, overall shift is 12 / 16 = 0 and 13 / 16 = 0.
+    {
+        MotionGate gate(grid_options());
+        GrayFrame frame(100);
+        EXPECT_TRUE(gate.Pass(frame.Get()));
+
+        frame.Fill(1, 2, 112);
+        EXPECT_FALSE(gate.Pass(frame.Get()));
+        frame.Fill(1, 2, 113);
+        EXPECT_TRUE(gate.Pass(frame.Get()));
+    }
+
+    // changed_ratio of 0.25 needs 4 cells out of 16.
+    {
+        MotionGateOptions opts = grid_options();
+        opts.changed_ratio = 0.25;
+        MotionGate gate(opts);
+        GrayFrame frame(100);
+        EXPECT_TRUE(gate.Pass(frame.Get()));
+
+        for (int x = 0; x < 3; x++) {
+            frame.Fill(x, 0, 130);
+        }
+        EXPECT_FALSE(gate.Pass(frame.Get()));
+        frame.Fill(3, 0, 130);
+        EXPECT_TRUE(gate.Pass(frame.Get()));
+    }
+};
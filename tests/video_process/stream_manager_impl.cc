@@ -0,0 +1,112 @@
+#include "donde/video_process/stream_manager_impl.h"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+using donde_toolkits::video_process::FFmpegVideoFrame;
+using donde_toolkits::video_process::RateMeter;
+using donde_toolkits::video_process::StreamContext;
+using donde_toolkits::video_process::StreamOptions;
+using donde_toolkits::video_process::StreamQueue;
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace {
+
+std::shared_ptr<StreamContext> make_stream(int id) {
+    return std::make_shared<StreamContext>(
+        id, "stream-" + std::to_string(id), [](const FFmpegVideoFrame*) { return true; },
+        StreamOptions{});
+};
+
+} // namespace
+
+TEST(VideoProcess, RateMeterCountsOverLastFullSecond) {
+    RateMeter meter;
+    auto start = steady_clock::now();
+    EXPECT_EQ(meter.Rate(start), 0);
+
+    // 10 events in the first second.
+    for (int i = 0; i < 10; i++) {
+        meter.Tick(start + milliseconds(i * 100));
+    }
+    EXPECT_EQ(meter.Rate(start + milliseconds(900)), 0);
+    EXPECT_DOUBLE_EQ(meter.Rate(start + milliseconds(1000)), 10);
+
+    // the rate is kept during next second, and drops once it is over without events.
+    EXPECT_DOUBLE_EQ(meter.Rate(start + milliseconds(1500)), 10);
+    EXPECT_DOUBLE_EQ(meter.Rate(start + milliseconds(2000)), 0);
+
+    // a longer window is averaged.
+    for (int i = 0; i < 5; i++) {
+        meter.Tick(start + milliseconds(2000 + i * 100));
+    }
+    EXPECT_DOUBLE_EQ(meter.Rate(start + milliseconds(4500)), 2);
+};
+
+TEST(VideoProcess, StreamQueueIsFifo) {
+    StreamQueue queue;
+    for (int i = 0; i < 3; i++) {
+        queue.Push(make_stream(i));
+    }
+
+    std::shared_ptr<StreamContext> stream;
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(queue.Pop(stream));
+        EXPECT_EQ(stream->id, i);
+    }
+
+    // Pop blocks until a push, and returns false once closed.
+    std::thread pusher([&] {
+        std::this_thread::sleep_for(milliseconds(20));
+        queue.Push(make_stream(3));
+    });
+    ASSERT_TRUE(queue.Pop(stream));
+    EXPECT_EQ(stream->id, 3);
+    pusher.join();
+
+    std::thread closer([&] {
+        std::this_thread::sleep_for(milliseconds(20));
+        queue.Close();
+    });
+    EXPECT_FALSE(queue.Pop(stream));
+    closer.join();
+
+    // pushes to a closed queue are dropped.
+    queue.Push(make_stream(4));
+    EXPECT_FALSE(queue.Pop(stream));
+};
+
+TEST(VideoProcess, StreamQueueHoldsIdleStreams) {
+    StreamQueue queue;
+    auto start = steady_clock::now();
+
+    // an idle stream is passed by streams ready behind it.
+    queue.Push(make_stream(0), start + milliseconds(50));
+    queue.Push(make_stream(1));
+
+    std::shared_ptr<StreamContext> stream;
+    ASSERT_TRUE(queue.Pop(stream));
+    EXPECT_EQ(stream->id, 1);
+
+    // and popped once it is ready.
+    ASSERT_TRUE(queue.Pop(stream));
+    EXPECT_EQ(stream->id, 0);
+    EXPECT_GE(steady_clock::now() - start, milliseconds(50));
+
+    // a stream ready earlier, pushed while Pop waits, is popped first.
+    queue.Push(make_stream(2), steady_clock::now() + milliseconds(1000));
+    std::thread pusher([&] {
+        std::this_thread::sleep_for(milliseconds(20));
+        queue.Push(make_stream(3));
+    });
+    ASSERT_TRUE(queue.Pop(stream));
+    EXPECT_EQ(stream->id, 3);
+    pusher.join();
+    queue.Close();
+};